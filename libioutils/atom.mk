@@ -28,6 +28,23 @@ endif
 
 include $(BUILD_LIBRARY)
 
+###############################################################################
+# io_replay
+###############################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := io_replay
+LOCAL_DESCRIPTION := Replays io traffic captured with libioutils into an io
+LOCAL_CATEGORY_PATH := devel
+
+LOCAL_SRC_FILES := \
+	$(call all-c-files-under,example) \
+
+LOCAL_LIBRARIES := libioutils
+
+include $(BUILD_EXECUTABLE)
+
 ###############################################################################
 # tst-libioutils
 ###############################################################################
@@ -0,0 +1,180 @@
+/**
+ * @file io_replay.c
+ * @brief Replays one direction of a capture file recorded with
+ * io_io_capture_traffic() into an io, through a socketpair, and reports how the
+ * io coped with it. Used for tuning the read buffer size and threshold of an
+ * io against realistic traffic
+ *
+ * @copyright Copyright (C) 2011 Parrot S.A.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <error.h>
+#include <time.h>
+
+#include <io_mon.h>
+#include <io_io.h>
+#include <io_io_capture.h>
+
+static void usage(int exit_code)
+{
+	FILE *out = exit_code ? stderr : stdout;
+	fprintf(out, "usage : io_replay [-s SPEED] [-d rx|tx] [-b SIZE] "
+		"[-t THRESHOLD] CAPTURE_FILE\n"
+		"\tReplays the chunks of one direction of CAPTURE_FILE into "
+		"an io and prints its statistics.\n"
+		"\t-s SPEED\tacceleration factor, 1 for the original timing, "
+		"0 (default) for no delay\n"
+		"\t-d rx|tx\tdirection replayed, rx by default\n"
+		"\t-b SIZE\t\tread buffer size of the io\n"
+		"\t-t THRESHOLD\tread threshold of the io\n");
+
+	exit(exit_code);
+}
+
+static int read_cb(struct io_io *io, struct rs_rb *rb, void *data)
+{
+	unsigned long *callbacks = data;
+
+	(*callbacks)++;
+	rs_rb_empty(rb);
+
+	return 0;
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) +
+			(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+	int opt;
+	int capture_fd;
+	int sockets[2];
+	int status;
+	unsigned speed = 0;
+	enum io_io_log_dir dir = IO_IO_LOG_RX;
+	size_t size = 0;
+	size_t threshold = 0;
+	unsigned long callbacks = 0;
+	struct io_mon mon;
+	struct io_io io;
+	struct io_io_stats stats;
+	struct timespec start;
+	double duration;
+	ssize_t sret;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "hs:d:b:t:")) != -1) {
+		switch (opt) {
+		case 's':
+			speed = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			if (0 == strcmp(optarg, "rx"))
+				dir = IO_IO_LOG_RX;
+			else if (0 == strcmp(optarg, "tx"))
+				dir = IO_IO_LOG_TX;
+			else
+				usage(EXIT_FAILURE);
+			break;
+		case 'b':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			threshold = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(EXIT_SUCCESS);
+			break;
+		default:
+			usage(EXIT_FAILURE);
+		}
+	}
+	if (optind != argc - 1)
+		usage(EXIT_FAILURE);
+
+	capture_fd = open(argv[optind], O_RDONLY | O_CLOEXEC);
+	if (-1 == capture_fd)
+		error(EXIT_FAILURE, errno, "open %s", argv[optind]);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets);
+	if (-1 == ret)
+		error(EXIT_FAILURE, errno, "socketpair");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pid = fork();
+	if (-1 == pid)
+		error(EXIT_FAILURE, errno, "fork");
+	if (0 == pid) {
+		/* in child, the end of file tells the parent the replay's over */
+		close(sockets[0]);
+		sret = io_io_capture_replay(capture_fd, sockets[1], dir, speed);
+		if (sret < 0)
+			error(EXIT_FAILURE, -sret, "io_io_capture_replay");
+		_exit(EXIT_SUCCESS);
+	}
+
+	/* in parent */
+	close(sockets[1]);
+	ret = io_mon_init(&mon);
+	if (ret < 0)
+		error(EXIT_FAILURE, -ret, "io_mon_init");
+	ret = io_io_init(&io, &mon, "replay", sockets[0], sockets[0], 0);
+	if (ret < 0)
+		error(EXIT_FAILURE, -ret, "io_io_init");
+	if (0 != size) {
+		ret = io_io_read_set_buffer_size(&io, size, 0);
+		if (ret < 0)
+			error(EXIT_FAILURE, -ret, "io_io_read_set_buffer_size");
+	}
+	io_io_read_set_threshold(&io, threshold);
+	ret = io_io_read_start(&io, read_cb, &callbacks, 0);
+	if (ret < 0)
+		error(EXIT_FAILURE, -ret, "io_io_read_start");
+
+	while (!io_io_has_read_error(&io)) {
+		ret = io_mon_poll(&mon, -1);
+		if (ret < 0 && ret != -EINTR)
+			error(EXIT_FAILURE, -ret, "io_mon_poll");
+	}
+	duration = elapsed(&start);
+	io_io_get_stats(&io, &stats);
+
+	printf("bytes read:\t%llu\n", (unsigned long long)stats.nbread);
+	printf("read calls:\t%llu\n", (unsigned long long)stats.read_calls);
+	printf("read eagain:\t%llu\n",
+			(unsigned long long)stats.read_eagain);
+	printf("callbacks:\t%lu\n", callbacks);
+	printf("ring max:\t%zu\n", stats.ring_max);
+	printf("duration:\t%.3f s\n", duration);
+	if (duration > 0)
+		printf("throughput:\t%.1f MiB/s\n",
+				stats.nbread / duration / (1 << 20));
+
+	io_io_clean(&io);
+	io_mon_clean(&mon);
+	close(sockets[0]);
+	close(capture_fd);
+	waitpid(pid, &status, 0);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}
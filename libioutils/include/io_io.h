@@ -12,11 +12,15 @@
 #ifndef IO_IO_H_
 #define IO_IO_H_
 
+#include <sys/types.h>
+#include <stdbool.h>
+
 #include <rs_rb.h>
 #include <rs_dll.h>
 
 #include <io_mon.h>
 #include <io_src_tmr.h>
+#include <io_io_log.h>
 
 /**
  * @enum io_io_state
@@ -31,8 +35,20 @@ enum io_io_state {
 /* forward reference for io_io_read_cb definition */
 struct io_io;
 
+/* forward reference for the pump fields of the read and write contexts */
+struct io_io_pump;
+
+/* forward reference for the traffic capture, see io_io_capture_traffic() */
+struct io_io_capture;
+
+/* forward references for the io_uring mode, see io_io_use_ring() */
+struct io_ring;
+struct io_io_ring_ctx;
+
 /**
- * Callback called when some data is ready to be consumed
+ * Callback called when some data is ready to be consumed. It is called at most
+ * once per I/O event, with all the data read during the processing of the
+ * event
  * @param io IO context
  * @param rb ring buffer containing the data just read
  * @param data user data as was passed in io_io_read_start()
@@ -40,23 +56,66 @@ struct io_io;
  */
 typedef int (*io_io_read_cb)(struct io_io *io, struct rs_rb *rb, void *data);
 
+/**
+ * Callback called when the read ring buffer is full and can't grow anymore.
+ * Reading is paused until the client frees some room in the ring buffer and
+ * calls io_io_read_resume(), no data is lost, a hang up of the peer meanwhile
+ * being reported once the data received before it have been read
+ * @param io IO context
+ * @param rb ring buffer, full
+ * @param data user data as was passed in io_io_read_start()
+ */
+typedef void (*io_io_overflow_cb)(struct io_io *io, struct rs_rb *rb,
+		void *data);
+
+/**
+ * Callback called when a buffer posted with io_io_read_post() has been filled,
+ * or when reading fails before it is
+ * @param io IO context
+ * @param buffer Buffer posted
+ * @param length Number of bytes stored in buffer, its size on success
+ * @param err 0 on success, -EPIPE on end of file or read error
+ * @param data user data as was passed in io_io_read_post()
+ */
+typedef void (*io_io_read_post_cb)(struct io_io *io, void *buffer,
+		size_t length, int err, void *data);
+
 /**
  * @def IO_IO_RB_BUFFER_SIZE
- * @brief size of the ring buffer's buffer
+ * @brief initial size of the read ring buffer, rounded up to the page size
  */
 #define IO_IO_RB_BUFFER_SIZE 512
 
+/**
+ * @def IO_IO_CHUNK_SIZE
+ * @brief size of the chunks storing the data queued with io_io_write_copy()
+ */
+#define IO_IO_CHUNK_SIZE 4096
+
+/**
+ * @def IO_IO_CHUNK_POOL_SIZE
+ * @brief number of free chunks kept for reuse, per io
+ */
+#define IO_IO_CHUNK_POOL_SIZE 4
+
 /**
  * @struct io_io_read_ctx
  * @brief context for reading data from the IO
  */
 struct io_io_read_ctx {
 	enum io_io_state state;			/**< io read ctx state */
+	int ign_eof;				/**< ignore end of file */
+	int paused;				/**< read paused, rb full */
+	int hangup;				/**< hung up while paused */
 	struct rs_rb rb;			/**< io read ring buffer */
-	char rb_buffer[IO_IO_RB_BUFFER_SIZE];	/**< ring buffer buffer */
 	io_io_read_cb cb;			/**< io read callback */
 	void *data;				/**< callback user data */
-	int ign_eof;				/**< ignore end of file */
+	size_t max_size;			/**< ring buffer max size */
+	size_t init_size;			/**< ring size at allocation */
+	io_io_overflow_cb overflow_cb;		/**< rb full callback */
+	struct io_io_pump *pump;		/**< pump reading from io */
+	size_t threshold;			/**< min bytes to notify */
+	void *post_buffer;			/**< posted buffer or NULL */
 };
 
 /**
@@ -68,6 +127,20 @@ enum io_io_write_status {
 	IO_IO_WRITE_ERROR,	/**< write failed */
 	IO_IO_WRITE_TIMEOUT,	/**< write ready timeout */
 	IO_IO_WRITE_ABORTED,	/**< write aborted */
+	IO_IO_WRITE_DROPPED,	/**< dropped by the queue policy, unsent */
+};
+
+/**
+ * @enum io_io_write_prio
+ * @brief Priority lanes of the write queue. The buffers of a lane are written
+ * only when the lanes of higher priority are empty, but a buffer partially
+ * written is always completed first
+ */
+enum io_io_write_prio {
+	IO_IO_PRIO_NORMAL,	/**< bulk data, the default */
+	IO_IO_PRIO_URGENT,	/**< control messages, written first */
+
+	IO_IO_PRIO_COUNT,	/**< number of lanes */
 };
 
 /* forward reference for io_io_write_cb definition */
@@ -90,7 +163,67 @@ struct io_io_write_buffer {
 	io_io_write_cb cb;	/**< user callback */
 	void *data;		/**< user data */
 	size_t length;		/**< write buffer length */
-	const void *address;	/**< write buffer data address*/
+	const void *address;	/**< write buffer data address, NULL if file */
+	int fd;			/**< file to send, if address is NULL */
+	off_t offset;		/**< offset of the data in fd */
+	uint32_t zc_id;		/**< last zero-copy send id, internal */
+	enum io_io_write_status zc_status;	/**< status once released */
+	enum io_io_write_prio prio;	/**< lane queued in, internal */
+	uint32_t tag;		/**< stream for keep-latest, 0 if none */
+	uint64_t drop_at;	/**< time in ms it expires at, internal */
+	struct rs_dll *lane;	/**< lane waiting in, or NULL, internal */
+	bool zerocopy;		/**< sent with MSG_ZEROCOPY, internal */
+};
+
+struct io_io_shared_buffer;
+
+/**
+ * Callback called when the last reference on a shared buffer is dropped
+ * @param shared Shared buffer, which isn't referenced by any io anymore
+ * @param data User data passed to io_io_shared_buffer_init()
+ */
+typedef void (*io_io_shared_release_cb)(struct io_io_shared_buffer *shared,
+		void *data);
+
+/**
+ * @struct io_io_shared_buffer
+ * @brief Reference counted payload, which can be queued for writing on
+ * several io at once, without being copied
+ */
+struct io_io_shared_buffer {
+	const void *address;		/**< payload address */
+	size_t length;			/**< payload length */
+	unsigned refcount;		/**< number of references held */
+	io_io_shared_release_cb release;/**< called on last unref */
+	void *data;			/**< user data */
+};
+
+/**
+ * Callback called when the number of bytes queued for writing crosses the
+ * watermarks
+ * @param io IO context
+ * @param high true if the high watermark has been reached, the producer should
+ * stop queuing data, false if the queue has drained down to the low
+ * watermark, the producer can resume
+ * @param data User data passed to io_io_write_set_watermarks()
+ */
+typedef void (*io_io_watermark_cb)(struct io_io *io, bool high, void *data);
+
+struct io_io_chunk;
+struct io_io_write_notify;
+
+/**
+ * @struct io_io_timer_group
+ * @brief Write timeout timer shared by compact ios. The ios with pending
+ * writes are kept in deadline order, which is also their order of insertion,
+ * since they all use the same timeout
+ */
+struct io_io_timer_group {
+	struct io_src_tmr timer;	/**< timer, armed for the first deadline */
+	struct io_mon *mon;		/**< monitor the timer is registered in */
+	int timeout;			/**< write ready timeout of the ios, in ms */
+	struct rs_dll ios;		/**< ios with a write deadline */
+	int armed;			/**< non-zero if timer is armed */
 };
 
 /**
@@ -98,14 +231,87 @@ struct io_io_write_buffer {
  * @brief context for writing data to the IO
  */
 struct io_io_write_ctx {
-	struct io_src src;		/**< io write source, used if needed */
 	enum io_io_state state;		/**< io write state */
 	int timeout;			/**< io write ready timeout in ms */
-	struct io_src_tmr timer;	/**< io write timer */
-	struct rs_dll buffers;		/**< io write buffers */
+	uint64_t deadline;		/**< current write deadline in ms, 0 if none */
+	/** io write buffers of the IO_IO_PRIO_NORMAL lane */
+	struct rs_dll normal;
 	struct io_io_write_buffer *current;	/**< io write current buffer */
 	size_t nbwritten;		/**< current buffer bytes written */
 	size_t nbeagain;		/**< number of eagain received */
+	struct io_io_pump *pump;	/**< pump writing to io */
+	size_t queued;			/**< bytes queued, not written yet */
+	struct io_io_chunk *open_chunk;	/**< chunk data can be appended to */
+	struct io_io_timer_group *group;/**< shared timer, compact io only */
+	struct rs_node group_node;	/**< node in group's pending ios */
+	/** completions being notified, internal */
+	struct io_io_write_notify *notify;
+};
+
+/**
+ * @struct io_io_lane_stats
+ * @brief Counters of the activity of a lane of the write queue
+ */
+struct io_io_lane_stats {
+	uint64_t buffers;		/**< buffers written */
+	uint64_t bytes;			/**< bytes of the buffers written */
+	size_t queue_max;		/**< lane depth high-water mark */
+};
+
+/**
+ * @struct io_io_stats
+ * @brief Counters of the activity of an io. The data relayed by a pump are
+ * accounted in the pump, not here
+ */
+struct io_io_stats {
+	uint64_t nbread;		/**< bytes read */
+	uint64_t nbwritten;		/**< bytes written */
+	uint64_t read_calls;		/**< read syscalls */
+	uint64_t write_calls;		/**< write syscalls */
+	uint64_t read_eagain;		/**< reads which returned EAGAIN */
+	uint64_t write_eagain;		/**< writes which returned EAGAIN */
+	size_t queue_max;		/**< write queue depth high-water mark */
+	size_t ring_max;		/**< read ring occupancy high-water mark */
+	uint64_t timeouts;		/**< write timeouts */
+	uint64_t aborts;		/**< buffers aborted */
+	uint64_t drops;			/**< buffers dropped by the policy */
+	/** per write queue lane counters, indexed by enum io_io_write_prio */
+	struct io_io_lane_stats lanes[IO_IO_PRIO_COUNT];
+};
+
+/**
+ * @struct io_io_extra
+ * @brief State of an io kept out of line: the write source of the half-duplex
+ * ios, the write timer and the activity counters of the regular ones and the
+ * state of the optional features. Regular and half-duplex ios allocate it at
+ * initialization, compact ones the first time they use such a feature
+ */
+struct io_io_extra {
+	struct io_io *io;		/**< io this state belongs to */
+	struct io_src src;		/**< io write source, if not duplex */
+	struct io_src_tmr timer;	/**< io write timer, regular io only */
+	int timer_armed;		/**< non-zero if timer is armed */
+	struct rs_dll urgent;		/**< IO_IO_PRIO_URGENT lane */
+	size_t zc_threshold;		/**< min size for zero-copy, 0 if off */
+	uint32_t zc_next_id;		/**< id of the next zero-copy send */
+	struct rs_dll zc_pending;	/**< zero-copy sends not released */
+	size_t low_wm;			/**< low watermark, in bytes */
+	size_t high_wm;			/**< high watermark, 0 if none */
+	bool above_high;		/**< high watermark reached */
+	io_io_watermark_cb wm_cb;	/**< watermarks callback */
+	void *wm_data;			/**< watermarks callback user data */
+	struct rs_dll chunk_pool;	/**< free chunks, regular io only */
+	unsigned keep_latest;		/**< buffers kept per tag, 0 if all */
+	int max_age;			/**< max queuing time in ms, 0 if none */
+	size_t post_size;		/**< size of readctx.post_buffer */
+	size_t post_filled;		/**< bytes stored in it */
+	io_io_read_post_cb post_cb;	/**< post_buffer filled cb */
+	void *post_data;		/**< post_cb user data */
+	void (*log_rx)(const char *);	/**< io log in input */
+	void (*log_tx)(const char *);	/**< io log in output */
+	struct io_io_log *log;		/**< io deferred traffic log */
+	struct io_io_capture *capture;	/**< io traffic capture */
+	struct io_io_stats stats;	/**< activity counters, regular io only */
 };
 
 /**
@@ -116,14 +322,46 @@ struct io_io_write_ctx {
 struct io_io {
 	/** io duplex source if fd_in == fd_out, read source otherwise */
 	struct io_src src;
-	/** equals &src if duplex, writectx.src otherwise */
+	/** equals &src if duplex, extra->src otherwise */
 	struct io_src *write_src;
 	char *name;			/**< io name, for logging purpose */
-	void (*log_rx)(const char *);	/**< io log in input */
-	void (*log_tx)(const char *);	/**< io log in output */
 	struct io_mon *mon;		/**< io monitor */
 	struct io_io_read_ctx readctx;	/**< io read context */
 	struct io_io_write_ctx writectx;/**< io write context */
+	struct io_io_ring_ctx *ringctx;	/**< io_uring mode context or NULL */
+	struct io_io_extra *extra;	/**< out of line state, may be NULL */
+};
+
+/**
+ * Callback notified when a pump stops relaying data
+ * @param pump Pump
+ * @param err 0 if the source reached end of file and all the data read has
+ * been relayed, -ETIMEDOUT if the destination hasn't been writable for the
+ * write timeout of the destination io, another negative errno-compatible
+ * value on I/O error
+ * @param data user data as was passed to io_io_pump_init()
+ */
+typedef void (*io_io_pump_cb)(struct io_io_pump *pump, int err, void *data);
+
+/**
+ * @struct io_io_pump
+ * @brief Relays the data read from an io to another one, without copying them
+ * in user space, thanks to splice(2) and an intermediate pipe. Both ios keep
+ * being monitored by their monitor(s) and the write buffers queued on the
+ * destination io are still written, in priority
+ */
+struct io_io_pump {
+	struct io_io *from;	/**< io data are read from */
+	struct io_io *to;	/**< io data are written to */
+	int pipe[2];		/**< intermediate pipe, read and write ends */
+	size_t capacity;	/**< capacity of the pipe */
+	size_t pending;		/**< bytes stored in the pipe */
+	int in_paused;		/**< IN monitoring suspended, pipe full */
+	int eof;		/**< source has reached end of file */
+	io_io_pump_cb cb;	/**< user callback, notified on stop */
+	void *data;		/**< callback user data */
+	uint64_t nbread;	/**< total bytes read from the source */
+	uint64_t nbwritten;	/**< total bytes written to the destination */
 };
 
 /**
@@ -139,6 +377,74 @@ struct io_io {
 int io_io_init(struct io_io *io, struct io_mon *mon, const char *name,
 		int fd_in, int fd_out, int ign_eof);
 
+/**
+ * Initializes an io with a reduced memory footprint, for applications
+ * handling a large number of connections. Compared to io_io_init():
+ * <ul>
+ *   <li>the read ring buffer is allocated when data arrive and released as
+ *   soon as the read callback has consumed all of it</li>
+ *   <li>no timer is created, write timeouts are handled by a timer shared
+ *   between all the ios of a group, with the group's timeout</li>
+ *   <li>the name isn't copied</li>
+ *   <li>no activity counters are kept</li>
+ *   <li>the chunks of io_io_write_copy() are freed as soon as written, not
+ *   pooled</li>
+ *   <li>the state of the urgent lane, zero-copy, watermarks, queue policies,
+ *   posted reads, logs and capture is allocated the first time one of them
+ *   is used, hence the functions enabling them may fail with -ENOMEM</li>
+ * </ul>
+ * @param io IO context to initialize
+ * @param mon Monitor
+ * @param name Name of the IO, used for logging purpose only, must stay valid
+ * until io_io_clean() is called
+ * @param fd_in File descriptor for reading
+ * @param fd_out File descriptor for writing, can be the same as fd_in
+ * @param ign_eof set 0 to stop read on end of file, 1 to continue read
+ * @param group Timer group handling the write timeouts, registered in mon
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_init_compact(struct io_io *io, struct io_mon *mon, const char *name,
+		int fd_in, int fd_out, int ign_eof,
+		struct io_io_timer_group *group);
+
+/**
+ * Switches an io to io_uring transfers: readiness isn't monitored any more,
+ * data are received by a multishot receive into the ring's provided buffers and
+ * the buffers queued for writing are sent as chains of linked sends. The
+ * completions are notified through the usual read and write callbacks, with
+ * the following differences:
+ * <ul>
+ *   <li>io_io_read_resume() delivers the data received meanwhile, hence may
+ *   call the read callback</li>
+ *   <li>write ready timeouts, zero-copy and file buffers aren't supported, nor
+ *   are pumps</li>
+ * </ul>
+ * @param io IO context, duplex on a stream socket, whose read is stopped and
+ * write queue is empty
+ * @param ring Ring performing the transfers, must outlive the io
+ * @return -ENOSYS if io_uring isn't available, -EBUSY if the io is already
+ * in use, another negative errno-compatible value on error, 0 on success
+ */
+int io_io_use_ring(struct io_io *io, struct io_ring *ring);
+
+/**
+ * Initializes a timer group, for the write timeouts of compact ios
+ * @param group Timer group to initialize
+ * @param mon Monitor the timer is registered in
+ * @param timeout Write ready timeout of the ios, in ms
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_timer_group_init(struct io_io_timer_group *group,
+		struct io_mon *mon, int timeout);
+
+/**
+ * Cleans up a timer group
+ * @param group Timer group
+ * @return -EBUSY if an io of the group still has pending writes, another
+ * negative errno-compatible value on error, 0 on success
+ */
+int io_io_timer_group_clean(struct io_io_timer_group *group);
+
 /**
  * Cleans up all the resources associated to an io and make it ready for a new
  * call to io_io_init()
@@ -158,6 +464,126 @@ int io_io_clean(struct io_io *io);
 int io_io_read_start(struct io_io *io, io_io_read_cb cb, void *data,
 		int clear);
 
+/**
+ * Configures the size of the read ring buffer. When full, the ring buffer
+ * doubles it's size, as long as it stays below max_size, after what, reading
+ * is paused until the client consumes data and calls io_io_read_resume()
+ * @param io IO context
+ * @param size Size of the ring buffer, rounded to the next multiple of a page
+ * size, must then be a power of two
+ * @param max_size Size the ring buffer is allowed to grow to, 0 to forbid the
+ * ring buffer to grow
+ * @return -ENOBUFS if the data currently stored doesn't fit in size, another
+ * negative errno-compatible value on error, 0 on success
+ */
+int io_io_read_set_buffer_size(struct io_io *io, size_t size,
+		size_t max_size);
+
+/**
+ * Returns the size the read ring buffer is allowed to grow to
+ * @param io IO context
+ * @return Maximum size of the ring buffer, 0 on error
+ */
+size_t io_io_read_get_max_size(struct io_io *io);
+
+/**
+ * Sets the minimum number of bytes which must be available in the read ring
+ * buffer for the read callback to be notified. The callback is notified
+ * anyway, when the ring buffer is full or on end of file or error
+ * @param io IO context
+ * @param threshold Minimum number of bytes, 0 or 1 for notifying as soon as
+ * data are available, which is the default
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_read_set_threshold(struct io_io *io, size_t threshold);
+
+/**
+ * Sets the callback notified when the read ring buffer is full and can't
+ * grow anymore, i.e. when reading gets paused
+ * @param io IO context
+ * @param overflow_cb Callback, NULL for no notification
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_read_set_overflow_cb(struct io_io *io,
+		io_io_overflow_cb overflow_cb);
+
+/**
+ * Posts a buffer to fill with the next bytes read, which is then read into
+ * directly, without going through the read ring buffer. The read callback
+ * isn't notified until the buffer is full, reading then goes on in the ring
+ * buffer, unless another buffer is posted, for example from cb. The bytes
+ * already in the ring buffer are moved first to the buffer, so that the order
+ * of the stream is kept
+ * @param io IO context, whose read must be started
+ * @param buffer Buffer to fill, must stay valid until cb is called or the post
+ * is canceled
+ * @param size Size of buffer
+ * @param cb Callback notified when buffer is full, which can be called before
+ * io_io_read_post() returns, if the ring buffer already held enough data
+ * @param data User data passed to cb
+ * @return -EBUSY if a buffer is already posted, another negative
+ * errno-compatible value on error, 0 on success
+ */
+int io_io_read_post(struct io_io *io, void *buffer, size_t size,
+		io_io_read_post_cb cb, void *data);
+
+/**
+ * Cancels the buffer posted with io_io_read_post(), its callback isn't called.
+ * Also done by io_io_read_stop()
+ * @param io IO context
+ * @return -ENOENT if no buffer is posted, another negative errno-compatible
+ * value on error, number of bytes already stored in the buffer on success,
+ * they have been removed from the stream
+ */
+ssize_t io_io_read_post_cancel(struct io_io *io);
+
+/**
+ * Pauses reading, for example because the consumer of the data is saturated.
+ * The data already read stay in the read ring buffer, the read callback isn't
+ * notified until io_io_read_resume() is called
+ * @param io IO context, whose read must be started
+ * @return Negative errno-compatible value on error, 0 on success, including
+ * when the read was already paused
+ */
+int io_io_read_pause(struct io_io *io);
+
+/**
+ * Resumes reading, after it has been paused because the read ring buffer was
+ * full or by io_io_read_pause(). Must be called by the client once it has
+ * consumed some data
+ * @param io IO context
+ * @return -ENOBUFS if there is still no room in the read ring buffer, another
+ * negative errno-compatible value on error, 0 on success, including when the
+ * read wasn't paused
+ */
+int io_io_read_resume(struct io_io *io);
+
+/**
+ * Says if the IO has it's read paused, because it's read ring buffer is full
+ * or io_io_read_pause() has been called
+ * @param io IO context
+ * @return non-zero if read is paused, 0 otherwise
+ */
+int io_io_is_read_paused(struct io_io *io);
+
+/**
+ * Retrieves the activity counters of an io
+ * @param io IO context
+ * @param stats In output, counters accumulated since the io's initialization
+ * or the last call to io_io_reset_stats()
+ * @return -ENOTSUP for a compact io, which keeps no counters, another
+ * negative errno-compatible value on error, 0 on success
+ */
+int io_io_get_stats(struct io_io *io, struct io_io_stats *stats);
+
+/**
+ * Resets all the activity counters of an io to 0
+ * @param io IO context
+ * @return -ENOTSUP for a compact io, which keeps no counters, another
+ * negative errno-compatible value on error, 0 on success
+ */
+int io_io_reset_stats(struct io_io *io);
+
 /**
  * Sets the function used for logging input traffic
  * @param io IO context
@@ -166,6 +592,30 @@ int io_io_read_start(struct io_io *io, io_io_read_cb cb, void *data,
  */
 int io_io_log_rx(struct io_io *io, void (*log_rx)(const char *));
 
+/**
+ * Sets a deferred log, recording both input and output traffic. Contrary to
+ * the log_rx and log_tx callbacks, the data are only copied in the I/O path,
+ * the formatting happens when io_io_log_flush() is called
+ * @param io IO context
+ * @param log Deferred log, NULL for disabling it, can be shared by several io
+ * running in the same thread
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_log_async(struct io_io *io, struct io_io_log *log);
+
+/**
+ * Sets a capture, recording both input and output traffic, timestamped, for
+ * replaying it later with io_io_capture_replay(). As for the deferred log, the
+ * data are only copied in the I/O path, they are written to the capture file
+ * when io_io_capture_flush() is called. The data sent from files or relayed by
+ * pumps don't go through user space, hence aren't captured
+ * @param io IO context
+ * @param capture Capture, NULL for disabling it, can be shared by several io
+ * running in the same thread, whose traffic is then interleaved
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_capture_traffic(struct io_io *io, struct io_io_capture *capture);
+
 /**
  * Sets the function used for logging output traffic
  * @param io IO context
@@ -196,16 +646,34 @@ int io_io_is_read_started(struct io_io *io);
 int io_io_has_read_error(struct io_io *io);
 
 /**
- * Adds a buffer in the write queue. Order is preserve across writes
+ * Adds a buffer in the write queue. Order is preserve across writes. If
+ * nothing is being written, the buffer is written at once and the write ready
+ * event is monitored only if it couldn't be written completely, hence its
+ * callback can be notified before the function returns. A buffer added from
+ * such a callback is queued for the next write ready event
  * @param io IO context
  * @param buffer Buffer to append.
  * @return Negative errno-compatible value on error, 0 on success
  */
 int io_io_write_add(struct io_io *io, struct io_io_write_buffer *buffer);
 
+/**
+ * Adds a buffer in a lane of the write queue. The order is preserved inside a
+ * lane, but a buffer of a higher priority lane overtakes the buffers of lower
+ * priority not started yet. io_io_write_add() queues in IO_IO_PRIO_NORMAL
+ * @param io IO context
+ * @param buffer Buffer to append
+ * @param prio Lane to append the buffer to
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_write_add_prio(struct io_io *io, struct io_io_write_buffer *buffer,
+		enum io_io_write_prio prio);
+
 /**
  * Aborts all the buffers currently pending in the write queue. The buffer's
- * callbacks are invoked with status IO_IO_WRITE_ABORTED
+ * callbacks are invoked with status IO_IO_WRITE_ABORTED. The buffers already
+ * sent with zero-copy, even partially, are still used by the kernel, their
+ * callbacks are notified only once it has released them
  * @param io IO context
  * @return Negative errno-compatible value on error, 0 on success
  */
@@ -223,6 +691,23 @@ int io_io_write_abort(struct io_io *io);
 int io_io_write_buffer_init(struct io_io_write_buffer *buf, io_io_write_cb cb,
 		void *data, size_t length, const void *address);
 
+/**
+ * Initializes a write buffer whose data are read from a file. The data are
+ * transferred by the kernel, with sendfile(), without being copied in user
+ * space. Completion and timeout are notified as for memory buffers
+ * @param buf Write buffer to initialize
+ * @param cb Callback called when write succeeds or fails
+ * @param data User data passed back to cb when called
+ * @param fd File descriptor of the file, must stay open until cb is called,
+ * it's file offset isn't modified
+ * @param offset Offset of the data in the file
+ * @param length Length of the data to write, if the file is shorter, the write
+ * fails
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_write_file_init(struct io_io_write_buffer *buf, io_io_write_cb cb,
+		void *data, int fd, off_t offset, size_t length);
+
 /**
  * Cleans a write buffer. No memory liberation is performed, but this allows to
  * put the buffer in a clean state for reuse
@@ -231,5 +716,177 @@ int io_io_write_buffer_init(struct io_io_write_buffer *buf, io_io_write_cb cb,
  */
 int io_io_write_buffer_clean(struct io_io_write_buffer *buf);
 
+/**
+ * Queues a copy of some data for writing. Small writes are coalesced in
+ * chunks of IO_IO_CHUNK_SIZE bytes, taken from a per-io pool, except for
+ * compact ios, and released as soon as they are written, so no callback is
+ * needed. The data go in the IO_IO_PRIO_NORMAL lane, the order with the
+ * buffers queued with io_io_write_add() is preserved. The data are never
+ * written at once, but on the next write ready event, for consecutive copies
+ * to be coalesced
+ * @param io IO context
+ * @param data Data to copy
+ * @param length Length of the data
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_write_copy(struct io_io *io, const void *data, size_t length);
+
+/**
+ * Cancels a buffer waiting in the write queue, in constant time. Its callback
+ * is notified with status IO_IO_WRITE_ABORTED
+ * @param io IO context
+ * @param buffer Buffer to cancel
+ * @return -EBUSY if the buffer is being written, -ENOENT if it isn't waiting
+ * in the queue of io, another negative errno-compatible value on error, 0 on
+ * success
+ */
+int io_io_write_cancel(struct io_io *io, struct io_io_write_buffer *buffer);
+
+/**
+ * Tags a write buffer as belonging to a stream of messages, each superseding
+ * the previous ones, for io_io_write_set_keep_latest(). Must be called before
+ * the buffer is queued
+ * @param buf Write buffer
+ * @param tag Stream of the buffer, 0 for none, the default
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_write_buffer_set_tag(struct io_io_write_buffer *buf, uint32_t tag);
+
+/**
+ * Limits the number of buffers of the same tag waiting in a lane of the write
+ * queue. When a tagged buffer is queued and its lane already holds count
+ * buffers of the same tag not started yet, the oldest is dropped and its
+ * callback notified with status IO_IO_WRITE_DROPPED. Queuing a tagged buffer
+ * costs a scan of its lane
+ * @param io IO context
+ * @param count Number of buffers kept per tag, 0 to keep them all
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_write_set_keep_latest(struct io_io *io, unsigned count);
+
+/**
+ * Sets the maximum time a buffer may wait in the write queue. A buffer which
+ * has waited longer when its turn comes is dropped without any of its bytes
+ * being sent and its callback notified with status IO_IO_WRITE_DROPPED.
+ * Applies to the buffers queued after the call
+ * @param io IO context
+ * @param max_age Maximum queuing time in ms, 0 for no limit
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_write_set_max_age(struct io_io *io, int max_age);
+
+/**
+ * Sets watermarks on the number of bytes queued for writing. When the high
+ * watermark is reached, the callback is notified and the io is considered
+ * above watermark until the queue drains down to the low watermark, at which
+ * point the callback is notified again. The queue itself isn't limited, it's
+ * up to the producer to stop queuing
+ * @param io IO context
+ * @param low Low watermark, must be lower than high
+ * @param high High watermark, 0 to disable the watermarks
+ * @param cb Callback notified when the watermarks are crossed, can be NULL if
+ * the state is polled with io_io_write_is_above_watermark()
+ * @param data User data passed to cb
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_write_set_watermarks(struct io_io *io, size_t low, size_t high,
+		io_io_watermark_cb cb, void *data);
+
+/**
+ * Says if the number of bytes queued for writing has reached the high
+ * watermark and hasn't drained down to the low watermark since
+ * @param io IO context
+ * @return true if above watermark, false otherwise or on error
+ */
+bool io_io_write_is_above_watermark(struct io_io *io);
+
+/**
+ * Returns the number of bytes queued for writing and not written yet
+ * @param io IO context
+ * @return Number of bytes queued, 0 on error
+ */
+size_t io_io_write_get_queued(struct io_io *io);
+
+/**
+ * Enables sending the buffers with MSG_ZEROCOPY, for socket-backed ios. The
+ * callback of a buffer sent this way, even partly, is notified only once the
+ * kernel has released the memory, which is signaled through the socket's error
+ * queue, be its write completed, timed out, failed or aborted.
+ * Smaller buffers, for which pinning the pages costs more than copying them,
+ * are still copied, coalesced with their neighbours. The buffers the kernel
+ * hasn't released yet when the io is cleaned are notified with status
+ * IO_IO_WRITE_ABORTED, their memory must then be kept until the socket is
+ * closed
+ * @param io IO context
+ * @param threshold Minimum size of a buffer for being sent with zero-copy, 0
+ * to disable zero-copy
+ * @return Negative errno-compatible value on error, for example if the io's
+ * write fd isn't a socket supporting SO_ZEROCOPY, 0 on success
+ */
+int io_io_write_set_zerocopy(struct io_io *io, size_t threshold);
+
+/**
+ * Initializes a shared buffer, holding one reference, for the caller
+ * @param shared Shared buffer to initialize
+ * @param release Callback called when the last reference is dropped, i.e.
+ * when the caller has dropped it's own and each io it was queued on has
+ * completed or aborted it's write, can be NULL
+ * @param data User data passed to release
+ * @param length Length of the payload
+ * @param address Address of the payload, must stay valid until release is
+ * called
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_shared_buffer_init(struct io_io_shared_buffer *shared,
+		io_io_shared_release_cb release, void *data, size_t length,
+		const void *address);
+
+/**
+ * Takes a reference on a shared buffer
+ * @param shared Shared buffer
+ * @return shared
+ */
+struct io_io_shared_buffer *io_io_shared_buffer_ref(
+		struct io_io_shared_buffer *shared);
+
+/**
+ * Drops a reference on a shared buffer, calls it's release callback if it
+ * was the last one
+ * @param shared Shared buffer
+ */
+void io_io_shared_buffer_unref(struct io_io_shared_buffer *shared);
+
+/**
+ * Queues a shared buffer for writing on an io. The io takes it's own
+ * reference, dropped once the write has completed, failed or was aborted, so
+ * the same shared buffer can be queued on as many io as needed
+ * @param io IO context
+ * @param shared Shared buffer to write
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_write_add_shared(struct io_io *io,
+		struct io_io_shared_buffer *shared);
+
+/**
+ * Starts relaying all the data read from an io to another one. Both ios must
+ * be initialized and the source mustn't have it's read started
+ * @param pump Pump to initialize
+ * @param from IO to read data from
+ * @param to IO to write data to, can't be the destination of another pump
+ * @param cb Callback notified when the pump stops
+ * @param data User data passed back to cb
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_pump_init(struct io_io_pump *pump, struct io_io *from,
+		struct io_io *to, io_io_pump_cb cb, void *data);
+
+/**
+ * Stops a pump and releases it's resources. Data still stored in the pump are
+ * lost. Must be called before the ios are cleaned
+ * @param pump Pump to clean
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_pump_clean(struct io_io_pump *pump);
+
 #endif /* IO_IO_H_ */
 
@@ -0,0 +1,132 @@
+/**
+ * @file io_io_capture.h
+ * @brief Capture of io traffic in a compact binary file, for replaying it
+ * later with its original timing. The chunks are copied with a timestamp in a
+ * ring buffer in the I/O path and written to the file when flushed, possibly
+ * from another thread
+ *
+ * The file starts with a struct io_io_capture_header, followed by records,
+ * each made of a struct io_io_capture_record and of the data of the chunk.
+ * Integers are stored in the byte order of the capturing host.
+ *
+ * @copyright Copyright (C) 2011 Parrot S.A.
+ */
+
+#ifndef IO_IO_CAPTURE_H_
+#define IO_IO_CAPTURE_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <io_io_log.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** magic number starting a capture file, "IOCP" */
+#define IO_IO_CAPTURE_MAGIC 0x50434f49
+/** version of the capture file format */
+#define IO_IO_CAPTURE_VERSION 1
+/**
+ * direction of a record marking a gap: the length is the number of bytes
+ * which couldn't be captured and no data follow
+ */
+#define IO_IO_CAPTURE_GAP 0xff
+
+/**
+ * @struct io_io_capture_header
+ * @brief Header of a capture file
+ */
+struct io_io_capture_header {
+	uint32_t magic;		/**< IO_IO_CAPTURE_MAGIC */
+	uint16_t version;	/**< IO_IO_CAPTURE_VERSION */
+	uint16_t reserved;	/**< 0 */
+	uint64_t start;		/**< realtime of the capture start, in ns */
+};
+
+/**
+ * @struct io_io_capture_record
+ * @brief Header of a captured chunk
+ */
+struct io_io_capture_record {
+	uint64_t timestamp;	/**< monotonic time of the transfer, in ns */
+	uint32_t length;	/**< size of the data following */
+	uint8_t dir;		/**< enum io_io_log_dir or IO_IO_CAPTURE_GAP */
+	uint8_t reserved[3];	/**< 0 */
+};
+
+/**
+ * @struct io_io_capture
+ * @brief Single producer, single consumer lock-free ring of records, written
+ * to the capture file by io_io_capture_flush()
+ */
+struct io_io_capture {
+	uint8_t *buffer;	/**< records storage, in the file format */
+	size_t size;		/**< size of buffer, power of two */
+	size_t head;		/**< producer position, free running */
+	size_t tail;		/**< consumer position, free running */
+	int fd;			/**< capture file, not owned */
+	size_t dropped;		/**< bytes dropped, not reported yet */
+};
+
+/**
+ * Initializes a capture and writes the file header
+ * @param capture Capture to initialize
+ * @param fd File descriptor of the capture file, must stay open until
+ * io_io_capture_clean() is called
+ * @param size Size of the records storage, rounded up to a power of two
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_capture_init(struct io_io_capture *capture, int fd, size_t size);
+
+/**
+ * Records a chunk of traffic, costs a copy of the data and never blocks. If
+ * the ring is full, the chunk is dropped and a gap record is inserted before
+ * the next chunk recorded. Must be called from only one thread at a time
+ * @param capture Capture
+ * @param dir Direction of the traffic
+ * @param buffer Data
+ * @param length Size of the data
+ * @return -ENOBUFS if the data were dropped because the ring is full, another
+ * negative errno-compatible value on error, 0 on success
+ */
+int io_io_capture_record(struct io_io_capture *capture,
+		enum io_io_log_dir dir, const void *buffer, size_t length);
+
+/**
+ * Writes the pending records to the capture file. Can be called from a thread
+ * other than the one recording, but from only one thread at a time
+ * @param capture Capture
+ * @return Negative errno-compatible value on error, number of bytes written
+ * on success, the file being possibly non-blocking
+ */
+ssize_t io_io_capture_flush(struct io_io_capture *capture);
+
+/**
+ * Flushes the pending records and cleans up a capture, the file isn't closed
+ * @param capture Capture
+ */
+void io_io_capture_clean(struct io_io_capture *capture);
+
+/**
+ * Replays the chunks of one direction of a capture file, by writing them to a
+ * file descriptor, typically one end of a pipe or socketpair whose other end
+ * is read by an io. Blocks until the end of the capture
+ * @param capture_fd File descriptor of the capture file, positioned at its
+ * start
+ * @param fd File descriptor the chunks are written to
+ * @param dir Direction of the chunks replayed
+ * @param speed Acceleration factor of the original timing, 1 for the
+ * original speed, 0 for replaying the chunks without any delay
+ * @return -EPROTO if the capture file is invalid, another negative
+ * errno-compatible value on error, number of bytes replayed on success
+ */
+ssize_t io_io_capture_replay(int capture_fd, int fd, enum io_io_log_dir dir,
+		unsigned speed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IO_IO_CAPTURE_H_ */
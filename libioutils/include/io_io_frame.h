@@ -0,0 +1,143 @@
+/**
+ * @file io_io_frame.h
+ * @brief Framing of the data read by an io, either length-prefixed or
+ * delimiter-based. Frames are delivered as pointers in the io's mirrored read
+ * ring buffer, without being copied
+ *
+ * @copyright Copyright (C) 2011 Parrot S.A.
+ */
+
+#ifndef IO_IO_FRAME_H_
+#define IO_IO_FRAME_H_
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+
+#include <rs_rb.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct io_io;
+
+/** maximum size of the header of a length-prefixed frame */
+#define IO_IO_FRAME_HEADER_MAX 8
+
+struct io_io_frame;
+
+/**
+ * Callback called for each complete frame received, or on error
+ * @param frame Framing context
+ * @param payload Payload of the frame, points inside the ring buffer and is
+ * valid only until the callback returns, NULL on error
+ * @param size Size of the payload, delimiter or header excluded
+ * @param err 0 if a frame is delivered, -EMSGSIZE if an incoming frame is
+ * bigger than the maximum size, in which case reading is stopped, -EPIPE on
+ * end of file or read error of the io
+ * @param data User data passed at initialization
+ * @return 0 for continuing to deliver the frames received, non-zero for
+ * stopping, the remaining frames are then kept in the ring buffer until the
+ * next read event
+ */
+typedef int (*io_io_frame_cb)(struct io_io_frame *frame, const void *payload,
+		size_t size, int err, void *data);
+
+/**
+ * @enum io_io_frame_type
+ * @brief Kind of framing
+ */
+enum io_io_frame_type {
+	IO_IO_FRAME_LENGTH,	/**< payload size header, then payload */
+	IO_IO_FRAME_DELIMITER,	/**< payload, then delimiter */
+};
+
+/**
+ * @struct io_io_frame
+ * @brief Framing context
+ */
+struct io_io_frame {
+	enum io_io_frame_type type;	/**< kind of framing */
+	size_t header_size;		/**< size of the length header */
+	bool big_endian;		/**< byte order of the length header */
+	const void *delimiter;		/**< delimiter, not copied */
+	size_t delimiter_size;		/**< size of the delimiter */
+	size_t max_size;		/**< max payload size, 0 for no limit */
+	size_t scanned;			/**< bytes searched for delimiter */
+	io_io_frame_cb cb;		/**< frames callback */
+	void *data;			/**< user data */
+};
+
+/**
+ * Initializes a length-prefixed framing context
+ * @param frame Framing context to initialize
+ * @param header_size Size of the header holding the payload size, 1, 2, 4 or 8
+ * @param big_endian true if the header is big endian, false otherwise
+ * @param max_size Maximum size of a payload, 0 for no limit other than the
+ * maximum size of the io's read ring buffer
+ * @param cb Callback notified of the frames received
+ * @param data User data passed to cb
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_frame_init_length(struct io_io_frame *frame, size_t header_size,
+		bool big_endian, size_t max_size, io_io_frame_cb cb,
+		void *data);
+
+/**
+ * Initializes a delimiter-based framing context
+ * @param frame Framing context to initialize
+ * @param delimiter Delimiter ending each frame, must stay valid for the
+ * lifetime of the framing context
+ * @param delimiter_size Size of the delimiter
+ * @param max_size Maximum size of a payload, 0 for no limit other than the
+ * maximum size of the io's read ring buffer
+ * @param cb Callback notified of the frames received
+ * @param data User data passed to cb
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_frame_init_delimiter(struct io_io_frame *frame,
+		const void *delimiter, size_t delimiter_size, size_t max_size,
+		io_io_frame_cb cb, void *data);
+
+/**
+ * Starts reading an io, notifying the frames received to the framing
+ * context's callback
+ * @param frame Framing context
+ * @param io IO context, whose read mustn't be started
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_frame_read_start(struct io_io_frame *frame, struct io_io *io);
+
+/**
+ * Delivers the complete frames stored in a ring buffer and consumes them.
+ * Used internally by io_io_frame_read_start(), can be called from a custom
+ * read callback
+ * @param frame Framing context
+ * @param rb Ring buffer, must be mirrored, as the one of io_io is
+ * @return -EMSGSIZE if a frame is bigger than the maximum size, another
+ * negative errno-compatible value on error, number of frames delivered on
+ * success
+ */
+int io_io_frame_process(struct io_io_frame *frame, struct rs_rb *rb);
+
+/**
+ * Builds the vector for writing a frame, that is the header and the payload,
+ * or the payload and the delimiter
+ * @param frame Framing context
+ * @param header Storage for the header, of at least IO_IO_FRAME_HEADER_MAX
+ * bytes, unused for delimiter-based framing
+ * @param payload Payload of the frame
+ * @param size Size of the payload
+ * @param iov Vector filled, of 2 elements
+ * @return Negative errno-compatible value on error, for example if size
+ * doesn't fit in the header or exceeds the maximum size, number of elements
+ * of iov filled on success
+ */
+int io_io_frame_encode(const struct io_io_frame *frame, void *header,
+		const void *payload, size_t size, struct iovec *iov);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IO_IO_FRAME_H_ */
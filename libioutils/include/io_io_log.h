@@ -0,0 +1,106 @@
+/**
+ * @file io_io_log.h
+ * @brief Deferred logging of io traffic, the data are copied in a ring buffer
+ * in the I/O path and formatted as hexdump later, on demand
+ *
+ * @copyright Copyright (C) 2011 Parrot S.A.
+ */
+
+#ifndef IO_IO_LOG_H_
+#define IO_IO_LOG_H_
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** size of the name stored along with each record, including the '\0' */
+#define IO_IO_LOG_NAME_SIZE 16
+
+/**
+ * @enum io_io_log_dir
+ * @brief Direction of the traffic recorded
+ */
+enum io_io_log_dir {
+	IO_IO_LOG_RX,	/**< data read */
+	IO_IO_LOG_TX,	/**< data written */
+};
+
+/**
+ * @struct io_io_log
+ * @brief Single producer, single consumer lock-free ring of traffic records.
+ * Records are added by the io, in the I/O path and formatted by whoever calls
+ * io_io_log_flush(), which can be done from another thread
+ */
+struct io_io_log {
+	uint8_t *buffer;		/**< records storage */
+	size_t size;			/**< size of buffer, power of two */
+	size_t head;			/**< producer position, free running */
+	size_t tail;			/**< consumer position, free running */
+	void (*log_cb)(const char *);	/**< output of formatted lines */
+	size_t rate;			/**< max bytes per second, 0 unlimited */
+	uint64_t window;		/**< current rate limiting second */
+	size_t window_bytes;		/**< bytes recorded in current window */
+	size_t dropped;			/**< bytes dropped since last flush */
+};
+
+/**
+ * Initializes a deferred log
+ * @param log Log to initialize
+ * @param size Size of the records storage, rounded up to a power of two
+ * @param log_cb Callback called by io_io_log_flush() for each formatted line
+ * @param rate Maximum number of bytes of traffic recorded per second, 0 for no
+ * limit. Data above the limit are dropped and only their amount is logged
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_log_init(struct io_io_log *log, size_t size,
+		void (*log_cb)(const char *), size_t rate);
+
+/**
+ * Records a chunk of traffic, costs a copy of the data and never blocks. Must
+ * be called from only one thread at a time
+ * @param log Log
+ * @param dir Direction of the traffic
+ * @param name Name of the io, truncated to IO_IO_LOG_NAME_SIZE - 1 characters
+ * @param fd File descriptor the data were transferred on
+ * @param buffer Data
+ * @param length Size of the data
+ * @return -ENOBUFS if the data were dropped because of the rate limit or
+ * because the log is full, another negative errno-compatible value on error,
+ * 0 on success
+ */
+int io_io_log_record(struct io_io_log *log, enum io_io_log_dir dir,
+		const char *name, int fd, const void *buffer, size_t length);
+
+/**
+ * Formats all the pending records and passes them, line by line, to the log
+ * callback. Can be called from a thread other than the one recording, but
+ * from only one thread at a time
+ * @param log Log
+ * @return Negative errno-compatible value on error, number of records
+ * formatted on success
+ */
+int io_io_log_flush(struct io_io_log *log);
+
+/**
+ * Formats a buffer as hexdump, 16 bytes per line, and passes each line to a
+ * callback
+ * @param log_cb Callback called for each line
+ * @param buffer Data to format
+ * @param length Size of the data
+ */
+void io_io_log_hexdump(void (*log_cb)(const char *), const void *buffer,
+		size_t length);
+
+/**
+ * Cleans up a deferred log, the pending records are discarded
+ * @param log Log
+ */
+void io_io_log_clean(struct io_io_log *log);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IO_IO_LOG_H_ */
@@ -0,0 +1,199 @@
+/**
+ * @file io_io_pipeline.h
+ * @brief Chain of processing stages between a source io and a sink io, e.g.
+ * "read device, decode, filter, write socket". The stages hand over the
+ * ownership of the buffers to each other, without copying the data, the only
+ * copy being made at the source, from the io's read ring buffer. Each stage
+ * can bound the number of bytes it holds, the source io being paused while a
+ * stage is saturated
+ *
+ * @copyright Copyright (C) 2011 Parrot S.A.
+ */
+
+#ifndef IO_IO_PIPELINE_H_
+#define IO_IO_PIPELINE_H_
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <rs_dll.h>
+
+#include <io_io.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def IO_IO_PIPELINE_BUFFER_SIZE
+ * @brief maximum size of the buffers the source's data are copied to
+ */
+#define IO_IO_PIPELINE_BUFFER_SIZE 16384
+
+/**
+ * @def IO_IO_PIPELINE_POOL_SIZE
+ * @brief number of free buffers kept for reuse, per pipeline
+ */
+#define IO_IO_PIPELINE_POOL_SIZE 8
+
+struct io_io_pipeline;
+struct io_io_pipeline_stage;
+
+/**
+ * @struct io_io_pipeline_buffer
+ * @brief Buffer exchanged between the stages, owned by one stage at a time
+ */
+struct io_io_pipeline_buffer {
+	struct io_io_write_buffer write;	/**< queued in sink, internal */
+	struct rs_node node;			/**< in live or pool, internal */
+	struct io_io_pipeline *pipeline;	/**< NULL once cleaned, internal */
+	struct io_io_pipeline_stage *owner;	/**< holder, internal */
+	size_t accounted;			/**< bytes accounted to owner */
+	void *data;				/**< storage of the data */
+	size_t size;				/**< size of the storage */
+	size_t length;				/**< bytes of data stored */
+};
+
+/**
+ * Callback called when a buffer is handed over to a stage, which becomes its
+ * owner, whatever the value returned. The stage must eventually pass it to
+ * the next stage with io_io_pipeline_forward(), or release it, with
+ * io_io_pipeline_buffer_release(), it can modify the data in place, change
+ * their length or keep the buffer for later
+ * @param stage Stage
+ * @param buffer Buffer handed over
+ * @param data User data passed to io_io_pipeline_add_stage()
+ * @return Negative errno-compatible value to stop the pipeline, 0 otherwise
+ */
+typedef int (*io_io_pipeline_process_cb)(struct io_io_pipeline_stage *stage,
+		struct io_io_pipeline_buffer *buffer, void *data);
+
+/**
+ * Callback called when the pipeline ends
+ * @param pipeline Pipeline
+ * @param err 0 if the source has reached its end and all the data have been
+ * written to the sink, -EIO if a buffer couldn't be written to the sink, or
+ * the negative errno-compatible value returned by a stage
+ * @param data User data passed to io_io_pipeline_init()
+ */
+typedef void (*io_io_pipeline_end_cb)(struct io_io_pipeline *pipeline,
+		int err, void *data);
+
+/**
+ * @struct io_io_pipeline_stage
+ * @brief Processing stage of a pipeline
+ */
+struct io_io_pipeline_stage {
+	struct rs_node node;			/**< in pipeline's stages */
+	struct io_io_pipeline *pipeline;	/**< pipeline of the stage */
+	io_io_pipeline_process_cb process;	/**< processing, NULL if sink */
+	void *data;				/**< process user data */
+	size_t max_inflight;			/**< max bytes held, 0 if none */
+	size_t inflight;			/**< bytes held by the stage */
+	bool saturated;				/**< max_inflight reached */
+};
+
+/**
+ * @struct io_io_pipeline
+ * @brief Pipeline context
+ */
+struct io_io_pipeline {
+	struct io_io *source;			/**< io the data are read from */
+	struct io_io *sink;			/**< io the data are written to */
+	struct rs_dll stages;			/**< processing stages, in order */
+	struct io_io_pipeline_stage sink_stage;	/**< data queued in sink */
+	unsigned saturated;			/**< number of stages saturated */
+	struct rs_dll live;			/**< buffers in use */
+	struct rs_dll pool;			/**< free buffers, for reuse */
+	bool source_ended;			/**< no more data will be read */
+	bool draining;				/**< handing the source's data */
+	bool ended;				/**< end callback notified */
+	io_io_pipeline_end_cb cb;		/**< end callback */
+	void *cb_data;				/**< end callback user data */
+};
+
+/**
+ * Initializes a pipeline, without any processing stage, which would copy the
+ * data of source to sink as they come
+ * @param pipeline Pipeline to initialize
+ * @param source IO the data are read from, whose read mustn't be started
+ * @param sink IO the data are written to, can be source
+ * @param max_inflight Maximum number of bytes queued for writing in sink by
+ * the pipeline, 0 for no limit
+ * @param cb Callback notified when the pipeline ends, can be NULL
+ * @param data User data passed to cb
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_pipeline_init(struct io_io_pipeline *pipeline, struct io_io *source,
+		struct io_io *sink, size_t max_inflight, io_io_pipeline_end_cb cb,
+		void *data);
+
+/**
+ * Appends a processing stage to a pipeline, after the stages already added.
+ * When the stage holds max_inflight bytes or more, no more data are handed
+ * over to the first stage, those already read being left in the source's
+ * ring buffer, and reading the source is paused, until the stage has released
+ * or forwarded enough buffers to hold half of it at most. The first stage
+ * thus never holds more than max_inflight + IO_IO_PIPELINE_BUFFER_SIZE bytes
+ * @param pipeline Pipeline, not started yet
+ * @param stage Stage to initialize and append
+ * @param process Callback the buffers are handed over to
+ * @param max_inflight Maximum number of bytes held by the stage, 0 for no
+ * limit
+ * @param data User data passed to process
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_pipeline_add_stage(struct io_io_pipeline *pipeline,
+		struct io_io_pipeline_stage *stage,
+		io_io_pipeline_process_cb process, size_t max_inflight,
+		void *data);
+
+/**
+ * Starts reading the source, the data read flow through the stages
+ * @param pipeline Pipeline
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_pipeline_start(struct io_io_pipeline *pipeline);
+
+/**
+ * Hands a buffer over to the stage following a given one, or queues it for
+ * writing to the sink, if it's the last stage. Ownership is transferred
+ * whatever the result
+ * @param stage Stage owning the buffer
+ * @param buffer Buffer, an empty one is released
+ * @return -EPIPE if the pipeline has ended or has been cleaned, in which case
+ * the buffer is released, another negative errno-compatible value on error,
+ * 0 on success
+ */
+int io_io_pipeline_forward(struct io_io_pipeline_stage *stage,
+		struct io_io_pipeline_buffer *buffer);
+
+/**
+ * Allocates a buffer, for a stage producing more data than it receives, the
+ * buffer isn't accounted to any stage until it's forwarded
+ * @param pipeline Pipeline
+ * @param size Size of the storage of the buffer
+ * @return Buffer, NULL on error, with errno set
+ */
+struct io_io_pipeline_buffer *io_io_pipeline_buffer_new(
+		struct io_io_pipeline *pipeline, size_t size);
+
+/**
+ * Releases a buffer the stage owning it doesn't forward
+ * @param buffer Buffer
+ */
+void io_io_pipeline_buffer_release(struct io_io_pipeline_buffer *buffer);
+
+/**
+ * Cleans a pipeline. Reading the source is stopped and the buffers queued
+ * in the sink, but not started, are canceled. The buffers still held by the
+ * stages, or being written, stay valid and are freed when released
+ * @param pipeline Pipeline
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_io_pipeline_clean(struct io_io_pipeline *pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IO_IO_PIPELINE_H_ */
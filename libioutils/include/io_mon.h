@@ -36,6 +36,11 @@ struct io_mon {
 	struct rs_node source;
 	/** file descriptor for monitoring all the sources */
 	int epollfd;
+	/**
+	 * source whose callback is being notified, reset to NULL if the
+	 * callback removes it from the monitor
+	 */
+	struct io_src *processed;
 };
 
 /**
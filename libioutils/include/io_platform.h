@@ -83,6 +83,34 @@ extern "C" {
 #define TFD_CLOEXEC O_CLOEXEC
 #endif
 
+/* for zero-copy send */
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+
+/* for io_ring, io_uring headers may be missing or too old */
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IORING_RECV_MULTISHOT
+/**
+ * @def IO_HAVE_IO_URING
+ * @brief Defined if the tool chain's io_uring interface is recent enough for
+ * io_ring, which also checks the kernel's support at run time
+ */
+#define IO_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
 /* for socket */
 #ifndef SOCK_CLOEXEC
 /**
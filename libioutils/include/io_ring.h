@@ -0,0 +1,197 @@
+/**
+ * @file io_ring.h
+ * @brief Minimal io_uring instance, monitored by an io_mon. Used by io_io for
+ * performing its transfers without readiness notifications: files are
+ * registered, to spare the per-request file descriptor lookups, and data are
+ * received in buffers provided to the kernel in a ring shared by all the files
+ *
+ * @copyright Copyright (C) 2011 Parrot S.A.
+ */
+
+#ifndef IO_RING_H_
+#define IO_RING_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <io_mon.h>
+#include <io_src.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct io_ring_req;
+
+/**
+ * Callback notified of the completion of a request
+ * @param req Request
+ * @param res Result of the operation, negative errno-compatible value on
+ * error, -ECANCELED if the request has been canceled
+ * @param more true if more completions will follow, for multishot requests
+ * @param bid Index of the provided buffer holding the data received, -1 if
+ * none, must be given back with io_ring_recycle_buffer()
+ */
+typedef void (*io_ring_cb)(struct io_ring_req *req, int32_t res, bool more,
+		int bid);
+
+/**
+ * @struct io_ring_req
+ * @brief Request, embedded by the users of the ring in their own structures.
+ * Many operations can be submitted with the same request, for example a chain
+ * of linked sends, their completions are notified in submission order
+ */
+struct io_ring_req {
+	io_ring_cb cb;		/**< completion callback */
+};
+
+/**
+ * @struct io_ring
+ * @brief Ring context
+ */
+struct io_ring {
+	struct io_src src;	/**< source of the ring's fd */
+	struct io_mon *mon;	/**< monitor the ring is registered in */
+
+	void *sq_ring;		/**< submission ring mapping */
+	size_t sq_ring_size;	/**< size of sq_ring */
+	void *cq_ring;		/**< completion ring mapping, may be sq_ring */
+	size_t cq_ring_size;	/**< size of cq_ring */
+	void *sqes;		/**< submission entries mapping */
+	size_t sqes_size;	/**< size of sqes */
+	uint32_t *sq_head;	/**< submission ring head, kernel side */
+	uint32_t *sq_tail;	/**< submission ring tail, user side */
+	uint32_t *sq_array;	/**< submission ring indices */
+	uint32_t sq_mask;	/**< submission ring index mask */
+	uint32_t sq_entries;	/**< submission ring size */
+	uint32_t *cq_head;	/**< completion ring head, user side */
+	uint32_t *cq_tail;	/**< completion ring tail, kernel side */
+	uint32_t cq_mask;	/**< completion ring index mask */
+	void *cqes;		/**< completion entries */
+	unsigned to_submit;	/**< entries queued, not submitted yet */
+
+	int *files;		/**< registered fds, -1 for free slots */
+	unsigned nr_files;	/**< size of files */
+
+	void *buf_ring;		/**< provided buffers ring, shared */
+	size_t buf_ring_size;	/**< size of buf_ring's mapping */
+	uint8_t *bufs;		/**< storage of the provided buffers */
+	unsigned nr_bufs;	/**< number of provided buffers */
+	size_t buf_size;	/**< size of one provided buffer */
+	uint16_t buf_tail;	/**< provided buffers ring tail */
+};
+
+/**
+ * Creates an io_uring instance and registers it in a monitor
+ * @param ring Ring to initialize
+ * @param mon Monitor, whose poll processes the completions
+ * @param entries Size of the submission ring, the completion ring is twice as
+ * large
+ * @param nr_files Maximum number of files registered at once
+ * @param nr_bufs Number of buffers provided for receiving, shared by all the
+ * files, a power of two
+ * @param buf_size Size of each buffer provided
+ * @return -ENOSYS if io_uring isn't supported by the kernel or the tool chain,
+ * another negative errno-compatible value on error, 0 on success
+ */
+int io_ring_init(struct io_ring *ring, struct io_mon *mon, unsigned entries,
+		unsigned nr_files, unsigned nr_bufs, size_t buf_size);
+
+/**
+ * Registers a file, so that requests can reference it by index
+ * @param ring Ring
+ * @param fd File descriptor, not duplicated
+ * @return -ENOSPC if nr_files files are already registered, another negative
+ * errno-compatible value on error, index of the file on success
+ */
+int io_ring_register_file(struct io_ring *ring, int fd);
+
+/**
+ * Unregisters a file. The requests still in flight on it aren't canceled
+ * @param ring Ring
+ * @param index Index of the file
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_ring_unregister_file(struct io_ring *ring, int index);
+
+/**
+ * Queues a multishot receive on a registered file, the data received are
+ * stored in the provided buffers. It completes once per buffer filled, until
+ * end of file, error, cancellation, or shortage of provided buffers, with
+ * -ENOBUFS
+ * @param ring Ring
+ * @param req Request notified
+ * @param index Index of the file
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_ring_recv_multishot(struct io_ring *ring, struct io_ring_req *req,
+		int index);
+
+/**
+ * Queues the sending of a buffer on a registered socket. It completes when the
+ * whole buffer is sent or on error
+ * @param ring Ring
+ * @param req Request notified
+ * @param index Index of the file
+ * @param buf Data to send, must stay valid until completion
+ * @param len Size of the data
+ * @param link true if the next request queued must start only once this one
+ * has succeeded, it is canceled otherwise
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_ring_send(struct io_ring *ring, struct io_ring_req *req, int index,
+		const void *buf, size_t len, bool link);
+
+/**
+ * Queues the cancellation of all the requests in flight submitted with a given
+ * request. The cancellation itself isn't notified
+ * @param ring Ring
+ * @param req Request to cancel
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_ring_cancel(struct io_ring *ring, struct io_ring_req *req);
+
+/**
+ * Submits the requests queued. Called automatically after the processing of
+ * the completions
+ * @param ring Ring
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_ring_submit(struct io_ring *ring);
+
+/**
+ * Submits the requests queued, waits for at least one completion and
+ * processes the completions available
+ * @param ring Ring
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_ring_wait(struct io_ring *ring);
+
+/**
+ * Returns the storage of a provided buffer
+ * @param ring Ring
+ * @param bid Index of the buffer, as notified on completion
+ * @return Buffer, of buf_size bytes, NULL on error
+ */
+const void *io_ring_get_buffer(struct io_ring *ring, int bid);
+
+/**
+ * Gives a provided buffer back to the kernel, once its content is consumed
+ * @param ring Ring
+ * @param bid Index of the buffer, as notified on completion
+ */
+void io_ring_recycle_buffer(struct io_ring *ring, int bid);
+
+/**
+ * Unregisters the ring from its monitor and releases its resources. The users
+ * must have waited for the completion of all their requests
+ * @param ring Ring
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int io_ring_clean(struct io_ring *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IO_RING_H_ */
@@ -103,7 +103,8 @@ struct io_src {
 
 	/**
 	 * epoll events which occurred on this source, set before the callback
-	 * is called
+	 * is called. The callback can clear the error events it has fully
+	 * handled, for the source not to be removed from the monitor
 	 * @see man epoll_ctl
 	 */
 	uint32_t events;
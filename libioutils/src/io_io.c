@@ -23,389 +23,2035 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <ctype.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
 
 #include <ut_string.h>
+#include <ut_file.h>
 
 #include <io_src_tmr.h>
+#include <io_platform.h>
 
 #include "io_io.h"
+#include "io_io_capture.h"
+#include "io_ring.h"
 
 /**
- *
- * @param log_cb
- * @param func
- * @param buffer
- * @param length
- * @param fmt
+ * @struct io_io_chunk
+ * @brief Storage of the data queued with io_io_write_copy()
+ */
+struct io_io_chunk {
+	struct io_io_write_buffer buffer;	/**< chunk's write buffer */
+	uint8_t data[IO_IO_CHUNK_SIZE];		/**< data copied */
+};
+
+/**
+ * @struct io_io_write_notify
+ * @brief Notification of the buffers' callbacks by write_queued(). While in
+ * progress, the buffers queued on the same io aren't written at once, which
+ * would complete them before the buffers not notified yet and would let a
+ * producer queuing from its buffers' callbacks recurse without bound
+ */
+struct io_io_write_notify {
+	struct io_io_write_notify *outer;	/**< enclosing notification */
+	bool destroyed;				/**< io cleaned by a callback */
+};
+
+/**
+ * Returns the activity counters to update
+ * @param io IO context
+ * @return Counters of a regular io, NULL for a compact one, which keeps none
+ */
+static struct io_io_stats *io_stats(struct io_io *io)
+{
+	if (io->writectx.group != NULL || io->extra == NULL)
+		return NULL;
+
+	return &io->extra->stats;
+}
+
+/**
+ * Returns the out of line state of an io, allocating it if needed
+ * @param io IO context
+ * @return Out of line state, NULL if it couldn't be allocated
+ */
+static struct io_io_extra *get_extra(struct io_io *io)
+{
+	struct io_io_extra *extra = io->extra;
+
+	if (extra != NULL)
+		return extra;
+
+	extra = calloc(1, sizeof(*extra));
+	if (NULL == extra)
+		return NULL;
+	extra->io = io;
+	rs_dll_init(&extra->urgent, NULL);
+	rs_dll_init(&extra->zc_pending, NULL);
+	rs_dll_init(&extra->chunk_pool, NULL);
+	io->extra = extra;
+
+	return extra;
+}
+
+/**
+ * Logs a header line, then the data, as hexdump
+ * @param log_cb Logging callback
+ * @param func Unused
+ * @param buffer Data to log
+ * @param length Size of the data
+ * @param fmt Format of the header line
  */
 __attribute__((format(printf, 5, 6)))
 static void io_log_raw(void (*log_cb)(const char *), const char *func,
 		const void *buffer, size_t length, const char *fmt, ...)
 {
-	static const char hexdigits[] = "0123456789ABCDEF";
-	static char log_buf[512];
+	char log_buf[512];
 	va_list args;
-	uint8_t byte;
-	size_t n = 0, p = 0;
-	size_t i;
 
 	if (!log_cb)
 		return;
 
 	/* log "header" */
 	va_start(args, fmt);
-	vsnprintf(log_buf, 512, fmt, args);
+	vsnprintf(log_buf, sizeof(log_buf), fmt, args);
 	va_end(args);
-	log_buf[511] = '\0';
 	(*log_cb)(log_buf);
 
-	/* log format */
-	/* xx xx xx xx xx xx xx xx xx xx xx xx xx xx xx xx
-	 * .................*/
-	for (i = 0; i < length; i++) {
-		byte = ((const uint8_t *)buffer)[i] & 0xff;
-		log_buf[((n % 16) * 3)] = hexdigits[byte >> 4];
-		log_buf[((n % 16) * 3) + 1] = hexdigits[byte & 0xf];
-		log_buf[((n % 16) * 3) + 2] = ' ';
-		if (isprint(byte))
-			log_buf[(n % 16) + 51] = byte;
-		else
-			log_buf[(n % 16) + 51] = '.';
-
-		if ((n + 1) % 16 == 0) {
-			log_buf[48] = ' ';
-			log_buf[49] = '|';
-			log_buf[50] = ' ';
-			log_buf[67] = '\0';
-			log_cb(log_buf);
-		}
-		n++;
-	}
+	io_io_log_hexdump(log_cb, buffer, length);
+}
 
-	if (n % 16 > 0) {
-		p = (n % 16);
-		while (p < 16) {
-			log_buf[((p % 16) * 3)] = ' ';
-			log_buf[((p % 16) * 3) + 1] = ' ';
-			log_buf[((p % 16) * 3) + 2] = ' ';
-			log_buf[(p % 16) + 51] = ' ';
-			p++;
-		}
-		log_buf[48] = ' ';
-		log_buf[49] = '|';
-		log_buf[50] = ' ';
-		log_buf[67] = '\0';
-		log_cb(log_buf);
+/**
+ * Accounts and logs data read
+ * @param io IO context
+ * @param fd File descriptor read from
+ * @param buffer Data read
+ * @param length Size of the data
+ */
+static void account_read(struct io_io *io, int fd, const void *buffer,
+		size_t length)
+{
+	struct io_io_extra *extra = io->extra;
+	struct io_io_stats *stats = io_stats(io);
+
+	if (stats != NULL)
+		stats->nbread += length;
+
+	/* log data read */
+	if (NULL == extra)
+		return;
+	if (extra->log)
+		io_io_log_record(extra->log, IO_IO_LOG_RX, io->name, fd,
+				buffer, length);
+	if (extra->capture)
+		io_io_capture_record(extra->capture, IO_IO_LOG_RX, buffer,
+				length);
+	if (extra->log_rx)
+		io_log_raw(extra->log_rx, __func__, buffer, length,
+				"%s read fd=%d length=%zu", io->name, fd,
+				length);
+}
+
+/**
+ * Accounts and logs data written
+ * @param io IO context
+ * @param fd File descriptor written to
+ * @param iov Buffers written, partially for the last one
+ * @param iovcnt Number of buffers in iov
+ * @param length Number of bytes written
+ */
+static void account_written(struct io_io *io, int fd, const struct iovec *iov,
+		int iovcnt, size_t length)
+{
+	struct io_io_extra *extra = io->extra;
+	struct io_io_stats *stats = io_stats(io);
+	size_t size;
+	int i;
+
+	if (stats != NULL)
+		stats->nbwritten += length;
+
+	/* log data written */
+	if (NULL == extra || (NULL == extra->log && NULL == extra->log_tx &&
+			NULL == extra->capture))
+		return;
+	for (i = 0; i < iovcnt && length > 0; i++) {
+		size = iov[i].iov_len < length ? iov[i].iov_len : length;
+		if (extra->log)
+			io_io_log_record(extra->log, IO_IO_LOG_TX, io->name,
+					fd, iov[i].iov_base, size);
+		if (extra->log_tx)
+			io_log_raw(extra->log_tx, __func__, iov[i].iov_base,
+					size, "%s written fd=%d length=%zu",
+					io->name, fd, size);
+		if (extra->capture)
+			io_io_capture_record(extra->capture, IO_IO_LOG_TX,
+					iov[i].iov_base, size);
+		length -= size;
 	}
 }
 
 /**
- *
- * @param fd
- * @param ign_eof
- * @param log_cb
- * @param name
- * @param buffer
- * @param size
- * @param length
- * @return
+ * Reads from a file descriptor and logs the data read
+ * @param io IO context, for logging purpose
+ * @param fd File descriptor to read from
+ * @param buffer Buffer to read into
+ * @param size Size of buffer
+ * @param length In output, number of bytes read
+ * @return Negative errno-compatible value on error, 0 on success
  */
-static int read_io(int fd, int ign_eof, void (*log_cb)(const char *),
-		const char *name, void *buffer, size_t size, size_t *length)
+static int read_io(struct io_io *io, int fd, void *buffer, size_t size,
+		size_t *length)
 {
+	struct io_io_stats *stats = io_stats(io);
 	ssize_t nbytes;
 
 	*length = 0;
 	/* read without blocking */
 	do {
 		nbytes = read(fd, buffer, size);
+		if (stats != NULL)
+			stats->read_calls++;
 	} while (nbytes == -1 && errno == EINTR);
 
-	if (nbytes == -1)
+	if (nbytes == -1) {
+		if (errno == EAGAIN && stats != NULL)
+			stats->read_eagain++;
 		return -errno;
+	}
 	if (0 != nbytes) {
 		*length = (size_t)(nbytes);
+		account_read(io, fd, buffer, *length);
+	}
+
+	return 0;
+}
+
+/**
+ * Writes a vector of buffers in one system call and logs the data written
+ * @param io IO context, for logging purpose
+ * @param fd File descriptor to write to
+ * @param iov Buffers to write
+ * @param iovcnt Number of buffers in iov
+ * @param flags Flags passed to sendmsg(), if not 0, writev() is used otherwise
+ * @param length In output, number of bytes written
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+static int writev_io(struct io_io *io, int fd, const struct iovec *iov,
+		int iovcnt, int flags, size_t *length)
+{
+	struct msghdr msg = {
+		.msg_iov = (struct iovec *)iov,
+		.msg_iovlen = iovcnt,
+	};
+	struct io_io_stats *stats = io_stats(io);
+	ssize_t nbytes;
+
+	*length = 0;
+	/* write without blocking */
+	do {
+		if (flags != 0)
+			nbytes = sendmsg(fd, &msg, flags);
+		else
+			nbytes = writev(fd, iov, iovcnt);
+		if (stats != NULL)
+			stats->write_calls++;
+	} while (nbytes == -1 && errno == EINTR);
 
-		/* log data read */
-		if (log_cb)
-			io_log_raw(log_cb, __func__, buffer, *length,
-					"%s read fd=%d length=%zu", name, fd,
-					*length);
+	if (nbytes == -1) {
+		if (errno == EAGAIN && stats != NULL)
+			stats->write_eagain++;
+		return -errno;
 	}
+	*length = (size_t)(nbytes);
+	account_written(io, fd, iov, iovcnt, *length);
 
 	return 0;
 }
 
 /**
- *
- * @param read_src
+ * Returns the value of the monotonic clock, which doesn't involve a syscall
+ * @return Current time, in milliseconds
  */
-static void read_src_cb(struct io_src *read_src)
+static uint64_t now_ms(void)
 {
-	struct io_io *io = ut_container_of(read_src, struct io_io, src);
-	struct io_io_read_ctx *readctx = &io->readctx;
-	size_t length = 0;
-	void *buffer;
-	size_t size;
-	int cbret = 0;
-	int eof = 0;
-	int ret = 0;
-	int fd = io_src_get_fd(read_src);
+	struct timespec ts;
 
-	/* remove source from loop on error */
-	if (io_src_has_error(read_src))
-		/*
-		 * TODO change for an explicit value other than EAGAIN, e.g EIO
-		 */
-		ret = -1;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	/* do not treat event other than read available */
-	if (!io_src_has_in(read_src))
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Notifies the watermarks callback if the number of bytes queued for writing
+ * has crossed the high watermark upward or the low one downward
+ * @param io IO context
+ */
+static void update_watermarks(struct io_io *io)
+{
+	struct io_io_extra *extra = io->extra;
+	size_t queued = io->writectx.queued;
+
+	if (NULL == extra || extra->high_wm == 0)
 		return;
 
-	/* read until no more space in ring buffer or read error */
-	while (ret == 0 && !eof && rs_rb_get_write_length(&readctx->rb) > 0) {
-		buffer = rs_rb_get_write_ptr(&readctx->rb);
-		size = rs_rb_get_write_length_no_wrap(&readctx->rb);
-		assert(size > 0);
-		ret = read_io(fd, io->readctx.ign_eof, io->log_rx, io->name,
-				buffer, size, &length);
+	if (!extra->above_high && queued >= extra->high_wm) {
+		extra->above_high = true;
+		if (extra->wm_cb)
+			extra->wm_cb(io, true, extra->wm_data);
+	} else if (extra->above_high && queued <= extra->low_wm) {
+		extra->above_high = false;
+		if (extra->wm_cb)
+			extra->wm_cb(io, false, extra->wm_data);
+	}
+}
 
-		/* check if first part of ring buffer is full-filled */
-		if (ret == 0 && length > 0) {
-			rs_rb_write_incr(&readctx->rb, length);
-			/* if free space available in ring buffer read again */
-			if (rs_rb_get_write_length(&readctx->rb) > 0)
-				continue;
+/**
+ * Returns a lane of the write queue
+ * @param ctx Write context
+ * @param prio Priority of the lane
+ * @return Lane, NULL for the urgent lane of a compact io which hasn't used it
+ */
+static struct rs_dll *get_lane(struct io_io_write_ctx *ctx,
+		enum io_io_write_prio prio)
+{
+	struct io_io *io = ut_container_of(ctx, struct io_io, writectx);
 
-		} else if (ret == 0 && length == 0) {
-			/* end of file */
-			eof = 1;
-		}
+	if (prio == IO_IO_PRIO_NORMAL)
+		return &ctx->normal;
 
-		/* notify client if new bytes available */
-		/* TODO move this out of the loop for notifying only once ? */
-		if (rs_rb_get_read_length(&readctx->rb) > 0) {
-			cbret = (*readctx->cb)(io, &readctx->rb, readctx->data);
-			/* continue only if client need more data */
-			if (cbret != 0)
-				return;
+	return io->extra != NULL ? &io->extra->urgent : NULL;
+}
+
+/**
+ * Removes the first buffer of the highest priority lane not empty
+ * @param ctx Write context
+ * @return Node of the buffer, NULL if all the lanes are empty
+ */
+static struct rs_node *pop_queued(struct io_io_write_ctx *ctx)
+{
+	struct rs_node *node;
+	int prio;
+
+	for (prio = IO_IO_PRIO_COUNT - 1; prio >= 0; prio--) {
+		node = rs_dll_pop(get_lane(ctx, prio));
+		if (node != NULL) {
+			ut_container_of(node, struct io_io_write_buffer,
+					node)->lane = NULL;
+			return node;
 		}
 	}
 
-	/* log something if read buffer is full */
-	if (rs_rb_get_write_length(&readctx->rb) == 0) {
-		/* TODO replace with a client notification */
-/*		at_log_warn("%s fd=%d, io read buffer(%dB) full, data lost!",
-				io->name, fd, rs_rb_get_size(&readctx->rb)); */
-		rs_rb_empty(&readctx->rb);
+	return NULL;
+}
+
+/**
+ * Appends a buffer to its lane
+ * @param ctx Write context
+ * @param buffer Buffer, whose prio is set
+ */
+static void enqueue_lane(struct io_io_write_ctx *ctx,
+		struct io_io_write_buffer *buffer)
+{
+	buffer->lane = get_lane(ctx, buffer->prio);
+	rs_dll_enqueue(buffer->lane, &buffer->node);
+}
+
+/**
+ * Removes a buffer not started yet from its lane, in constant time, its bytes
+ * aren't queued any more
+ * @param ctx Write context
+ * @param buffer Buffer, waiting in its lane
+ */
+static void unqueue(struct io_io_write_ctx *ctx,
+		struct io_io_write_buffer *buffer)
+{
+	rs_dll_remove_node(buffer->lane, &buffer->node);
+	buffer->lane = NULL;
+	ctx->queued -= buffer->length;
+	/* nothing must be appended to a chunk leaving the queue */
+	if (&ctx->open_chunk->buffer == buffer)
+		ctx->open_chunk = NULL;
+}
+
+/**
+ * Iterates over the buffers queued, in the order they will be written
+ * @param ctx Write context
+ * @param node Current node, NULL to start from the first
+ * @return Node of the buffer written after node, NULL if none
+ */
+static struct rs_node *next_queued(struct io_io_write_ctx *ctx,
+		struct rs_node *node)
+{
+	int prio = IO_IO_PRIO_COUNT - 1;
+
+	if (node != NULL) {
+		prio = ut_container_of(node, struct io_io_write_buffer,
+				node)->prio;
+		node = rs_dll_next_from(get_lane(ctx, prio), node);
+		if (node != NULL)
+			return node;
+		prio--;
+	}
+	for (; prio >= 0; prio--) {
+		node = rs_dll_next_from(get_lane(ctx, prio), NULL);
+		if (node != NULL)
+			return node;
 	}
 
-	/* remove source if end of file or read error
-	 * (other than no more data!)
-	 */
-	if ((eof && !io->readctx.ign_eof) || (ret < 0 && ret != -EAGAIN)) {
-		io_mon_remove_source(io->mon, read_src);
-		io_src_clean(read_src);
-		/* update state and notify client */
-		readctx->state = IO_IO_ERROR;
-		(*readctx->cb)(io, &readctx->rb, readctx->data);
+	return NULL;
+}
+
+/**
+ * Counts the buffers queued in all the lanes
+ * @param ctx Write context
+ * @return Number of buffers queued, the current one excluded
+ */
+static unsigned count_queued(struct io_io_write_ctx *ctx)
+{
+	struct rs_dll *lane;
+	unsigned count = 0;
+	int prio;
+
+	for (prio = 0; prio < IO_IO_PRIO_COUNT; prio++) {
+		lane = get_lane(ctx, prio);
+		if (lane != NULL)
+			count += rs_dll_get_count(lane);
 	}
+
+	return count;
 }
 
 /**
- *
- * @param fd
- * @param log_cb
- * @param name
- * @param buffer
- * @param size
- * @param length
- * @return
+ * Accounts a buffer completely written in the statistics of its lane
+ * @param io IO context
+ * @param buffer Buffer written
  */
-static int write_io(int fd, void (*log_cb)(const char *), const char *name,
-		const void *buffer, size_t size, size_t *length)
+static void account_lane(struct io_io *io,
+		const struct io_io_write_buffer *buffer)
 {
-	int ret = 0;
-	ssize_t nbytes;
+	struct io_io_stats *stats = io_stats(io);
 
-	*length = 0;
-	/* write without blocking */
-	do {
-		nbytes = write(fd, buffer, size);
-	} while (nbytes == -1 && errno == EINTR);
+	if (stats == NULL)
+		return;
+	stats->lanes[buffer->prio].buffers++;
+	stats->lanes[buffer->prio].bytes += buffer->length;
+}
 
-	if (nbytes == -1)
-		return -errno;
-	*length = (size_t)(nbytes);
+/**
+ * Accounts the depth of the write queue, once a buffer has been queued
+ * @param io IO context
+ * @param prio Lane the buffer was queued in
+ */
+static void account_queue(struct io_io *io, enum io_io_write_prio prio)
+{
+	struct io_io_write_ctx *ctx = &io->writectx;
+	struct io_io_stats *stats = io_stats(io);
+	struct io_io_lane_stats *lane;
+	size_t depth;
 
-	/* log data written */
-	if (NULL != log_cb)
-		io_log_raw(log_cb, __func__, buffer, *length,
-				"%s written fd=%d length=%zu", name, fd,
-				*length);
+	if (stats == NULL)
+		return;
+	depth = count_queued(ctx) + (ctx->current != NULL);
+	if (depth > stats->queue_max)
+		stats->queue_max = depth;
+	lane = stats->lanes + prio;
+	depth = rs_dll_get_count(get_lane(ctx, prio));
+	if (depth > lane->queue_max)
+		lane->queue_max = depth;
+}
 
+/**
+ * Accounts the number of bytes waiting in the read ring buffer
+ * @param io IO context
+ * @param available Bytes in the ring buffer
+ */
+static void account_ring(struct io_io *io, size_t available)
+{
+	struct io_io_stats *stats = io_stats(io);
 
-	return ret;
+	if (stats != NULL && available > stats->ring_max)
+		stats->ring_max = available;
 }
 
 /**
- *
- * @param io
+ * Makes the first queued buffer, if any, the current write buffer
+ * @param ctx Write context
  */
-static void process_next_write(struct io_io *io)
+static void pop_next_write(struct io_io_write_ctx *ctx)
 {
 	struct rs_node *first;
-	struct io_io_write_ctx *ctx = &io->writectx;
 
 	/* reset current buffer info */
 	ctx->current = NULL;
 	ctx->nbwritten = 0;
 	ctx->nbeagain = 0;
 
-	first = rs_dll_pop(&ctx->buffers);
-	if (first) {
-		/* get next write buffer */
+	first = pop_queued(ctx);
+	if (first)
 		ctx->current = ut_container_of(first, struct io_io_write_buffer,
 				node);
-		/* add fd object in loop if not already done */
-		io_mon_activate_out_source(io->mon, io->write_src, 1);
+}
 
-		/* set write timer */
-		io_src_tmr_set(&ctx->timer, ctx->timeout);
-	} else {
-		/* no more buffer, clear timer */
-		io_src_tmr_set(&ctx->timer, IO_SRC_TMR_DISARM);
-		/* remove fd object if added */
-		io_mon_activate_out_source(io->mon, io->write_src, 0);
-	}
+/**
+ * Says if a buffer has waited longer than the maximum age it was queued with
+ * @param buffer Buffer not started yet
+ * @param now In input, current time in ms or 0 if not read yet, in output,
+ * current time if it had to be read
+ * @return true if the buffer must be dropped
+ */
+static bool is_stale(const struct io_io_write_buffer *buffer, uint64_t *now)
+{
+	if (buffer->drop_at == 0)
+		return false;
+	if (*now == 0)
+		*now = now_ms();
+
+	return *now >= buffer->drop_at;
 }
 
 /**
- *
- * @param timer
- * @param nbexpired
+ * Moves the buffers which have waited too long for being written to a list,
+ * for their callbacks to be notified with IO_IO_WRITE_DROPPED. A lane is
+ * checked up to its first buffer not expired yet, those queued after it
+ * expiring later, and so is the current buffer, provided none of its bytes
+ * have been sent
+ * @param io IO context
+ * @param dropped List the buffers dropped are appended to
  */
-static void write_timer_cb(struct io_src_tmr *timer, uint64_t *nbexpired)
+static void drop_stale(struct io_io *io, struct rs_dll *dropped)
 {
-	struct io_io_write_ctx *ctx = ut_container_of(timer,
-			struct io_io_write_ctx, timer);
-	struct io_io *io = ut_container_of(ctx, struct io_io, writectx);
+	struct io_io_write_ctx *ctx = &io->writectx;
+	struct io_io_stats *stats = io_stats(io);
 	struct io_io_write_buffer *buffer;
+	struct rs_node *node;
+	struct rs_node *next;
+	uint64_t now = 0;
+	int prio;
+
+	for (prio = 0; prio < IO_IO_PRIO_COUNT; prio++) {
+		next = rs_dll_next_from(get_lane(ctx, prio), NULL);
+		while ((node = next) != NULL) {
+			next = node->next;
+			buffer = ut_container_of(node,
+					struct io_io_write_buffer, node);
+			/* buffers queued without maximum age never expire */
+			if (buffer->drop_at == 0)
+				continue;
+			if (!is_stale(buffer, &now))
+				break;
+			unqueue(ctx, buffer);
+			if (stats != NULL)
+				stats->drops++;
+			rs_dll_enqueue(dropped, node);
+		}
+	}
 
-	/* get current write buffer */
+	/* the lanes are clean, so the next current buffer isn't stale */
 	buffer = ctx->current;
-	if (!buffer) {
-		io_src_tmr_set(&ctx->timer, IO_SRC_TMR_DISARM);
-		return;
+	if (buffer != NULL && ctx->nbwritten == 0 && is_stale(buffer, &now)) {
+		ctx->queued -= buffer->length;
+		pop_next_write(ctx);
+		if (stats != NULL)
+			stats->drops++;
+		rs_dll_enqueue(dropped, &buffer->node);
 	}
-
-	/* process next buffer */
-	process_next_write(io);
-
-	/* notify buffer cb */
-	(*buffer->cb)(buffer, IO_IO_WRITE_TIMEOUT);
 }
 
 /**
- *
- * @param src
+ * Notifies the callbacks of the buffers dropped by the queue policies
+ * @param dropped List of the buffers dropped
  */
-static void write_src_cb(struct io_src *src)
+static void notify_dropped(struct rs_dll *dropped)
 {
-	struct io_io_write_ctx *writectx = ut_container_of(src,
-			struct io_io_write_ctx, src);
-	struct io_io *io = ut_container_of(writectx, struct io_io, writectx);
 	struct io_io_write_buffer *buffer;
-	enum io_io_write_status status;
-	size_t length = 0;
-	int ret = 0;
-	struct io_src *write_src = io->write_src;
-
-	/* remove source from loop on error */
-	if (io_src_has_error(write_src)) {
-		io_mon_remove_source(io->mon, write_src);
-		io_src_clean(write_src);
-		return;
-	}
-
-	/* do not treat event other than write ready */
-	if (!io_src_has_out(write_src))
-		return;
-
-	/* get current write buffer */
-	buffer = writectx->current;
-	if (!buffer) { /* TODO can this really happen ? replace by an assert? */
-		io_mon_activate_out_source(io->mon, write_src, 0);
-		return;
-	}
+	struct rs_node *node;
 
-	/* write current buffer */
-	while (ret == 0 && writectx->nbwritten < buffer->length) {
-		ret = write_io(write_src->fd, io->log_tx, io->name,
-				(const uint8_t *) buffer->address
-						+ writectx->nbwritten,
-				buffer->length - writectx->nbwritten, &length);
-		if (ret == 0) {
-			/* clear eagain flags */
-			writectx->nbeagain = 0;
-			writectx->nbwritten += length;
-		} else if (ret == -EAGAIN) {
-			writectx->nbeagain++;
-		}
+	while ((node = rs_dll_pop(dropped))) {
+		buffer = ut_container_of(node, struct io_io_write_buffer, node);
+		(*buffer->cb)(buffer, IO_IO_WRITE_DROPPED);
 	}
+}
 
-	/* if we received more than 20 EAGAIN with POLLOUT set,
-	 * a PROBLEM occurs in driver */
-	if (writectx->nbeagain >= 20)
-		ret = -ENOBUFS;
-
-	/* wait for a next write ready if needed else buffer process completed*/
-	if (ret != -EAGAIN) {
-
-		process_next_write(io);
-
-		/* notify buffer cb */
-		status = ret == 0 ? IO_IO_WRITE_OK : IO_IO_WRITE_ERROR;
-		(*buffer->cb)(buffer, status);
+/**
+ * Drops the oldest buffers of the same tag as a buffer about to be queued, so
+ * that at most keep_latest of them wait in its lane, once it's queued
+ * @param io IO context
+ * @param buffer Tagged buffer about to be queued, whose prio is set
+ * @param dropped List the buffers dropped are appended to
+ */
+static void keep_latest(struct io_io *io, struct io_io_write_buffer *buffer,
+		struct rs_dll *dropped)
+{
+	struct io_io_write_ctx *ctx = &io->writectx;
+	struct io_io_stats *stats = io_stats(io);
+	struct io_io_write_buffer *other;
+	struct rs_node *node = get_lane(ctx, buffer->prio)->tail;
+	struct rs_node *prev;
+	unsigned count = 1;
+
+	/* from the newest to the oldest */
+	for (; node != NULL; node = prev) {
+		prev = node->prev;
+		other = ut_container_of(node, struct io_io_write_buffer, node);
+		if (other->tag != buffer->tag ||
+				++count <= io->extra->keep_latest)
+			continue;
+		unqueue(ctx, other);
+		if (stats != NULL)
+			stats->drops++;
+		rs_dll_enqueue(dropped, node);
 	}
 }
 
 /**
- *
- * @param buffer
- * @param status
+ * Sets the write deadline of a compact io and arms the group's timer if needed
+ * @param io IO context, whose timer group is set
  */
-static void default_write_cb(struct io_io_write_buffer *buffer,
-	enum io_io_write_status status)
+static void group_set_deadline(struct io_io *io)
 {
+	struct io_io_write_ctx *ctx = &io->writectx;
+	struct io_io_timer_group *group = ctx->group;
 
+	/*
+	 * all the ios of the group have the same timeout, so the last deadline
+	 * set is the latest, moving the io to the tail keeps the list sorted
+	 */
+	if (ctx->deadline != 0)
+		rs_dll_remove_node(&group->ios, &ctx->group_node);
+	ctx->deadline = now_ms() + group->timeout;
+	rs_dll_enqueue(&group->ios, &ctx->group_node);
+
+	/* the timer, if armed, expires at the latest on the first deadline */
+	if (!group->armed) {
+		io_src_tmr_set(&group->timer, group->timeout);
+		group->armed = 1;
+	}
 }
 
 /**
- *
- * @param src
+ * Updates the output monitoring and the write timer, depending on whether
+ * there is a current write buffer or not
+ * @param io IO context
  */
-static void duplex_src_cb(struct io_src *src)
+static void update_write_monitoring(struct io_io *io)
 {
-	struct io_io *io = ut_container_of(src, struct io_io, src);
+	struct io_io_write_ctx *ctx = &io->writectx;
 
-	/* TODO errors ? */
+	if (ctx->current || (ctx->pump && ctx->pump->pending > 0)) {
+		/* add fd object in loop if not already done */
+		io_mon_activate_out_source(io->mon, io->write_src, 1);
 
-	if (io_src_has_in(src))
-		read_src_cb(src);
+		if (ctx->group) {
+			group_set_deadline(io);
+			return;
+		}
 
-	if (io_src_has_out(src))
-		write_src_cb(&io->writectx.src);
-}
+		/*
+		 * only move the deadline forward, the timer is armed only if it
+		 * isn't already, write_timer_cb() will re-arm it for the
+		 * remaining time if the deadline has moved in between
+		 */
+		ctx->deadline = now_ms() + ctx->timeout;
+		if (!io->extra->timer_armed) {
+			io_src_tmr_set(&io->extra->timer, ctx->timeout);
+			io->extra->timer_armed = 1;
+		}
+	} else {
+		/*
+		 * no more buffer, the timer is left armed and will be ignored
+		 * at expiration, which saves two syscalls per buffer
+		 */
+		if (ctx->group && ctx->deadline != 0)
+			rs_dll_remove_node(&ctx->group->ios, &ctx->group_node);
+		ctx->deadline = 0;
+		/* remove fd object if added */
+		io_mon_activate_out_source(io->mon, io->write_src, 0);
+	}
+}
+
+/**
+ *
+ * @param io
+ */
+static void process_next_write(struct io_io *io)
+{
+	pop_next_write(&io->writectx);
+	update_write_monitoring(io);
+}
+
+/**
+ * Says if a buffer must be sent with MSG_ZEROCOPY
+ * @param io IO context
+ * @param buffer Buffer
+ * @return non-zero if zero-copy is enabled and the buffer is large enough
+ */
+static int is_zerocopy(const struct io_io *io,
+		const struct io_io_write_buffer *buffer)
+{
+	const struct io_io_extra *extra = io->extra;
+
+	return extra != NULL && extra->zc_threshold != 0 &&
+			buffer->address != NULL &&
+			buffer->length >= extra->zc_threshold;
+}
+
+/**
+ * Defers the notification of the current buffer, whose write ends before
+ * completion, if part of it was sent with zero-copy: the kernel may still use
+ * its memory, it is then notified with the given status once released
+ * @param io IO context
+ * @param buffer Current buffer, before it is replaced
+ * @param status Status to notify the buffer's callback with
+ * @return true if the notification is deferred, false if the callback can be
+ * notified right away
+ */
+static bool defer_zerocopy(struct io_io *io,
+		struct io_io_write_buffer *buffer,
+		enum io_io_write_status status)
+{
+	if (!buffer->zerocopy)
+		return false;
+
+	buffer->zc_status = status;
+	rs_dll_enqueue(&io->extra->zc_pending, &buffer->node);
+
+	return true;
+}
+
+/**
+ * Sends the part of the current buffer, a file one, still to write
+ * @param io IO context
+ * @param fd File descriptor to write to
+ * @param length In output, number of bytes written
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+static int sendfile_io(struct io_io *io, int fd, size_t *length)
+{
+	struct io_io_write_ctx *ctx = &io->writectx;
+	struct io_io_write_buffer *buffer = ctx->current;
+	off_t offset = buffer->offset + ctx->nbwritten;
+	struct io_io_stats *stats = io_stats(io);
+	ssize_t nbytes;
+
+	*length = 0;
+	do {
+		nbytes = sendfile(fd, buffer->fd, &offset,
+				buffer->length - ctx->nbwritten);
+		if (stats != NULL)
+			stats->write_calls++;
+	} while (nbytes == -1 && errno == EINTR);
+
+	if (nbytes == -1) {
+		if (errno == EAGAIN && stats != NULL)
+			stats->write_eagain++;
+		return -errno;
+	}
+	/* the file is shorter than announced */
+	if (nbytes == 0)
+		return -EIO;
+	*length = (size_t)(nbytes);
+	if (stats != NULL)
+		stats->nbwritten += *length;
+
+	return 0;
+}
+
+/**
+ * Fills a vector with the part of the current buffer still to write,
+ * followed by the buffers queued after it. Buffers sent with zero-copy are
+ * always sent alone and file buffers aren't part of the vector
+ * @param io IO context, must have a current buffer, not a file one
+ * @param iov Vector to fill, of size IOV_MAX
+ * @return Number of buffers stored in iov
+ */
+static int fill_write_iov(struct io_io *io, struct iovec *iov)
+{
+	struct io_io_write_ctx *ctx = &io->writectx;
+	struct io_io_write_buffer *buffer = ctx->current;
+	struct rs_node *node = NULL;
+	int iovcnt = 0;
+
+	iov[iovcnt].iov_base = (uint8_t *)buffer->address + ctx->nbwritten;
+	iov[iovcnt].iov_len = buffer->length - ctx->nbwritten;
+	iovcnt++;
+	if (is_zerocopy(io, buffer))
+		return iovcnt;
+
+	while (iovcnt < IOV_MAX && (node = next_queued(ctx, node))) {
+		buffer = ut_container_of(node, struct io_io_write_buffer, node);
+		if (is_zerocopy(io, buffer) || buffer->address == NULL)
+			break;
+		iov[iovcnt].iov_base = (void *)buffer->address;
+		iov[iovcnt].iov_len = buffer->length;
+		iovcnt++;
+	}
+
+	return iovcnt;
+}
+
+/**
+ * Accounts for bytes written, which can span multiple buffers. The buffers
+ * fully written are moved to a list, for their callbacks to be notified, or,
+ * if sent with zero-copy, to the list of buffers waiting for the kernel to
+ * release them
+ * @param io IO context
+ * @param length Number of bytes written
+ * @param done List the buffers fully written are appended to
+ */
+static void consume_written(struct io_io *io, size_t length,
+		struct rs_dll *done)
+{
+	struct io_io_write_ctx *ctx = &io->writectx;
+	struct io_io_write_buffer *buffer;
+	size_t remaining;
+
+	ctx->queued -= length;
+	while ((buffer = ctx->current) != NULL) {
+		remaining = buffer->length - ctx->nbwritten;
+		if (length < remaining) {
+			ctx->nbwritten += length;
+			return;
+		}
+		length -= remaining;
+		account_lane(io, buffer);
+		if (buffer->zerocopy)
+			rs_dll_enqueue(&io->extra->zc_pending, &buffer->node);
+		else
+			rs_dll_enqueue(done, &buffer->node);
+		pop_next_write(ctx);
+	}
+}
+
+/**
+ * Notifies the pump's client that the pump has stopped
+ * @param pump Pump
+ * @param err Reason of the stop, 0 on end of file
+ */
+static void pump_stop(struct io_io_pump *pump, int err)
+{
+	/* the pump stays inactive until it is cleaned */
+	io_mon_activate_in_source(pump->from->mon, &pump->from->src, 0);
+	pump->in_paused = 0;
+	pump->pending = 0;
+	update_write_monitoring(pump->to);
+
+	(*pump->cb)(pump, err, pump->data);
+}
+
+/**
+ * Moves data from the pump's source to it's pipe
+ * @param pump Pump
+ */
+static void pump_read(struct io_io_pump *pump)
+{
+	struct io_io *from = pump->from;
+	struct io_io *to = pump->to;
+	int fd = io_src_get_fd(&from->src);
+	ssize_t nbytes = 0;
+
+	while (pump->pending < pump->capacity) {
+		nbytes = splice(fd, NULL, pump->pipe[1], NULL,
+				pump->capacity - pump->pending,
+				SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (nbytes <= 0)
+			break;
+		pump->pending += nbytes;
+		pump->nbread += nbytes;
+	}
+
+	if (pump->pending > 0)
+		update_write_monitoring(to);
+
+	if (nbytes == -1 && errno == EINTR)
+		return;
+	if (nbytes == 0) {
+		/* end of file, notify once all the data have been relayed */
+		pump->eof = 1;
+		io_mon_activate_in_source(from->mon, &from->src, 0);
+		if (pump->pending == 0)
+			pump_stop(pump, 0);
+		return;
+	}
+	if (nbytes == -1 && errno != EAGAIN) {
+		pump_stop(pump, -errno);
+		return;
+	}
+
+	/*
+	 * either the pipe is full or the source is empty, we can't know for
+	 * sure if the pipe isn't empty, because pipe's capacity is in pages
+	 */
+	if (pump->pending > 0) {
+		io_mon_activate_in_source(from->mon, &from->src, 0);
+		pump->in_paused = 1;
+	}
+}
+
+/**
+ * Moves data from the pump's pipe to it's destination
+ * @param pump Pump
+ */
+static void pump_write(struct io_io_pump *pump)
+{
+	struct io_io *from = pump->from;
+	struct io_io *to = pump->to;
+	int fd = io_src_get_fd(to->write_src);
+	size_t pending = pump->pending;
+	ssize_t nbytes = 0;
+
+	while (pump->pending > 0) {
+		nbytes = splice(pump->pipe[0], NULL, fd, NULL, pump->pending,
+				SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (nbytes <= 0)
+			break;
+		pump->pending -= nbytes;
+		pump->nbwritten += nbytes;
+	}
+
+	if (nbytes == -1 && errno != EAGAIN && errno != EINTR) {
+		pump_stop(pump, -errno);
+		return;
+	}
+	if (pump->pending == pending)
+		return;
+
+	/* data could be written, rearm the write ready timeout */
+	update_write_monitoring(to);
+
+	/* there is room in the pipe again */
+	if (pump->in_paused) {
+		pump->in_paused = 0;
+		io_mon_activate_in_source(from->mon, &from->src, 1);
+	}
+
+	if (pump->pending == 0 && pump->eof)
+		pump_stop(pump, 0);
+}
+
+/**
+ * Doubles the size of the read ring buffer, if it doesn't exceed it's maximum
+ * size
+ * @param io IO context
+ * @return -ENOBUFS if the ring buffer can't grow anymore, another negative
+ * errno-compatible value on error, 0 on success
+ */
+static int grow_read_buffer(struct io_io *io)
+{
+	struct io_io_read_ctx *readctx = &io->readctx;
+	size_t size = rs_rb_get_size(&readctx->rb);
+
+	/* not allocated yet, compact io */
+	if (size == 0)
+		return rs_rb_init(&readctx->rb, NULL, readctx->init_size);
+	if (2 * size > readctx->max_size)
+		return -ENOBUFS;
+
+	return rs_rb_resize(&readctx->rb, 2 * size);
+}
+
+/**
+ * Releases the read ring buffer of a compact io, if it is empty. It will be
+ * allocated again when data arrive
+ * @param io IO context
+ */
+static void release_read_buffer(struct io_io *io)
+{
+	struct io_io_read_ctx *readctx = &io->readctx;
+
+	if (io->writectx.group == NULL || readctx->paused ||
+			rs_rb_get_size(&readctx->rb) == 0 ||
+			rs_rb_get_read_length(&readctx->rb) != 0)
+		return;
+
+	rs_rb_clean(&readctx->rb);
+}
+
+/**
+ * Stops monitoring the read source until the client frees some room in the
+ * read ring buffer, then notifies it
+ * @param io IO context
+ */
+static void pause_read(struct io_io *io)
+{
+	struct io_io_read_ctx *readctx = &io->readctx;
+
+	if (io->ringctx == NULL)
+		io_mon_activate_in_source(io->mon, &io->src, 0);
+	readctx->paused = 1;
+
+	if (readctx->overflow_cb == NULL)
+		return;
+	(*readctx->overflow_cb)(io, &readctx->rb, readctx->data);
+
+	/* the client may have consumed data from it's callback */
+	if (readctx->paused && rs_rb_get_write_length(&readctx->rb) > 0)
+		io_io_read_resume(io);
+}
+
+/**
+ * Removes the buffer posted, if any, without notifying the client
+ * @param io IO context
+ */
+static void clear_post(struct io_io *io)
+{
+	struct io_io_extra *extra = io->extra;
+
+	io->readctx.post_buffer = NULL;
+	if (NULL == extra)
+		return;
+	extra->post_cb = NULL;
+	extra->post_data = NULL;
+	extra->post_size = 0;
+	extra->post_filled = 0;
+}
+
+/**
+ * Notifies the client that the buffer it posted is filled, or that it won't
+ * be. The post is removed before, so that another one can be made from the
+ * callback
+ * @param io IO context
+ * @param err 0 if the buffer is full, -EPIPE otherwise
+ */
+static void complete_post(struct io_io *io, int err)
+{
+	struct io_io_extra *extra = io->extra;
+	io_io_read_post_cb cb = extra->post_cb;
+	void *buffer = io->readctx.post_buffer;
+	size_t filled = extra->post_filled;
+	void *data = extra->post_data;
+
+	clear_post(io);
+
+	(*cb)(io, buffer, filled, err, data);
+}
+
+/**
+ * Moves the data pending in the read ring buffer to the posted buffer, then
+ * notifies the client if it is full
+ * @param io IO context
+ */
+static void fill_post_from_ring(struct io_io *io)
+{
+	struct io_io_read_ctx *readctx = &io->readctx;
+	struct io_io_extra *extra = io->extra;
+	size_t length;
+
+	length = rs_rb_get_read_length(&readctx->rb);
+	if (length > extra->post_size - extra->post_filled)
+		length = extra->post_size - extra->post_filled;
+	if (length == 0)
+		return;
+
+	/* the ring buffer is mirrored, the data are contiguous */
+	memcpy((char *)readctx->post_buffer + extra->post_filled,
+			rs_rb_get_read_ptr(&readctx->rb), length);
+	rs_rb_read_incr(&readctx->rb, length);
+	extra->post_filled += length;
+	if (extra->post_filled == extra->post_size)
+		complete_post(io, 0);
+}
+
+/**
+ * Reads directly in the posted buffer, notifies the client if it is full
+ * @param io IO context
+ * @param fd File descriptor to read from
+ * @param length In output, number of bytes read, 0 on end of file
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+static int read_post(struct io_io *io, int fd, size_t *length)
+{
+	struct io_io_extra *extra = io->extra;
+	int ret;
+
+	ret = read_io(io, fd, (char *)io->readctx.post_buffer +
+			extra->post_filled,
+			extra->post_size - extra->post_filled, length);
+	if (ret < 0 || *length == 0)
+		return ret;
+
+	extra->post_filled += *length;
+	if (extra->post_filled == extra->post_size)
+		complete_post(io, 0);
+
+	return 0;
+}
+
+/**
+ *
+ * @param read_src
+ */
+static void read_src_cb(struct io_src *read_src)
+{
+	struct io_io *io = ut_container_of(read_src, struct io_io, src);
+	struct io_io_read_ctx *readctx = &io->readctx;
+	size_t length = 0;
+	size_t available;
+	void *buffer;
+	size_t size;
+	int cbret = 0;
+	int eof = 0;
+	int hangup = 0;
+	int full;
+	int ret = 0;
+	int fd = io_src_get_fd(read_src);
+
+	/* remove source from loop on error */
+	if (read_src->events & EPOLLERR)
+		/*
+		 * TODO change for an explicit value other than EAGAIN, e.g EIO
+		 */
+		ret = -1;
+	/* on hang up, the data sent by the peer before must be read first */
+	else if (io_src_has_error(read_src))
+		hangup = 1;
+
+	/* do not treat event other than read available */
+	if (!io_src_has_in(read_src))
+		return;
+
+	if (readctx->pump) {
+		pump_read(readctx->pump);
+		return;
+	}
+
+	/* drain the fd into the ring buffer, until read error or no more space */
+	while (ret == 0 && !eof) {
+		/* a posted buffer bypasses the ring buffer, which is empty */
+		if (readctx->post_buffer != NULL) {
+			ret = read_post(io, fd, &length);
+			if (ret == 0 && length == 0)
+				eof = 1;
+			/* the client may have stopped reading */
+			if (readctx->state != IO_IO_STARTED)
+				return;
+			continue;
+		}
+
+		/* make some room, if the client didn't consume enough data */
+		if (rs_rb_get_write_length(&readctx->rb) == 0 &&
+				grow_read_buffer(io) < 0)
+			break;
+
+		buffer = rs_rb_get_write_ptr(&readctx->rb);
+		size = rs_rb_get_write_length_no_wrap(&readctx->rb);
+		assert(size > 0);
+		ret = read_io(io, fd, buffer, size, &length);
+		if (ret == 0 && length > 0)
+			rs_rb_write_incr(&readctx->rb, length);
+		else if (ret == 0 && length == 0)
+			/* end of file */
+			eof = 1;
+	}
+	/*
+	 * the hang up is handled once all the data are read, until then, the
+	 * monitor mustn't remove the source
+	 */
+	if (hangup && (eof || ret == -EAGAIN))
+		ret = -1;
+	else if (hangup)
+		read_src->events &= ~IO_EPOLL_ERROR_EVENTS;
+	full = ret == 0 && !eof;
+
+	if (readctx->post_buffer != NULL && (eof || (ret < 0 &&
+			ret != -EAGAIN)))
+		complete_post(io, -EPIPE);
+
+	available = rs_rb_get_read_length(&readctx->rb);
+	account_ring(io, available);
+	if (available == 0)
+		release_read_buffer(io);
+
+	/*
+	 * notify client once, with all the bytes available, when there are
+	 * enough of them or when no more will come
+	 */
+	if (available > 0 && (available >= readctx->threshold || full ||
+			eof || (ret < 0 && ret != -EAGAIN))) {
+		cbret = (*readctx->cb)(io, &readctx->rb, readctx->data);
+		/*
+		 * read buffer full and can't grow, stop reading instead of
+		 * loosing data, until the client consumes some
+		 */
+		if (full && rs_rb_get_write_length(&readctx->rb) == 0) {
+			pause_read(io);
+			return;
+		}
+		release_read_buffer(io);
+		/* continue only if client need more data */
+		if (cbret != 0)
+			return;
+	}
+
+	/* remove source if end of file or read error
+	 * (other than no more data!)
+	 */
+	if ((eof && !io->readctx.ign_eof) || (ret < 0 && ret != -EAGAIN)) {
+		io_mon_remove_source(io->mon, read_src);
+		io_src_clean(read_src);
+		/* update state and notify client */
+		readctx->state = IO_IO_ERROR;
+		(*readctx->cb)(io, &readctx->rb, readctx->data);
+	}
+}
+
+/* maximum number of sends linked in one chain, in io_uring mode */
+#define RING_SEND_BATCH 16
+
+/**
+ * @struct ring_pending
+ * @brief Data received in a provided buffer, not moved yet to the read ring
+ * buffer
+ */
+struct ring_pending {
+	int bid;		/**< index of the provided buffer */
+	uint32_t offset;	/**< offset of the data not moved yet */
+	uint32_t length;	/**< size of the data not moved yet */
+};
+
+/**
+ * @struct io_io_ring_ctx
+ * @brief State of an io in io_uring mode
+ */
+struct io_io_ring_ctx {
+	struct io_io *io;		/**< io */
+	struct io_ring *ring;		/**< ring performing the transfers */
+	int file;			/**< index of the registered socket */
+	struct io_ring_req recv_req;	/**< multishot receive */
+	struct io_ring_req send_req;	/**< sends of the chain in flight */
+	bool recv_armed;		/**< multishot receive in flight */
+	bool delivering;		/**< ring_deliver() is running */
+	bool closing;			/**< io being cleaned */
+	bool eof;			/**< end of file received */
+	int error;			/**< receive error, 0 if none */
+	struct rs_dll inflight;		/**< buffers of the chain in flight */
+	unsigned sends;			/**< sends not completed yet */
+	struct ring_pending *pending;	/**< FIFO of ring->nr_bufs elements */
+	unsigned pending_head;		/**< index of the first pending */
+	unsigned pending_count;		/**< number of pending */
+};
+
+/**
+ * Arms the multishot receive, if it isn't and reading can go on
+ * @param io IO context in io_uring mode
+ */
+static void ring_recv(struct io_io *io)
+{
+	struct io_io_ring_ctx *ctx = io->ringctx;
+
+	if (ctx->recv_armed || ctx->eof || ctx->error != 0 || ctx->closing)
+		return;
+
+	ctx->error = io_ring_recv_multishot(ctx->ring, &ctx->recv_req,
+			ctx->file);
+	if (ctx->error < 0)
+		return;
+	ctx->recv_armed = true;
+	io_ring_submit(ctx->ring);
+}
+
+/**
+ * Gives the provided buffers holding data not delivered back to the kernel
+ * @param io IO context in io_uring mode
+ */
+static void ring_drop_pending(struct io_io *io)
+{
+	struct io_io_ring_ctx *ctx = io->ringctx;
+	struct ring_pending *p;
+
+	while (ctx->pending_count > 0) {
+		p = ctx->pending + ctx->pending_head;
+		io_ring_recycle_buffer(ctx->ring, p->bid);
+		ctx->pending_head = (ctx->pending_head + 1) %
+				ctx->ring->nr_bufs;
+		ctx->pending_count--;
+	}
+}
+
+/**
+ * Moves the data received in provided buffers to the read ring buffer and
+ * gives the buffers emptied back to the kernel
+ * @param io IO context in io_uring mode
+ * @return true if the read ring buffer is full and data remain, false if all
+ * the data have been moved
+ */
+static bool ring_fill(struct io_io *io)
+{
+	struct io_io_ring_ctx *ctx = io->ringctx;
+	struct rs_rb *rb = &io->readctx.rb;
+	struct ring_pending *p;
+	const uint8_t *buf;
+	size_t n;
+
+	while (ctx->pending_count > 0) {
+		if (rs_rb_get_write_length(rb) == 0 && grow_read_buffer(io) < 0)
+			return true;
+
+		p = ctx->pending + ctx->pending_head;
+		buf = io_ring_get_buffer(ctx->ring, p->bid);
+		n = rs_rb_get_write_length_no_wrap(rb);
+		if (n > p->length)
+			n = p->length;
+		memcpy(rs_rb_get_write_ptr(rb), buf + p->offset, n);
+		rs_rb_write_incr(rb, n);
+		p->offset += n;
+		p->length -= n;
+		if (p->length > 0)
+			continue;
+
+		io_ring_recycle_buffer(ctx->ring, p->bid);
+		ctx->pending_head = (ctx->pending_head + 1) %
+				ctx->ring->nr_bufs;
+		ctx->pending_count--;
+	}
+
+	return false;
+}
+
+/**
+ * Moves the data received to the read ring buffer, then to the posted buffer,
+ * if any, until there's no more data or room
+ * @param io IO context in io_uring mode
+ * @return true if the read ring buffer is full and data remain, false if all
+ * the data have been moved
+ */
+static bool ring_fill_all(struct io_io *io)
+{
+	struct io_io_read_ctx *readctx = &io->readctx;
+	bool full;
+
+	do {
+		full = ring_fill(io);
+		if (readctx->post_buffer == NULL ||
+				rs_rb_get_read_length(&readctx->rb) == 0)
+			break;
+		fill_post_from_ring(io);
+	} while (full);
+
+	return full;
+}
+
+/**
+ * Delivers the data received to the read callback, as read_src_cb() does for
+ * readiness based reads, then re-arms the receive if needed
+ * @param io IO context in io_uring mode
+ */
+static void ring_deliver(struct io_io *io)
+{
+	struct io_io_ring_ctx *ctx = io->ringctx;
+	struct io_io_read_ctx *readctx = &io->readctx;
+	size_t available;
+	bool full;
+	bool end;
+
+	/* called back from the read or overflow callback, the loop goes on */
+	if (ctx->delivering)
+		return;
+
+	ctx->delivering = true;
+	do {
+		full = ring_fill_all(io);
+		end = ctx->pending_count == 0 && (ctx->eof || ctx->error != 0);
+		available = rs_rb_get_read_length(&readctx->rb);
+		account_ring(io, available);
+		if (available == 0 || (available < readctx->threshold &&
+				!full && !end))
+			break;
+
+		(*readctx->cb)(io, &readctx->rb, readctx->data);
+		if (readctx->state != IO_IO_STARTED)
+			break;
+		if (full && rs_rb_get_write_length(&readctx->rb) == 0) {
+			pause_read(io);
+			if (readctx->paused)
+				break;
+		}
+	} while (ctx->pending_count > 0);
+	ctx->delivering = false;
+
+	if (readctx->state != IO_IO_STARTED || readctx->paused)
+		return;
+	release_read_buffer(io);
+
+	if (ctx->pending_count == 0 && (ctx->eof || ctx->error != 0)) {
+		if (readctx->post_buffer != NULL)
+			complete_post(io, -EPIPE);
+		if (!ctx->eof || !readctx->ign_eof) {
+			readctx->state = IO_IO_ERROR;
+			(*readctx->cb)(io, &readctx->rb, readctx->data);
+		}
+		return;
+	}
+
+	ring_recv(io);
+}
+
+/**
+ * Completion callback of the multishot receive
+ * @param req Receive request
+ * @param res Number of bytes received, 0 on end of file, negative
+ * errno-compatible value on error
+ * @param more true if the receive goes on
+ * @param bid Index of the provided buffer holding the data, -1 if none
+ */
+static void ring_recv_cb(struct io_ring_req *req, int32_t res, bool more,
+		int bid)
+{
+	struct io_io_ring_ctx *ctx = ut_container_of(req,
+			struct io_io_ring_ctx, recv_req);
+	struct io_io *io = ctx->io;
+	struct io_io_stats *stats = io_stats(io);
+	struct ring_pending *p;
+
+	if (!more)
+		ctx->recv_armed = false;
+
+	if (bid >= 0 && res > 0) {
+		p = ctx->pending + (ctx->pending_head + ctx->pending_count) %
+				ctx->ring->nr_bufs;
+		p->bid = bid;
+		p->offset = 0;
+		p->length = res;
+		ctx->pending_count++;
+		if (stats != NULL)
+			stats->read_calls++;
+		account_read(io, io_src_get_fd(&io->src),
+				io_ring_get_buffer(ctx->ring, bid), res);
+	} else if (bid >= 0) {
+		io_ring_recycle_buffer(ctx->ring, bid);
+	}
+	if (res == 0)
+		ctx->eof = true;
+	/* shortage of buffers and cancellation are not fatal */
+	else if (res < 0 && res != -ENOBUFS && res != -ECANCELED)
+		ctx->error = res;
+
+	if (ctx->closing || io->readctx.state != IO_IO_STARTED)
+		return;
+	ring_deliver(io);
+}
+
+/**
+ * Sends the buffers queued as a chain of linked sends, if no chain is in
+ * flight
+ * @param io IO context in io_uring mode
+ * @param dropped List the buffers dropped for being too old are appended to
+ */
+static void ring_send(struct io_io *io, struct rs_dll *dropped)
+{
+	struct io_io_ring_ctx *ctx = io->ringctx;
+	struct io_io_write_ctx *wctx = &io->writectx;
+	struct io_io_write_buffer *buffer;
+	struct rs_node *node;
+	unsigned max = RING_SEND_BATCH;
+	bool link;
+	int ret;
+
+	if (ctx->sends > 0 || ctx->closing)
+		return;
+
+	drop_stale(io, dropped);
+	/* the whole chain must be submitted at once, or it would be split */
+	if (io_ring_submit(ctx->ring) < 0)
+		return;
+	if (max > ctx->ring->sq_entries)
+		max = ctx->ring->sq_entries;
+	while (ctx->sends < max && (node = pop_queued(wctx))) {
+		buffer = ut_container_of(node, struct io_io_write_buffer, node);
+		/* a buffer submitted can't be appended to any more */
+		if (&wctx->open_chunk->buffer == buffer)
+			wctx->open_chunk = NULL;
+		link = ctx->sends + 1 < max && count_queued(wctx) > 0;
+		ret = io_ring_send(ctx->ring, &ctx->send_req, ctx->file,
+				buffer->address, buffer->length, link);
+		if (ret < 0) {
+			buffer->lane = get_lane(wctx, buffer->prio);
+			rs_dll_push(buffer->lane, node);
+			break;
+		}
+		rs_dll_enqueue(&ctx->inflight, node);
+		ctx->sends++;
+	}
+
+	io_ring_submit(ctx->ring);
+}
+
+/**
+ * Puts the buffers of a broken chain back in front of the write queue
+ * @param io IO context in io_uring mode
+ */
+static void ring_requeue(struct io_io *io)
+{
+	struct io_io_ring_ctx *ctx = io->ringctx;
+	struct io_io_write_ctx *wctx = &io->writectx;
+	struct rs_dll lanes[IO_IO_PRIO_COUNT];
+	struct io_io_write_buffer *buffer;
+	struct rs_node *node;
+	struct rs_dll *lane;
+	int prio;
+
+	if (rs_dll_is_empty(&ctx->inflight))
+		return;
+
+	/* each buffer goes back in front of its own lane */
+	for (prio = 0; prio < IO_IO_PRIO_COUNT; prio++)
+		rs_dll_init(lanes + prio, NULL);
+	while ((node = rs_dll_pop(&ctx->inflight))) {
+		buffer = ut_container_of(node, struct io_io_write_buffer, node);
+		buffer->lane = get_lane(wctx, buffer->prio);
+		rs_dll_enqueue(lanes + buffer->prio, node);
+	}
+	for (prio = 0; prio < IO_IO_PRIO_COUNT; prio++) {
+		/* buffers of a lane not allocated can't have been sent */
+		lane = get_lane(wctx, prio);
+		if (lane == NULL)
+			continue;
+		while ((node = rs_dll_pop(lane)))
+			rs_dll_enqueue(lanes + prio, node);
+		*lane = lanes[prio];
+	}
+}
+
+/**
+ * Completion callback of the sends, notified in submission order
+ * @param req Send request
+ * @param res Number of bytes sent, negative errno-compatible value on error,
+ * -ECANCELED if a previous send of the chain failed
+ * @param more Unused
+ * @param bid Unused
+ */
+static void ring_send_cb(struct io_ring_req *req, int32_t res, bool more,
+		int bid)
+{
+	struct io_io_ring_ctx *ctx = ut_container_of(req,
+			struct io_io_ring_ctx, send_req);
+	struct io_io *io = ctx->io;
+	struct io_io_stats *stats = io_stats(io);
+	struct io_io_write_buffer *buffer = NULL;
+	enum io_io_write_status status;
+	struct rs_dll dropped;
+	struct iovec iov;
+
+	rs_dll_init(&dropped, NULL);
+	ctx->sends--;
+	/* a canceled buffer stays in flight, to be sent again */
+	if (res != -ECANCELED) {
+		buffer = ut_container_of(rs_dll_pop(&ctx->inflight),
+				struct io_io_write_buffer, node);
+		io->writectx.queued -= buffer->length;
+		if (stats != NULL)
+			stats->write_calls++;
+		if (res > 0) {
+			iov.iov_base = (void *)buffer->address;
+			iov.iov_len = res;
+			account_written(io, io_src_get_fd(&io->src), &iov, 1,
+					res);
+		}
+		status = res == (int32_t)buffer->length ? IO_IO_WRITE_OK :
+				IO_IO_WRITE_ERROR;
+		if (status == IO_IO_WRITE_OK)
+			account_lane(io, buffer);
+	}
+
+	if (ctx->sends == 0 && !ctx->closing) {
+		ring_requeue(io);
+		ring_send(io, &dropped);
+	}
+	update_watermarks(io);
+
+	/* last, the client may clean the io */
+	notify_dropped(&dropped);
+	if (buffer != NULL)
+		(*buffer->cb)(buffer, status);
+}
+
+/**
+ * Leaves io_uring mode, waiting for the completion of the requests in flight
+ * @param io IO context in io_uring mode
+ */
+static void ring_detach(struct io_io *io)
+{
+	struct io_io_ring_ctx *ctx = io->ringctx;
+
+	ctx->closing = true;
+	if (ctx->recv_armed)
+		io_ring_cancel(ctx->ring, &ctx->recv_req);
+	if (ctx->sends > 0)
+		io_ring_cancel(ctx->ring, &ctx->send_req);
+	while ((ctx->recv_armed || ctx->sends > 0) &&
+			io_ring_wait(ctx->ring) == 0)
+		;
+
+	/* the buffers not sent will be aborted */
+	ring_requeue(io);
+	ring_drop_pending(io);
+	io_ring_unregister_file(ctx->ring, ctx->file);
+
+	free(ctx->pending);
+	free(ctx);
+	io->ringctx = NULL;
+}
+
+/**
+ * Notifies the current write buffer, or the pump writing to the io, that the
+ * write ready timeout has expired
+ * @param io IO context
+ */
+static void write_timeout(struct io_io *io)
+{
+	struct io_io_write_ctx *ctx = &io->writectx;
+	struct io_io_stats *stats = io_stats(io);
+	struct io_io_write_buffer *buffer;
+	bool deferred;
+
+	/* get current write buffer */
+	buffer = ctx->current;
+	if (!buffer) {
+		if (ctx->pump && ctx->pump->pending > 0) {
+			if (stats != NULL)
+				stats->timeouts++;
+			pump_stop(ctx->pump, -ETIMEDOUT);
+		}
+		return;
+	}
+
+	/* process next buffer */
+	if (stats != NULL)
+		stats->timeouts++;
+	ctx->queued -= buffer->length - ctx->nbwritten;
+	deferred = defer_zerocopy(io, buffer, IO_IO_WRITE_TIMEOUT);
+	process_next_write(io);
+	update_watermarks(io);
+
+	/* notify buffer cb */
+	if (!deferred)
+		(*buffer->cb)(buffer, IO_IO_WRITE_TIMEOUT);
+}
+
+/**
+ *
+ * @param timer
+ * @param nbexpired
+ */
+static void write_timer_cb(struct io_src_tmr *timer, uint64_t *nbexpired)
+{
+	struct io_io_extra *extra = ut_container_of(timer, struct io_io_extra,
+			timer);
+	struct io_io *io = extra->io;
+	struct io_io_write_ctx *ctx = &io->writectx;
+	uint64_t now;
+
+	extra->timer_armed = 0;
+
+	/* nothing is waiting to be written any more */
+	if (ctx->deadline == 0)
+		return;
+
+	/* progress was made since the timer was armed, wait the remaining */
+	now = now_ms();
+	if (now < ctx->deadline) {
+		io_src_tmr_set(&extra->timer, ctx->deadline - now);
+		extra->timer_armed = 1;
+		return;
+	}
+	ctx->deadline = 0;
+
+	write_timeout(io);
+}
+
+/**
+ * Timer callback of a timer group, times out the writes of the ios whose
+ * deadline has passed, then re-arms the timer for the next deadline
+ * @param timer Timer of the group
+ * @param nbexpired Unused
+ */
+static void group_timer_cb(struct io_src_tmr *timer, uint64_t *nbexpired)
+{
+	struct io_io_timer_group *group = ut_container_of(timer,
+			struct io_io_timer_group, timer);
+	struct io_io_write_ctx *ctx;
+	struct rs_node *node;
+	uint64_t now = now_ms();
+
+	group->armed = 0;
+
+	while ((node = rs_dll_next_from(&group->ios, NULL))) {
+		ctx = ut_container_of(node, struct io_io_write_ctx, group_node);
+		if (ctx->deadline > now) {
+			io_src_tmr_set(&group->timer, ctx->deadline - now);
+			group->armed = 1;
+			return;
+		}
+		rs_dll_remove_node(&group->ios, node);
+		ctx->deadline = 0;
+
+		/* may set a new deadline, hence re-enqueue the io */
+		write_timeout(ut_container_of(ctx, struct io_io, writectx));
+	}
+}
+
+/**
+ * Writes as much of the queued buffers as possible at once, then notifies the
+ * callbacks of the buffers completed, the io mustn't be accessed afterwards
+ * @param io IO context, whose current buffer is set
+ * @param dropped Buffers dropped by the queue policies, notified too
+ * @param monitored true if called on write ready, in which case the write
+ * monitoring is updated only if a buffer has completed
+ */
+static void write_queued(struct io_io *io, struct rs_dll *dropped,
+		bool monitored)
+{
+	struct io_io_write_ctx *writectx = &io->writectx;
+	struct io_io_write_buffer *buffer = NULL;
+	struct io_io_write_buffer *written;
+	struct iovec iov[IOV_MAX];
+	struct rs_dll done;
+	struct rs_node *node;
+	struct io_io_write_notify notify;
+	bool failed = false;
+	int zerocopy;
+	int iovcnt;
+	size_t total;
+	size_t length = 0;
+	int ret = 0;
+	int i;
+	struct io_src *write_src = io->write_src;
+
+	rs_dll_init(&done, NULL);
+	while (writectx->current != NULL) {
+		if (writectx->current->address == NULL) {
+			/* file buffer, sent by the kernel without copy */
+			iov[0].iov_len = writectx->current->length -
+					writectx->nbwritten;
+			iovcnt = 1;
+			zerocopy = 0;
+			ret = sendfile_io(io, write_src->fd, &length);
+		} else {
+			iovcnt = fill_write_iov(io, iov);
+			zerocopy = is_zerocopy(io, writectx->current);
+			ret = writev_io(io, write_src->fd, iov, iovcnt,
+					zerocopy ? MSG_ZEROCOPY : 0, &length);
+		}
+		if (ret < 0) {
+			if (ret == -EAGAIN)
+				writectx->nbeagain++;
+			break;
+		}
+		/* each successful zero-copy send is notified with a new id */
+		if (zerocopy) {
+			writectx->current->zc_id = io->extra->zc_next_id++;
+			writectx->current->zerocopy = true;
+		}
+		/* clear eagain flags */
+		writectx->nbeagain = 0;
+		consume_written(io, length, &done);
+
+		/* partial write, wait for the next write ready */
+		for (total = 0, i = 0; i < iovcnt; i++)
+			total += iov[i].iov_len;
+		if (length < total)
+			break;
+	}
+
+	/* if we received more than 20 EAGAIN with POLLOUT set,
+	 * a PROBLEM occurs in driver */
+	if (writectx->nbeagain >= 20)
+		ret = -ENOBUFS;
+
+	/* on error, the current buffer process is completed */
+	if (ret < 0 && ret != -EAGAIN) {
+		buffer = writectx->current;
+		writectx->queued -= buffer->length - writectx->nbwritten;
+		failed = !defer_zerocopy(io, buffer, IO_IO_WRITE_ERROR);
+		pop_next_write(writectx);
+	}
+
+	if (!monitored || buffer != NULL || !rs_dll_is_empty(&done) ||
+			!rs_dll_is_empty(dropped))
+		update_write_monitoring(io);
+	update_watermarks(io);
+
+	/* notify buffers cb, the io mustn't be accessed if they destroy it */
+	notify.outer = writectx->notify;
+	notify.destroyed = false;
+	writectx->notify = &notify;
+	notify_dropped(dropped);
+	while ((node = rs_dll_pop(&done))) {
+		written = ut_container_of(node, struct io_io_write_buffer,
+				node);
+		(*written->cb)(written, IO_IO_WRITE_OK);
+	}
+	if (failed)
+		(*buffer->cb)(buffer, IO_IO_WRITE_ERROR);
+	if (!notify.destroyed)
+		writectx->notify = notify.outer;
+}
+
+/**
+ * Processes the events of the write source
+ * @param io IO context
+ */
+static void write_src_cb(struct io_io *io)
+{
+	struct io_io_write_ctx *writectx = &io->writectx;
+	struct rs_dll dropped;
+	struct io_src *write_src = io->write_src;
+
+	/* remove source from loop on error */
+	if (io_src_has_error(write_src)) {
+		io_mon_remove_source(io->mon, write_src);
+		io_src_clean(write_src);
+		return;
+	}
+
+	/* do not treat event other than write ready */
+	if (!io_src_has_out(write_src))
+		return;
+
+	/* buffers which have waited too long aren't worth sending any more */
+	rs_dll_init(&dropped, NULL);
+	drop_stale(io, &dropped);
+	if (!writectx->current && !rs_dll_is_empty(&dropped)) {
+		update_write_monitoring(io);
+		update_watermarks(io);
+		notify_dropped(&dropped);
+		return;
+	}
+
+	/* buffers are written in priority over the data of a pump */
+	if (!writectx->current) {
+		if (writectx->pump && writectx->pump->pending > 0) {
+			pump_write(writectx->pump);
+			return;
+		}
+		/* TODO can this really happen ? replace by an assert? */
+		io_mon_activate_out_source(io->mon, write_src, 0);
+		return;
+	}
+
+	write_queued(io, &dropped, true);
+}
+
+/**
+ * Reads the zero-copy completion notifications from the socket's error queue
+ * and moves the buffers the kernel has released to a list, for their
+ * callbacks to be notified. If the error events of the source were only due
+ * to these notifications, they are cleared, so that the source isn't
+ * considered in error, neither by the io, nor by the monitor
+ * @param io IO context
+ * @param src Source the error event occurred on
+ * @param done List the released buffers are appended to
+ */
+static void collect_zerocopy(struct io_io *io, struct io_src *src,
+		struct rs_dll *done)
+{
+	struct io_io_extra *extra = io->extra;
+	struct io_io_write_buffer *buffer;
+	struct sock_extended_err *serr;
+	struct cmsghdr *cm;
+	struct rs_node *node;
+	char control[128];
+	struct msghdr msg;
+	int real_error = 0;
+	int err = 0;
+	socklen_t len = sizeof(err);
+	ssize_t ret;
+
+	if (NULL == extra || (extra->zc_threshold == 0 &&
+			rs_dll_is_empty(&extra->zc_pending)))
+		return;
+
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		ret = recvmsg(src->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+		if (ret == -1) {
+			if (errno != EAGAIN && errno != EINTR)
+				real_error = 1;
+			if (errno != EINTR)
+				break;
+			continue;
+		}
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			serr = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+					serr->ee_errno != 0) {
+				real_error = 1;
+				continue;
+			}
+			/*
+			 * ids [ee_info, ee_data] are released, the kernel
+			 * releases them in order, for stream sockets
+			 */
+			while ((node = rs_dll_next_from(&extra->zc_pending,
+					NULL))) {
+				buffer = ut_container_of(node,
+						struct io_io_write_buffer,
+						node);
+				if ((int32_t)(buffer->zc_id - serr->ee_data) > 0)
+					break;
+				rs_dll_pop(&extra->zc_pending);
+				rs_dll_enqueue(done, &buffer->node);
+			}
+		}
+	}
 
-int io_io_init(struct io_io *io, struct io_mon *mon, const char *name,
-		int fd_in, int fd_out, int ign_eof)
+	if (getsockopt(src->fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 ||
+			err != 0)
+		real_error = 1;
+	if (!real_error && !(src->events & (EPOLLHUP | EPOLLRDHUP)))
+		src->events &= ~EPOLLERR;
+}
+
+/**
+ * Notifies the callbacks of the buffers released by the kernel
+ * @param done List of the buffers released
+ */
+static void notify_zerocopy(struct rs_dll *done)
+{
+	struct io_io_write_buffer *buffer;
+	struct rs_node *node;
+
+	while ((node = rs_dll_pop(done))) {
+		buffer = ut_container_of(node, struct io_io_write_buffer,
+				node);
+		(*buffer->cb)(buffer, buffer->zc_status);
+	}
+}
+
+/**
+ * Callback of the write source of half-duplex ios
+ * @param src Write source
+ */
+static void out_src_cb(struct io_src *src)
+{
+	struct io_io *io = ut_container_of(src, struct io_io_extra, src)->io;
+	struct rs_dll zc_done;
+
+	rs_dll_init(&zc_done, NULL);
+	if (io_src_has_error(src))
+		collect_zerocopy(io, src, &zc_done);
+
+	write_src_cb(io);
+
+	/* notified last, the io may have been destroyed by now */
+	notify_zerocopy(&zc_done);
+}
+
+/**
+ *
+ * @param buffer
+ * @param status
+ */
+static void default_write_cb(struct io_io_write_buffer *buffer,
+	enum io_io_write_status status)
+{
+
+}
+
+/**
+ * Write callback of the chunks, puts them back in the pool, or frees them
+ * if the pool is full or if the io is a compact one, which has no pool
+ * @param buffer Chunk's write buffer
+ * @param status Unused
+ */
+static void chunk_write_cb(struct io_io_write_buffer *buffer,
+	enum io_io_write_status status)
+{
+	struct io_io_chunk *chunk = ut_container_of(buffer, struct io_io_chunk,
+			buffer);
+	struct io_io *io = buffer->data;
+	struct io_io_write_ctx *ctx = &io->writectx;
+
+	if (ctx->open_chunk == chunk)
+		ctx->open_chunk = NULL;
+
+	if (ctx->group == NULL && rs_dll_get_count(&io->extra->chunk_pool) <
+			IO_IO_CHUNK_POOL_SIZE)
+		rs_dll_push(&io->extra->chunk_pool, &buffer->node);
+	else
+		free(chunk);
+}
+
+/**
+ * Write callback of the reference nodes queued by io_io_write_add_shared(),
+ * drops the io's reference on the shared buffer, whatever the status
+ * @param buffer Reference node
+ * @param status Unused
+ */
+static void shared_write_cb(struct io_io_write_buffer *buffer,
+	enum io_io_write_status status)
+{
+	io_io_shared_buffer_unref(buffer->data);
+	free(buffer);
+}
+
+/**
+ * Handles a hang up occurring while reading is paused, epoll reporting it
+ * whatever the events monitored. The source is removed from the monitor until
+ * reading resumes, for the data received before the hang up to be read then,
+ * instead of being lost with the source
+ * @param io IO context, whose read is paused
+ */
+static void hold_hangup(struct io_io *io)
+{
+	/* the monitor lets a source monitored for nothing in the epoll set */
+	io_mon_activate_in_source(io->mon, &io->src, 1);
+	io_mon_remove_source(io->mon, &io->src);
+	io->src.events &= ~IO_EPOLL_ERROR_EVENTS;
+	io->readctx.hangup = 1;
+}
+
+/**
+ *
+ * @param src
+ */
+static void duplex_src_cb(struct io_src *src)
+{
+	struct io_io *io = ut_container_of(src, struct io_io, src);
+	struct rs_dll zc_done;
+
+	rs_dll_init(&zc_done, NULL);
+	if (io_src_has_error(src))
+		collect_zerocopy(io, src, &zc_done);
+
+	if (io_src_has_in(src))
+		read_src_cb(src);
+	else if (io->readctx.paused && !(src->events & EPOLLERR) &&
+			io_src_has_error(src))
+		hold_hangup(io);
+
+	if (io_src_has_out(src))
+		write_src_cb(io);
+
+	/* notified last, the io may have been destroyed by now */
+	notify_zerocopy(&zc_done);
+}
+
+/**
+ * Initializes an io, either regular or compact
+ * @param io IO context to initialize
+ * @param mon Monitor
+ * @param name Name of the IO
+ * @param fd_in File descriptor for reading
+ * @param fd_out File descriptor for writing
+ * @param ign_eof set 0 to stop read on end of file, 1 to continue read
+ * @param group Timer group for a compact io, NULL for a regular one
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+static int init_io(struct io_io *io, struct io_mon *mon, const char *name,
+		int fd_in, int fd_out, int ign_eof,
+		struct io_io_timer_group *group)
 {
 	int ret;
 	int duplex = fd_in == fd_out;
 	enum io_src_event source_type = duplex ? IO_DUPLEX : IO_IN;
+	long page_size;
 
 	if (NULL == io || NULL == mon || ut_string_is_invalid(name))
 		return -EINVAL;
@@ -415,14 +2061,23 @@ int io_io_init(struct io_io *io, struct io_mon *mon, const char *name,
 
 	memset(io, 0, sizeof(*io));
 
-	/* disable io log by default */
-	io->log_rx = NULL;
-	io->log_tx = NULL;
+	/* needed for the timer or the write source, allocated later otherwise */
+	if ((group == NULL || !duplex) && get_extra(io) == NULL)
+		return -ENOMEM;
 
-	/* create a magic ring buffer for reads, the size should be 4096 */
-	ret = rs_rb_init(&io->readctx.rb, NULL, IO_IO_RB_BUFFER_SIZE);
-	if (ret < 0)
-		return ret;
+	if (group == NULL) {
+		/* create a magic ring buffer for reads, the size is 4096 */
+		ret = rs_rb_init(&io->readctx.rb, NULL, IO_IO_RB_BUFFER_SIZE);
+		if (ret < 0)
+			goto free_extra;
+		io->readctx.init_size = rs_rb_get_size(&io->readctx.rb);
+	} else {
+		/* allocated on first read, rounded up as rs_rb_init() does */
+		page_size = sysconf(_SC_PAGE_SIZE);
+		io->readctx.init_size = IO_IO_RB_BUFFER_SIZE < page_size ?
+				(size_t)page_size : IO_IO_RB_BUFFER_SIZE;
+	}
+	io->readctx.max_size = io->readctx.init_size;
 
 	/* TODO split out creation/initialization of read and write contexts */
 
@@ -435,109 +2090,484 @@ int io_io_init(struct io_io *io, struct io_mon *mon, const char *name,
 	io->readctx.data = NULL;
 	io->readctx.ign_eof = ign_eof;
 
-	/* create write timer */
-	ret = io_src_tmr_init(&io->writectx.timer, &write_timer_cb);
-	if (ret < 0)
-		goto free_rb;
-
 	io->mon = mon;
+	io->writectx.group = group;
+	if (group == NULL) {
+		/* create write timer */
+		ret = io_src_tmr_init(&io->extra->timer, &write_timer_cb);
+		if (ret < 0)
+			goto free_rb;
+		ret = io_mon_add_source(mon,
+				io_src_tmr_get_source(&io->extra->timer));
+		if (0 != ret)
+			goto clean_tmr;
+		io->name = strdup(name);
+	} else {
+		/* the group's timer is used and the name isn't copied */
+		io->name = (char *)name;
+	}
+
 	io->writectx.current = NULL;
 	io->writectx.nbwritten = 0;
 
 	/* init write buffer queue */
-	rs_dll_init(&io->writectx.buffers, NULL);
+	rs_dll_init(&io->writectx.normal, NULL);
+
+	/* set default write ready timeout to 10s */
+	io->writectx.timeout = group == NULL ? 10000 : group->timeout;
+	io->writectx.state = IO_IO_STARTED;
+
+	ret = io_mon_add_source(mon, &io->src);
+	if (0 != ret)
+		goto remove_tmr;
+
+	if (duplex) {
+		io->write_src = &io->src;
+	} else {
+		/* create a separate write source with fd_out, only if needed */
+		io_src_init(&io->extra->src, fd_out, IO_OUT, &out_src_cb);
+		ret = io_mon_add_source(mon, &io->extra->src);
+		if (0 != ret)
+			goto remove_tmr;
+		io->write_src = &io->extra->src;
+	}
+
+	return 0;
+
+	/* TODO better error handling */
+remove_tmr:
+	if (group == NULL) {
+		io_mon_remove_source(mon,
+				io_src_tmr_get_source(&io->extra->timer));
+		free(io->name);
+	}
+clean_tmr:
+	if (group == NULL)
+		io_src_tmr_clean(&io->extra->timer);
+free_rb:
+	rs_rb_clean(&io->readctx.rb);
+free_extra:
+	free(io->extra);
+	io->extra = NULL;
+
+	return ret;
+}
+
+int io_io_init(struct io_io *io, struct io_mon *mon, const char *name,
+		int fd_in, int fd_out, int ign_eof)
+{
+	return init_io(io, mon, name, fd_in, fd_out, ign_eof, NULL);
+}
+
+int io_io_init_compact(struct io_io *io, struct io_mon *mon, const char *name,
+		int fd_in, int fd_out, int ign_eof,
+		struct io_io_timer_group *group)
+{
+	if (NULL == group)
+		return -EINVAL;
+
+	return init_io(io, mon, name, fd_in, fd_out, ign_eof, group);
+}
+
+int io_io_use_ring(struct io_io *io, struct io_ring *ring)
+{
+	struct io_io_ring_ctx *ctx;
+	int ret;
+
+	if (NULL == io || NULL == ring)
+		return -EINVAL;
+	/* a single registered file performs both the reads and the writes */
+	if (io->write_src != &io->src)
+		return -EINVAL;
+	if (io->ringctx || io->readctx.state != IO_IO_STOPPED ||
+			io->readctx.pump || io->writectx.pump ||
+			io->writectx.current ||
+			count_queued(&io->writectx) > 0 ||
+			(io->extra && io->extra->zc_threshold != 0))
+		return -EBUSY;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (NULL == ctx)
+		return -errno;
+	ctx->pending = calloc(ring->nr_bufs, sizeof(*ctx->pending));
+	if (NULL == ctx->pending) {
+		ret = -errno;
+		goto free_ctx;
+	}
+	ret = io_ring_register_file(ring, io_src_get_fd(&io->src));
+	if (ret < 0)
+		goto free_pending;
+	ctx->file = ret;
+	ctx->io = io;
+	ctx->ring = ring;
+	ctx->recv_req.cb = ring_recv_cb;
+	ctx->send_req.cb = ring_send_cb;
+	rs_dll_init(&ctx->inflight, NULL);
+
+	/* readiness isn't needed any more */
+	io_mon_remove_source(io->mon, &io->src);
+	io->ringctx = ctx;
+
+	return 0;
+
+free_pending:
+	free(ctx->pending);
+free_ctx:
+	free(ctx);
+
+	return ret;
+}
+
+int io_io_timer_group_init(struct io_io_timer_group *group,
+		struct io_mon *mon, int timeout)
+{
+	int ret;
+
+	if (NULL == group || NULL == mon || timeout <= 0)
+		return -EINVAL;
+
+	memset(group, 0, sizeof(*group));
+	ret = io_src_tmr_init(&group->timer, &group_timer_cb);
+	if (ret < 0)
+		return ret;
+	ret = io_mon_add_source(mon, io_src_tmr_get_source(&group->timer));
+	if (ret < 0) {
+		io_src_tmr_clean(&group->timer);
+		return ret;
+	}
+	group->mon = mon;
+	group->timeout = timeout;
+	rs_dll_init(&group->ios, NULL);
+
+	return 0;
+}
+
+int io_io_timer_group_clean(struct io_io_timer_group *group)
+{
+	if (NULL == group)
+		return -EINVAL;
+	if (!rs_dll_is_empty(&group->ios))
+		return -EBUSY;
+
+	io_mon_remove_source(group->mon,
+			io_src_tmr_get_source(&group->timer));
+	io_src_tmr_clean(&group->timer);
+	memset(group, 0, sizeof(*group));
+
+	return 0;
+}
+
+int io_io_clean(struct io_io *io)
+{
+	struct io_io_extra *extra;
+	struct io_io_write_buffer *buffer;
+	struct io_io_write_notify *notify;
+	struct rs_dll zc_done;
+	struct rs_node *node;
+
+	if (NULL == io)
+		return -EINVAL;
+	extra = io->extra;
+
+	/* cleaned by a buffer's callback, write_queued() must forget the io */
+	for (notify = io->writectx.notify; notify; notify = notify->outer)
+		notify->destroyed = true;
+	io->writectx.notify = NULL;
+
+	if (io->ringctx)
+		ring_detach(io);
+
+	/* stop read if started */
+	if (io->readctx.state == IO_IO_STARTED)
+		io_io_read_stop(io);
+
+	if (io->writectx.group == NULL && extra != NULL)
+		io_mon_remove_source(io->mon,
+				io_src_tmr_get_source(&extra->timer));
+	if (extra != NULL)
+		io_mon_remove_source(io->mon, &extra->src);
+	io_mon_remove_source(io->mon, &io->src);
+
+	rs_rb_clean(&io->readctx.rb);
+
+	/* destroy write */
+	io_io_write_abort(io);
+	/*
+	 * the zero-copy sends can't be waited for any more, the ones the kernel
+	 * has released are notified as such, the others are aborted
+	 */
+	rs_dll_init(&zc_done, NULL);
+	collect_zerocopy(io, io->write_src, &zc_done);
+	notify_zerocopy(&zc_done);
+	/* the callbacks may have enabled a feature of a compact io */
+	extra = io->extra;
+	if (extra != NULL) {
+		while ((node = rs_dll_pop(&extra->zc_pending))) {
+			buffer = ut_container_of(node,
+					struct io_io_write_buffer, node);
+			(*buffer->cb)(buffer, IO_IO_WRITE_ABORTED);
+		}
+		while ((node = rs_dll_pop(&extra->chunk_pool)))
+			free(ut_container_of(node, struct io_io_chunk,
+					buffer.node));
+		io_src_clean(&extra->src);
+	}
+
+	io_src_clean(&io->src);
+	if (io->writectx.group == NULL) {
+		if (extra != NULL)
+			io_src_tmr_clean(&extra->timer);
+		free(io->name);
+	} else if (io->writectx.deadline != 0) {
+		/* a pump may still have been writing */
+		rs_dll_remove_node(&io->writectx.group->ios,
+				&io->writectx.group_node);
+	}
+
+	free(extra);
+	memset(io, 0, sizeof(*io));
+
+	return 0;
+}
+
+int io_io_read_start(struct io_io *io, io_io_read_cb cb, void *data,
+		int clear)
+{
+	int ret;
+
+	if (!io || !cb)
+		return -EINVAL;
+
+	if (io->readctx.state != IO_IO_STOPPED || io->readctx.pump)
+		return -EBUSY;
+
+	/*
+	 * activate out source, useless at init, but needed after calls to
+	 * io_io_read_stop()
+	 */
+	if (io->ringctx == NULL) {
+		ret = io_mon_activate_in_source(io->mon, &io->src, 1);
+		if (ret < 0)
+			return ret;
+	}
+
+	/* set callback info */
+	io->readctx.cb = cb;
+	io->readctx.data = data;
+
+	/* clear read buffer if needed */
+	if (clear) {
+		rs_rb_empty(&io->readctx.rb);
+		if (io->ringctx)
+			ring_drop_pending(io);
+	}
+
+	/* update read state */
+	io->readctx.state = IO_IO_STARTED;
+	io->readctx.paused = 0;
+
+	/* in io_uring mode, the data received while stopped are delivered */
+	if (io->ringctx)
+		ring_deliver(io);
+
+	return 0;
+}
+
+int io_io_read_set_buffer_size(struct io_io *io, size_t size,
+		size_t max_size)
+{
+	int ret;
+	struct io_io_read_ctx *readctx;
+
+	if (NULL == io || 0 == size)
+		return -EINVAL;
+	if (0 != max_size && max_size < size)
+		return -EINVAL;
+	readctx = &io->readctx;
+
+	if (rs_rb_get_size(&readctx->rb) == 0) {
+		/* not allocated, compact io, allocate it to validate size */
+		ret = rs_rb_init(&readctx->rb, NULL, size);
+		if (ret < 0)
+			return ret;
+	} else if (size != rs_rb_get_size(&readctx->rb)) {
+		ret = rs_rb_resize(&readctx->rb, size);
+		if (ret < 0)
+			return ret;
+	}
+	/* size may have been rounded up by the ring buffer */
+	size = rs_rb_get_size(&readctx->rb);
+	readctx->init_size = size;
+	readctx->max_size = max_size < size ? size : max_size;
+	release_read_buffer(io);
+
+	if (readctx->paused && rs_rb_get_write_length(&readctx->rb) > 0)
+		return io_io_read_resume(io);
+
+	return 0;
+}
+
+size_t io_io_read_get_max_size(struct io_io *io)
+{
+	return NULL == io ? 0 : io->readctx.max_size;
+}
+
+int io_io_read_set_threshold(struct io_io *io, size_t threshold)
+{
+	if (NULL == io)
+		return -EINVAL;
+
+	io->readctx.threshold = threshold;
+
+	return 0;
+}
+
+int io_io_read_set_overflow_cb(struct io_io *io,
+		io_io_overflow_cb overflow_cb)
+{
+	if (NULL == io)
+		return -EINVAL;
+
+	io->readctx.overflow_cb = overflow_cb;
+
+	return 0;
+}
+
+int io_io_read_post(struct io_io *io, void *buffer, size_t size,
+		io_io_read_post_cb cb, void *data)
+{
+	struct io_io_read_ctx *readctx;
+	struct io_io_extra *extra;
+
+	if (NULL == io || NULL == buffer || 0 == size || NULL == cb)
+		return -EINVAL;
+	readctx = &io->readctx;
+	if (readctx->state != IO_IO_STARTED)
+		return -EINVAL;
+	if (readctx->post_buffer != NULL || readctx->pump)
+		return -EBUSY;
+	extra = get_extra(io);
+	if (NULL == extra)
+		return -ENOMEM;
 
-	/* set default write ready timeout to 10s */
-	io->writectx.timeout = 10000;
-	io->writectx.state = IO_IO_STARTED;
-	io->name = strdup(name);
+	readctx->post_buffer = buffer;
+	extra->post_size = size;
+	extra->post_filled = 0;
+	extra->post_cb = cb;
+	extra->post_data = data;
 
-	ret = io_mon_add_sources(mon,
-			io_src_tmr_get_source(&io->writectx.timer),
-			&io->src,
-			NULL /* NULL guard */
-			);
-	if (0 != ret)
-		goto free_rb;
+	/* the bytes already read come first */
+	fill_post_from_ring(io);
 
-	if (duplex) {
-		io->write_src = &io->src;
-	} else {
-		/* create a separate write source with fd_out, only if needed */
-		io_src_init(&io->writectx.src, fd_out, IO_OUT, &write_src_cb);
-		ret = io_mon_add_source(mon, &io->writectx.src);
-		if (0 != ret)
-			goto free_rb;
-		io->write_src = &io->writectx.src;
-	}
+	/* the room freed in the ring buffer allows reading again */
+	if (readctx->paused && rs_rb_get_write_length(&readctx->rb) > 0)
+		return io_io_read_resume(io);
 
 	return 0;
-
-	/* TODO better error handling */
-free_rb:
-	rs_rb_clean(&io->readctx.rb);
-
-	return ret;
 }
 
-int io_io_clean(struct io_io *io)
+ssize_t io_io_read_post_cancel(struct io_io *io)
 {
+	size_t filled;
+
 	if (NULL == io)
 		return -EINVAL;
+	if (io->readctx.post_buffer == NULL)
+		return -ENOENT;
 
-	/* stop read if started */
-	if (io->readctx.state == IO_IO_STARTED)
-		io_io_read_stop(io);
-
-	io_mon_remove_source(io->mon,
-			io_src_tmr_get_source(&io->writectx.timer));
-	io_mon_remove_source(io->mon, &io->writectx.src);
-	io_mon_remove_source(io->mon, &io->src);
+	filled = io->extra->post_filled;
+	clear_post(io);
 
-	rs_rb_clean(&io->readctx.rb);
+	return filled;
+}
 
-	/* destroy write */
-	io_io_write_abort(io);
+int io_io_read_pause(struct io_io *io)
+{
+	int ret;
 
-	io_src_clean(&io->writectx.src);
-	io_src_clean(&io->src);
-	io_src_tmr_clean(&io->writectx.timer);
+	if (NULL == io)
+		return -EINVAL;
+	if (io->readctx.state != IO_IO_STARTED)
+		return -EBUSY;
 
-	free(io->name);
-	memset(io, 0, sizeof(*io));
+	if (io->readctx.paused)
+		return 0;
+	if (io->ringctx == NULL) {
+		ret = io_mon_activate_in_source(io->mon, &io->src, 0);
+		if (ret < 0)
+			return ret;
+	}
+	io->readctx.paused = 1;
 
 	return 0;
 }
 
-int io_io_read_start(struct io_io *io, io_io_read_cb cb, void *data,
-		int clear)
+int io_io_read_resume(struct io_io *io)
 {
 	int ret;
 
-	if (!io || !cb)
+	if (NULL == io)
 		return -EINVAL;
 
-	if (io->readctx.state != IO_IO_STOPPED)
-		return -EBUSY;
+	if (!io->readctx.paused)
+		return 0;
+	/* the ring buffer of a compact io may not be allocated */
+	if (rs_rb_get_size(&io->readctx.rb) != 0 &&
+			rs_rb_get_write_length(&io->readctx.rb) == 0)
+		return -ENOBUFS;
+
+	if (io->ringctx) {
+		io->readctx.paused = 0;
+		ring_deliver(io);
+		return 0;
+	}
+
+	if (io->readctx.hangup) {
+		/* monitored for IN only, the hang up will be reported again */
+		ret = io_mon_add_source(io->mon, &io->src);
+		if (ret < 0)
+			return ret;
+		io->readctx.hangup = 0;
+		io->readctx.paused = 0;
+		if (io->write_src == &io->src && io->writectx.current)
+			io_mon_activate_out_source(io->mon, &io->src, 1);
+		return 0;
+	}
 
-	/*
-	 * activate out source, useless at init, but needed after calls to
-	 * io_io_read_stop()
-	 */
 	ret = io_mon_activate_in_source(io->mon, &io->src, 1);
 	if (ret < 0)
 		return ret;
+	io->readctx.paused = 0;
 
-	/* set callback info */
-	io->readctx.cb = cb;
-	io->readctx.data = data;
+	return 0;
+}
 
-	/* clear read buffer if needed */
-	if (clear)
-		rs_rb_empty(&io->readctx.rb);
+int io_io_is_read_paused(struct io_io *io)
+{
+	return NULL != io ? io->readctx.paused : 0;
+}
+
+int io_io_get_stats(struct io_io *io, struct io_io_stats *stats)
+{
+	if (NULL == io || NULL == stats)
+		return -EINVAL;
+	if (io_stats(io) == NULL)
+		return -ENOTSUP;
+
+	*stats = io->extra->stats;
+
+	return 0;
+}
+
+int io_io_reset_stats(struct io_io *io)
+{
+	if (NULL == io)
+		return -EINVAL;
+	if (io_stats(io) == NULL)
+		return -ENOTSUP;
+
+	memset(&io->extra->stats, 0, sizeof(io->extra->stats));
 
-	/* update read state */
-	io->readctx.state = IO_IO_STARTED;
 	return 0;
 }
 
@@ -545,8 +2575,34 @@ int io_io_log_rx(struct io_io *io, void (*log_rx)(const char *))
 {
 	if (NULL == io)
 		return -EINVAL;
+	if (NULL == get_extra(io))
+		return -ENOMEM;
+
+	io->extra->log_rx = log_rx;
+
+	return 0;
+}
+
+int io_io_log_async(struct io_io *io, struct io_io_log *log)
+{
+	if (NULL == io)
+		return -EINVAL;
+	if (NULL == get_extra(io))
+		return -ENOMEM;
+
+	io->extra->log = log;
+
+	return 0;
+}
+
+int io_io_capture_traffic(struct io_io *io, struct io_io_capture *capture)
+{
+	if (NULL == io)
+		return -EINVAL;
+	if (NULL == get_extra(io))
+		return -ENOMEM;
 
-	io->log_rx = log_rx;
+	io->extra->capture = capture;
 
 	return 0;
 }
@@ -555,8 +2611,10 @@ int io_io_log_tx(struct io_io *io, void (*log_tx)(const char *))
 {
 	if (NULL == io)
 		return -EINVAL;
+	if (NULL == get_extra(io))
+		return -ENOMEM;
 
-	io->log_tx = log_tx;
+	io->extra->log_tx = log_tx;
 
 	return 0;
 }
@@ -573,8 +2631,26 @@ int io_io_read_stop(struct io_io *io)
 	io->readctx.cb = NULL;
 	io->readctx.data = NULL;
 
+	/* drop the posted buffer, if any */
+	clear_post(io);
+
 	/* update state */
 	io->readctx.state = IO_IO_STOPPED;
+	io->readctx.paused = 0;
+	/* the source of an io hung up is left removed, as the monitor does */
+	if (io->readctx.hangup) {
+		io->readctx.hangup = 0;
+		return 0;
+	}
+
+	if (io->ringctx) {
+		if (io->ringctx->recv_armed) {
+			io_ring_cancel(io->ringctx->ring,
+					&io->ringctx->recv_req);
+			io_ring_submit(io->ringctx->ring);
+		}
+		return 0;
+	}
 
 	return io_mon_activate_in_source(io->mon, &io->src, 0);
 }
@@ -590,53 +2666,226 @@ int io_io_has_read_error(struct io_io *io)
 }
 
 int io_io_write_add(struct io_io *io, struct io_io_write_buffer *buffer)
+{
+	return io_io_write_add_prio(io, buffer, IO_IO_PRIO_NORMAL);
+}
+
+/**
+ * Adds a buffer in a lane of the write queue
+ * @param io IO context
+ * @param buffer Buffer to append
+ * @param prio Lane to append the buffer to
+ * @param optimistic true if the buffer can be written at once when nothing is
+ * being written, false to wait for the next write ready event, so that it can
+ * be coalesced with the buffers queued in between
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+static int write_add(struct io_io *io, struct io_io_write_buffer *buffer,
+		enum io_io_write_prio prio, bool optimistic)
 {
 	int ret = 0;
 	struct io_io_write_ctx *ctx;
+	struct io_io_extra *extra;
+	struct rs_dll dropped;
 
 	if (NULL == io || NULL == buffer)
 		return -EINVAL;
-	if (!buffer->address || buffer->length == 0)
+	if (prio < 0 || prio >= IO_IO_PRIO_COUNT)
+		return -EINVAL;
+	if ((!buffer->address && buffer->fd < 0) || buffer->length == 0)
 		return -EINVAL;
+	if (io->ringctx && !buffer->address)
+		return -ENOTSUP;
+	/* the urgent lane of a compact io is allocated on first use */
+	if (prio != IO_IO_PRIO_NORMAL && NULL == get_extra(io))
+		return -ENOMEM;
 
 	ctx = &io->writectx;
+	extra = io->extra;
 
 	if (!buffer->cb) {
 		buffer->cb = &default_write_cb;
 		buffer->data = io;
 	}
 
-	rs_dll_enqueue(&ctx->buffers, &buffer->node);
-	if (ctx->current == NULL)
+	/*
+	 * data copied from now on mustn't be appended before this buffer, the
+	 * chunks being in the normal lane, other lanes don't matter
+	 */
+	if (prio == IO_IO_PRIO_NORMAL)
+		ctx->open_chunk = NULL;
+
+	buffer->prio = prio;
+	buffer->zc_status = IO_IO_WRITE_OK;
+	buffer->zerocopy = false;
+	buffer->drop_at = extra != NULL && extra->max_age != 0 ?
+			now_ms() + extra->max_age : 0;
+	rs_dll_init(&dropped, NULL);
+	if (buffer->tag != 0 && extra != NULL && extra->keep_latest != 0)
+		keep_latest(io, buffer, &dropped);
+	enqueue_lane(ctx, buffer);
+	ctx->queued += buffer->length;
+	account_queue(io, prio);
+	if (io->ringctx) {
+		ring_send(io, &dropped);
+	} else if (ctx->current == NULL && optimistic && ctx->notify == NULL) {
+		/*
+		 * optimistic write, the write ready event is monitored only if
+		 * the buffer can't be written at once
+		 */
+		pop_next_write(ctx);
+		write_queued(io, &dropped, false);
+		return ret;
+	} else if (ctx->current == NULL) {
 		process_next_write(io);
+	}
+	update_watermarks(io);
+	notify_dropped(&dropped);
 
 	return ret;
 }
 
+int io_io_write_cancel(struct io_io *io, struct io_io_write_buffer *buffer)
+{
+	struct io_io_write_ctx *ctx;
+	struct io_io_stats *stats;
+
+	if (NULL == io || NULL == buffer)
+		return -EINVAL;
+
+	ctx = &io->writectx;
+	if (buffer == ctx->current)
+		return -EBUSY;
+	/* the lanes of each io are its own */
+	if (buffer->lane == NULL || buffer->lane != get_lane(ctx, buffer->prio))
+		return -ENOENT;
+
+	unqueue(ctx, buffer);
+	stats = io_stats(io);
+	if (stats != NULL)
+		stats->aborts++;
+	update_watermarks(io);
+	(*buffer->cb)(buffer, IO_IO_WRITE_ABORTED);
+
+	return 0;
+}
+
+int io_io_write_add_prio(struct io_io *io, struct io_io_write_buffer *buffer,
+		enum io_io_write_prio prio)
+{
+	return write_add(io, buffer, prio, true);
+}
+
+int io_io_write_copy(struct io_io *io, const void *data, size_t length)
+{
+	struct io_io_write_ctx *ctx;
+	struct io_io_chunk *chunk;
+	struct rs_node *node;
+	const uint8_t *src = data;
+	size_t room;
+	size_t n;
+	int ret;
+
+	if (NULL == io || NULL == data || 0 == length)
+		return -EINVAL;
+
+	ctx = &io->writectx;
+	while (length > 0) {
+		/* append to the last chunk queued, while it has room */
+		chunk = ctx->open_chunk;
+		if (chunk != NULL) {
+			room = IO_IO_CHUNK_SIZE - chunk->buffer.length;
+			n = length < room ? length : room;
+			memcpy(chunk->data + chunk->buffer.length, src, n);
+			chunk->buffer.length += n;
+			ctx->queued += n;
+			if (chunk->buffer.length == IO_IO_CHUNK_SIZE)
+				ctx->open_chunk = NULL;
+			src += n;
+			length -= n;
+			continue;
+		}
+
+		/* compact ios have no pool */
+		node = ctx->group == NULL ? rs_dll_pop(&io->extra->chunk_pool) :
+				NULL;
+		if (node != NULL)
+			chunk = ut_container_of(node, struct io_io_chunk,
+					buffer.node);
+		else
+			chunk = malloc(sizeof(*chunk));
+		if (NULL == chunk)
+			return -ENOMEM;
+		n = length < IO_IO_CHUNK_SIZE ? length : IO_IO_CHUNK_SIZE;
+		memcpy(chunk->data, src, n);
+		io_io_write_buffer_init(&chunk->buffer, chunk_write_cb, io, n,
+				chunk->data);
+		ret = write_add(io, &chunk->buffer, IO_IO_PRIO_NORMAL, false);
+		if (ret < 0) {
+			free(chunk);
+			return ret;
+		}
+		/*
+		 * a chunk already written, or submitted to the ring, can't
+		 * grow any more
+		 */
+		if (n < IO_IO_CHUNK_SIZE && (chunk->buffer.lane != NULL ||
+				(io->ringctx == NULL &&
+				ctx->current == &chunk->buffer)))
+			ctx->open_chunk = chunk;
+		src += n;
+		length -= n;
+	}
+	update_watermarks(io);
+
+	return 0;
+}
+
 int io_io_write_abort(struct io_io *io)
 {
 	struct io_io_write_ctx *ctx;
+	struct io_io_stats *stats;
 	struct io_io_write_buffer *buffer = NULL;
 	struct rs_node *node;
 
 	if (NULL == io)
 		return -EINVAL;
 	ctx = &io->writectx;
+	stats = io_stats(io);
 	buffer = ctx->current;
 
 	/* TODO: how to be safe on io destroy call in write cb here ? */
 	if (buffer) {
-		(*buffer->cb)(buffer, IO_IO_WRITE_ABORTED);
+		if (stats != NULL)
+			stats->aborts++;
 		ctx->current = NULL;
+		/* partially sent, the kernel may still use its memory */
+		if (!defer_zerocopy(io, buffer, IO_IO_WRITE_ABORTED))
+			(*buffer->cb)(buffer, IO_IO_WRITE_ABORTED);
 		ctx->nbwritten = 0;
 	}
 
-	while ((node = rs_dll_pop(&ctx->buffers))) {
+	while ((node = pop_queued(ctx))) {
 		buffer = ut_container_of(node, struct io_io_write_buffer, node);
+		if (stats != NULL)
+			stats->aborts++;
 		(*buffer->cb)(buffer, IO_IO_WRITE_ABORTED);
 	}
 
+	/*
+	 * the zero-copy sends stay pending, their callbacks are notified once
+	 * the kernel has released their memory
+	 */
+
+	ctx->queued = 0;
+	/* the sends in flight in io_uring mode can't be aborted */
+	node = NULL;
+	while (io->ringctx &&
+			(node = rs_dll_next_from(&io->ringctx->inflight, node)))
+		ctx->queued += ut_container_of(node, struct io_io_write_buffer,
+				node)->length;
 	process_next_write(io);
+	update_watermarks(io);
 
 	return 0;
 }
@@ -661,12 +2910,242 @@ int io_io_write_buffer_init(struct io_io_write_buffer *buf, io_io_write_cb cb,
 	return 0;
 }
 
+int io_io_write_file_init(struct io_io_write_buffer *buf, io_io_write_cb cb,
+		void *data, int fd, off_t offset, size_t length)
+{
+	int ret;
+
+	if (NULL == buf || 0 == length || fd < 0 || offset < 0)
+		return -EINVAL;
+
+	ret = io_io_write_buffer_clean(buf);
+	if (0 != ret)
+		return ret;
+
+	buf->cb = cb;
+	buf->data = data;
+	buf->length = length;
+	buf->fd = fd;
+	buf->offset = offset;
+
+	return 0;
+}
+
+int io_io_write_buffer_set_tag(struct io_io_write_buffer *buf, uint32_t tag)
+{
+	if (NULL == buf)
+		return -EINVAL;
+
+	buf->tag = tag;
+
+	return 0;
+}
+
 int io_io_write_buffer_clean(struct io_io_write_buffer *buf)
 {
 	if (NULL == buf)
 		return -EINVAL;
 
 	memset(buf, 0, sizeof(*buf));
+	buf->fd = -1;
+
+	return 0;
+}
+
+int io_io_write_set_watermarks(struct io_io *io, size_t low, size_t high,
+		io_io_watermark_cb cb, void *data)
+{
+	struct io_io_extra *extra;
+
+	if (NULL == io || (high != 0 && low >= high))
+		return -EINVAL;
+	extra = get_extra(io);
+	if (NULL == extra)
+		return -ENOMEM;
+
+	extra->low_wm = low;
+	extra->high_wm = high;
+	extra->wm_cb = cb;
+	extra->wm_data = data;
+	/* the state is re-evaluated against the new watermarks */
+	extra->above_high = false;
+	update_watermarks(io);
+
+	return 0;
+}
+
+int io_io_write_set_keep_latest(struct io_io *io, unsigned count)
+{
+	if (NULL == io)
+		return -EINVAL;
+	if (NULL == get_extra(io))
+		return -ENOMEM;
+
+	io->extra->keep_latest = count;
+
+	return 0;
+}
+
+int io_io_write_set_max_age(struct io_io *io, int max_age)
+{
+	if (NULL == io || max_age < 0)
+		return -EINVAL;
+	if (NULL == get_extra(io))
+		return -ENOMEM;
+
+	io->extra->max_age = max_age;
+
+	return 0;
+}
+
+bool io_io_write_is_above_watermark(struct io_io *io)
+{
+	return NULL != io && NULL != io->extra && io->extra->above_high;
+}
+
+size_t io_io_write_get_queued(struct io_io *io)
+{
+	return NULL == io ? 0 : io->writectx.queued;
+}
+
+int io_io_write_set_zerocopy(struct io_io *io, size_t threshold)
+{
+	int on = threshold != 0;
+	int ret;
+
+	if (NULL == io)
+		return -EINVAL;
+	if (io->ringctx)
+		return -ENOTSUP;
+	if (NULL == get_extra(io))
+		return -ENOMEM;
+
+	ret = setsockopt(io->write_src->fd, SOL_SOCKET, SO_ZEROCOPY, &on,
+			sizeof(on));
+	if (ret == -1)
+		return -errno;
+	io->extra->zc_threshold = threshold;
+
+	return 0;
+}
+
+int io_io_shared_buffer_init(struct io_io_shared_buffer *shared,
+		io_io_shared_release_cb release, void *data, size_t length,
+		const void *address)
+{
+	if (NULL == shared || 0 == length || NULL == address)
+		return -EINVAL;
+
+	shared->address = address;
+	shared->length = length;
+	shared->refcount = 1;
+	shared->release = release;
+	shared->data = data;
+
+	return 0;
+}
+
+struct io_io_shared_buffer *io_io_shared_buffer_ref(
+		struct io_io_shared_buffer *shared)
+{
+	if (NULL != shared)
+		shared->refcount++;
+
+	return shared;
+}
+
+void io_io_shared_buffer_unref(struct io_io_shared_buffer *shared)
+{
+	if (NULL == shared || shared->refcount == 0)
+		return;
+
+	shared->refcount--;
+	if (shared->refcount == 0 && shared->release)
+		shared->release(shared, shared->data);
+}
+
+int io_io_write_add_shared(struct io_io *io,
+		struct io_io_shared_buffer *shared)
+{
+	struct io_io_write_buffer *ref;
+	int ret;
+
+	if (NULL == io || NULL == shared || shared->refcount == 0)
+		return -EINVAL;
+
+	/* the reference node is the only per-io allocation */
+	ref = calloc(1, sizeof(*ref));
+	if (NULL == ref)
+		return -errno;
+	ret = io_io_write_buffer_init(ref, shared_write_cb,
+			io_io_shared_buffer_ref(shared), shared->length,
+			shared->address);
+	if (ret == 0)
+		ret = io_io_write_add(io, ref);
+	if (ret < 0) {
+		io_io_shared_buffer_unref(shared);
+		free(ref);
+	}
+
+	return ret;
+}
+
+int io_io_pump_init(struct io_io_pump *pump, struct io_io *from,
+		struct io_io *to, io_io_pump_cb cb, void *data)
+{
+	int ret;
+
+	if (NULL == pump || NULL == from || NULL == to || NULL == cb)
+		return -EINVAL;
+	if (from->readctx.state != IO_IO_STOPPED || from->readctx.pump ||
+			to->writectx.pump)
+		return -EBUSY;
+	if (from->ringctx || to->ringctx)
+		return -ENOTSUP;
+
+	memset(pump, 0, sizeof(*pump));
+	ret = io_pipe2(pump->pipe, O_NONBLOCK | O_CLOEXEC);
+	if (ret == -1)
+		return -errno;
+	ret = fcntl(pump->pipe[0], F_GETPIPE_SZ);
+	if (ret == -1) {
+		ret = -errno;
+		goto err;
+	}
+	pump->capacity = ret;
+	pump->from = from;
+	pump->to = to;
+	pump->cb = cb;
+	pump->data = data;
+
+	ret = io_mon_activate_in_source(from->mon, &from->src, 1);
+	if (ret < 0)
+		goto err;
+	from->readctx.pump = pump;
+	to->writectx.pump = pump;
+
+	return 0;
+err:
+	ut_file_fd_close(pump->pipe + 0);
+	ut_file_fd_close(pump->pipe + 1);
+
+	return ret;
+}
+
+int io_io_pump_clean(struct io_io_pump *pump)
+{
+	if (NULL == pump || NULL == pump->from)
+		return -EINVAL;
+
+	io_mon_activate_in_source(pump->from->mon, &pump->from->src, 0);
+	pump->from->readctx.pump = NULL;
+	pump->to->writectx.pump = NULL;
+	pump->pending = 0;
+	update_write_monitoring(pump->to);
+
+	ut_file_fd_close(pump->pipe + 0);
+	ut_file_fd_close(pump->pipe + 1);
+	memset(pump, 0, sizeof(*pump));
 
 	return 0;
 }
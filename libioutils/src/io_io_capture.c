@@ -0,0 +1,314 @@
+/**
+ * @file io_io_capture.c
+ * @brief Capture of io traffic in a compact binary file, for replaying it
+ * later with its original timing
+ *
+ * @copyright Copyright (C) 2011 Parrot S.A.
+ */
+
+#include <sys/uio.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "io_io_capture.h"
+
+/** ns per second */
+#define NS_PER_S 1000000000ull
+
+/**
+ * Reads a clock
+ * @param clock_id Clock
+ * @return Time, in ns
+ */
+static uint64_t now_ns(clockid_t clock_id)
+{
+	struct timespec now;
+
+	clock_gettime(clock_id, &now);
+
+	return now.tv_sec * NS_PER_S + now.tv_nsec;
+}
+
+/**
+ * Copies data in the ring, at a given position, wrapping if needed
+ * @param capture Capture
+ * @param pos Free running position to copy to
+ * @param src Data to copy
+ * @param n Size of the data
+ */
+static void ring_copy_in(struct io_io_capture *capture, size_t pos,
+		const void *src, size_t n)
+{
+	size_t offset = pos & (capture->size - 1);
+	size_t first = capture->size - offset < n ? capture->size - offset : n;
+
+	memcpy(capture->buffer + offset, src, first);
+	memcpy(capture->buffer, (const uint8_t *)src + first, n - first);
+}
+
+/**
+ * Writes a whole buffer, waiting for the file to be writable if needed
+ * @param fd File descriptor
+ * @param buffer Data
+ * @param length Size of the data
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+static int write_all(int fd, const void *buffer, size_t length)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+	const uint8_t *p = buffer;
+	ssize_t sret;
+
+	while (length > 0) {
+		sret = write(fd, p, length);
+		if (sret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				return -errno;
+			poll(&pfd, 1, -1);
+			continue;
+		}
+		p += sret;
+		length -= sret;
+	}
+
+	return 0;
+}
+
+/**
+ * Reads a whole buffer
+ * @param fd File descriptor
+ * @param buffer Destination
+ * @param length Size to read
+ * @return -EPROTO if the file ends in the middle of the buffer, another
+ * negative errno-compatible value on error, 0 if the file ends before the
+ * buffer, 1 on success
+ */
+static int read_all(int fd, void *buffer, size_t length)
+{
+	uint8_t *p = buffer;
+	size_t done = 0;
+	ssize_t sret;
+
+	while (done < length) {
+		sret = read(fd, p + done, length - done);
+		if (sret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (sret == 0)
+			return done == 0 ? 0 : -EPROTO;
+		done += sret;
+	}
+
+	return 1;
+}
+
+int io_io_capture_init(struct io_io_capture *capture, int fd, size_t size)
+{
+	struct io_io_capture_header header = {
+		.magic = IO_IO_CAPTURE_MAGIC,
+		.version = IO_IO_CAPTURE_VERSION,
+	};
+	size_t pow2 = 1;
+	int ret;
+
+	if (NULL == capture || fd < 0 ||
+			size < sizeof(struct io_io_capture_record))
+		return -EINVAL;
+
+	while (pow2 < size)
+		pow2 <<= 1;
+
+	header.start = now_ns(CLOCK_REALTIME);
+	ret = write_all(fd, &header, sizeof(header));
+	if (ret < 0)
+		return ret;
+
+	memset(capture, 0, sizeof(*capture));
+	capture->buffer = malloc(pow2);
+	if (NULL == capture->buffer)
+		return -errno;
+	capture->size = pow2;
+	capture->fd = fd;
+
+	return 0;
+}
+
+int io_io_capture_record(struct io_io_capture *capture,
+		enum io_io_log_dir dir, const void *buffer, size_t length)
+{
+	struct io_io_capture_record record;
+	size_t room;
+	size_t head;
+	size_t tail;
+
+	if (NULL == capture || NULL == capture->buffer ||
+			(NULL == buffer && length != 0) || length > UINT32_MAX)
+		return -EINVAL;
+
+	memset(&record, 0, sizeof(record));
+	record.timestamp = now_ns(CLOCK_MONOTONIC);
+	head = capture->head;
+	tail = __atomic_load_n(&capture->tail, __ATOMIC_ACQUIRE);
+	room = capture->size - (head - tail);
+
+	/* the gap goes first, so that the replay knows data are missing */
+	if (capture->dropped != 0) {
+		if (room < 2 * sizeof(record) + length)
+			goto drop;
+		record.length = capture->dropped;
+		record.dir = IO_IO_CAPTURE_GAP;
+		ring_copy_in(capture, head, &record, sizeof(record));
+		head += sizeof(record);
+		capture->dropped = 0;
+	} else if (room < sizeof(record) + length) {
+		goto drop;
+	}
+
+	record.length = length;
+	record.dir = dir;
+	ring_copy_in(capture, head, &record, sizeof(record));
+	ring_copy_in(capture, head + sizeof(record), buffer, length);
+
+	/* publish the records to the consumer */
+	__atomic_store_n(&capture->head, head + sizeof(record) + length,
+			__ATOMIC_RELEASE);
+
+	return 0;
+drop:
+	if (capture->dropped + length <= UINT32_MAX)
+		capture->dropped += length;
+
+	return -ENOBUFS;
+}
+
+ssize_t io_io_capture_flush(struct io_io_capture *capture)
+{
+	struct iovec iov[2];
+	size_t offset;
+	size_t head;
+	size_t tail;
+	size_t n;
+	ssize_t sret;
+	ssize_t total = 0;
+
+	if (NULL == capture || NULL == capture->buffer)
+		return -EINVAL;
+
+	head = __atomic_load_n(&capture->head, __ATOMIC_ACQUIRE);
+	tail = capture->tail;
+	while (tail != head) {
+		/* the ring holds the file's content, at most in two parts */
+		offset = tail & (capture->size - 1);
+		n = head - tail;
+		iov[0].iov_base = capture->buffer + offset;
+		iov[0].iov_len = capture->size - offset < n ?
+				capture->size - offset : n;
+		iov[1].iov_base = capture->buffer;
+		iov[1].iov_len = n - iov[0].iov_len;
+		sret = writev(capture->fd, iov, iov[1].iov_len == 0 ? 1 : 2);
+		if (sret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				break;
+			return -errno;
+		}
+
+		/* release the room to the producer */
+		tail += sret;
+		total += sret;
+		__atomic_store_n(&capture->tail, tail, __ATOMIC_RELEASE);
+	}
+
+	return total;
+}
+
+void io_io_capture_clean(struct io_io_capture *capture)
+{
+	if (NULL == capture)
+		return;
+
+	if (NULL != capture->buffer)
+		io_io_capture_flush(capture);
+	free(capture->buffer);
+	memset(capture, 0, sizeof(*capture));
+}
+
+ssize_t io_io_capture_replay(int capture_fd, int fd, enum io_io_log_dir dir,
+		unsigned speed)
+{
+	struct io_io_capture_header header;
+	struct io_io_capture_record record;
+	struct timespec deadline;
+	uint64_t first = UINT64_MAX;
+	uint64_t start;
+	uint64_t due;
+	uint8_t *data = NULL;
+	uint8_t *tmp;
+	size_t data_size = 0;
+	ssize_t total = 0;
+	int ret;
+
+	if (capture_fd < 0 || fd < 0)
+		return -EINVAL;
+
+	ret = read_all(capture_fd, &header, sizeof(header));
+	if (ret <= 0)
+		return ret == 0 ? -EPROTO : ret;
+	if (header.magic != IO_IO_CAPTURE_MAGIC ||
+			header.version != IO_IO_CAPTURE_VERSION)
+		return -EPROTO;
+
+	start = now_ns(CLOCK_MONOTONIC);
+	while ((ret = read_all(capture_fd, &record, sizeof(record))) > 0) {
+		/* a gap has no data, nothing can be replayed for it */
+		if (record.dir == IO_IO_CAPTURE_GAP)
+			continue;
+		if (record.length > data_size) {
+			tmp = realloc(data, record.length);
+			if (NULL == tmp) {
+				ret = -errno;
+				break;
+			}
+			data = tmp;
+			data_size = record.length;
+		}
+		ret = read_all(capture_fd, data, record.length);
+		if (ret <= 0) {
+			if (ret == 0)
+				ret = -EPROTO;
+			break;
+		}
+		if (record.dir != dir)
+			continue;
+
+		/* the first chunk replayed gives the time origin */
+		if (first == UINT64_MAX)
+			first = record.timestamp;
+		if (speed != 0 && record.timestamp > first) {
+			due = start + (record.timestamp - first) / speed;
+			deadline.tv_sec = due / NS_PER_S;
+			deadline.tv_nsec = due % NS_PER_S;
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&deadline, NULL) == EINTR)
+				;
+		}
+
+		ret = write_all(fd, data, record.length);
+		if (ret < 0)
+			break;
+		total += record.length;
+	}
+	free(data);
+
+	return ret < 0 ? ret : total;
+}
@@ -0,0 +1,262 @@
+/**
+ * @file io_io_frame.c
+ * @brief Framing of the data read by an io, either length-prefixed or
+ * delimiter-based. Frames are delivered as pointers in the io's mirrored read
+ * ring buffer, without being copied
+ *
+ * @copyright Copyright (C) 2011 Parrot S.A.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "io_io.h"
+#include "io_io_frame.h"
+
+/**
+ * Decodes the payload size stored in a length header
+ * @param frame Framing context
+ * @param header Header
+ * @return Payload size
+ */
+static uint64_t decode_length(const struct io_io_frame *frame,
+		const uint8_t *header)
+{
+	uint64_t length = 0;
+	size_t i;
+
+	for (i = 0; i < frame->header_size; i++) {
+		if (frame->big_endian)
+			length = (length << 8) | header[i];
+		else
+			length |= (uint64_t)header[i] << (8 * i);
+	}
+
+	return length;
+}
+
+/**
+ * Encodes a payload size in a length header
+ * @param frame Framing context
+ * @param header Header
+ * @param length Payload size
+ */
+static void encode_length(const struct io_io_frame *frame, uint8_t *header,
+		uint64_t length)
+{
+	size_t i;
+	size_t shift;
+
+	for (i = 0; i < frame->header_size; i++) {
+		shift = frame->big_endian ? frame->header_size - 1 - i : i;
+		header[i] = (length >> (8 * shift)) & 0xff;
+	}
+}
+
+/**
+ * Finds the next complete frame in the data available
+ * @param frame Framing context
+ * @param buf Data available
+ * @param len Size of the data available
+ * @param offset In output, offset of the payload in buf
+ * @param size In output, size of the payload
+ * @return -EAGAIN if no frame is complete, -EMSGSIZE if the next frame is too
+ * big, size of the frame, header or delimiter included, otherwise
+ */
+static ssize_t next_frame(struct io_io_frame *frame, const uint8_t *buf,
+		size_t len, size_t *offset, size_t *size)
+{
+	const uint8_t *delim;
+	uint64_t length;
+	size_t start;
+
+	if (frame->type == IO_IO_FRAME_LENGTH) {
+		if (len < frame->header_size)
+			return -EAGAIN;
+		length = decode_length(frame, buf);
+		if (frame->max_size != 0 && length > frame->max_size)
+			return -EMSGSIZE;
+		if (len - frame->header_size < length)
+			return -EAGAIN;
+		*offset = frame->header_size;
+		*size = length;
+
+		return frame->header_size + length;
+	}
+
+	/* don't search again in the bytes already searched */
+	start = frame->scanned;
+	if (start + 1 > frame->delimiter_size)
+		start = start + 1 - frame->delimiter_size;
+	else
+		start = 0;
+	delim = memmem(buf + start, len - start, frame->delimiter,
+			frame->delimiter_size);
+	if (NULL == delim) {
+		frame->scanned = len;
+		if (frame->max_size != 0 &&
+				len > frame->max_size + frame->delimiter_size)
+			return -EMSGSIZE;
+		return -EAGAIN;
+	}
+	frame->scanned = 0;
+	*offset = 0;
+	*size = delim - buf;
+	if (frame->max_size != 0 && *size > frame->max_size)
+		return -EMSGSIZE;
+
+	return *size + frame->delimiter_size;
+}
+
+/**
+ * Read callback of an io read with io_io_frame_read_start()
+ * @param io IO context
+ * @param rb Read ring buffer
+ * @param data Framing context
+ * @return 0
+ */
+static int frame_read_cb(struct io_io *io, struct rs_rb *rb, void *data)
+{
+	struct io_io_frame *frame = data;
+	int ret;
+
+	if (io_io_has_read_error(io)) {
+		/* deliver what was received before the error */
+		io_io_frame_process(frame, rb);
+		frame->cb(frame, NULL, 0, -EPIPE, frame->data);
+		return 0;
+	}
+
+	ret = io_io_frame_process(frame, rb);
+	/*
+	 * no frame could be extracted, hence no callback asked to stop, yet the
+	 * ring buffer is full and can't grow: the frame will never fit
+	 */
+	if (ret == 0 && rs_rb_get_write_length(rb) == 0 &&
+			rs_rb_get_size(rb) >= io_io_read_get_max_size(io))
+		ret = -EMSGSIZE;
+	if (ret == -EMSGSIZE) {
+		/* synchronization is lost, no more frame can be delivered */
+		io_io_read_stop(io);
+		frame->cb(frame, NULL, 0, -EMSGSIZE, frame->data);
+	}
+
+	return 0;
+}
+
+int io_io_frame_init_length(struct io_io_frame *frame, size_t header_size,
+		bool big_endian, size_t max_size, io_io_frame_cb cb,
+		void *data)
+{
+	if (NULL == frame || NULL == cb)
+		return -EINVAL;
+	if (header_size != 1 && header_size != 2 && header_size != 4 &&
+			header_size != 8)
+		return -EINVAL;
+
+	memset(frame, 0, sizeof(*frame));
+	frame->type = IO_IO_FRAME_LENGTH;
+	frame->header_size = header_size;
+	frame->big_endian = big_endian;
+	frame->max_size = max_size;
+	frame->cb = cb;
+	frame->data = data;
+
+	return 0;
+}
+
+int io_io_frame_init_delimiter(struct io_io_frame *frame,
+		const void *delimiter, size_t delimiter_size, size_t max_size,
+		io_io_frame_cb cb, void *data)
+{
+	if (NULL == frame || NULL == delimiter || 0 == delimiter_size ||
+			NULL == cb)
+		return -EINVAL;
+
+	memset(frame, 0, sizeof(*frame));
+	frame->type = IO_IO_FRAME_DELIMITER;
+	frame->delimiter = delimiter;
+	frame->delimiter_size = delimiter_size;
+	frame->max_size = max_size;
+	frame->cb = cb;
+	frame->data = data;
+
+	return 0;
+}
+
+int io_io_frame_read_start(struct io_io_frame *frame, struct io_io *io)
+{
+	if (NULL == frame || NULL == io)
+		return -EINVAL;
+
+	frame->scanned = 0;
+
+	return io_io_read_start(io, frame_read_cb, frame, 0);
+}
+
+int io_io_frame_process(struct io_io_frame *frame, struct rs_rb *rb)
+{
+	const uint8_t *buf;
+	size_t offset;
+	size_t size;
+	size_t len;
+	ssize_t ret;
+	int count = 0;
+	int cbret;
+
+	if (NULL == frame || NULL == rb || !rb->mirror)
+		return -EINVAL;
+
+	while ((len = rs_rb_get_read_length(rb)) > 0) {
+		/* the mirror mapping makes all the data contiguous */
+		buf = rs_rb_get_read_ptr(rb);
+		ret = next_frame(frame, buf, len, &offset, &size);
+		if (ret == -EAGAIN)
+			break;
+		if (ret < 0)
+			return ret;
+
+		cbret = frame->cb(frame, buf + offset, size, 0, frame->data);
+		rs_rb_read_incr(rb, ret);
+		count++;
+		if (cbret != 0)
+			break;
+	}
+
+	return count;
+}
+
+int io_io_frame_encode(const struct io_io_frame *frame, void *header,
+		const void *payload, size_t size, struct iovec *iov)
+{
+	if (NULL == frame || NULL == iov || (NULL == payload && size != 0))
+		return -EINVAL;
+	if (frame->max_size != 0 && size > frame->max_size)
+		return -EMSGSIZE;
+
+	if (frame->type == IO_IO_FRAME_DELIMITER) {
+		iov[0].iov_base = (void *)payload;
+		iov[0].iov_len = size;
+		iov[1].iov_base = (void *)frame->delimiter;
+		iov[1].iov_len = frame->delimiter_size;
+
+		return 2;
+	}
+
+	if (NULL == header)
+		return -EINVAL;
+	if (frame->header_size < 8 &&
+			(uint64_t)size >> (8 * frame->header_size) != 0)
+		return -EMSGSIZE;
+	encode_length(frame, header, size);
+	iov[0].iov_base = header;
+	iov[0].iov_len = frame->header_size;
+	iov[1].iov_base = (void *)payload;
+	iov[1].iov_len = size;
+
+	return 2;
+}
@@ -0,0 +1,265 @@
+/**
+ * @file io_io_log.c
+ * @brief Deferred logging of io traffic, the data are copied in a ring buffer
+ * in the I/O path and formatted as hexdump later, on demand
+ *
+ * @copyright Copyright (C) 2011 Parrot S.A.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "io_io_log.h"
+
+/* number of bytes per hexdump line */
+#define LINE_BYTES 16
+
+/* offsets in a hexdump line, the same format as the one io_io always used */
+#define LINE_SEP_OFFSET (LINE_BYTES * 3)
+#define LINE_ASCII_OFFSET (LINE_SEP_OFFSET + 3)
+#define LINE_SIZE (LINE_ASCII_OFFSET + LINE_BYTES + 1)
+
+#define HEX_ROW(h) h "0" h "1" h "2" h "3" h "4" h "5" h "6" h "7" h "8" h "9" \
+		h "A" h "B" h "C" h "D" h "E" h "F"
+
+/* two hex digits per byte value, avoids any computation when formatting */
+static const char hex_table[] = HEX_ROW("0") HEX_ROW("1") HEX_ROW("2")
+		HEX_ROW("3") HEX_ROW("4") HEX_ROW("5") HEX_ROW("6")
+		HEX_ROW("7") HEX_ROW("8") HEX_ROW("9") HEX_ROW("A")
+		HEX_ROW("B") HEX_ROW("C") HEX_ROW("D") HEX_ROW("E")
+		HEX_ROW("F");
+
+/**
+ * @struct record
+ * @brief Header of a traffic record, stored in front of the data
+ */
+struct record {
+	uint32_t length;		/**< size of the data following */
+	int32_t fd;			/**< file descriptor of the transfer */
+	uint8_t dir;			/**< enum io_io_log_dir */
+	char name[IO_IO_LOG_NAME_SIZE];	/**< name of the io */
+};
+
+/**
+ * Formats up to 16 bytes as one hexdump line
+ * @param line Output, must be at least LINE_SIZE bytes long
+ * @param bytes Data to format
+ * @param n Number of bytes in data, at most LINE_BYTES
+ */
+static void format_line(char *line, const uint8_t *bytes, size_t n)
+{
+	const char *hex;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		hex = hex_table + 2 * bytes[i];
+		line[3 * i] = hex[0];
+		line[3 * i + 1] = hex[1];
+		line[3 * i + 2] = ' ';
+		line[LINE_ASCII_OFFSET + i] = bytes[i] >= 0x20 &&
+				bytes[i] < 0x7f ? bytes[i] : '.';
+	}
+	/* pad the last line */
+	for (; i < LINE_BYTES; i++) {
+		memset(line + 3 * i, ' ', 3);
+		line[LINE_ASCII_OFFSET + i] = ' ';
+	}
+	memcpy(line + LINE_SEP_OFFSET, " | ", 3);
+	line[LINE_SIZE - 1] = '\0';
+}
+
+/**
+ * Copies data in the ring, at a given position, wrapping if needed
+ * @param log Log
+ * @param pos Free running position to copy to
+ * @param src Data to copy
+ * @param n Size of the data
+ */
+static void ring_copy_in(struct io_io_log *log, size_t pos, const void *src,
+		size_t n)
+{
+	size_t offset = pos & (log->size - 1);
+	size_t first = log->size - offset < n ? log->size - offset : n;
+
+	memcpy(log->buffer + offset, src, first);
+	memcpy(log->buffer, (const uint8_t *)src + first, n - first);
+}
+
+/**
+ * Copies data out of the ring, from a given position, wrapping if needed
+ * @param log Log
+ * @param pos Free running position to copy from
+ * @param dst Destination buffer
+ * @param n Size of the data
+ */
+static void ring_copy_out(struct io_io_log *log, size_t pos, void *dst,
+		size_t n)
+{
+	size_t offset = pos & (log->size - 1);
+	size_t first = log->size - offset < n ? log->size - offset : n;
+
+	memcpy(dst, log->buffer + offset, first);
+	memcpy((uint8_t *)dst + first, log->buffer, n - first);
+}
+
+/**
+ * Checks the rate limit and accounts the bytes to record
+ * @param log Log
+ * @param length Number of bytes to record
+ * @return 1 if the bytes can be recorded, 0 otherwise
+ */
+static int rate_allows(struct io_io_log *log, size_t length)
+{
+	struct timespec now;
+
+	if (log->rate == 0)
+		return 1;
+
+	/* coarse clock, the window has a resolution of one second anyway */
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	if ((uint64_t)now.tv_sec != log->window) {
+		log->window = now.tv_sec;
+		log->window_bytes = 0;
+	}
+	if (log->window_bytes + length > log->rate)
+		return 0;
+	log->window_bytes += length;
+
+	return 1;
+}
+
+int io_io_log_init(struct io_io_log *log, size_t size,
+		void (*log_cb)(const char *), size_t rate)
+{
+	size_t pow2 = 1;
+
+	if (NULL == log || NULL == log_cb || size < sizeof(struct record))
+		return -EINVAL;
+
+	while (pow2 < size)
+		pow2 <<= 1;
+
+	memset(log, 0, sizeof(*log));
+	log->buffer = malloc(pow2);
+	if (NULL == log->buffer)
+		return -errno;
+	log->size = pow2;
+	log->log_cb = log_cb;
+	log->rate = rate;
+
+	return 0;
+}
+
+int io_io_log_record(struct io_io_log *log, enum io_io_log_dir dir,
+		const char *name, int fd, const void *buffer, size_t length)
+{
+	struct record record;
+	size_t total;
+	size_t head;
+	size_t tail;
+
+	if (NULL == log || NULL == log->buffer || NULL == name ||
+			(NULL == buffer && length != 0))
+		return -EINVAL;
+
+	total = sizeof(record) + length;
+	head = log->head;
+	tail = __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE);
+	if (total > log->size - (head - tail) || !rate_allows(log, length)) {
+		__atomic_add_fetch(&log->dropped, length, __ATOMIC_RELAXED);
+		return -ENOBUFS;
+	}
+
+	record.length = length;
+	record.fd = fd;
+	record.dir = dir;
+	strncpy(record.name, name, IO_IO_LOG_NAME_SIZE - 1);
+	record.name[IO_IO_LOG_NAME_SIZE - 1] = '\0';
+	ring_copy_in(log, head, &record, sizeof(record));
+	ring_copy_in(log, head + sizeof(record), buffer, length);
+
+	/* publish the record to the consumer */
+	__atomic_store_n(&log->head, head + total, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+int io_io_log_flush(struct io_io_log *log)
+{
+	char line[LINE_SIZE > 64 ? LINE_SIZE : 64];
+	uint8_t bytes[LINE_BYTES];
+	struct record record;
+	size_t dropped;
+	size_t head;
+	size_t tail;
+	size_t pos;
+	size_t n;
+	int count = 0;
+
+	if (NULL == log || NULL == log->buffer)
+		return -EINVAL;
+
+	dropped = __atomic_exchange_n(&log->dropped, 0, __ATOMIC_RELAXED);
+	if (dropped != 0) {
+		snprintf(line, sizeof(line), "%zu bytes not logged", dropped);
+		log->log_cb(line);
+	}
+
+	head = __atomic_load_n(&log->head, __ATOMIC_ACQUIRE);
+	tail = log->tail;
+	while (tail != head) {
+		ring_copy_out(log, tail, &record, sizeof(record));
+		snprintf(line, sizeof(line), "%s %s fd=%d length=%"PRIu32,
+				record.name, record.dir == IO_IO_LOG_RX ?
+						"read" : "written",
+				record.fd, record.length);
+		log->log_cb(line);
+
+		for (pos = 0; pos < record.length; pos += n) {
+			n = record.length - pos;
+			if (n > LINE_BYTES)
+				n = LINE_BYTES;
+			ring_copy_out(log, tail + sizeof(record) + pos, bytes,
+					n);
+			format_line(line, bytes, n);
+			log->log_cb(line);
+		}
+
+		/* release the room to the producer */
+		tail += sizeof(record) + record.length;
+		__atomic_store_n(&log->tail, tail, __ATOMIC_RELEASE);
+		count++;
+	}
+
+	return count;
+}
+
+void io_io_log_hexdump(void (*log_cb)(const char *), const void *buffer,
+		size_t length)
+{
+	const uint8_t *bytes = buffer;
+	char line[LINE_SIZE];
+	size_t n;
+
+	if (NULL == log_cb || NULL == buffer)
+		return;
+
+	for (; length > 0; length -= n, bytes += n) {
+		n = length < LINE_BYTES ? length : LINE_BYTES;
+		format_line(line, bytes, n);
+		log_cb(line);
+	}
+}
+
+void io_io_log_clean(struct io_io_log *log)
+{
+	if (NULL == log)
+		return;
+
+	free(log->buffer);
+	memset(log, 0, sizeof(*log));
+}
@@ -0,0 +1,391 @@
+/**
+ * @file io_io_pipeline.c
+ * @brief Chain of processing stages between a source io and a sink io, the
+ * buffers being handed over from a stage to the next, without copy
+ *
+ * @copyright Copyright (C) 2011 Parrot S.A.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <ut_utils.h>
+
+#include "io_io.h"
+#include "io_io_pipeline.h"
+
+/**
+ * Notifies the end of the pipeline, once, and stops reading the source
+ * @param pipeline Pipeline
+ * @param err 0 on success, negative errno-compatible value on error
+ */
+static void end_pipeline(struct io_io_pipeline *pipeline, int err)
+{
+	if (pipeline->ended)
+		return;
+
+	pipeline->ended = true;
+	if (!pipeline->source_ended)
+		io_io_read_pause(pipeline->source);
+	if (pipeline->cb != NULL)
+		pipeline->cb(pipeline, err, pipeline->cb_data);
+}
+
+/**
+ * Notifies the end of the pipeline if the source has ended and all the
+ * buffers have been written
+ * @param pipeline Pipeline
+ */
+static void check_end(struct io_io_pipeline *pipeline)
+{
+	if (pipeline->source_ended && rs_dll_is_empty(&pipeline->live))
+		end_pipeline(pipeline, 0);
+}
+
+/**
+ * Accounts a buffer to the stage it's handed over to, pausing the source if
+ * the stage gets saturated
+ * @param stage Stage
+ * @param buffer Buffer, not owned by any stage
+ */
+static void stage_enter(struct io_io_pipeline_stage *stage,
+		struct io_io_pipeline_buffer *buffer)
+{
+	struct io_io_pipeline *pipeline = stage->pipeline;
+
+	buffer->owner = stage;
+	buffer->accounted = buffer->length;
+	stage->inflight += buffer->length;
+	if (stage->saturated || stage->max_inflight == 0 ||
+			stage->inflight < stage->max_inflight)
+		return;
+
+	stage->saturated = true;
+	if (pipeline->saturated++ == 0 && !pipeline->source_ended)
+		io_io_read_pause(pipeline->source);
+}
+
+/**
+ * Removes a buffer from the account of the stage owning it, if any
+ * @param buffer Buffer
+ * @return true if no stage is saturated any more, the source must then be
+ * drained, false otherwise
+ */
+static bool stage_leave(struct io_io_pipeline_buffer *buffer)
+{
+	struct io_io_pipeline_stage *stage = buffer->owner;
+
+	if (stage == NULL)
+		return false;
+
+	buffer->owner = NULL;
+	stage->inflight -= buffer->accounted;
+	buffer->accounted = 0;
+	/* hysteresis, for not pausing and resuming on each buffer */
+	if (!stage->saturated || stage->inflight > stage->max_inflight / 2)
+		return false;
+
+	stage->saturated = false;
+
+	return --stage->pipeline->saturated == 0;
+}
+
+/**
+ * Write callback of the buffers queued in the sink
+ * @param write Write buffer of the pipeline buffer
+ * @param status Status of the write
+ */
+static void sink_write_cb(struct io_io_write_buffer *write,
+		enum io_io_write_status status)
+{
+	struct io_io_pipeline_buffer *buffer = ut_container_of(write,
+			struct io_io_pipeline_buffer, write);
+	struct io_io_pipeline *pipeline = buffer->pipeline;
+
+	/* the error must be notified before the end is detected on release */
+	if (pipeline != NULL && status != IO_IO_WRITE_OK)
+		end_pipeline(pipeline, -EIO);
+	io_io_pipeline_buffer_release(buffer);
+}
+
+/**
+ * Hands a buffer over to a stage, or to the sink
+ * @param pipeline Pipeline
+ * @param node Node of the stage, NULL for the sink
+ * @param buffer Buffer, not owned by any stage
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+static int deliver(struct io_io_pipeline *pipeline, struct rs_node *node,
+		struct io_io_pipeline_buffer *buffer)
+{
+	struct io_io_pipeline_stage *stage;
+	int ret;
+
+	if (pipeline->ended) {
+		io_io_pipeline_buffer_release(buffer);
+		return -EPIPE;
+	}
+	if (buffer->length == 0) {
+		io_io_pipeline_buffer_release(buffer);
+		return 0;
+	}
+
+	if (node == NULL) {
+		stage_enter(&pipeline->sink_stage, buffer);
+		io_io_write_buffer_init(&buffer->write, sink_write_cb, NULL,
+				buffer->length, buffer->data);
+		/* can be written, and released, before returning */
+		ret = io_io_write_add(pipeline->sink, &buffer->write);
+		if (ret < 0) {
+			io_io_pipeline_buffer_release(buffer);
+			end_pipeline(pipeline, ret);
+		}
+		return ret;
+	}
+
+	stage = ut_container_of(node, struct io_io_pipeline_stage, node);
+	stage_enter(stage, buffer);
+	ret = stage->process(stage, buffer, stage->data);
+	if (ret < 0)
+		end_pipeline(pipeline, ret);
+
+	return ret;
+}
+
+/**
+ * Copies the data waiting in the source's ring buffer in buffers and hands
+ * them over to the first stage, until a stage gets saturated, the rest being
+ * left in the ring buffer. Then resumes reading the source, if no stage is
+ * saturated. Does nothing if called back from a hand over, the caller goes on
+ * @param pipeline Pipeline
+ */
+static void drain_source(struct io_io_pipeline *pipeline)
+{
+	struct io_io_pipeline_buffer *buffer;
+	struct rs_rb *rb;
+	size_t available;
+	size_t n;
+
+	/* cleaned, by an end callback */
+	if (pipeline->source == NULL || pipeline->draining)
+		return;
+
+	rb = &pipeline->source->readctx.rb;
+	pipeline->draining = true;
+	while (!pipeline->ended && pipeline->saturated == 0 &&
+			(available = rs_rb_get_read_length(rb)) > 0) {
+		n = available < IO_IO_PIPELINE_BUFFER_SIZE ? available :
+				IO_IO_PIPELINE_BUFFER_SIZE;
+		buffer = io_io_pipeline_buffer_new(pipeline, n);
+		if (buffer == NULL) {
+			end_pipeline(pipeline, -ENOMEM);
+			break;
+		}
+		/* the ring buffer is mirrored, the data are contiguous */
+		memcpy(buffer->data, rs_rb_get_read_ptr(rb), n);
+		buffer->length = n;
+		rs_rb_read_incr(rb, n);
+		deliver(pipeline, rs_dll_next_from(&pipeline->stages, NULL),
+				buffer);
+	}
+	pipeline->draining = false;
+
+	/* nobody will ever consume them */
+	if (pipeline->ended)
+		rs_rb_empty(rb);
+	else if (pipeline->saturated == 0 && !pipeline->source_ended)
+		io_io_read_resume(pipeline->source);
+}
+
+/**
+ * Read callback of the source
+ * @param io Source
+ * @param rb Read ring buffer of the source
+ * @param data Pipeline
+ * @return 0
+ */
+static int source_read_cb(struct io_io *io, struct rs_rb *rb, void *data)
+{
+	struct io_io_pipeline *pipeline = data;
+
+	if (io_io_has_read_error(io))
+		pipeline->source_ended = true;
+	drain_source(pipeline);
+	if (pipeline->source_ended)
+		check_end(pipeline);
+
+	return 0;
+}
+
+int io_io_pipeline_init(struct io_io_pipeline *pipeline, struct io_io *source,
+		struct io_io *sink, size_t max_inflight, io_io_pipeline_end_cb cb,
+		void *data)
+{
+	if (NULL == pipeline || NULL == source || NULL == sink)
+		return -EINVAL;
+
+	memset(pipeline, 0, sizeof(*pipeline));
+	pipeline->source = source;
+	pipeline->sink = sink;
+	rs_dll_init(&pipeline->stages, NULL);
+	rs_dll_init(&pipeline->live, NULL);
+	rs_dll_init(&pipeline->pool, NULL);
+	pipeline->sink_stage.pipeline = pipeline;
+	pipeline->sink_stage.max_inflight = max_inflight;
+	pipeline->cb = cb;
+	pipeline->cb_data = data;
+
+	return 0;
+}
+
+int io_io_pipeline_add_stage(struct io_io_pipeline *pipeline,
+		struct io_io_pipeline_stage *stage,
+		io_io_pipeline_process_cb process, size_t max_inflight,
+		void *data)
+{
+	if (NULL == pipeline || NULL == stage || NULL == process)
+		return -EINVAL;
+	if (io_io_is_read_started(pipeline->source))
+		return -EBUSY;
+
+	memset(stage, 0, sizeof(*stage));
+	stage->pipeline = pipeline;
+	stage->process = process;
+	stage->data = data;
+	stage->max_inflight = max_inflight;
+
+	return rs_dll_enqueue(&pipeline->stages, &stage->node);
+}
+
+int io_io_pipeline_start(struct io_io_pipeline *pipeline)
+{
+	if (NULL == pipeline)
+		return -EINVAL;
+
+	return io_io_read_start(pipeline->source, source_read_cb, pipeline, 0);
+}
+
+int io_io_pipeline_forward(struct io_io_pipeline_stage *stage,
+		struct io_io_pipeline_buffer *buffer)
+{
+	struct io_io_pipeline *pipeline;
+	bool drain;
+	int ret;
+
+	if (NULL == stage || NULL == buffer)
+		return -EINVAL;
+
+	pipeline = buffer->pipeline;
+	if (pipeline == NULL) {
+		io_io_pipeline_buffer_release(buffer);
+		return -EPIPE;
+	}
+	if (stage == &pipeline->sink_stage)
+		return -EINVAL;
+
+	drain = stage_leave(buffer);
+	ret = deliver(pipeline, rs_dll_next_from(&pipeline->stages,
+			&stage->node), buffer);
+	/* the data left in the source must follow this buffer, not overtake it */
+	if (drain)
+		drain_source(pipeline);
+
+	return ret;
+}
+
+struct io_io_pipeline_buffer *io_io_pipeline_buffer_new(
+		struct io_io_pipeline *pipeline, size_t size)
+{
+	struct io_io_pipeline_buffer *buffer;
+	struct rs_node *node;
+
+	if (NULL == pipeline || 0 == size) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* the small buffers are all of the same size, for being reused */
+	if (size <= IO_IO_PIPELINE_BUFFER_SIZE) {
+		node = rs_dll_pop(&pipeline->pool);
+		if (node != NULL) {
+			buffer = ut_container_of(node,
+					struct io_io_pipeline_buffer, node);
+			goto out;
+		}
+		size = IO_IO_PIPELINE_BUFFER_SIZE;
+	}
+	buffer = malloc(sizeof(*buffer) + size);
+	if (NULL == buffer)
+		return NULL;
+	buffer->data = buffer + 1;
+	buffer->size = size;
+out:
+	buffer->pipeline = pipeline;
+	buffer->owner = NULL;
+	buffer->accounted = 0;
+	buffer->length = 0;
+	rs_dll_enqueue(&pipeline->live, &buffer->node);
+
+	return buffer;
+}
+
+void io_io_pipeline_buffer_release(struct io_io_pipeline_buffer *buffer)
+{
+	struct io_io_pipeline *pipeline;
+	bool drain;
+
+	if (NULL == buffer)
+		return;
+
+	/* the pipeline has been cleaned */
+	pipeline = buffer->pipeline;
+	if (pipeline == NULL) {
+		free(buffer);
+		return;
+	}
+
+	drain = stage_leave(buffer);
+	rs_dll_remove_node(&pipeline->live, &buffer->node);
+	if (buffer->size == IO_IO_PIPELINE_BUFFER_SIZE &&
+			rs_dll_get_count(&pipeline->pool) <
+			IO_IO_PIPELINE_POOL_SIZE)
+		rs_dll_push(&pipeline->pool, &buffer->node);
+	else
+		free(buffer);
+
+	if (drain)
+		drain_source(pipeline);
+	check_end(pipeline);
+}
+
+int io_io_pipeline_clean(struct io_io_pipeline *pipeline)
+{
+	struct io_io_pipeline_buffer *buffer;
+	struct rs_node *node;
+	bool queued;
+
+	if (NULL == pipeline)
+		return -EINVAL;
+
+	/* no more notification */
+	pipeline->ended = true;
+	if (io_io_is_read_started(pipeline->source))
+		io_io_read_stop(pipeline->source);
+
+	/* the buffers still in use are freed by their release */
+	while ((node = rs_dll_pop(&pipeline->live))) {
+		buffer = ut_container_of(node, struct io_io_pipeline_buffer,
+				node);
+		queued = buffer->owner == &pipeline->sink_stage;
+		buffer->pipeline = NULL;
+		buffer->owner = NULL;
+		if (queued)
+			io_io_write_cancel(pipeline->sink, &buffer->write);
+	}
+	while ((node = rs_dll_pop(&pipeline->pool)))
+		free(ut_container_of(node, struct io_io_pipeline_buffer, node));
+	memset(pipeline, 0, sizeof(*pipeline));
+
+	return 0;
+}
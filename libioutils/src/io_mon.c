@@ -152,6 +152,8 @@ static int remove_source(struct io_mon *mon, struct io_src *src)
 		return -ENOENT;
 
 	old_src = to_src(node);
+	if (old_src == mon->processed)
+		mon->processed = NULL;
 	if (IO_NONE != old_src->active) {
 		old_src->active = IO_NONE;
 		ret = alter_source(mon->epollfd, old_src, EPOLL_CTL_DEL);
@@ -199,8 +201,16 @@ static int process_event_sets(struct io_mon *mon, struct io_src *src)
 	 */
 	if (!has_events_pending(src))
 		return 0;
+	mon->processed = src;
 	src->cb(src);
 
+	/*
+	 * the client cb can clear the error events it has handled, as long as
+	 * the source is still alive, i.e. hasn't been removed by the cb
+	 */
+	if (mon->processed == src)
+		backup_src.events = src->events;
+	mon->processed = NULL;
 	if (io_src_has_error(&backup_src))
 		remove_source_by_fd(mon, backup_src.fd);
 
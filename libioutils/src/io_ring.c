@@ -0,0 +1,589 @@
+/**
+ * @file io_ring.c
+ * @brief Minimal io_uring instance, monitored by an io_mon. The system calls
+ * are used directly, there is no dependency on liburing
+ *
+ * @copyright Copyright (C) 2011 Parrot S.A.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include <ut_utils.h>
+#include <ut_file.h>
+
+#include <io_platform.h>
+
+#include "io_ring.h"
+
+#ifdef IO_HAVE_IO_URING
+
+/* all the provided buffers belong to the same group */
+#define BUF_GROUP 0
+
+/**
+ * Wrapper around the io_uring_setup system call
+ * @param entries Size of the submission ring
+ * @param params Parameters, filled by the kernel
+ * @return -1 is returned, with errno set, file descriptor created on success
+ */
+static int ring_setup(unsigned entries, struct io_uring_params *params)
+{
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+/**
+ * Wrapper around the io_uring_enter system call
+ * @param fd File descriptor of the ring
+ * @param to_submit Number of entries to submit
+ * @param min_complete Number of completions to wait for
+ * @param flags Flags, IORING_ENTER_*
+ * @return -1 is returned, with errno set, number of entries submitted on
+ * success
+ */
+static int ring_enter(int fd, unsigned to_submit, unsigned min_complete,
+		unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+			NULL, 0);
+}
+
+/**
+ * Wrapper around the io_uring_register system call
+ * @param fd File descriptor of the ring
+ * @param opcode Operation, IORING_REGISTER_*
+ * @param arg Argument of the operation
+ * @param nr_args Number of elements in arg
+ * @return Negative errno-compatible value on error, 0 or positive value on
+ * success
+ */
+static int ring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+	int ret;
+
+	ret = syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+
+	return ret < 0 ? -errno : ret;
+}
+
+/**
+ * Takes the next free submission entry, submitting the queued ones first if
+ * the submission ring is full
+ * @param ring Ring
+ * @return Submission entry, zeroed, NULL if the submission ring is full
+ */
+static struct io_uring_sqe *get_sqe(struct io_ring *ring)
+{
+	struct io_uring_sqe *sqe;
+	uint32_t head;
+	uint32_t tail = *ring->sq_tail;
+
+	head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	if (tail - head >= ring->sq_entries) {
+		if (io_ring_submit(ring) < 0)
+			return NULL;
+		head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+		if (tail - head >= ring->sq_entries)
+			return NULL;
+	}
+
+	sqe = (struct io_uring_sqe *)ring->sqes + (tail & ring->sq_mask);
+	memset(sqe, 0, sizeof(*sqe));
+
+	return sqe;
+}
+
+/**
+ * Publishes a submission entry obtained with get_sqe() to the kernel, it will
+ * be submitted with the next io_uring_enter()
+ * @param ring Ring
+ */
+static void queue_sqe(struct io_ring *ring)
+{
+	uint32_t tail = *ring->sq_tail;
+
+	ring->sq_array[tail & ring->sq_mask] = tail & ring->sq_mask;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->to_submit++;
+}
+
+/**
+ * Consumes and dispatches the completions available
+ * @param ring Ring
+ */
+static void process_completions(struct io_ring *ring)
+{
+	struct io_uring_cqe *cqe;
+	struct io_ring_req *req;
+	uint32_t head = *ring->cq_head;
+	int32_t res;
+	uint32_t flags;
+	int bid;
+
+	while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		cqe = (struct io_uring_cqe *)ring->cqes + (head & ring->cq_mask);
+		req = (struct io_ring_req *)(uintptr_t)cqe->user_data;
+		res = cqe->res;
+		flags = cqe->flags;
+
+		/* release the entry before the callback, which may wait */
+		head++;
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+		/* completions of cancellations aren't notified */
+		if (NULL == req)
+			continue;
+		bid = flags & IORING_CQE_F_BUFFER ?
+				(int)(flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+		req->cb(req, res, flags & IORING_CQE_F_MORE, bid);
+		head = *ring->cq_head;
+	}
+}
+
+/**
+ * Callback of the ring's source, the ring is readable when completions are
+ * available
+ * @param src Source of the ring
+ */
+static void ring_src_cb(struct io_src *src)
+{
+	struct io_ring *ring = ut_container_of(src, struct io_ring, src);
+
+	process_completions(ring);
+	/* submit what the callbacks have queued */
+	io_ring_submit(ring);
+}
+
+/**
+ * Maps the submission and completion rings, and the submission entries
+ * @param ring Ring
+ * @param p Parameters returned by io_uring_setup
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+static int map_rings(struct io_ring *ring, struct io_uring_params *p)
+{
+	int fd = io_src_get_fd(&ring->src);
+	uint8_t *sq;
+	uint8_t *cq;
+
+	ring->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(uint32_t);
+	ring->cq_ring_size = p->cq_off.cqes +
+			p->cq_entries * sizeof(struct io_uring_cqe);
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_size > ring->sq_ring_size)
+			ring->sq_ring_size = ring->cq_ring_size;
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED)
+		goto err;
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_size,
+				PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, fd,
+				IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED)
+			goto err;
+	}
+	ring->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+		goto err;
+
+	sq = ring->sq_ring;
+	ring->sq_head = (uint32_t *)(sq + p->sq_off.head);
+	ring->sq_tail = (uint32_t *)(sq + p->sq_off.tail);
+	ring->sq_array = (uint32_t *)(sq + p->sq_off.array);
+	ring->sq_mask = *(uint32_t *)(sq + p->sq_off.ring_mask);
+	ring->sq_entries = p->sq_entries;
+	cq = ring->cq_ring;
+	ring->cq_head = (uint32_t *)(cq + p->cq_off.head);
+	ring->cq_tail = (uint32_t *)(cq + p->cq_off.tail);
+	ring->cq_mask = *(uint32_t *)(cq + p->cq_off.ring_mask);
+	ring->cqes = cq + p->cq_off.cqes;
+
+	return 0;
+err:
+	if (ring->sq_ring == MAP_FAILED)
+		ring->sq_ring = NULL;
+	if (ring->cq_ring == MAP_FAILED)
+		ring->cq_ring = NULL;
+	if (ring->sqes == MAP_FAILED)
+		ring->sqes = NULL;
+
+	return -errno;
+}
+
+/**
+ * Registers the table of files, all slots free, and the provided buffers
+ * @param ring Ring
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+static int register_resources(struct io_ring *ring)
+{
+	struct io_uring_buf_reg reg;
+	int fd = io_src_get_fd(&ring->src);
+	unsigned i;
+	int ret;
+
+	ring->files = malloc(ring->nr_files * sizeof(*ring->files));
+	if (NULL == ring->files)
+		return -errno;
+	for (i = 0; i < ring->nr_files; i++)
+		ring->files[i] = -1;
+	ret = ring_register(fd, IORING_REGISTER_FILES, ring->files,
+			ring->nr_files);
+	if (ret < 0)
+		return ret;
+
+	/* the buffer ring must be page aligned */
+	ring->buf_ring_size = ring->nr_bufs * sizeof(struct io_uring_buf);
+	ring->buf_ring = mmap(NULL, ring->buf_ring_size,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+			-1, 0);
+	if (ring->buf_ring == MAP_FAILED) {
+		ring->buf_ring = NULL;
+		return -errno;
+	}
+	ring->bufs = malloc(ring->nr_bufs * ring->buf_size);
+	if (NULL == ring->bufs)
+		return -errno;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uintptr_t)ring->buf_ring;
+	reg.ring_entries = ring->nr_bufs;
+	reg.bgid = BUF_GROUP;
+	ret = ring_register(fd, IORING_REGISTER_PBUF_RING, &reg, 1);
+	if (ret < 0)
+		return ret;
+	for (i = 0; i < ring->nr_bufs; i++)
+		io_ring_recycle_buffer(ring, i);
+
+	return 0;
+}
+
+int io_ring_init(struct io_ring *ring, struct io_mon *mon, unsigned entries,
+		unsigned nr_files, unsigned nr_bufs, size_t buf_size)
+{
+	struct io_uring_params params;
+	int fd;
+	int ret;
+
+	if (NULL == ring || NULL == mon || 0 == entries || 0 == nr_files ||
+			0 == buf_size || buf_size > UINT32_MAX)
+		return -EINVAL;
+	/* the kernel requires a power of two */
+	if (0 == nr_bufs || nr_bufs > 32768 || (nr_bufs & (nr_bufs - 1)) != 0)
+		return -EINVAL;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&params, 0, sizeof(params));
+	fd = ring_setup(entries, &params);
+	if (fd < 0)
+		return -errno;
+	io_src_init(&ring->src, fd, IO_IN, ring_src_cb);
+	ring->mon = mon;
+	ring->nr_files = nr_files;
+	ring->nr_bufs = nr_bufs;
+	ring->buf_size = buf_size;
+
+	ret = map_rings(ring, &params);
+	if (ret < 0)
+		goto err;
+	ret = register_resources(ring);
+	if (ret < 0)
+		goto err;
+	ret = io_mon_add_source(mon, &ring->src);
+	if (ret < 0)
+		goto err;
+
+	return 0;
+err:
+	ring->mon = NULL;
+	io_ring_clean(ring);
+
+	return ret;
+}
+
+int io_ring_register_file(struct io_ring *ring, int fd)
+{
+	struct io_uring_files_update update;
+	unsigned i;
+	int ret;
+
+	if (NULL == ring || fd < 0)
+		return -EINVAL;
+
+	for (i = 0; i < ring->nr_files; i++)
+		if (ring->files[i] == -1)
+			break;
+	if (i == ring->nr_files)
+		return -ENOSPC;
+
+	memset(&update, 0, sizeof(update));
+	update.offset = i;
+	update.fds = (uintptr_t)&fd;
+	ret = ring_register(io_src_get_fd(&ring->src),
+			IORING_REGISTER_FILES_UPDATE, &update, 1);
+	if (ret < 0)
+		return ret;
+	ring->files[i] = fd;
+
+	return i;
+}
+
+int io_ring_unregister_file(struct io_ring *ring, int index)
+{
+	struct io_uring_files_update update;
+	int fd = -1;
+	int ret;
+
+	if (NULL == ring || index < 0 || (unsigned)index >= ring->nr_files ||
+			ring->files[index] == -1)
+		return -EINVAL;
+
+	memset(&update, 0, sizeof(update));
+	update.offset = index;
+	update.fds = (uintptr_t)&fd;
+	ret = ring_register(io_src_get_fd(&ring->src),
+			IORING_REGISTER_FILES_UPDATE, &update, 1);
+	if (ret < 0)
+		return ret;
+	ring->files[index] = -1;
+
+	return 0;
+}
+
+int io_ring_recv_multishot(struct io_ring *ring, struct io_ring_req *req,
+		int index)
+{
+	struct io_uring_sqe *sqe;
+
+	if (NULL == ring || NULL == req || NULL == req->cb || index < 0)
+		return -EINVAL;
+
+	sqe = get_sqe(ring);
+	if (NULL == sqe)
+		return -EBUSY;
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = index;
+	sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->buf_group = BUF_GROUP;
+	sqe->user_data = (uintptr_t)req;
+	queue_sqe(ring);
+
+	return 0;
+}
+
+int io_ring_send(struct io_ring *ring, struct io_ring_req *req, int index,
+		const void *buf, size_t len, bool link)
+{
+	struct io_uring_sqe *sqe;
+
+	if (NULL == ring || NULL == req || NULL == req->cb || index < 0 ||
+			NULL == buf || 0 == len || len > UINT32_MAX)
+		return -EINVAL;
+
+	sqe = get_sqe(ring);
+	if (NULL == sqe)
+		return -EBUSY;
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = index;
+	sqe->flags = IOSQE_FIXED_FILE | (link ? IOSQE_IO_LINK : 0);
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = len;
+	/* retry partial sends, a short count breaks the chain otherwise */
+	sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+	sqe->user_data = (uintptr_t)req;
+	queue_sqe(ring);
+
+	return 0;
+}
+
+int io_ring_cancel(struct io_ring *ring, struct io_ring_req *req)
+{
+	struct io_uring_sqe *sqe;
+
+	if (NULL == ring || NULL == req)
+		return -EINVAL;
+
+	sqe = get_sqe(ring);
+	if (NULL == sqe)
+		return -EBUSY;
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = (uintptr_t)req;
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+	/* user_data left to 0, the completion isn't notified */
+	queue_sqe(ring);
+
+	return 0;
+}
+
+int io_ring_submit(struct io_ring *ring)
+{
+	int ret;
+
+	if (NULL == ring)
+		return -EINVAL;
+
+	while (ring->to_submit > 0) {
+		ret = ring_enter(io_src_get_fd(&ring->src), ring->to_submit, 0,
+				0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		ring->to_submit -= ret;
+	}
+
+	return 0;
+}
+
+int io_ring_wait(struct io_ring *ring)
+{
+	int ret;
+
+	if (NULL == ring)
+		return -EINVAL;
+
+	do {
+		ret = ring_enter(io_src_get_fd(&ring->src), ring->to_submit,
+				1, IORING_ENTER_GETEVENTS);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0)
+		return -errno;
+	ring->to_submit -= ret;
+	process_completions(ring);
+
+	return 0;
+}
+
+const void *io_ring_get_buffer(struct io_ring *ring, int bid)
+{
+	if (NULL == ring || bid < 0 || (unsigned)bid >= ring->nr_bufs)
+		return NULL;
+
+	return ring->bufs + (size_t)bid * ring->buf_size;
+}
+
+void io_ring_recycle_buffer(struct io_ring *ring, int bid)
+{
+	struct io_uring_buf_ring *br;
+	struct io_uring_buf *buf;
+
+	if (NULL == ring || bid < 0 || (unsigned)bid >= ring->nr_bufs)
+		return;
+
+	br = ring->buf_ring;
+	buf = &br->bufs[ring->buf_tail & (ring->nr_bufs - 1)];
+	buf->addr = (uintptr_t)(ring->bufs + (size_t)bid * ring->buf_size);
+	buf->len = ring->buf_size;
+	buf->bid = bid;
+	ring->buf_tail++;
+	/* publish the buffer to the kernel */
+	__atomic_store_n(&br->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+int io_ring_clean(struct io_ring *ring)
+{
+	if (NULL == ring)
+		return -EINVAL;
+
+	if (ring->mon != NULL)
+		io_mon_remove_source(ring->mon, &ring->src);
+	/* closing the ring releases the registrations */
+	io_src_close_fd(&ring->src);
+	io_src_clean(&ring->src);
+
+	if (ring->sqes != NULL)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	if (ring->sq_ring != NULL)
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	if (ring->buf_ring != NULL)
+		munmap(ring->buf_ring, ring->buf_ring_size);
+	free(ring->bufs);
+	free(ring->files);
+	memset(ring, 0, sizeof(*ring));
+
+	return 0;
+}
+
+#else /* IO_HAVE_IO_URING */
+
+int io_ring_init(struct io_ring *ring, struct io_mon *mon, unsigned entries,
+		unsigned nr_files, unsigned nr_bufs, size_t buf_size)
+{
+	return -ENOSYS;
+}
+
+int io_ring_register_file(struct io_ring *ring, int fd)
+{
+	return -ENOSYS;
+}
+
+int io_ring_unregister_file(struct io_ring *ring, int index)
+{
+	return -ENOSYS;
+}
+
+int io_ring_recv_multishot(struct io_ring *ring, struct io_ring_req *req,
+		int index)
+{
+	return -ENOSYS;
+}
+
+int io_ring_send(struct io_ring *ring, struct io_ring_req *req, int index,
+		const void *buf, size_t len, bool link)
+{
+	return -ENOSYS;
+}
+
+int io_ring_cancel(struct io_ring *ring, struct io_ring_req *req)
+{
+	return -ENOSYS;
+}
+
+int io_ring_submit(struct io_ring *ring)
+{
+	return -ENOSYS;
+}
+
+int io_ring_wait(struct io_ring *ring)
+{
+	return -ENOSYS;
+}
+
+const void *io_ring_get_buffer(struct io_ring *ring, int bid)
+{
+	return NULL;
+}
+
+void io_ring_recycle_buffer(struct io_ring *ring, int bid)
+{
+}
+
+int io_ring_clean(struct io_ring *ring)
+{
+	return -ENOSYS;
+}
+
+#endif /* IO_HAVE_IO_URING */
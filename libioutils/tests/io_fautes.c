@@ -21,6 +21,10 @@ const char io_interp[] __attribute__((section(".interp"))) =
 
 struct suite_t *libioutils_test_suites[] = {
 		&io_suite,
+		&io_log_suite,
+		&io_frame_suite,
+		&io_capture_suite,
+		&io_pipeline_suite,
 		&mon_suite,
 		&process_suite,
 		&src_inot_suite,
@@ -39,6 +43,10 @@ struct suite_t *libioutils_test_suites[] = {
 static void libioutils_pool_initializer(void)
 {
 	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(io_suite);
+	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(io_log_suite);
+	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(io_frame_suite);
+	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(io_capture_suite);
+	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(io_pipeline_suite);
 	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(mon_suite);
 	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(process_suite);
 	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(src_inot_suite);
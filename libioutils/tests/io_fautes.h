@@ -11,6 +11,10 @@
 #define IO_FAUTES_H_
 
 extern struct suite_t io_suite;
+extern struct suite_t io_log_suite;
+extern struct suite_t io_frame_suite;
+extern struct suite_t io_capture_suite;
+extern struct suite_t io_pipeline_suite;
 extern struct suite_t mon_suite;
 extern struct suite_t process_suite;
 extern struct suite_t src_inot_suite;
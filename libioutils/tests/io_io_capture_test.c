@@ -0,0 +1,257 @@
+/**
+ * @file io_io_capture_test.c
+ * @brief Unit tests for the io traffic capture and replay
+ *
+ * Copyright (C) 2013 Parrot S.A.
+ */
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <CUnit/Basic.h>
+
+#include <fautes.h>
+
+#include <ut_file.h>
+
+#include <io_mon.h>
+#include <io_io.h>
+#include <io_io_capture.h>
+
+#define SUITE_NAME "io_capture_suite"
+
+static int capture_file(void)
+{
+	char path[] = "/tmp/io_capture_XXXXXX";
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd >= 0)
+		unlink(path);
+
+	return fd;
+}
+
+static void testIO_CAPTURE_INIT(void)
+{
+	int ret;
+	int fd;
+	struct io_io_capture capture;
+	struct io_io_capture_header header;
+
+	/* initialization */
+	fd = capture_file();
+	CU_ASSERT_FATAL(fd >= 0);
+
+	/* normal use cases */
+	ret = io_io_capture_init(&capture, fd, 1000);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(capture.size, 1024);
+	CU_ASSERT_PTR_NOT_NULL(capture.buffer);
+	io_io_capture_clean(&capture);
+	CU_ASSERT_PTR_NULL(capture.buffer);
+	lseek(fd, 0, SEEK_SET);
+	CU_ASSERT_EQUAL(read(fd, &header, sizeof(header)), sizeof(header));
+	CU_ASSERT_EQUAL(header.magic, IO_IO_CAPTURE_MAGIC);
+	CU_ASSERT_EQUAL(header.version, IO_IO_CAPTURE_VERSION);
+
+	/* error use cases */
+	ret = io_io_capture_init(NULL, fd, 1000);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_capture_init(&capture, -1, 1000);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_capture_init(&capture, fd, 1);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	io_io_capture_clean(NULL);
+
+	/* cleanup */
+	ut_file_fd_close(&fd);
+}
+
+static void testIO_CAPTURE_RECORD_FLUSH(void)
+{
+	int ret;
+	int fd;
+	ssize_t sret;
+	struct io_io_capture capture;
+	struct io_io_capture_header header;
+	struct io_io_capture_record record;
+	char data[64];
+	char big[64] = {0};
+
+	/* initialization */
+	fd = capture_file();
+	CU_ASSERT_FATAL(fd >= 0);
+	ret = io_io_capture_init(&capture, fd, 64);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	ret = io_io_capture_record(&capture, IO_IO_LOG_RX, "ping", 4);
+	CU_ASSERT_EQUAL(ret, 0);
+	/* full, dropped and reported as a gap in front of the next record */
+	ret = io_io_capture_record(&capture, IO_IO_LOG_TX, big, sizeof(big));
+	CU_ASSERT_EQUAL(ret, -ENOBUFS);
+	sret = io_io_capture_flush(&capture);
+	CU_ASSERT_EQUAL(sret, sizeof(record) + 4);
+	ret = io_io_capture_record(&capture, IO_IO_LOG_TX, "pong", 4);
+	CU_ASSERT_EQUAL(ret, 0);
+	sret = io_io_capture_flush(&capture);
+	CU_ASSERT_EQUAL(sret, 2 * sizeof(record) + 4);
+	sret = io_io_capture_flush(&capture);
+	CU_ASSERT_EQUAL(sret, 0);
+
+	lseek(fd, 0, SEEK_SET);
+	CU_ASSERT_EQUAL(read(fd, &header, sizeof(header)), sizeof(header));
+	CU_ASSERT_EQUAL(read(fd, &record, sizeof(record)), sizeof(record));
+	CU_ASSERT_EQUAL(record.dir, IO_IO_LOG_RX);
+	CU_ASSERT_EQUAL(record.length, 4);
+	CU_ASSERT_EQUAL(read(fd, data, 4), 4);
+	CU_ASSERT(memcmp(data, "ping", 4) == 0);
+	CU_ASSERT_EQUAL(read(fd, &record, sizeof(record)), sizeof(record));
+	CU_ASSERT_EQUAL(record.dir, IO_IO_CAPTURE_GAP);
+	CU_ASSERT_EQUAL(record.length, sizeof(big));
+	CU_ASSERT_EQUAL(read(fd, &record, sizeof(record)), sizeof(record));
+	CU_ASSERT_EQUAL(record.dir, IO_IO_LOG_TX);
+	CU_ASSERT_EQUAL(record.length, 4);
+	CU_ASSERT_EQUAL(read(fd, data, 4), 4);
+	CU_ASSERT(memcmp(data, "pong", 4) == 0);
+
+	/* error use cases */
+	ret = io_io_capture_record(NULL, IO_IO_LOG_RX, "ping", 4);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_capture_record(&capture, IO_IO_LOG_RX, NULL, 4);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	sret = io_io_capture_flush(NULL);
+	CU_ASSERT_NOT_EQUAL(sret, 0);
+
+	/* cleanup */
+	io_io_capture_clean(&capture);
+	ut_file_fd_close(&fd);
+}
+
+static void testIO_CAPTURE_REPLAY(void)
+{
+	int ret;
+	int fd;
+	int sockets[2];
+	int replay[2];
+	struct io_mon mon;
+	struct io_io_capture capture;
+	/* here io is allocated because of the stack's size */
+	struct io_io *io;
+	char rx[16] = {0};
+	ssize_t sret;
+	int io_cb(struct io_io *local_io, struct rs_rb *rb, void *data)
+	{
+		rs_rb_empty(rb);
+
+		return 0;
+	}
+
+	/* initialization */
+	fd = capture_file();
+	CU_ASSERT_FATAL(fd >= 0);
+	ret = io_io_capture_init(&capture, fd, 4096);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			replay);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_read_start(io, io_cb, NULL, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	ret = io_io_capture_traffic(io, &capture);
+	CU_ASSERT_EQUAL(ret, 0);
+	sret = write(sockets[1], "hello ", 6);
+	CU_ASSERT_EQUAL(sret, 6);
+	ret = io_mon_poll(&mon, 1000);
+	CU_ASSERT(ret >= 0);
+	ret = io_io_write_copy(io, "ignored", 7);
+	CU_ASSERT_EQUAL(ret, 0);
+	usleep(10000);
+	sret = write(sockets[1], "world", 5);
+	CU_ASSERT_EQUAL(sret, 5);
+	ret = io_mon_poll(&mon, 1000);
+	CU_ASSERT(ret >= 0);
+	sret = io_io_capture_flush(&capture);
+	CU_ASSERT(sret > 0);
+
+	/* only the data read are replayed, with their timing */
+	lseek(fd, 0, SEEK_SET);
+	sret = io_io_capture_replay(fd, replay[0], IO_IO_LOG_RX, 1);
+	CU_ASSERT_EQUAL(sret, 11);
+	sret = read(replay[1], rx, sizeof(rx) - 1);
+	CU_ASSERT_EQUAL(sret, 11);
+	CU_ASSERT_STRING_EQUAL(rx, "hello world");
+	lseek(fd, 0, SEEK_SET);
+	sret = io_io_capture_replay(fd, replay[0], IO_IO_LOG_TX, 0);
+	CU_ASSERT_EQUAL(sret, 7);
+
+	/* error use cases */
+	ret = io_io_capture_traffic(NULL, &capture);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	sret = io_io_capture_replay(-1, replay[0], IO_IO_LOG_RX, 0);
+	CU_ASSERT_NOT_EQUAL(sret, 0);
+	/* no header */
+	lseek(fd, 0, SEEK_END);
+	sret = io_io_capture_replay(fd, replay[0], IO_IO_LOG_RX, 0);
+	CU_ASSERT_EQUAL(sret, -EPROTO);
+
+	/* cleanup */
+	io_io_clean(io);
+	free(io);
+	io_io_capture_clean(&capture);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+	ut_file_fd_close(replay + 0);
+	ut_file_fd_close(replay + 1);
+	ut_file_fd_close(&fd);
+}
+
+static const struct test_t tests[] = {
+		{
+				.fn = testIO_CAPTURE_INIT,
+				.name = "io_io_capture_init"
+		},
+		{
+				.fn = testIO_CAPTURE_RECORD_FLUSH,
+				.name = "io_io_capture_record_flush"
+		},
+		{
+				.fn = testIO_CAPTURE_REPLAY,
+				.name = "io_io_capture_replay"
+		},
+
+		/* NULL guard */
+		{.fn = NULL, .name = NULL},
+};
+
+static int init_io_capture_suite(void)
+{
+	return 0; /* return non-zero on error */
+}
+
+static int clean_io_capture_suite(void)
+{
+	return 0; /* return non-zero on error */
+}
+
+struct suite_t io_capture_suite = {
+		.name = SUITE_NAME,
+		.init = init_io_capture_suite,
+		.clean = clean_io_capture_suite,
+		.tests = tests,
+};
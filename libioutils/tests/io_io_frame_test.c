@@ -0,0 +1,312 @@
+/**
+ * @file io_io_frame_test.c
+ * @brief Unit tests for the io framing codecs
+ *
+ * Copyright (C) 2013 Parrot S.A.
+ */
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <CUnit/Basic.h>
+
+#include <fautes.h>
+
+#include <ut_file.h>
+
+#include <io_mon.h>
+#include <io_io.h>
+#include <io_io_frame.h>
+
+#define SUITE_NAME "io_frame_suite"
+
+static char frames[8][64];
+static int nb_frames;
+static int last_err;
+
+static int frame_cb(struct io_io_frame *frame, const void *payload,
+		size_t size, int err, void *data)
+{
+	last_err = err;
+	if (err != 0)
+		return 0;
+	CU_ASSERT(size < sizeof(frames[0]));
+	if (nb_frames < 8 && size < sizeof(frames[0])) {
+		memcpy(frames[nb_frames], payload, size);
+		frames[nb_frames][size] = '\0';
+	}
+	nb_frames++;
+
+	return 0;
+}
+
+static void reset_frames(void)
+{
+	memset(frames, 0, sizeof(frames));
+	nb_frames = 0;
+	last_err = 0;
+}
+
+static void rb_push(struct rs_rb *rb, const void *buf, size_t size)
+{
+	memcpy(rs_rb_get_write_ptr(rb), buf, size);
+	rs_rb_write_incr(rb, size);
+}
+
+static void testIO_FRAME_INIT(void)
+{
+	int ret;
+	struct io_io_frame frame;
+
+	/* normal use cases */
+	ret = io_io_frame_init_length(&frame, 2, true, 0, frame_cb, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(frame.type, IO_IO_FRAME_LENGTH);
+	ret = io_io_frame_init_delimiter(&frame, "\r\n", 2, 0, frame_cb, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(frame.type, IO_IO_FRAME_DELIMITER);
+
+	/* error use cases */
+	ret = io_io_frame_init_length(NULL, 2, true, 0, frame_cb, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_frame_init_length(&frame, 3, true, 0, frame_cb, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_frame_init_length(&frame, 2, true, 0, NULL, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_frame_init_delimiter(&frame, NULL, 2, 0, frame_cb, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_frame_init_delimiter(&frame, "\r\n", 0, 0, frame_cb, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_frame_read_start(NULL, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+}
+
+static void testIO_FRAME_LENGTH(void)
+{
+	int ret;
+	struct rs_rb rb;
+	struct io_io_frame frame;
+
+	/* initialization */
+	ret = rs_rb_init(&rb, NULL, 4096);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	/* big endian, frames split across pushes */
+	reset_frames();
+	ret = io_io_frame_init_length(&frame, 2, true, 0, frame_cb, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	rb_push(&rb, "\x00\x05hello\x00", 8);
+	ret = io_io_frame_process(&frame, &rb);
+	CU_ASSERT_EQUAL(ret, 1);
+	CU_ASSERT_STRING_EQUAL(frames[0], "hello");
+	CU_ASSERT_EQUAL(rs_rb_get_read_length(&rb), 1);
+	rb_push(&rb, "\x03", 1);
+	ret = io_io_frame_process(&frame, &rb);
+	CU_ASSERT_EQUAL(ret, 0);
+	rb_push(&rb, "abc\x00\x00", 5);
+	ret = io_io_frame_process(&frame, &rb);
+	CU_ASSERT_EQUAL(ret, 2);
+	CU_ASSERT_STRING_EQUAL(frames[1], "abc");
+	CU_ASSERT_STRING_EQUAL(frames[2], "");
+	CU_ASSERT_EQUAL(rs_rb_get_read_length(&rb), 0);
+
+	/* little endian, 4 bytes header */
+	reset_frames();
+	ret = io_io_frame_init_length(&frame, 4, false, 0, frame_cb, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	rb_push(&rb, "\x02\x00\x00\x00ok", 6);
+	ret = io_io_frame_process(&frame, &rb);
+	CU_ASSERT_EQUAL(ret, 1);
+	CU_ASSERT_STRING_EQUAL(frames[0], "ok");
+
+	/* error use cases */
+	ret = io_io_frame_init_length(&frame, 1, true, 3, frame_cb, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	rb_push(&rb, "\x04", 1);
+	ret = io_io_frame_process(&frame, &rb);
+	CU_ASSERT_EQUAL(ret, -EMSGSIZE);
+	ret = io_io_frame_process(NULL, &rb);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_frame_process(&frame, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	rs_rb_clean(&rb);
+}
+
+static void testIO_FRAME_DELIMITER(void)
+{
+	int ret;
+	struct rs_rb rb;
+	struct io_io_frame frame;
+
+	/* initialization */
+	ret = rs_rb_init(&rb, NULL, 4096);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_frame_init_delimiter(&frame, "\r\n", 2, 8, frame_cb, NULL);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	reset_frames();
+	rb_push(&rb, "GET\r\nHOST\r", 10);
+	ret = io_io_frame_process(&frame, &rb);
+	CU_ASSERT_EQUAL(ret, 1);
+	CU_ASSERT_STRING_EQUAL(frames[0], "GET");
+	/* the delimiter is split across two reads */
+	rb_push(&rb, "\n\r\n", 3);
+	ret = io_io_frame_process(&frame, &rb);
+	CU_ASSERT_EQUAL(ret, 2);
+	CU_ASSERT_STRING_EQUAL(frames[1], "HOST");
+	CU_ASSERT_STRING_EQUAL(frames[2], "");
+	CU_ASSERT_EQUAL(rs_rb_get_read_length(&rb), 0);
+
+	/* error use cases */
+	rb_push(&rb, "0123456789abcdef", 16);
+	ret = io_io_frame_process(&frame, &rb);
+	CU_ASSERT_EQUAL(ret, -EMSGSIZE);
+
+	/* cleanup */
+	rs_rb_clean(&rb);
+}
+
+static void testIO_FRAME_ENCODE(void)
+{
+	int ret;
+	struct io_io_frame frame;
+	struct iovec iov[2];
+	uint8_t header[IO_IO_FRAME_HEADER_MAX];
+
+	/* normal use cases */
+	ret = io_io_frame_init_length(&frame, 2, true, 0, frame_cb, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_frame_encode(&frame, header, "hello", 5, iov);
+	CU_ASSERT_EQUAL(ret, 2);
+	CU_ASSERT_PTR_EQUAL(iov[0].iov_base, header);
+	CU_ASSERT_EQUAL(iov[0].iov_len, 2);
+	CU_ASSERT(memcmp(header, "\x00\x05", 2) == 0);
+	CU_ASSERT_EQUAL(iov[1].iov_len, 5);
+	ret = io_io_frame_init_length(&frame, 4, false, 0, frame_cb, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_frame_encode(&frame, header, "hello", 0x102, iov);
+	CU_ASSERT_EQUAL(ret, 2);
+	CU_ASSERT(memcmp(header, "\x02\x01\x00\x00", 4) == 0);
+	ret = io_io_frame_init_delimiter(&frame, "\n", 1, 0, frame_cb, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_frame_encode(&frame, NULL, "hello", 5, iov);
+	CU_ASSERT_EQUAL(ret, 2);
+	CU_ASSERT_EQUAL(iov[0].iov_len, 5);
+	CU_ASSERT_EQUAL(iov[1].iov_len, 1);
+
+	/* error use cases */
+	ret = io_io_frame_init_length(&frame, 1, true, 0, frame_cb, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_frame_encode(&frame, header, "hello", 256, iov);
+	CU_ASSERT_EQUAL(ret, -EMSGSIZE);
+	ret = io_io_frame_encode(&frame, NULL, "hello", 5, iov);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_frame_encode(NULL, header, "hello", 5, iov);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+}
+
+static void testIO_FRAME_READ_START(void)
+{
+	int ret;
+	int sockets[2];
+	struct io_mon mon;
+	/* here io is allocated because of the stack's size */
+	struct io_io *io;
+	struct io_io_frame frame;
+	struct iovec iov[4];
+	uint8_t headers[2][IO_IO_FRAME_HEADER_MAX];
+	ssize_t sret;
+
+	/* initialization */
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 0);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_frame_init_length(&frame, 2, true, 0, frame_cb, NULL);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	reset_frames();
+	ret = io_io_frame_read_start(&frame, io);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_frame_encode(&frame, headers[0], "first", 5, iov);
+	CU_ASSERT_EQUAL(ret, 2);
+	ret = io_io_frame_encode(&frame, headers[1], "second", 6, iov + 2);
+	CU_ASSERT_EQUAL(ret, 2);
+	sret = writev(sockets[1], iov, 4);
+	CU_ASSERT_EQUAL(sret, 2 + 5 + 2 + 6);
+	ret = io_mon_poll(&mon, 1000);
+	CU_ASSERT(ret >= 0);
+	CU_ASSERT_EQUAL(nb_frames, 2);
+	CU_ASSERT_STRING_EQUAL(frames[0], "first");
+	CU_ASSERT_STRING_EQUAL(frames[1], "second");
+	/* end of file is notified */
+	ut_file_fd_close(sockets + 1);
+	ret = io_mon_poll(&mon, 1000);
+	CU_ASSERT(ret >= 0);
+	CU_ASSERT_EQUAL(last_err, -EPIPE);
+
+	/* error use cases */
+	ret = io_io_frame_read_start(&frame, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	io_io_clean(io);
+	free(io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+}
+
+static const struct test_t tests[] = {
+		{
+				.fn = testIO_FRAME_INIT,
+				.name = "io_io_frame_init"
+		},
+		{
+				.fn = testIO_FRAME_LENGTH,
+				.name = "io_io_frame_length"
+		},
+		{
+				.fn = testIO_FRAME_DELIMITER,
+				.name = "io_io_frame_delimiter"
+		},
+		{
+				.fn = testIO_FRAME_ENCODE,
+				.name = "io_io_frame_encode"
+		},
+		{
+				.fn = testIO_FRAME_READ_START,
+				.name = "io_io_frame_read_start"
+		},
+
+		/* NULL guard */
+		{.fn = NULL, .name = NULL},
+};
+
+static int init_io_frame_suite(void)
+{
+	return 0; /* return non-zero on error */
+}
+
+static int clean_io_frame_suite(void)
+{
+	return 0; /* return non-zero on error */
+}
+
+struct suite_t io_frame_suite = {
+		.name = SUITE_NAME,
+		.init = init_io_frame_suite,
+		.clean = clean_io_frame_suite,
+		.tests = tests,
+};
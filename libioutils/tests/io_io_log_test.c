@@ -0,0 +1,273 @@
+/**
+ * @file io_io_log_test.c
+ * @brief Unit tests for the io deferred traffic log
+ *
+ * Copyright (C) 2013 Parrot S.A.
+ */
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <CUnit/Basic.h>
+
+#include <fautes.h>
+
+#include <ut_file.h>
+
+#include <io_mon.h>
+#include <io_io.h>
+#include <io_io_log.h>
+
+#define SUITE_NAME "io_log_suite"
+
+static char last_line[128];
+static int nb_lines;
+
+static void log_cb(const char *line)
+{
+	snprintf(last_line, sizeof(last_line), "%s", line);
+	nb_lines++;
+}
+
+static void reset_lines(void)
+{
+	last_line[0] = '\0';
+	nb_lines = 0;
+}
+
+static void testIO_LOG_INIT(void)
+{
+	int ret;
+	struct io_io_log log;
+
+	/* normal use cases */
+	ret = io_io_log_init(&log, 1000, log_cb, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(log.size, 1024);
+	CU_ASSERT_PTR_NOT_NULL(log.buffer);
+	io_io_log_clean(&log);
+	CU_ASSERT_PTR_NULL(log.buffer);
+
+	/* error use cases */
+	ret = io_io_log_init(NULL, 1000, log_cb, 0);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_log_init(&log, 1000, NULL, 0);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_log_init(&log, 1, log_cb, 0);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	io_io_log_clean(NULL);
+}
+
+static void testIO_LOG_HEXDUMP(void)
+{
+	/* normal use cases */
+	reset_lines();
+	io_io_log_hexdump(log_cb, "0123456789abcdef\x01", 17);
+	CU_ASSERT_EQUAL(nb_lines, 2);
+	CU_ASSERT_STRING_EQUAL(last_line, "01                                "
+			"               | .               ");
+	reset_lines();
+	io_io_log_hexdump(log_cb, "AZ\n", 3);
+	CU_ASSERT_EQUAL(nb_lines, 1);
+	CU_ASSERT_STRING_EQUAL(last_line, "41 5A 0A                          "
+			"               | AZ.             ");
+
+	/* error use cases */
+	reset_lines();
+	io_io_log_hexdump(NULL, "AZ", 2);
+	io_io_log_hexdump(log_cb, NULL, 2);
+	CU_ASSERT_EQUAL(nb_lines, 0);
+}
+
+static void testIO_LOG_RECORD_FLUSH(void)
+{
+	int ret;
+	struct io_io_log log;
+	char buf[600] = {0};
+
+	/* initialization */
+	ret = io_io_log_init(&log, 1024, log_cb, 0);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	reset_lines();
+	ret = io_io_log_record(&log, IO_IO_LOG_RX, "a very long io name", 3,
+			"hello", 5);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_log_record(&log, IO_IO_LOG_TX, "io", 4, "world!", 6);
+	CU_ASSERT_EQUAL(ret, 0);
+	/* nothing is formatted before flushing */
+	CU_ASSERT_EQUAL(nb_lines, 0);
+	ret = io_io_log_flush(&log);
+	CU_ASSERT_EQUAL(ret, 2);
+	CU_ASSERT_EQUAL(nb_lines, 4);
+	CU_ASSERT_STRING_EQUAL(last_line, "77 6F 72 6C 64 21                 "
+			"               | world!          ");
+	ret = io_io_log_flush(&log);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* records wrap at the end of the ring */
+	reset_lines();
+	ret = io_io_log_record(&log, IO_IO_LOG_RX, "io", 3, buf, sizeof(buf));
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_log_record(&log, IO_IO_LOG_RX, "io", 3, buf, sizeof(buf));
+	CU_ASSERT_EQUAL(ret, -ENOBUFS);
+	ret = io_io_log_flush(&log);
+	CU_ASSERT_EQUAL(ret, 1);
+	CU_ASSERT_EQUAL(nb_lines, 2 + (sizeof(buf) + 15) / 16);
+	CU_ASSERT_STRING_EQUAL(last_line, "00 00 00 00 00 00 00 00           "
+			"               | ........        ");
+	reset_lines();
+	ret = io_io_log_record(&log, IO_IO_LOG_RX, "io", 3, buf, sizeof(buf));
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_log_flush(&log);
+	CU_ASSERT_EQUAL(ret, 1);
+	CU_ASSERT_EQUAL(nb_lines, 1 + (sizeof(buf) + 15) / 16);
+
+	/* error use cases */
+	ret = io_io_log_record(NULL, IO_IO_LOG_RX, "io", 3, buf, 1);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_log_record(&log, IO_IO_LOG_RX, NULL, 3, buf, 1);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_log_record(&log, IO_IO_LOG_RX, "io", 3, NULL, 1);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_log_flush(NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	io_io_log_clean(&log);
+}
+
+static void testIO_LOG_RATE(void)
+{
+	int ret;
+	struct io_io_log log;
+	char buf[100] = {0};
+
+	/* initialization */
+	ret = io_io_log_init(&log, 4096, log_cb, 150);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	reset_lines();
+	ret = io_io_log_record(&log, IO_IO_LOG_RX, "io", 3, buf, sizeof(buf));
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_log_record(&log, IO_IO_LOG_RX, "io", 3, buf, sizeof(buf));
+	if (ret == 0) {
+		/* a new second has begun, let it another try */
+		ret = io_io_log_record(&log, IO_IO_LOG_RX, "io", 3, buf,
+				sizeof(buf));
+	}
+	CU_ASSERT_EQUAL(ret, -ENOBUFS);
+	io_io_log_flush(&log);
+	reset_lines();
+	ret = io_io_log_flush(&log);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(nb_lines, 0);
+
+	/* cleanup */
+	io_io_log_clean(&log);
+}
+
+static void testIO_LOG_ASYNC(void)
+{
+	int ret;
+	int sockets[2];
+	struct io_mon mon;
+	struct io_io_log log;
+	/* here io is allocated because of the stack's size */
+	struct io_io *io;
+	ssize_t sret;
+	int io_cb(struct io_io *local_io, struct rs_rb *rb, void *data)
+	{
+		rs_rb_empty(rb);
+
+		return 0;
+	}
+
+	/* initialization */
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_log_init(&log, 4096, log_cb, 0);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_read_start(io, io_cb, NULL, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	ret = io_io_log_async(io, &log);
+	CU_ASSERT_EQUAL(ret, 0);
+	reset_lines();
+	sret = write(sockets[1], "ping", 4);
+	CU_ASSERT_EQUAL(sret, 4);
+	ret = io_mon_poll(&mon, 1000);
+	CU_ASSERT(ret >= 0);
+	CU_ASSERT_EQUAL(nb_lines, 0);
+	ret = io_io_log_flush(&log);
+	CU_ASSERT_EQUAL(ret, 1);
+	CU_ASSERT_EQUAL(nb_lines, 2);
+	CU_ASSERT_STRING_EQUAL(last_line, "70 69 6E 67                       "
+			"               | ping            ");
+
+	/* error use cases */
+	ret = io_io_log_async(NULL, &log);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	io_io_clean(io);
+	free(io);
+	io_io_log_clean(&log);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+}
+
+static const struct test_t tests[] = {
+		{
+				.fn = testIO_LOG_INIT,
+				.name = "io_io_log_init"
+		},
+		{
+				.fn = testIO_LOG_HEXDUMP,
+				.name = "io_io_log_hexdump"
+		},
+		{
+				.fn = testIO_LOG_RECORD_FLUSH,
+				.name = "io_io_log_record_flush"
+		},
+		{
+				.fn = testIO_LOG_RATE,
+				.name = "io_io_log_rate"
+		},
+		{
+				.fn = testIO_LOG_ASYNC,
+				.name = "io_io_log_async"
+		},
+
+		/* NULL guard */
+		{.fn = NULL, .name = NULL},
+};
+
+static int init_io_log_suite(void)
+{
+	return 0; /* return non-zero on error */
+}
+
+static int clean_io_log_suite(void)
+{
+	return 0; /* return non-zero on error */
+}
+
+struct suite_t io_log_suite = {
+		.name = SUITE_NAME,
+		.init = init_io_log_suite,
+		.clean = clean_io_log_suite,
+		.tests = tests,
+};
@@ -0,0 +1,420 @@
+/**
+ * @file io_io_pipeline_test.c
+ * @brief Unit tests for the pipelines of processing stages between ios
+ *
+ * Copyright (C) 2013 Parrot S.A.
+ */
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include <CUnit/Basic.h>
+
+#include <fautes.h>
+
+#include <ut_file.h>
+
+#include <io_mon.h>
+#include <io_io.h>
+#include <io_io_pipeline.h>
+
+#define SUITE_NAME "io_pipeline_suite"
+
+/**
+ * @struct endpoints
+ * @brief Source and sink ios of a pipeline, each one with its peer socket
+ */
+struct endpoints {
+	struct io_mon mon;
+	int src[2];
+	int dst[2];
+	struct io_io *source;
+	struct io_io *sink;
+};
+
+static void endpoints_init(struct endpoints *e)
+{
+	int ret;
+
+	ret = io_mon_init(&e->mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			e->src);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			e->dst);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	/* here ios are allocated because of the stack's size */
+	e->source = calloc(1, sizeof(*e->source));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(e->source);
+	e->sink = calloc(1, sizeof(*e->sink));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(e->sink);
+	ret = io_io_init(e->source, &e->mon, SUITE_NAME, e->src[0], e->src[0],
+			1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_init(e->sink, &e->mon, SUITE_NAME, e->dst[0], e->dst[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+}
+
+static void endpoints_clean(struct endpoints *e)
+{
+	io_io_clean(e->source);
+	io_io_clean(e->sink);
+	free(e->source);
+	free(e->sink);
+	io_mon_clean(&e->mon);
+	ut_file_fd_close(e->src + 0);
+	ut_file_fd_close(e->src + 1);
+	ut_file_fd_close(e->dst + 0);
+	ut_file_fd_close(e->dst + 1);
+}
+
+static void testIO_PIPELINE_INIT(void)
+{
+	int ret;
+	struct endpoints e;
+	struct io_io_pipeline pipeline;
+	struct io_io_pipeline_stage stage;
+	struct io_io_pipeline_buffer *buffer;
+	int process(struct io_io_pipeline_stage *local_stage,
+			struct io_io_pipeline_buffer *local_buffer, void *data)
+	{
+		return io_io_pipeline_forward(local_stage, local_buffer);
+	}
+
+	/* initialization */
+	endpoints_init(&e);
+
+	/* normal use cases */
+	ret = io_io_pipeline_init(&pipeline, e.source, e.sink, 0, NULL, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_pipeline_add_stage(&pipeline, &stage, process, 0, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	buffer = io_io_pipeline_buffer_new(&pipeline, 10);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buffer);
+	CU_ASSERT_EQUAL(buffer->size, IO_IO_PIPELINE_BUFFER_SIZE);
+	io_io_pipeline_buffer_release(buffer);
+	/* released to the pool, reused */
+	CU_ASSERT_PTR_EQUAL(io_io_pipeline_buffer_new(&pipeline, 100), buffer);
+	io_io_pipeline_buffer_release(buffer);
+	buffer = io_io_pipeline_buffer_new(&pipeline,
+			2 * IO_IO_PIPELINE_BUFFER_SIZE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buffer);
+	CU_ASSERT_EQUAL(buffer->size, 2 * IO_IO_PIPELINE_BUFFER_SIZE);
+	io_io_pipeline_buffer_release(buffer);
+	ret = io_io_pipeline_start(&pipeline);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT(io_io_is_read_started(e.source));
+	/* stages can't be added to a running pipeline */
+	ret = io_io_pipeline_add_stage(&pipeline, &stage, process, 0, NULL);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+	ret = io_io_pipeline_clean(&pipeline);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT(!io_io_is_read_started(e.source));
+
+	/* error use cases */
+	ret = io_io_pipeline_init(NULL, e.source, e.sink, 0, NULL, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_pipeline_init(&pipeline, NULL, e.sink, 0, NULL, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_pipeline_init(&pipeline, e.source, NULL, 0, NULL, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_pipeline_init(&pipeline, e.source, e.sink, 0, NULL, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_pipeline_add_stage(NULL, &stage, process, 0, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_pipeline_add_stage(&pipeline, NULL, process, 0, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_pipeline_add_stage(&pipeline, &stage, NULL, 0, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_NULL(io_io_pipeline_buffer_new(NULL, 10));
+	CU_ASSERT_PTR_NULL(io_io_pipeline_buffer_new(&pipeline, 0));
+	ret = io_io_pipeline_forward(NULL, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_pipeline_start(NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_pipeline_clean(NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	io_io_pipeline_buffer_release(NULL);
+
+	/* cleanup */
+	io_io_pipeline_clean(&pipeline);
+	endpoints_clean(&e);
+}
+
+static void testIO_PIPELINE_TRANSFER(void)
+{
+	int ret;
+	struct endpoints e;
+	struct io_io_pipeline pipeline;
+	struct io_io_pipeline_stage upper;
+	struct io_io_pipeline_stage count;
+	const char msg[] = "hello pipeline";
+	char rx[64] = {0};
+	size_t counted = 0;
+	ssize_t sret;
+	int ended = 0;
+	int end_err = 1;
+	int loops = 0;
+	int upper_cb(struct io_io_pipeline_stage *stage,
+			struct io_io_pipeline_buffer *buffer, void *data)
+	{
+		size_t i;
+		char *p = buffer->data;
+
+		/* transformed in place */
+		for (i = 0; i < buffer->length; i++)
+			p[i] = toupper(p[i]);
+
+		return io_io_pipeline_forward(stage, buffer);
+	}
+	int count_cb(struct io_io_pipeline_stage *stage,
+			struct io_io_pipeline_buffer *buffer, void *data)
+	{
+		CU_ASSERT_PTR_EQUAL(data, &counted);
+		counted += buffer->length;
+
+		return io_io_pipeline_forward(stage, buffer);
+	}
+	void end_cb(struct io_io_pipeline *local_pipeline, int err, void *data)
+	{
+		CU_ASSERT_PTR_EQUAL(local_pipeline, &pipeline);
+		ended++;
+		end_err = err;
+	}
+
+	/* initialization */
+	endpoints_init(&e);
+	ret = io_io_pipeline_init(&pipeline, e.source, e.sink, 0, end_cb,
+			NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_pipeline_add_stage(&pipeline, &upper, upper_cb, 0, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_pipeline_add_stage(&pipeline, &count, count_cb, 0,
+			&counted);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_pipeline_start(&pipeline);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	sret = write(e.src[1], msg, strlen(msg));
+	CU_ASSERT_EQUAL(sret, strlen(msg));
+	io_mon_poll(&e.mon, 1000);
+	sret = read(e.dst[1], rx, sizeof(rx) - 1);
+	CU_ASSERT_EQUAL(sret, strlen(msg));
+	CU_ASSERT_STRING_EQUAL(rx, "HELLO PIPELINE");
+	CU_ASSERT_EQUAL(counted, strlen(msg));
+	/* the sink was idle, the buffer has been written and released */
+	CU_ASSERT_EQUAL(pipeline.sink_stage.inflight, 0);
+	CU_ASSERT(rs_dll_is_empty(&pipeline.live));
+	CU_ASSERT_EQUAL(ended, 0);
+
+	/* the end of the source ends the pipeline */
+	ut_file_fd_close(e.src + 1);
+	while (ended == 0 && loops++ < 10)
+		io_mon_poll(&e.mon, 100);
+	CU_ASSERT_EQUAL(ended, 1);
+	CU_ASSERT_EQUAL(end_err, 0);
+
+	/* cleanup */
+	io_io_pipeline_clean(&pipeline);
+	endpoints_clean(&e);
+}
+
+static void testIO_PIPELINE_BACKPRESSURE(void)
+{
+#define NB_HELD 16
+#define BIG_SIZE (2 * IO_IO_PIPELINE_BUFFER_SIZE + 100)
+	int ret;
+	int i;
+	struct endpoints e;
+	struct io_io_pipeline pipeline;
+	struct io_io_pipeline_stage hold;
+	struct io_io_pipeline_stage check;
+	struct io_io_pipeline_buffer *held[NB_HELD];
+	int nb_held = 0;
+	char rx[64] = {0};
+	char *big_tx;
+	char *big_rx;
+	size_t total;
+	ssize_t sret;
+	int ended = 0;
+	int end_err = 0;
+	int hold_cb(struct io_io_pipeline_stage *stage,
+			struct io_io_pipeline_buffer *buffer, void *data)
+	{
+		/* the stage owns the buffer, even on error */
+		if (nb_held == NB_HELD) {
+			io_io_pipeline_buffer_release(buffer);
+			return -ENOBUFS;
+		}
+		held[nb_held++] = buffer;
+
+		return 0;
+	}
+	int check_cb(struct io_io_pipeline_stage *stage,
+			struct io_io_pipeline_buffer *buffer, void *data)
+	{
+		if (memcmp(buffer->data, "bad", 3) == 0) {
+			io_io_pipeline_buffer_release(buffer);
+			return -EPROTO;
+		}
+
+		return io_io_pipeline_forward(stage, buffer);
+	}
+	void end_cb(struct io_io_pipeline *local_pipeline, int err, void *data)
+	{
+		ended++;
+		end_err = err;
+	}
+
+	/* initialization */
+	endpoints_init(&e);
+	ret = io_io_pipeline_init(&pipeline, e.source, e.sink, 0, end_cb,
+			NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_pipeline_add_stage(&pipeline, &hold, hold_cb, 8, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_pipeline_add_stage(&pipeline, &check, check_cb, 0, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	/* large enough for the source to read more than one buffer at once */
+	ret = io_io_read_set_buffer_size(e.source,
+			4 * IO_IO_PIPELINE_BUFFER_SIZE, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_pipeline_start(&pipeline);
+	CU_ASSERT_EQUAL(ret, 0);
+	/* here buffers are allocated because of the stack's size */
+	big_tx = calloc(2, BIG_SIZE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(big_tx);
+	big_rx = big_tx + BIG_SIZE;
+	for (i = 0; i < BIG_SIZE; i++)
+		big_tx[i] = 'a' + i % 26;
+
+	/* normal use cases */
+	/* the stage holding more than allowed pauses the source */
+	sret = write(e.src[1], "0123456789", 10);
+	CU_ASSERT_EQUAL(sret, 10);
+	io_mon_poll(&e.mon, 1000);
+	CU_ASSERT_EQUAL(nb_held, 1);
+	CU_ASSERT_EQUAL(hold.inflight, 10);
+	CU_ASSERT(hold.saturated);
+	CU_ASSERT(io_io_is_read_paused(e.source));
+	sret = write(e.src[1], "abcdef", 6);
+	CU_ASSERT_EQUAL(sret, 6);
+	io_mon_poll(&e.mon, 100);
+	CU_ASSERT_EQUAL(nb_held, 1);
+
+	/* forwarding resumes the source */
+	ret = io_io_pipeline_forward(&hold, held[0]);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(hold.inflight, 0);
+	CU_ASSERT(!hold.saturated);
+	CU_ASSERT(!io_io_is_read_paused(e.source));
+	io_mon_poll(&e.mon, 1000);
+	CU_ASSERT_EQUAL(nb_held, 2);
+	CU_ASSERT(!io_io_is_read_paused(e.source));
+	ret = io_io_pipeline_forward(&hold, held[1]);
+	CU_ASSERT_EQUAL(ret, 0);
+	sret = read(e.dst[1], rx, sizeof(rx) - 1);
+	CU_ASSERT_EQUAL(sret, 16);
+	CU_ASSERT_STRING_EQUAL(rx, "0123456789abcdef");
+
+	/*
+	 * data read past saturation are left in the source's ring buffer,
+	 * bounding what the stage holds to max_inflight plus one buffer
+	 */
+	sret = write(e.src[1], big_tx, BIG_SIZE);
+	CU_ASSERT_EQUAL(sret, BIG_SIZE);
+	io_mon_poll(&e.mon, 1000);
+	CU_ASSERT_EQUAL(nb_held, 3);
+	CU_ASSERT(hold.inflight <= 8 + IO_IO_PIPELINE_BUFFER_SIZE);
+	CU_ASSERT(rs_rb_get_read_length(&e.source->readctx.rb) > 0);
+	CU_ASSERT(io_io_is_read_paused(e.source));
+	/* each buffer forwarded lets the next one in */
+	for (i = 2; i < nb_held; i++) {
+		ret = io_io_pipeline_forward(&hold, held[i]);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT(hold.inflight <= 8 + IO_IO_PIPELINE_BUFFER_SIZE);
+	}
+	CU_ASSERT_EQUAL(nb_held, 5);
+	CU_ASSERT_EQUAL(hold.inflight, 0);
+	CU_ASSERT_EQUAL(rs_rb_get_read_length(&e.source->readctx.rb), 0);
+	CU_ASSERT(!io_io_is_read_paused(e.source));
+	total = 0;
+	for (i = 0; i < 100 && total < BIG_SIZE; i++) {
+		io_mon_poll(&e.mon, 10);
+		sret = read(e.dst[1], big_rx + total, BIG_SIZE - total);
+		if (sret > 0)
+			total += sret;
+	}
+	CU_ASSERT_EQUAL(total, BIG_SIZE);
+	CU_ASSERT(memcmp(big_tx, big_rx, BIG_SIZE) == 0);
+
+	/* an error of a stage ends the pipeline */
+	sret = write(e.src[1], "bad", 3);
+	CU_ASSERT_EQUAL(sret, 3);
+	io_mon_poll(&e.mon, 1000);
+	CU_ASSERT_EQUAL(nb_held, 6);
+	ret = io_io_pipeline_forward(&hold, held[nb_held - 1]);
+	CU_ASSERT_EQUAL(ret, -EPROTO);
+	CU_ASSERT_EQUAL(ended, 1);
+	CU_ASSERT_EQUAL(end_err, -EPROTO);
+	CU_ASSERT(io_io_is_read_paused(e.source));
+
+	/* a buffer held while the pipeline is cleaned is freed on release */
+	sret = write(e.src[1], "late", 4);
+	CU_ASSERT_EQUAL(sret, 4);
+	held[nb_held] = io_io_pipeline_buffer_new(&pipeline, 4);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(held[nb_held]);
+	io_io_pipeline_clean(&pipeline);
+	ret = io_io_pipeline_forward(&hold, held[nb_held]);
+	CU_ASSERT_EQUAL(ret, -EPIPE);
+
+	/* error use cases */
+	ret = io_io_pipeline_forward(&hold, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	free(big_tx);
+	endpoints_clean(&e);
+#undef BIG_SIZE
+#undef NB_HELD
+}
+
+static const struct test_t tests[] = {
+		{
+				.fn = testIO_PIPELINE_INIT,
+				.name = "io_io_pipeline_init"
+		},
+		{
+				.fn = testIO_PIPELINE_TRANSFER,
+				.name = "io_io_pipeline_transfer"
+		},
+		{
+				.fn = testIO_PIPELINE_BACKPRESSURE,
+				.name = "io_io_pipeline_backpressure"
+		},
+
+		/* NULL guard */
+		{.fn = NULL, .name = NULL},
+};
+
+static int init_io_pipeline_suite(void)
+{
+	return 0; /* return non-zero on error */
+}
+
+static int clean_io_pipeline_suite(void)
+{
+	return 0; /* return non-zero on error */
+}
+
+struct suite_t io_pipeline_suite = {
+		.name = SUITE_NAME,
+		.init = init_io_pipeline_suite,
+		.clean = clean_io_pipeline_suite,
+		.tests = tests,
+};
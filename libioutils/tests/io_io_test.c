@@ -7,7 +7,12 @@
  * Copyright (C) 2013 Parrot S.A.
  */
 #include <sys/socket.h>
+#include <netinet/in.h>
 #include <unistd.h>
+#include <fcntl.h>
+
+#include <errno.h>
+#include <signal.h>
 
 #include <CUnit/Basic.h>
 
@@ -18,6 +23,7 @@
 
 #include <io_mon.h>
 #include <io_io.h>
+#include <io_ring.h>
 
 #define SUITE_NAME "io_suite"
 
@@ -468,19 +474,25 @@ static void testIO_SIMPLE_USE_CASE(void)
 	};
 	int io_cb(struct io_io *local_io, struct rs_rb *rb, void *data)
 	{
-		size_t newbytes = rs_rb_get_read_length(rb);
-
-		if (strncmp(rs_rb_get_read_ptr(rb), ANS1, sizeof(ANS1)) == 0) {
-			CU_ASSERT_EQUAL(newbytes, sizeof(ANS1));
-			CU_ASSERT(!(STATE_ANS1_RECEIVED & state));
-			state |= STATE_ANS1_RECEIVED;
-			rs_rb_read_incr(rb, newbytes);
-		} else if (strncmp(rs_rb_get_read_ptr(rb), ANS2,
-				sizeof(ANS2)) == 0) {
-			CU_ASSERT_EQUAL(newbytes, sizeof(ANS2));
-			CU_ASSERT(!(STATE_ANS2_RECEIVED & state));
-			state |= STATE_ANS2_RECEIVED;
-			rs_rb_read_incr(rb, newbytes);
+		size_t newbytes;
+
+		/* MSG2 being written at once, both answers can come together */
+		while ((newbytes = rs_rb_get_read_length(rb)) > 0) {
+			if (strncmp(rs_rb_get_read_ptr(rb), ANS1,
+					sizeof(ANS1)) == 0) {
+				CU_ASSERT(newbytes >= sizeof(ANS1));
+				CU_ASSERT(!(STATE_ANS1_RECEIVED & state));
+				state |= STATE_ANS1_RECEIVED;
+				rs_rb_read_incr(rb, sizeof(ANS1));
+			} else if (strncmp(rs_rb_get_read_ptr(rb), ANS2,
+					sizeof(ANS2)) == 0) {
+				CU_ASSERT_EQUAL(newbytes, sizeof(ANS2));
+				CU_ASSERT(!(STATE_ANS2_RECEIVED & state));
+				state |= STATE_ANS2_RECEIVED;
+				rs_rb_read_incr(rb, newbytes);
+			} else {
+				break;
+			}
 		}
 
 		return 0;
@@ -581,95 +593,2283 @@ out:
 	ut_file_fd_close(sockets + 1);
 }
 
-static void testIO_WRITE_BUFFER_INIT(void)
+static void testIO_READ_SET_BUFFER_SIZE(void)
 {
-#define MSG "titi tata toto"
 	int ret;
-	struct io_io_write_buffer wb;
+	int sockets[2];
+	struct io_mon mon;
+	struct io_io io;
+	size_t page_size = sysconf(_SC_PAGE_SIZE);
+
+	/* initialization */
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_init(&io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
 
 	/* normal use cases */
-	ret = io_io_write_buffer_init(&wb, dummy_write_cb, (void *) 42,
-			sizeof(MSG), MSG);
+	ret = io_io_read_set_buffer_size(&io, 2 * page_size, 8 * page_size);
 	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(rs_rb_get_size(&io.readctx.rb), 2 * page_size);
+	CU_ASSERT_EQUAL(io_io_read_get_max_size(&io), 8 * page_size);
+	ret = io_io_read_set_buffer_size(&io, 1, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(rs_rb_get_size(&io.readctx.rb), page_size);
+	CU_ASSERT_EQUAL(io_io_read_get_max_size(&io), page_size);
 
 	/* error use cases */
-	ret = io_io_write_buffer_init(NULL, dummy_write_cb, (void *) 42,
-			sizeof(MSG), MSG);
+	CU_ASSERT_EQUAL(io_io_read_get_max_size(NULL), 0);
+	ret = io_io_read_set_buffer_size(NULL, page_size, 0);
 	CU_ASSERT_NOT_EQUAL(ret, 0);
-	ret = io_io_write_buffer_init(&wb, dummy_write_cb, (void *) 42,
-			0, MSG);
+	ret = io_io_read_set_buffer_size(&io, 0, 0);
 	CU_ASSERT_NOT_EQUAL(ret, 0);
-	ret = io_io_write_buffer_init(&wb, dummy_write_cb, (void *) 42,
-			sizeof(MSG), NULL);
+	ret = io_io_read_set_buffer_size(&io, 2 * page_size, page_size);
 	CU_ASSERT_NOT_EQUAL(ret, 0);
-#undef MSG
+	ret = io_io_read_set_buffer_size(&io, 3 * page_size, 0);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	io_io_clean(&io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
 }
 
-static void testIO_WRITE_BUFFER_CLEAN(void)
+static void testIO_READ_OVERFLOW(void)
 {
-#define MSG "titi tata toto"
 	int ret;
-	struct io_io_write_buffer buf;
+	int sockets[2];
+	struct io_mon mon;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	size_t page_size = sysconf(_SC_PAGE_SIZE);
+	char *buf;
+	ssize_t sret;
+	size_t received = 0;
+	int overflows = 0;
+	int loops = 0;
+	int io_cb(struct io_io *local_io, struct rs_rb *rb, void *data)
+	{
+		return 0;
+	}
+	void overflow_cb(struct io_io *local_io, struct rs_rb *rb, void *data)
+	{
+		CU_ASSERT_EQUAL(rs_rb_get_write_length(rb), 0);
+		overflows++;
+	}
 
 	/* initialization */
-	ret = io_io_write_buffer_init(&buf, dummy_write_cb, (void *) 42,
-			sizeof(MSG), MSG);
+	buf = calloc(3, page_size);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_read_set_buffer_size(io, page_size, 2 * page_size);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_read_set_overflow_cb(io, overflow_cb);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_read_start(io, io_cb, NULL, 0);
 	CU_ASSERT_EQUAL(ret, 0);
 
 	/* normal use cases */
-	ret = io_io_write_buffer_clean(&buf);
+	sret = write(sockets[1], buf, 3 * page_size);
+	CU_ASSERT_EQUAL(sret, 3 * page_size);
+	while (overflows == 0 && loops++ < 10)
+		io_mon_poll(&mon, 1000);
+	/* the ring buffer has grown, but no data was lost */
+	CU_ASSERT_EQUAL(overflows, 1);
+	CU_ASSERT(io_io_is_read_paused(io));
+	CU_ASSERT_EQUAL(rs_rb_get_size(&io->readctx.rb), 2 * page_size);
+	CU_ASSERT_EQUAL(rs_rb_get_read_length(&io->readctx.rb), 2 * page_size);
+	ret = io_io_read_resume(io);
+	CU_ASSERT_EQUAL(ret, -ENOBUFS);
+	ret = io_mon_poll(&mon, 100);
 	CU_ASSERT_EQUAL(ret, 0);
+	received += rs_rb_get_read_length(&io->readctx.rb);
+	rs_rb_empty(&io->readctx.rb);
+	ret = io_io_read_resume(io);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT(!io_io_is_read_paused(io));
+	loops = 0;
+	while (rs_rb_get_read_length(&io->readctx.rb) < page_size &&
+			loops++ < 10)
+		io_mon_poll(&mon, 1000);
+	received += rs_rb_get_read_length(&io->readctx.rb);
+	CU_ASSERT_EQUAL(received, 3 * page_size);
+	CU_ASSERT_EQUAL(overflows, 1);
+
+	/* the peer hangs up while reading is paused, the data aren't lost */
+	rs_rb_empty(&io->readctx.rb);
+	received = 0;
+	sret = write(sockets[1], buf, 3 * page_size);
+	CU_ASSERT_EQUAL(sret, 3 * page_size);
+	ut_file_fd_close(sockets + 1);
+	loops = 0;
+	while (!io_io_has_read_error(io) && loops++ < 100) {
+		io_mon_poll(&mon, 10);
+		if (!io_io_is_read_paused(io))
+			continue;
+		/* the hang up is reported meanwhile */
+		ret = io_mon_poll(&mon, 10);
+		CU_ASSERT(ret >= 0);
+		CU_ASSERT(io_io_is_read_paused(io));
+		received += rs_rb_get_read_length(&io->readctx.rb);
+		rs_rb_empty(&io->readctx.rb);
+		ret = io_io_read_resume(io);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	CU_ASSERT(io_io_has_read_error(io));
+	received += rs_rb_get_read_length(&io->readctx.rb);
+	CU_ASSERT_EQUAL(received, 3 * page_size);
+	CU_ASSERT_EQUAL(overflows, 2);
 
 	/* error use cases */
-	ret = io_io_write_buffer_clean(NULL);
+	ret = io_io_read_set_overflow_cb(NULL, overflow_cb);
 	CU_ASSERT_NOT_EQUAL(ret, 0);
-#undef MSG
+	ret = io_io_read_resume(NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	CU_ASSERT(!io_io_is_read_paused(NULL));
+
+	/* cleanup */
+	free(buf);
+	io_io_clean(io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
 }
 
-static const struct test_t tests[] = {
-		{
-				.fn = testIO_INIT,
-				.name = "io_io_init"
-		},
-		{
-				.fn = testIO_CLEAN,
-				.name = "io_io_clean"
-		},
-		{
-				.fn = testIO_READ_START,
-				.name = "io_io_read_start"
-		},
-		{
-				.fn = testIO_LOG_RX,
-				.name = "io_io_log_rx"
-		},
-		{
-				.fn = testIO_LOG_TX,
-				.name = "io_io_log_tx"
-		},
-		{
-				.fn = testIO_READ_STOP,
-				.name = "io_io_read_stop"
-		},
-		{
-				.fn = testIO_IS_READ_STARTED,
-				.name = "io_io_is_read_started"
-		},
-		{
-				.fn = testIO_HAS_READ_ERROR,
-				.name = "io_io_has_read_error"
-		},
-		{
-				.fn = testIO_WRITE_ADD,
-				.name = "io_io_write_add"
-		},
-		{
-				.fn = testIO_ABORT,
-				.name = "io_io_write_abort"
-		},
-		{
-				.fn = testIO_SIMPLE_USE_CASE,
-				.name = "io_simple_use_case"
+static void testIO_READ_BATCHING(void)
+{
+	int ret;
+	int sockets[2];
+	struct io_mon mon;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	size_t page_size = sysconf(_SC_PAGE_SIZE);
+	char *buf;
+	ssize_t sret;
+	int notifications = 0;
+	size_t notified = 0;
+	int io_cb(struct io_io *local_io, struct rs_rb *rb, void *data)
+	{
+		notifications++;
+		notified = rs_rb_get_read_length(rb);
+		rs_rb_empty(rb);
+
+		return 0;
+	}
+
+	/* initialization */
+	buf = calloc(3, page_size);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_read_set_buffer_size(io, page_size, 4 * page_size);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_read_start(io, io_cb, NULL, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	/* one notification for all the data read during one event */
+	sret = write(sockets[1], buf, 3 * page_size);
+	CU_ASSERT_EQUAL(sret, 3 * page_size);
+	ret = io_mon_poll(&mon, 1000);
+	CU_ASSERT(ret >= 0);
+	CU_ASSERT_EQUAL(notifications, 1);
+	CU_ASSERT_EQUAL(notified, 3 * page_size);
+
+	/* no notification until the threshold is reached */
+	notifications = 0;
+	ret = io_io_read_set_threshold(io, 100);
+	CU_ASSERT_EQUAL(ret, 0);
+	sret = write(sockets[1], buf, 50);
+	CU_ASSERT_EQUAL(sret, 50);
+	ret = io_mon_poll(&mon, 1000);
+	CU_ASSERT(ret >= 0);
+	CU_ASSERT_EQUAL(notifications, 0);
+	sret = write(sockets[1], buf, 60);
+	CU_ASSERT_EQUAL(sret, 60);
+	ret = io_mon_poll(&mon, 1000);
+	CU_ASSERT(ret >= 0);
+	CU_ASSERT_EQUAL(notifications, 1);
+	CU_ASSERT_EQUAL(notified, 110);
+
+	/* error use cases */
+	ret = io_io_read_set_threshold(NULL, 100);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	free(buf);
+	io_io_clean(io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+}
+
+static void testIO_WRITE_COALESCING(void)
+{
+#define NB_BUFFERS 1000
+#define CHUNK_SIZE 1000
+	int ret;
+	int sockets[2];
+	struct io_mon mon;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	struct io_io_write_buffer *buffers;
+	uint8_t *data;
+	uint8_t rx[CHUNK_SIZE];
+	ssize_t sret;
+	size_t received = 0;
+	int count = 0;
+	int loops = 0;
+	int corrupted = 0;
+	int i;
+	void write_cb(struct io_io_write_buffer *buffer,
+		enum io_io_write_status status)
+	{
+		CU_ASSERT_EQUAL(status, IO_IO_WRITE_OK);
+		/* buffers must complete in order */
+		CU_ASSERT_PTR_EQUAL(buffer, buffers + count);
+		count++;
+	}
+
+	/* initialization */
+	buffers = calloc(NB_BUFFERS, sizeof(*buffers));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buffers);
+	data = malloc(NB_BUFFERS * CHUNK_SIZE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+	for (i = 0; i < NB_BUFFERS * CHUNK_SIZE; i++)
+		data[i] = i % 251;
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	for (i = 0; i < NB_BUFFERS; i++) {
+		ret = io_io_write_buffer_init(buffers + i, write_cb, NULL,
+				CHUNK_SIZE, data + i * CHUNK_SIZE);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = io_io_write_add(io, buffers + i);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	/* the socket's buffer is too small, writes are partial */
+	while (received < NB_BUFFERS * CHUNK_SIZE && loops++ < 10000) {
+		io_mon_poll(&mon, 100);
+		while ((sret = read(sockets[1], rx, CHUNK_SIZE)) > 0) {
+			for (i = 0; i < sret; i++)
+				if (rx[i] != (received + i) % 251)
+					corrupted = 1;
+			received += sret;
+		}
+	}
+	CU_ASSERT_EQUAL(received, NB_BUFFERS * CHUNK_SIZE);
+	CU_ASSERT_EQUAL(count, NB_BUFFERS);
+	CU_ASSERT(!corrupted);
+	/* much less wakeups than buffers were needed */
+	CU_ASSERT(loops < NB_BUFFERS);
+
+	/* cleanup */
+	io_io_clean(io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+	free(data);
+	free(buffers);
+#undef CHUNK_SIZE
+#undef NB_BUFFERS
+}
+
+static void testIO_WRITE_ORDER(void)
+{
+	int ret;
+	int sockets[2];
+	int other_sockets[2];
+	struct io_mon mon;
+	struct io_io io;
+	struct io_io other;
+	struct io_io *doomed;
+	struct io_io_write_buffer buffers[4];
+	struct io_io_write_buffer *order[4];
+	struct io_io_write_buffer other_buffer;
+	uint8_t fill[4096];
+	uint8_t data[4] = {'a', 'b', 'c', 'd'};
+	ssize_t sret;
+	int count = 0;
+	int other_count = 0;
+	int loops = 0;
+	int i;
+	void other_cb(struct io_io_write_buffer *buffer,
+		enum io_io_write_status status)
+	{
+		CU_ASSERT_EQUAL(status, IO_IO_WRITE_OK);
+		other_count++;
+	}
+	void doom_cb(struct io_io_write_buffer *buffer,
+		enum io_io_write_status status)
+	{
+		io_io_clean(doomed);
+		free(doomed);
+		doomed = NULL;
+	}
+	void write_cb(struct io_io_write_buffer *buffer,
+		enum io_io_write_status status)
+	{
+		CU_ASSERT_EQUAL(status, IO_IO_WRITE_OK);
+		order[count++] = buffer;
+		/* queued while b and c are still to be notified */
+		if (buffer == buffers + 0) {
+			ret = io_io_write_add(&io, buffers + 3);
+			CU_ASSERT_EQUAL(ret, 0);
+		}
+		/* whereas another io is still written to at once */
+		if (buffer == buffers + 1) {
+			ret = io_io_write_add(&other, &other_buffer);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(other_count, 1);
+		}
+	}
+
+	/* initialization */
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_init(&io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	for (i = 0; i < 4; i++) {
+		ret = io_io_write_buffer_init(buffers + i, write_cb, NULL, 1,
+				data + i);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			other_sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_init(&other, &mon, SUITE_NAME, other_sockets[0],
+			other_sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_write_buffer_init(&other_buffer, other_cb, NULL, 1, data);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	/* a, b and c complete in the same write ready event */
+	memset(fill, 0, sizeof(fill));
+	while (write(sockets[0], fill, sizeof(fill)) > 0)
+		;
+	for (i = 0; i < 3; i++) {
+		ret = io_io_write_add(&io, buffers + i);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	CU_ASSERT_EQUAL(count, 0);
+	while ((sret = read(sockets[1], fill, sizeof(fill))) > 0)
+		;
+	while (count < 4 && loops++ < 10)
+		io_mon_poll(&mon, 100);
+	CU_ASSERT_EQUAL_FATAL(count, 4);
+	for (i = 0; i < 4; i++)
+		CU_ASSERT_PTR_EQUAL(order[i], buffers + i);
+	sret = read(sockets[1], fill, sizeof(fill));
+	CU_ASSERT_EQUAL(sret, 4);
+	CU_ASSERT_EQUAL(memcmp(fill, data, sizeof(data)), 0);
+	CU_ASSERT_EQUAL(other_count, 1);
+	sret = read(other_sockets[1], fill, sizeof(fill));
+	CU_ASSERT_EQUAL(sret, 1);
+
+	/* an io destroyed by the callback of its buffer isn't accessed after */
+	io_io_clean(&other);
+	doomed = calloc(1, sizeof(*doomed));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(doomed);
+	ret = io_io_init(doomed, &mon, SUITE_NAME, other_sockets[0],
+			other_sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_write_buffer_init(&other_buffer, doom_cb, NULL, 1, data);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_write_add(doomed, &other_buffer);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_NULL(doomed);
+
+	/* cleanup */
+	io_io_clean(&io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(other_sockets + 0);
+	ut_file_fd_close(other_sockets + 1);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+}
+
+static void testIO_WRITE_TIMEOUT(void)
+{
+	int ret;
+	int sockets[2];
+	struct io_mon mon;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	struct io_io_write_buffer small;
+	struct io_io_write_buffer big;
+	size_t big_size = 4 * 1024 * 1024;
+	char *big_data;
+	char rx[16];
+	ssize_t sret;
+	int loops = 0;
+	int notified = 0;
+	enum io_io_write_status last_status = IO_IO_WRITE_OK;
+	void write_cb(struct io_io_write_buffer *buffer,
+		enum io_io_write_status status)
+	{
+		last_status = status;
+		notified++;
+	}
+
+	/* initialization */
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io->writectx.timeout = 100;
+	ret = io_io_write_buffer_init(&small, write_cb, NULL, 5, "hello");
+	CU_ASSERT_EQUAL(ret, 0);
+	big_data = calloc(1, big_size);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(big_data);
+	ret = io_io_write_buffer_init(&big, write_cb, NULL, big_size, big_data);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	/* a buffer written at once doesn't even arm the timer */
+	ret = io_io_write_add(io, &small);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(notified, 1);
+	CU_ASSERT_EQUAL(last_status, IO_IO_WRITE_OK);
+	CU_ASSERT(!io->extra->timer_armed);
+	CU_ASSERT_EQUAL(io->writectx.deadline, 0);
+	sret = read(sockets[1], rx, sizeof(rx));
+	CU_ASSERT_EQUAL(sret, 5);
+
+	/* a buffer which can't be written in time still times out */
+	ret = io_io_write_add(io, &big);
+	CU_ASSERT_EQUAL(ret, 0);
+	loops = 0;
+	while (notified == 1 && loops++ < 50)
+		io_mon_poll(&mon, 100);
+	CU_ASSERT_EQUAL(notified, 2);
+	CU_ASSERT_EQUAL(last_status, IO_IO_WRITE_TIMEOUT);
+	CU_ASSERT_EQUAL(io->writectx.deadline, 0);
+
+	/* cleanup */
+	free(big_data);
+	io_io_clean(io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+}
+
+static void testIO_WRITE_SHARED(void)
+{
+#define NB_IOS 3
+	int ret;
+	int sockets[NB_IOS][2];
+	struct io_mon mon;
+	/* here ios are allocated because of the stack's size */
+	struct io_io *ios;
+	struct io_io_shared_buffer shared;
+	const char payload[] = "telemetry";
+	char rx[sizeof(payload)];
+	ssize_t sret;
+	int released = 0;
+	int i;
+	void release_cb(struct io_io_shared_buffer *local_shared, void *data)
+	{
+		CU_ASSERT_PTR_EQUAL(local_shared, &shared);
+		CU_ASSERT_PTR_EQUAL(data, &shared);
+		released++;
+	}
+
+	/* initialization */
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ios = calloc(NB_IOS, sizeof(*ios));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ios);
+	for (i = 0; i < NB_IOS; i++) {
+		ret = socketpair(AF_UNIX,
+				SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+				sockets[i]);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+		ret = io_io_init(ios + i, &mon, SUITE_NAME, sockets[i][0],
+				sockets[i][0], 1);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+	}
+
+	/* normal use cases */
+	/* one payload written to all the ios */
+	ret = io_io_shared_buffer_init(&shared, release_cb, &shared,
+			sizeof(payload), payload);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (i = 0; i < NB_IOS; i++) {
+		ret = io_io_write_add_shared(ios + i, &shared);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	/* the ios being idle, each one has written the payload at once */
+	CU_ASSERT_EQUAL(shared.refcount, 1);
+	io_io_shared_buffer_unref(&shared);
+	CU_ASSERT_EQUAL(released, 1);
+	CU_ASSERT_EQUAL(shared.refcount, 0);
+	for (i = 0; i < NB_IOS; i++) {
+		sret = read(sockets[i][1], rx, sizeof(rx));
+		CU_ASSERT_EQUAL(sret, sizeof(payload));
+		CU_ASSERT_STRING_EQUAL(rx, payload);
+	}
+
+	/* aborted writes drop their reference too */
+	released = 0;
+	ret = io_io_shared_buffer_init(&shared, release_cb, &shared,
+			sizeof(payload), payload);
+	CU_ASSERT_EQUAL(ret, 0);
+	/* queued behind copied data, which are only written on write ready */
+	ret = io_io_write_copy(ios + 0, payload, sizeof(payload));
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_write_add_shared(ios + 0, &shared);
+	CU_ASSERT_EQUAL(ret, 0);
+	io_io_shared_buffer_unref(&shared);
+	CU_ASSERT_EQUAL(released, 0);
+	ret = io_io_write_abort(ios + 0);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(released, 1);
+
+	/* error use cases */
+	ret = io_io_shared_buffer_init(NULL, release_cb, NULL, sizeof(payload),
+			payload);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_shared_buffer_init(&shared, release_cb, NULL, 0, payload);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_shared_buffer_init(&shared, release_cb, NULL,
+			sizeof(payload), NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_add_shared(NULL, &shared);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_add_shared(ios + 0, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	/* all the references are released */
+	ret = io_io_write_add_shared(ios + 0, &shared);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_NULL(io_io_shared_buffer_ref(NULL));
+	io_io_shared_buffer_unref(NULL);
+
+	/* cleanup */
+	for (i = 0; i < NB_IOS; i++) {
+		io_io_clean(ios + i);
+		ut_file_fd_close(sockets[i] + 0);
+		ut_file_fd_close(sockets[i] + 1);
+	}
+	free(ios);
+	io_mon_clean(&mon);
+#undef NB_IOS
+}
+
+static int tcp_socketpair(int sockets[2])
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(addr);
+	int listener;
+	int ret = -1;
+
+	listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listener == -1)
+		return -1;
+	if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+			listen(listener, 1) == -1 ||
+			getsockname(listener, (struct sockaddr *)&addr,
+					&len) == -1)
+		goto out;
+	sockets[0] = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sockets[0] == -1)
+		goto out;
+	if (connect(sockets[0], (struct sockaddr *)&addr, sizeof(addr)) == -1)
+		goto out;
+	sockets[1] = accept(listener, NULL, NULL);
+	if (sockets[1] == -1)
+		goto out;
+	if (fcntl(sockets[0], F_SETFL, O_NONBLOCK) == -1 ||
+			fcntl(sockets[1], F_SETFL, O_NONBLOCK) == -1)
+		goto out;
+	ret = 0;
+out:
+	close(listener);
+
+	return ret;
+}
+
+static void testIO_WRITE_ZEROCOPY(void)
+{
+#define BIG_SIZE (256 * 1024)
+	int ret;
+	int sockets[2];
+	struct io_mon mon;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	struct io_io_write_buffer buffers[3];
+	char small[100];
+	char *big;
+	char *rx;
+	ssize_t sret;
+	size_t received = 0;
+	size_t expected = 2 * sizeof(small) + BIG_SIZE;
+	int notified = 0;
+	int aborted = 0;
+	int ended = 0;
+	enum io_io_write_status end_status = IO_IO_WRITE_OK;
+	void (*old_handler)(int);
+	int bufsize = 16384;
+	int loops = 0;
+	int i;
+	void write_cb(struct io_io_write_buffer *buffer,
+		enum io_io_write_status status)
+	{
+		CU_ASSERT_EQUAL(status, IO_IO_WRITE_OK);
+		notified++;
+	}
+	void abort_cb(struct io_io_write_buffer *buffer,
+		enum io_io_write_status status)
+	{
+		CU_ASSERT_EQUAL(status, IO_IO_WRITE_ABORTED);
+		aborted++;
+	}
+	void end_cb(struct io_io_write_buffer *buffer,
+		enum io_io_write_status status)
+	{
+		end_status = status;
+		ended++;
+	}
+
+	/* initialization */
+	big = malloc(BIG_SIZE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(big);
+	rx = malloc(expected);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rx);
+	memset(small, 's', sizeof(small));
+	for (i = 0; i < BIG_SIZE; i++)
+		big[i] = i % 251;
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = tcp_socketpair(sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	ret = io_io_write_set_zerocopy(io, 4096);
+	CU_ASSERT_EQUAL(ret, 0);
+	io_io_write_buffer_init(buffers + 0, write_cb, NULL, sizeof(small),
+			small);
+	io_io_write_buffer_init(buffers + 1, write_cb, NULL, BIG_SIZE, big);
+	io_io_write_buffer_init(buffers + 2, write_cb, NULL, sizeof(small),
+			small);
+	for (i = 0; i < 3; i++) {
+		ret = io_io_write_add(io, buffers + i);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	while ((notified < 3 || received < expected) && loops++ < 1000) {
+		io_mon_poll(&mon, 10);
+		while ((sret = read(sockets[1], rx + received,
+				expected - received)) > 0)
+			received += sret;
+	}
+	CU_ASSERT_EQUAL(notified, 3);
+	CU_ASSERT_EQUAL(received, expected);
+	CU_ASSERT(memcmp(rx + sizeof(small), big, BIG_SIZE) == 0);
+	CU_ASSERT(rs_dll_is_empty(&io->extra->zc_pending));
+	/* the io survived the error queue notifications */
+	CU_ASSERT(io_mon_is_registered(&mon, &io->src));
+
+	/* aborting doesn't release the buffers the kernel still uses */
+	notified = 0;
+	io_io_write_buffer_init(buffers + 1, write_cb, NULL, 8192, big);
+	ret = io_io_write_add(io, buffers + 1);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_NULL(io->writectx.current);
+	ret = io_io_write_abort(io);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(notified, 0);
+	CU_ASSERT(!rs_dll_is_empty(&io->extra->zc_pending));
+	/* sent before the abort, hence notified as written once released */
+	received = 0;
+	loops = 0;
+	while (notified < 1 && loops++ < 1000) {
+		io_mon_poll(&mon, 10);
+		while ((sret = read(sockets[1], rx, expected)) > 0)
+			received += sret;
+	}
+	CU_ASSERT_EQUAL(notified, 1);
+	CU_ASSERT(rs_dll_is_empty(&io->extra->zc_pending));
+
+	/* neither the one partially sent, notified as aborted once released */
+	ret = setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &bufsize,
+			sizeof(bufsize));
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = setsockopt(sockets[1], SOL_SOCKET, SO_RCVBUF, &bufsize,
+			sizeof(bufsize));
+	CU_ASSERT_EQUAL(ret, 0);
+	aborted = 0;
+	io_io_write_buffer_init(buffers + 1, abort_cb, NULL, BIG_SIZE, big);
+	ret = io_io_write_add(io, buffers + 1);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_FATAL(io->writectx.current == buffers + 1);
+	CU_ASSERT(io->writectx.nbwritten > 0);
+	ret = io_io_write_abort(io);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(aborted, 0);
+	CU_ASSERT_PTR_NULL(io->writectx.current);
+	loops = 0;
+	while (aborted < 1 && loops++ < 1000) {
+		io_mon_poll(&mon, 10);
+		while ((sret = read(sockets[1], rx, expected)) > 0)
+			received += sret;
+	}
+	CU_ASSERT_EQUAL(aborted, 1);
+	CU_ASSERT(rs_dll_is_empty(&io->extra->zc_pending));
+
+	/* even if zero-copy is disabled meanwhile */
+	aborted = 0;
+	io_io_write_buffer_init(buffers + 1, abort_cb, NULL, BIG_SIZE, big);
+	ret = io_io_write_add(io, buffers + 1);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT(io->writectx.nbwritten > 0);
+	ret = io_io_write_set_zerocopy(io, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_write_abort(io);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(aborted, 0);
+	loops = 0;
+	while (aborted < 1 && loops++ < 1000) {
+		io_mon_poll(&mon, 10);
+		while ((sret = read(sockets[1], rx, expected)) > 0)
+			received += sret;
+	}
+	CU_ASSERT_EQUAL(aborted, 1);
+	CU_ASSERT(rs_dll_is_empty(&io->extra->zc_pending));
+
+	/* whereas a buffer only copied so far isn't kept, whatever the size */
+	ret = io_io_write_set_zerocopy(io, 2 * BIG_SIZE);
+	CU_ASSERT_EQUAL(ret, 0);
+	aborted = 0;
+	io_io_write_buffer_init(buffers + 1, abort_cb, NULL, BIG_SIZE, big);
+	ret = io_io_write_add(io, buffers + 1);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT(io->writectx.nbwritten > 0);
+	ret = io_io_write_set_zerocopy(io, 4096);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_write_abort(io);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(aborted, 1);
+	CU_ASSERT(rs_dll_is_empty(&io->extra->zc_pending));
+	/* the part sent still has to be drained */
+	for (loops = 0; loops < 10; loops++) {
+		io_mon_poll(&mon, 10);
+		while ((sret = read(sockets[1], rx, expected)) > 0)
+			received += sret;
+	}
+
+	/* nor the one partially sent whose write times out */
+	io->writectx.timeout = 100;
+	io_io_write_buffer_init(buffers + 1, end_cb, NULL, BIG_SIZE, big);
+	ret = io_io_write_add(io, buffers + 1);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT(io->writectx.nbwritten > 0);
+	loops = 0;
+	while (io->writectx.current != NULL && loops++ < 1000)
+		io_mon_poll(&mon, 10);
+	CU_ASSERT_PTR_NULL(io->writectx.current);
+	CU_ASSERT_EQUAL(ended, 0);
+	CU_ASSERT(!rs_dll_is_empty(&io->extra->zc_pending));
+	loops = 0;
+	while (ended < 1 && loops++ < 1000) {
+		io_mon_poll(&mon, 10);
+		while ((sret = read(sockets[1], rx, expected)) > 0)
+			received += sret;
+	}
+	CU_ASSERT_EQUAL(ended, 1);
+	CU_ASSERT_EQUAL(end_status, IO_IO_WRITE_TIMEOUT);
+	CU_ASSERT(rs_dll_is_empty(&io->extra->zc_pending));
+	io->writectx.timeout = 10000;
+	/* the part sent still has to be drained */
+	for (loops = 0; loops < 10; loops++) {
+		io_mon_poll(&mon, 10);
+		while ((sret = read(sockets[1], rx, expected)) > 0)
+			received += sret;
+	}
+
+	/* nor the one partially sent whose write fails */
+	old_handler = signal(SIGPIPE, SIG_IGN);
+	ended = 0;
+	io_io_write_buffer_init(buffers + 1, end_cb, NULL, BIG_SIZE, big);
+	ret = io_io_write_add(io, buffers + 1);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT(io->writectx.nbwritten > 0);
+	/* the next send fails with EPIPE */
+	ret = shutdown(sockets[0], SHUT_WR);
+	CU_ASSERT_EQUAL(ret, 0);
+	loops = 0;
+	while (io->writectx.current != NULL && loops++ < 1000)
+		io_mon_poll(&mon, 10);
+	CU_ASSERT_PTR_NULL(io->writectx.current);
+	CU_ASSERT_EQUAL(ended, 0);
+	CU_ASSERT(!rs_dll_is_empty(&io->extra->zc_pending));
+	loops = 0;
+	while (ended < 1 && loops++ < 1000) {
+		io_mon_poll(&mon, 10);
+		while ((sret = read(sockets[1], rx, expected)) > 0)
+			received += sret;
+	}
+	CU_ASSERT_EQUAL(ended, 1);
+	CU_ASSERT_EQUAL(end_status, IO_IO_WRITE_ERROR);
+	CU_ASSERT(rs_dll_is_empty(&io->extra->zc_pending));
+	signal(SIGPIPE, old_handler);
+	ret = io_io_write_set_zerocopy(io, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* error use cases */
+	ret = io_io_write_set_zerocopy(NULL, 4096);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	io_io_clean(io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+	free(rx);
+	free(big);
+#undef BIG_SIZE
+}
+
+static void testIO_WRITE_FILE(void)
+{
+#define FILE_SIZE (1024 * 1024)
+	int ret;
+	int sockets[2];
+	struct io_mon mon;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	struct io_io_write_buffer buffers[3];
+	FILE *file;
+	char *content;
+	char *rx;
+	ssize_t sret;
+	size_t received = 0;
+	size_t expected = 2 * 5 + FILE_SIZE - 10;
+	int notified = 0;
+	int loops = 0;
+	int i;
+	void write_cb(struct io_io_write_buffer *buffer,
+		enum io_io_write_status status)
+	{
+		CU_ASSERT_EQUAL(status, IO_IO_WRITE_OK);
+		CU_ASSERT_PTR_EQUAL(buffer, buffers + notified);
+		notified++;
+	}
+
+	/* initialization */
+	content = malloc(FILE_SIZE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(content);
+	rx = malloc(expected);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rx);
+	for (i = 0; i < FILE_SIZE; i++)
+		content[i] = i % 251;
+	file = tmpfile();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+	CU_ASSERT_EQUAL(fwrite(content, 1, FILE_SIZE, file), FILE_SIZE);
+	fflush(file);
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	/* the file's content is sent in order, between memory buffers */
+	io_io_write_buffer_init(buffers + 0, write_cb, NULL, 5, "head:");
+	ret = io_io_write_file_init(buffers + 1, write_cb, NULL, fileno(file),
+			10, FILE_SIZE - 10);
+	CU_ASSERT_EQUAL(ret, 0);
+	io_io_write_buffer_init(buffers + 2, write_cb, NULL, 5, ":tail");
+	for (i = 0; i < 3; i++) {
+		ret = io_io_write_add(io, buffers + i);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	while ((notified < 3 || received < expected) && loops++ < 10000) {
+		io_mon_poll(&mon, 10);
+		while ((sret = read(sockets[1], rx + received,
+				expected - received)) > 0)
+			received += sret;
+	}
+	CU_ASSERT_EQUAL(notified, 3);
+	CU_ASSERT_EQUAL(received, expected);
+	CU_ASSERT(memcmp(rx, "head:", 5) == 0);
+	CU_ASSERT(memcmp(rx + 5, content + 10, FILE_SIZE - 10) == 0);
+	CU_ASSERT(memcmp(rx + expected - 5, ":tail", 5) == 0);
+	/* the file offset is left untouched */
+	CU_ASSERT_EQUAL(lseek(fileno(file), 0, SEEK_CUR), FILE_SIZE);
+
+	/* error use cases */
+	ret = io_io_write_file_init(NULL, write_cb, NULL, fileno(file), 0, 1);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_file_init(buffers, write_cb, NULL, -1, 0, 1);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_file_init(buffers, write_cb, NULL, fileno(file), -1,
+			1);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_file_init(buffers, write_cb, NULL, fileno(file), 0,
+			0);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	io_io_clean(io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+	fclose(file);
+	free(rx);
+	free(content);
+#undef FILE_SIZE
+}
+
+static void testIO_STATS(void)
+{
+	int ret;
+	int sockets[2];
+	struct io_mon mon;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	struct io_io_write_buffer buffers[3];
+	struct io_io_stats stats;
+	char rx[16];
+	ssize_t sret;
+	int notified = 0;
+	int i;
+	int io_cb(struct io_io *local_io, struct rs_rb *rb, void *data)
+	{
+		rs_rb_empty(rb);
+
+		return 0;
+	}
+	void write_cb(struct io_io_write_buffer *buffer,
+		enum io_io_write_status status)
+	{
+		notified++;
+	}
+
+	/* initialization */
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_read_start(io, io_cb, NULL, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	ret = io_io_get_stats(io, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(stats.nbread, 0);
+	CU_ASSERT_EQUAL(stats.nbwritten, 0);
+	sret = write(sockets[1], "hello", 5);
+	CU_ASSERT_EQUAL(sret, 5);
+	for (i = 0; i < 3; i++) {
+		io_io_write_buffer_init(buffers + i, write_cb, NULL, 4, "abcd");
+		ret = io_io_write_add(io, buffers + i);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	CU_ASSERT_EQUAL(notified, 3);
+	/* the data sent by the peer are read on the next poll */
+	io_mon_poll(&mon, 1000);
+	sret = read(sockets[1], rx, sizeof(rx));
+	CU_ASSERT_EQUAL(sret, 12);
+	ret = io_io_get_stats(io, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(stats.nbread, 5);
+	CU_ASSERT_EQUAL(stats.nbwritten, 12);
+	/* one successful read, then EAGAIN */
+	CU_ASSERT_EQUAL(stats.read_calls, 2);
+	CU_ASSERT_EQUAL(stats.read_eagain, 1);
+	/* the io being idle, each buffer is written at once */
+	CU_ASSERT_EQUAL(stats.write_calls, 3);
+	CU_ASSERT_EQUAL(stats.write_eagain, 0);
+	CU_ASSERT_EQUAL(stats.queue_max, 1);
+	CU_ASSERT_EQUAL(stats.ring_max, 5);
+	CU_ASSERT_EQUAL(stats.timeouts, 0);
+	CU_ASSERT_EQUAL(stats.aborts, 0);
+	ret = io_io_write_copy(io, "abcd", 4);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_write_abort(io);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_get_stats(io, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(stats.aborts, 1);
+	ret = io_io_reset_stats(io);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_get_stats(io, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(stats.nbread, 0);
+	CU_ASSERT_EQUAL(stats.aborts, 0);
+	CU_ASSERT_EQUAL(stats.queue_max, 0);
+
+	/* error use cases */
+	ret = io_io_get_stats(NULL, &stats);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_get_stats(io, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_reset_stats(NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	io_io_clean(io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+}
+
+static void testIO_WRITE_WATERMARKS(void)
+{
+#define NB_BUFFERS 4
+#define CHUNK_SIZE (64 * 1024)
+	int ret;
+	int sockets[2];
+	struct io_mon mon;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	struct io_io_write_buffer buffers[NB_BUFFERS];
+	char *data;
+	char *rx;
+	ssize_t sret;
+	int highs = 0;
+	int lows = 0;
+	int loops = 0;
+	int i;
+	void wm_cb(struct io_io *local_io, bool high, void *cb_data)
+	{
+		CU_ASSERT_PTR_EQUAL(local_io, io);
+		CU_ASSERT_EQUAL(io_io_write_is_above_watermark(local_io), high);
+		if (high)
+			highs++;
+		else
+			lows++;
+	}
+
+	/* initialization */
+	data = calloc(1, CHUNK_SIZE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+	rx = malloc(CHUNK_SIZE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rx);
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	/* keep the socket's buffer small, for the queue to fill up */
+	i = 4096;
+	ret = setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &i, sizeof(i));
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_write_set_watermarks(io, CHUNK_SIZE, 2 * CHUNK_SIZE, wm_cb,
+			NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT(!io_io_write_is_above_watermark(io));
+	for (i = 0; i < NB_BUFFERS; i++) {
+		io_io_write_buffer_init(buffers + i, NULL, NULL, CHUNK_SIZE,
+				data);
+		ret = io_io_write_add(io, buffers + i);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	/* the first buffer is partly written at once */
+	CU_ASSERT(io_io_write_get_queued(io) > 2 * CHUNK_SIZE);
+	CU_ASSERT_EQUAL(highs, 1);
+	CU_ASSERT(io_io_write_is_above_watermark(io));
+	/* the peer doesn't read, the queue can't drain */
+	io_mon_poll(&mon, 100);
+	CU_ASSERT(io_io_write_get_queued(io) > 0);
+	CU_ASSERT_EQUAL(lows, 0);
+	/* the peer reads, the queue drains */
+	while (io_io_write_get_queued(io) > 0 && loops++ < 1000) {
+		while ((sret = read(sockets[1], rx, CHUNK_SIZE)) > 0);
+		io_mon_poll(&mon, 10);
+	}
+	CU_ASSERT_EQUAL(io_io_write_get_queued(io), 0);
+	CU_ASSERT_EQUAL(highs, 1);
+	CU_ASSERT_EQUAL(lows, 1);
+	CU_ASSERT(!io_io_write_is_above_watermark(io));
+
+	/* error use cases */
+	ret = io_io_write_set_watermarks(NULL, 1, 2, wm_cb, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_set_watermarks(io, 2, 2, wm_cb, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	CU_ASSERT(!io_io_write_is_above_watermark(NULL));
+	CU_ASSERT_EQUAL(io_io_write_get_queued(NULL), 0);
+
+	/* cleanup */
+	io_io_clean(io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+	free(rx);
+	free(data);
+#undef CHUNK_SIZE
+#undef NB_BUFFERS
+}
+
+static void testIO_WRITE_COPY(void)
+{
+#define NB_MESSAGES 2000
+	int ret;
+	int sockets[2];
+	struct io_mon mon;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	struct io_io_stats stats;
+	char message[32];
+	char *rx;
+	ssize_t sret;
+	size_t received = 0;
+	size_t expected = 0;
+	int loops = 0;
+	int i;
+
+	/* initialization */
+	rx = malloc(NB_MESSAGES * sizeof(message));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rx);
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	for (i = 0; i < NB_MESSAGES; i++) {
+		snprintf(message, sizeof(message), "message %d\n", i);
+		ret = io_io_write_copy(io, message, strlen(message));
+		CU_ASSERT_EQUAL(ret, 0);
+		expected += strlen(message);
+	}
+	/* small messages are coalesced in chunks */
+	CU_ASSERT(rs_dll_get_count(&io->writectx.normal) <=
+			expected / IO_IO_CHUNK_SIZE);
+	CU_ASSERT_EQUAL(io_io_write_get_queued(io), expected);
+	while (received < expected && loops++ < 1000) {
+		io_mon_poll(&mon, 10);
+		while ((sret = read(sockets[1], rx + received,
+				expected - received)) > 0)
+			received += sret;
+	}
+	CU_ASSERT_EQUAL(received, expected);
+	CU_ASSERT(memcmp(rx, "message 0\nmessage 1\n", 20) == 0);
+	CU_ASSERT(memcmp(rx + expected - 13, "message 1999\n", 13) == 0);
+	ret = io_io_get_stats(io, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT(stats.write_calls < 10);
+	/* the chunks written are kept for reuse */
+	CU_ASSERT(rs_dll_get_count(&io->extra->chunk_pool) > 0);
+	CU_ASSERT(rs_dll_get_count(&io->extra->chunk_pool) <=
+			IO_IO_CHUNK_POOL_SIZE);
+
+	/* error use cases */
+	ret = io_io_write_copy(NULL, message, 1);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_copy(io, NULL, 1);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_copy(io, message, 0);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	io_io_clean(io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+	free(rx);
+#undef NB_MESSAGES
+}
+
+static void testIO_READ_POST(void)
+{
+#define TILE_SIZE 65536
+	int ret;
+	int sockets[2];
+	struct io_mon mon;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	char *tile;
+	char *tx;
+	size_t tx_size = 3 + TILE_SIZE + 4;
+	size_t sent = 0;
+	ssize_t sret;
+	int loops = 0;
+	int posted = 0;
+	int filled = 0;
+	size_t filled_length = 0;
+	char tail[5] = {0};
+	void post_cb(struct io_io *local_io, void *buffer, size_t length,
+			int err, void *data)
+	{
+		CU_ASSERT_PTR_EQUAL(buffer, tile);
+		CU_ASSERT_EQUAL(err, 0);
+		filled_length = length;
+		filled++;
+	}
+	int io_cb(struct io_io *local_io, struct rs_rb *rb, void *data)
+	{
+		int cbret;
+
+		if (!posted) {
+			if (rs_rb_get_read_length(rb) < 3)
+				return 0;
+			CU_ASSERT(memcmp(rs_rb_get_read_ptr(rb), "hdr", 3) == 0);
+			rs_rb_read_incr(rb, 3);
+			posted = 1;
+			cbret = io_io_read_post(local_io, tile, TILE_SIZE,
+					post_cb, NULL);
+			CU_ASSERT_EQUAL(cbret, 0);
+			return 0;
+		}
+		if (rs_rb_get_read_length(rb) >= 4) {
+			memcpy(tail, rs_rb_get_read_ptr(rb), 4);
+			rs_rb_read_incr(rb, 4);
+		}
+
+		return 0;
+	}
+
+	/* initialization */
+	tile = malloc(TILE_SIZE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(tile);
+	tx = malloc(tx_size);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(tx);
+	memcpy(tx, "hdr", 3);
+	memset(tx + 3, 'x', TILE_SIZE);
+	memcpy(tx + 3 + TILE_SIZE, "tail", 4);
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_read_start(io, io_cb, NULL, 0);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	while ((sent < tx_size || tail[0] == '\0') && loops++ < 1000) {
+		sret = write(sockets[1], tx + sent, tx_size - sent);
+		if (sret > 0)
+			sent += sret;
+		io_mon_poll(&mon, 10);
+	}
+	CU_ASSERT_EQUAL(filled, 1);
+	CU_ASSERT_EQUAL(filled_length, TILE_SIZE);
+	CU_ASSERT_STRING_EQUAL(tail, "tail");
+	CU_ASSERT(memcmp(tile, tx + 3, TILE_SIZE) == 0);
+	/* the bulk of the tile didn't go through the ring buffer */
+	CU_ASSERT(rs_rb_get_size(&io->readctx.rb) < TILE_SIZE);
+
+	/* bytes already in the ring buffer fill the post synchronously */
+	sret = write(sockets[1], "abcdef", 6);
+	CU_ASSERT_EQUAL(sret, 6);
+	posted = 1;
+	tail[0] = '\0';
+	io_mon_poll(&mon, 100);
+	CU_ASSERT_STRING_EQUAL(tail, "abcd");
+	ret = io_io_read_post(io, tile, 2, post_cb, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(filled, 2);
+	CU_ASSERT_EQUAL(filled_length, 2);
+	CU_ASSERT(memcmp(tile, "ef", 2) == 0);
+
+	/* cancel */
+	ret = io_io_read_post(io, tile, TILE_SIZE, post_cb, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_read_post(io, tile, TILE_SIZE, post_cb, NULL);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+	ret = io_io_read_post_cancel(io);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_read_post_cancel(io);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+
+	/* error use cases */
+	ret = io_io_read_post(NULL, tile, TILE_SIZE, post_cb, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_read_post(io, NULL, TILE_SIZE, post_cb, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_read_post(io, tile, 0, post_cb, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_read_post(io, tile, TILE_SIZE, NULL, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_read_post_cancel(NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	io_io_read_stop(io);
+	ret = io_io_read_post(io, tile, TILE_SIZE, post_cb, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	io_io_clean(io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+	free(tx);
+	free(tile);
+#undef TILE_SIZE
+}
+
+static void testIO_COMPACT(void)
+{
+	int ret;
+	int sockets[2];
+	int sockets2[2];
+	int sndbuf = 4096;
+	struct io_mon mon;
+	struct io_io_timer_group group;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	struct io_io __attribute__((cleanup(io_free)))*io2 = NULL;
+	struct io_io_write_buffer buffer;
+	char *big_data;
+	size_t big_size = 1 << 20;
+	enum io_io_write_status status = IO_IO_WRITE_OK;
+	char rx[16] = {0};
+	char tx[16];
+	struct io_io_stats stats;
+	ssize_t sret;
+	int loops = 0;
+	int io_cb(struct io_io *local_io, struct rs_rb *rb, void *data)
+	{
+		size_t len = rs_rb_get_read_length(rb);
+
+		if (len >= sizeof(rx))
+			len = sizeof(rx) - 1;
+		memcpy(rx, rs_rb_get_read_ptr(rb), len);
+		rs_rb_read_incr(rb, len);
+
+		return 0;
+	}
+	void write_cb(struct io_io_write_buffer *b,
+			enum io_io_write_status s)
+	{
+		status = s;
+	}
+
+	/* initialization */
+	big_data = calloc(1, big_size);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(big_data);
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets2);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = setsockopt(sockets2[0], SOL_SOCKET, SO_SNDBUF, &sndbuf,
+			sizeof(sndbuf));
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_timer_group_init(&group, &mon, 100);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	io2 = calloc(1, sizeof(*io2));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io2);
+
+	/* normal use cases */
+	ret = io_io_init_compact(io, &mon, SUITE_NAME, sockets[0], sockets[0],
+			1, &group);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_init_compact(io2, &mon, SUITE_NAME, sockets2[0],
+			sockets2[0], 1, &group);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	/* no ring buffer nor timer until needed */
+	CU_ASSERT_EQUAL(rs_rb_get_size(&io->readctx.rb), 0);
+	CU_ASSERT_PTR_EQUAL(io->name, SUITE_NAME);
+	ret = io_io_read_start(io, io_cb, NULL, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+	sret = write(sockets[1], "hello", 5);
+	CU_ASSERT_EQUAL(sret, 5);
+	ret = io_mon_poll(&mon, 100);
+	CU_ASSERT(ret >= 0);
+	CU_ASSERT_STRING_EQUAL(rx, "hello");
+	/* released once consumed */
+	CU_ASSERT_EQUAL(rs_rb_get_size(&io->readctx.rb), 0);
+
+	/* no out of line state, hence no counters, until a feature needs it */
+	CU_ASSERT(sizeof(*io) <= 512);
+	CU_ASSERT_PTR_NULL(io->extra);
+	ret = io_io_get_stats(io, &stats);
+	CU_ASSERT_EQUAL(ret, -ENOTSUP);
+	/* the chunks are freed once written, not pooled */
+	ret = io_io_write_copy(io, "world", 5);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_mon_poll(&mon, 100);
+	CU_ASSERT(ret >= 0);
+	sret = read(sockets[1], tx, sizeof(tx));
+	CU_ASSERT_EQUAL(sret, 5);
+	CU_ASSERT_EQUAL(io_io_write_get_queued(io), 0);
+	CU_ASSERT_PTR_NULL(io->extra);
+	ret = io_io_write_set_keep_latest(io, 1);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_NOT_NULL(io->extra);
+
+	/* the shared timer times out the writes of the ios of the group */
+	ret = io_io_write_buffer_init(&buffer, write_cb, NULL, big_size,
+			big_data);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_write_add(io2, &buffer);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(rs_dll_get_count(&group.ios), 1);
+	ret = io_io_timer_group_clean(&group);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+	while (status == IO_IO_WRITE_OK && loops++ < 100)
+		io_mon_poll(&mon, 50);
+	CU_ASSERT_EQUAL(status, IO_IO_WRITE_TIMEOUT);
+	CU_ASSERT_EQUAL(rs_dll_get_count(&group.ios), 0);
+
+	/* error use cases */
+	ret = io_io_init_compact(io, &mon, SUITE_NAME, sockets[0], sockets[0],
+			1, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_timer_group_init(NULL, &mon, 100);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_timer_group_init(&group, NULL, 100);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_timer_group_init(&group, &mon, 0);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_timer_group_clean(NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	io_io_clean(io);
+	io_io_clean(io2);
+	ret = io_io_timer_group_clean(&group);
+	CU_ASSERT_EQUAL(ret, 0);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+	ut_file_fd_close(sockets2 + 0);
+	ut_file_fd_close(sockets2 + 1);
+	free(big_data);
+}
+
+static void testIO_RING(void)
+{
+#define NB_BUFFERS 5
+	int ret;
+	int sockets[2];
+	struct io_mon mon;
+	struct io_ring ring;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	struct io_io_write_buffer buffers[NB_BUFFERS];
+	struct io_io_stats stats;
+	const char *tx = "0123456789";
+	char rx[64] = {0};
+	size_t received = 0;
+	int written = 0;
+	int failed = 0;
+	ssize_t sret;
+	int loops = 0;
+	int i;
+	int io_cb(struct io_io *local_io, struct rs_rb *rb, void *data)
+	{
+		size_t len = rs_rb_get_read_length(rb);
+
+		if (received + len >= sizeof(rx))
+			len = sizeof(rx) - 1 - received;
+		memcpy(rx + received, rs_rb_get_read_ptr(rb), len);
+		rs_rb_read_incr(rb, len);
+		received += len;
+
+		return 0;
+	}
+	void write_cb(struct io_io_write_buffer *b,
+			enum io_io_write_status s)
+	{
+		if (s == IO_IO_WRITE_OK)
+			written++;
+		else
+			failed++;
+	}
+
+	/* initialization */
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_ring_init(&ring, &mon, 8, 4, 8, 4096);
+	/* io_uring may be missing, or disabled */
+	if (ret == -ENOSYS || ret == -EPERM) {
+		io_mon_clean(&mon);
+		return;
+	}
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	ret = io_io_use_ring(io, &ring);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_read_start(io, io_cb, NULL, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+	sret = write(sockets[1], "hello", 5);
+	CU_ASSERT_EQUAL(sret, 5);
+	while (received < 5 && loops++ < 100)
+		io_mon_poll(&mon, 10);
+	CU_ASSERT_STRING_EQUAL(rx, "hello");
+
+	/* the buffers are sent by a chain of linked sends */
+	for (i = 0; i < NB_BUFFERS; i++) {
+		ret = io_io_write_buffer_init(buffers + i, write_cb, NULL, 2,
+				tx + 2 * i);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = io_io_write_add(io, buffers + i);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	loops = 0;
+	while (written + failed < NB_BUFFERS && loops++ < 100)
+		io_mon_poll(&mon, 10);
+	CU_ASSERT_EQUAL(written, NB_BUFFERS);
+	memset(rx, 0, sizeof(rx));
+	sret = read(sockets[1], rx, sizeof(rx) - 1);
+	CU_ASSERT_EQUAL(sret, 10);
+	CU_ASSERT_STRING_EQUAL(rx, tx);
+	ret = io_io_get_stats(io, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(stats.nbread, 5);
+	CU_ASSERT_EQUAL(stats.nbwritten, 10);
+
+	/* end of file */
+	received = 0;
+	memset(rx, 0, sizeof(rx));
+	sret = write(sockets[1], "bye", 3);
+	CU_ASSERT_EQUAL(sret, 3);
+	shutdown(sockets[1], SHUT_WR);
+	loops = 0;
+	while (received < 3 && loops++ < 100)
+		io_mon_poll(&mon, 10);
+	CU_ASSERT_STRING_EQUAL(rx, "bye");
+
+	/* error use cases */
+	ret = io_io_use_ring(NULL, &ring);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_use_ring(io, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_use_ring(io, &ring);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+	ret = io_io_write_set_zerocopy(io, 4096);
+	CU_ASSERT_EQUAL(ret, -ENOTSUP);
+
+	/* cleanup */
+	io_io_clean(io);
+	ret = io_ring_clean(&ring);
+	CU_ASSERT_EQUAL(ret, 0);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+#undef NB_BUFFERS
+}
+
+static void testIO_HANGUP(void)
+{
+#define DATA_SIZE 65536
+	int ret;
+	int sockets[2];
+	struct io_mon mon;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	uint8_t *data;
+	uint8_t *rx;
+	ssize_t sret;
+	size_t received = 0;
+	int loops = 0;
+	int i;
+	void consume(struct rs_rb *rb)
+	{
+		size_t length = rs_rb_get_read_length(rb);
+
+		/* the ring buffer is mirrored, its data are contiguous */
+		if (received + length <= DATA_SIZE)
+			memcpy(rx + received, rs_rb_get_read_ptr(rb), length);
+		received += length;
+		rs_rb_empty(rb);
+	}
+	int io_cb(struct io_io *local_io, struct rs_rb *rb, void *cb_data)
+	{
+		consume(rb);
+
+		return 0;
+	}
+	int lazy_cb(struct io_io *local_io, struct rs_rb *rb, void *cb_data)
+	{
+		/* consumes nothing, reading pauses once the ring is full */
+		return 0;
+	}
+
+	/* initialization */
+	data = malloc(DATA_SIZE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+	rx = calloc(1, DATA_SIZE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rx);
+	for (i = 0; i < DATA_SIZE; i++)
+		data[i] = i % 251;
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 0);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	/* the data can't be read in one wakeup */
+	ret = io_io_read_set_buffer_size(io, 4096, 4096);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_read_start(io, io_cb, NULL, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	/* the peer writes, then closes before anything is read */
+	sret = write(sockets[1], data, DATA_SIZE);
+	CU_ASSERT_EQUAL(sret, DATA_SIZE);
+	ut_file_fd_close(sockets + 1);
+	/* the data sent before the hang up are all read, then the error */
+	while (!io_io_has_read_error(io) && loops++ < 100)
+		io_mon_poll(&mon, 10);
+	CU_ASSERT(io_io_has_read_error(io));
+	CU_ASSERT_EQUAL(received, DATA_SIZE);
+	/* up to the last bytes */
+	CU_ASSERT_EQUAL(memcmp(rx + DATA_SIZE - 16, data + DATA_SIZE - 16, 16),
+			0);
+	CU_ASSERT_EQUAL(memcmp(rx, data, DATA_SIZE), 0);
+
+	/* same with a consumer leaving the ring full, reading being paused */
+	io_io_clean(io);
+	ut_file_fd_close(sockets + 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 0);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_read_set_buffer_size(io, 4096, 4096);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_read_start(io, lazy_cb, NULL, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+	received = 0;
+	memset(rx, 0, DATA_SIZE);
+	sret = write(sockets[1], data, DATA_SIZE);
+	CU_ASSERT_EQUAL(sret, DATA_SIZE);
+	ut_file_fd_close(sockets + 1);
+	loops = 0;
+	while (!io_io_has_read_error(io) && loops++ < 100) {
+		io_mon_poll(&mon, 10);
+		if (!io_io_is_read_paused(io))
+			continue;
+		/* the hang up is reported while paused */
+		io_mon_poll(&mon, 10);
+		CU_ASSERT(io_io_is_read_paused(io));
+		CU_ASSERT(!io_io_has_read_error(io));
+		consume(&io->readctx.rb);
+		ret = io_io_read_resume(io);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	CU_ASSERT(io_io_has_read_error(io));
+	/* the last bytes are left in the ring by the consumer */
+	consume(&io->readctx.rb);
+	CU_ASSERT_EQUAL(received, DATA_SIZE);
+	CU_ASSERT_EQUAL(memcmp(rx, data, DATA_SIZE), 0);
+
+	/* cleanup */
+	io_io_clean(io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	free(rx);
+	free(data);
+#undef DATA_SIZE
+}
+
+static void testIO_WRITE_PRIO(void)
+{
+#define BULK_SIZE 65536
+#define NB_BULK 3
+	int ret;
+	int sockets[2];
+	int sndbuf = 4096;
+	struct io_mon mon;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	struct io_io_write_buffer bulk[NB_BULK];
+	struct io_io_write_buffer urgent;
+	struct io_io_stats stats;
+	size_t total = NB_BULK * BULK_SIZE + 6;
+	size_t received = 0;
+	char *data;
+	char *rx;
+	ssize_t sret;
+	int loops = 0;
+	int i;
+
+	/* initialization */
+	data = malloc(NB_BULK * BULK_SIZE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+	rx = malloc(total);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rx);
+	for (i = 0; i < NB_BULK; i++)
+		memset(data + i * BULK_SIZE, 'a' + i, BULK_SIZE);
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &sndbuf,
+			sizeof(sndbuf));
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	for (i = 0; i < NB_BULK; i++) {
+		ret = io_io_write_buffer_init(bulk + i, NULL, NULL, BULK_SIZE,
+				data + i * BULK_SIZE);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = io_io_write_add(io, bulk + i);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	/* the first bulk buffer is partially written */
+	io_mon_poll(&mon, 10);
+	ret = io_io_write_buffer_init(&urgent, NULL, NULL, 6, "URGENT");
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_write_add_prio(io, &urgent, IO_IO_PRIO_URGENT);
+	CU_ASSERT_EQUAL(ret, 0);
+	while (received < total && loops++ < 1000) {
+		io_mon_poll(&mon, 10);
+		sret = read(sockets[1], rx + received, total - received);
+		if (sret > 0)
+			received += sret;
+	}
+	CU_ASSERT_EQUAL(received, total);
+	/* overtakes the bulk buffers queued, not the one started */
+	CU_ASSERT(memcmp(rx, data, BULK_SIZE) == 0);
+	CU_ASSERT(memcmp(rx + BULK_SIZE, "URGENT", 6) == 0);
+	CU_ASSERT(memcmp(rx + BULK_SIZE + 6, data + BULK_SIZE,
+			(NB_BULK - 1) * BULK_SIZE) == 0);
+	ret = io_io_get_stats(io, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(stats.lanes[IO_IO_PRIO_URGENT].buffers, 1);
+	CU_ASSERT_EQUAL(stats.lanes[IO_IO_PRIO_URGENT].bytes, 6);
+	CU_ASSERT_EQUAL(stats.lanes[IO_IO_PRIO_NORMAL].buffers, NB_BULK);
+	CU_ASSERT_EQUAL(stats.lanes[IO_IO_PRIO_NORMAL].bytes,
+			NB_BULK * BULK_SIZE);
+	CU_ASSERT_EQUAL(stats.lanes[IO_IO_PRIO_NORMAL].queue_max,
+			NB_BULK - 1);
+
+	/* error use cases */
+	ret = io_io_write_add_prio(NULL, &urgent, IO_IO_PRIO_URGENT);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_add_prio(io, NULL, IO_IO_PRIO_URGENT);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_add_prio(io, &urgent, IO_IO_PRIO_COUNT);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	io_io_clean(io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+	free(rx);
+	free(data);
+#undef NB_BULK
+#undef BULK_SIZE
+}
+
+static void testIO_WRITE_POLICY(void)
+{
+#define BULK_SIZE 65536
+	int ret;
+	int sockets[2];
+	int sndbuf = 4096;
+	struct io_mon mon;
+	/* here io is allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*io = NULL;
+	struct io_io __attribute__((cleanup(io_free)))*other = NULL;
+	int other_sockets[2];
+	struct io_io_write_buffer bulk;
+	struct io_io_write_buffer pos[3];
+	struct io_io_write_buffer cancel;
+	struct io_io_write_buffer stale;
+	struct io_io_stats stats;
+	size_t total = BULK_SIZE + 4;
+	size_t received = 0;
+	char *data;
+	char *rx;
+	ssize_t sret;
+	int loops = 0;
+	int i;
+	int status[5];
+	void write_cb(struct io_io_write_buffer *buffer,
+			enum io_io_write_status s)
+	{
+		status[(intptr_t)buffer->data] = s;
+	}
+
+	/* initialization */
+	for (i = 0; i < 5; i++)
+		status[i] = -1;
+	data = malloc(BULK_SIZE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+	rx = malloc(total);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rx);
+	memset(data, 'b', BULK_SIZE);
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &sndbuf,
+			sizeof(sndbuf));
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	io = calloc(1, sizeof(*io));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(io);
+	ret = io_io_init(io, &mon, SUITE_NAME, sockets[0], sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			other_sockets);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	other = calloc(1, sizeof(*other));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(other);
+	ret = io_io_init(other, &mon, SUITE_NAME, other_sockets[0],
+			other_sockets[0], 1);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	ret = io_io_write_buffer_init(&bulk, NULL, NULL, BULK_SIZE, data);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_write_add(io, &bulk);
+	CU_ASSERT_EQUAL(ret, 0);
+	io_mon_poll(&mon, 10);
+
+	/* only the latest position update is kept */
+	ret = io_io_write_set_keep_latest(io, 1);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (i = 0; i < 3; i++) {
+		ret = io_io_write_buffer_init(pos + i, write_cb,
+				(void *)(intptr_t)i, 4, i < 2 ? "old!" : "pos3");
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = io_io_write_buffer_set_tag(pos + i, 7);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = io_io_write_add(io, pos + i);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	CU_ASSERT_EQUAL(status[0], IO_IO_WRITE_DROPPED);
+	CU_ASSERT_EQUAL(status[1], IO_IO_WRITE_DROPPED);
+	CU_ASSERT_EQUAL(status[2], -1);
+
+	/* a buffer not started can be canceled, not the one being written */
+	ret = io_io_write_buffer_init(&cancel, write_cb, (void *)3, 6,
+			"cancel");
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_write_add(io, &cancel);
+	CU_ASSERT_EQUAL(ret, 0);
+	/* only by the io it is queued in */
+	ret = io_io_write_cancel(other, &cancel);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	CU_ASSERT_EQUAL(status[3], -1);
+	ret = io_io_write_cancel(io, &cancel);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(status[3], IO_IO_WRITE_ABORTED);
+	ret = io_io_write_cancel(io, &cancel);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	ret = io_io_write_cancel(io, &bulk);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+
+	/* a buffer waiting more than the maximum age is never sent */
+	ret = io_io_write_set_max_age(io, 20);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_write_buffer_init(&stale, write_cb, (void *)4, 5, "stale");
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = io_io_write_add(io, &stale);
+	CU_ASSERT_EQUAL(ret, 0);
+	usleep(50000);
+	while (received < total && loops++ < 1000) {
+		io_mon_poll(&mon, 10);
+		sret = read(sockets[1], rx + received, total - received);
+		if (sret > 0)
+			received += sret;
+	}
+	io_mon_poll(&mon, 10);
+	CU_ASSERT_EQUAL(received, total);
+	CU_ASSERT(memcmp(rx, data, BULK_SIZE) == 0);
+	CU_ASSERT(memcmp(rx + BULK_SIZE, "pos3", 4) == 0);
+	CU_ASSERT_EQUAL(status[2], IO_IO_WRITE_OK);
+	CU_ASSERT_EQUAL(status[4], IO_IO_WRITE_DROPPED);
+	CU_ASSERT_EQUAL(io_io_write_get_queued(io), 0);
+	sret = read(sockets[1], rx, total);
+	CU_ASSERT_EQUAL(sret, -1);
+	ret = io_io_get_stats(io, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(stats.drops, 3);
+	CU_ASSERT_EQUAL(stats.aborts, 1);
+
+	/* error use cases */
+	ret = io_io_write_cancel(NULL, &cancel);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_cancel(io, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_buffer_set_tag(NULL, 7);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_set_keep_latest(NULL, 1);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_set_max_age(NULL, 20);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_set_max_age(io, -1);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	io_io_clean(other);
+	io_io_clean(io);
+	io_mon_clean(&mon);
+	ut_file_fd_close(other_sockets + 0);
+	ut_file_fd_close(other_sockets + 1);
+	ut_file_fd_close(sockets + 0);
+	ut_file_fd_close(sockets + 1);
+	free(rx);
+	free(data);
+#undef BULK_SIZE
+}
+
+static void testIO_PUMP(void)
+{
+#define DATA_SIZE 300000
+	int ret;
+	int sockets_in[2];
+	int sockets_out[2];
+	struct io_mon mon;
+	/* here ios are allocated because of the stack's size */
+	struct io_io __attribute__((cleanup(io_free)))*from = NULL;
+	struct io_io __attribute__((cleanup(io_free)))*to = NULL;
+	struct io_io_pump pump;
+	uint8_t *data;
+	uint8_t rx[4096];
+	ssize_t sret;
+	size_t sent = 0;
+	size_t received = 0;
+	int stopped = 0;
+	int pump_err = 1;
+	int loops = 0;
+	int corrupted = 0;
+	int i;
+	void pump_cb(struct io_io_pump *p, int err, void *cb_data)
+	{
+		CU_ASSERT_PTR_EQUAL(p, &pump);
+		CU_ASSERT_PTR_EQUAL(cb_data, (void *)42);
+		pump_err = err;
+		stopped++;
+	}
+
+	/* initialization */
+	data = malloc(DATA_SIZE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+	for (i = 0; i < DATA_SIZE; i++)
+		data[i] = i % 251;
+	ret = io_mon_init(&mon);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets_in);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+			sockets_out);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	from = calloc(1, sizeof(*from));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(from);
+	to = calloc(1, sizeof(*to));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(to);
+	ret = io_io_init(from, &mon, SUITE_NAME, sockets_in[1],
+			sockets_in[1], 0);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = io_io_init(to, &mon, SUITE_NAME, sockets_out[0],
+			sockets_out[0], 0);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	ret = io_io_pump_init(&pump, from, to, pump_cb, (void *)42);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	while (received < DATA_SIZE && loops++ < 10000) {
+		if (sent < DATA_SIZE) {
+			sret = write(sockets_in[0], data + sent,
+					DATA_SIZE - sent);
+			if (sret > 0)
+				sent += sret;
+			if (sent == DATA_SIZE)
+				shutdown(sockets_in[0], SHUT_WR);
+		}
+		io_mon_poll(&mon, 100);
+		while ((sret = read(sockets_out[1], rx, sizeof(rx))) > 0) {
+			for (i = 0; i < sret; i++)
+				if (rx[i] != (received + i) % 251)
+					corrupted = 1;
+			received += sret;
+		}
+	}
+	loops = 0;
+	while (!stopped && loops++ < 10)
+		io_mon_poll(&mon, 100);
+	CU_ASSERT_EQUAL(received, DATA_SIZE);
+	CU_ASSERT(!corrupted);
+	CU_ASSERT_EQUAL(pump.nbread, DATA_SIZE);
+	CU_ASSERT_EQUAL(pump.nbwritten, DATA_SIZE);
+	CU_ASSERT_EQUAL(stopped, 1);
+	CU_ASSERT_EQUAL(pump_err, 0);
+
+	/* error use cases */
+	ret = io_io_pump_init(NULL, from, to, pump_cb, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_pump_init(&pump, NULL, to, pump_cb, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_pump_init(&pump, from, NULL, pump_cb, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_pump_init(&pump, from, to, NULL, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	/* already pumping */
+	ret = io_io_pump_init(&pump, from, to, pump_cb, NULL);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+	ret = io_io_read_start(from, dummy_io_cb, NULL, 0);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+	ret = io_io_pump_clean(NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	ret = io_io_pump_clean(&pump);
+	CU_ASSERT_EQUAL(ret, 0);
+	io_io_clean(from);
+	io_io_clean(to);
+	io_mon_clean(&mon);
+	ut_file_fd_close(sockets_in + 0);
+	ut_file_fd_close(sockets_in + 1);
+	ut_file_fd_close(sockets_out + 0);
+	ut_file_fd_close(sockets_out + 1);
+	free(data);
+#undef DATA_SIZE
+}
+
+static void testIO_WRITE_BUFFER_INIT(void)
+{
+#define MSG "titi tata toto"
+	int ret;
+	struct io_io_write_buffer wb;
+
+	/* normal use cases */
+	ret = io_io_write_buffer_init(&wb, dummy_write_cb, (void *) 42,
+			sizeof(MSG), MSG);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* error use cases */
+	ret = io_io_write_buffer_init(NULL, dummy_write_cb, (void *) 42,
+			sizeof(MSG), MSG);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_buffer_init(&wb, dummy_write_cb, (void *) 42,
+			0, MSG);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = io_io_write_buffer_init(&wb, dummy_write_cb, (void *) 42,
+			sizeof(MSG), NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+#undef MSG
+}
+
+static void testIO_WRITE_BUFFER_CLEAN(void)
+{
+#define MSG "titi tata toto"
+	int ret;
+	struct io_io_write_buffer buf;
+
+	/* initialization */
+	ret = io_io_write_buffer_init(&buf, dummy_write_cb, (void *) 42,
+			sizeof(MSG), MSG);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	ret = io_io_write_buffer_clean(&buf);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* error use cases */
+	ret = io_io_write_buffer_clean(NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+#undef MSG
+}
+
+static const struct test_t tests[] = {
+		{
+				.fn = testIO_INIT,
+				.name = "io_io_init"
+		},
+		{
+				.fn = testIO_CLEAN,
+				.name = "io_io_clean"
+		},
+		{
+				.fn = testIO_READ_START,
+				.name = "io_io_read_start"
+		},
+		{
+				.fn = testIO_LOG_RX,
+				.name = "io_io_log_rx"
+		},
+		{
+				.fn = testIO_LOG_TX,
+				.name = "io_io_log_tx"
+		},
+		{
+				.fn = testIO_READ_STOP,
+				.name = "io_io_read_stop"
+		},
+		{
+				.fn = testIO_IS_READ_STARTED,
+				.name = "io_io_is_read_started"
+		},
+		{
+				.fn = testIO_HAS_READ_ERROR,
+				.name = "io_io_has_read_error"
+		},
+		{
+				.fn = testIO_WRITE_ADD,
+				.name = "io_io_write_add"
+		},
+		{
+				.fn = testIO_ABORT,
+				.name = "io_io_write_abort"
+		},
+		{
+				.fn = testIO_SIMPLE_USE_CASE,
+				.name = "io_simple_use_case"
+		},
+		{
+				.fn = testIO_READ_SET_BUFFER_SIZE,
+				.name = "io_io_read_set_buffer_size"
+		},
+		{
+				.fn = testIO_READ_OVERFLOW,
+				.name = "io_io_read_overflow"
+		},
+		{
+				.fn = testIO_READ_BATCHING,
+				.name = "io_io_read_batching"
+		},
+		{
+				.fn = testIO_WRITE_COALESCING,
+				.name = "io_io_write_coalescing"
+		},
+		{
+				.fn = testIO_WRITE_ORDER,
+				.name = "io_io_write_order"
+		},
+		{
+				.fn = testIO_WRITE_TIMEOUT,
+				.name = "io_io_write_timeout"
+		},
+		{
+				.fn = testIO_WRITE_SHARED,
+				.name = "io_io_write_shared"
+		},
+		{
+				.fn = testIO_WRITE_ZEROCOPY,
+				.name = "io_io_write_zerocopy"
+		},
+		{
+				.fn = testIO_WRITE_FILE,
+				.name = "io_io_write_file"
+		},
+		{
+				.fn = testIO_STATS,
+				.name = "io_io_stats"
+		},
+		{
+				.fn = testIO_WRITE_WATERMARKS,
+				.name = "io_io_write_watermarks"
+		},
+		{
+				.fn = testIO_WRITE_COPY,
+				.name = "io_io_write_copy"
+		},
+		{
+				.fn = testIO_READ_POST,
+				.name = "io_io_read_post"
+		},
+		{
+				.fn = testIO_COMPACT,
+				.name = "io_io_compact"
+		},
+		{
+				.fn = testIO_RING,
+				.name = "io_io_ring"
+		},
+		{
+				.fn = testIO_HANGUP,
+				.name = "io_io_hangup"
+		},
+		{
+				.fn = testIO_WRITE_PRIO,
+				.name = "io_io_write_prio"
+		},
+		{
+				.fn = testIO_WRITE_POLICY,
+				.name = "io_io_write_policy"
+		},
+		{
+				.fn = testIO_PUMP,
+				.name = "io_io_pump"
 		},
 		{
 				.fn = testIO_WRITE_BUFFER_INIT,
@@ -16,6 +16,8 @@ LOCAL_SRC_FILES := $(call all-c-files-under,src)
 
 LOCAL_LIBRARIES := libutils
 
+LOCAL_LDLIBS := -lpthread
+
 ifdef TARGET_TEST
 LOCAL_SRC_FILES += $(call all-c-files-under,tests)
 
@@ -28,6 +30,25 @@ endif # TARGET_TEST
 
 include $(BUILD_LIBRARY)
 
+###############################################################################
+# rs_cmap_bench
+###############################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := rs_cmap_bench
+LOCAL_DESCRIPTION := Measures the scaling of librs concurrent hash map lookups
+LOCAL_CATEGORY_PATH := devel
+
+LOCAL_SRC_FILES := \
+	$(call all-c-files-under,example) \
+
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_LIBRARIES := librs
+
+include $(BUILD_EXECUTABLE)
+
 ###############################################################################
 # tst-librs
 ###############################################################################
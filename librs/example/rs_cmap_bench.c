@@ -0,0 +1,228 @@
+/**
+ * @file rs_cmap_bench.c
+ * @brief Measures the lookup throughput of a shared table with an increasing
+ * number of threads, for a rs_hmap protected by a mutex and for a rs_cmap,
+ * while a writer thread updates an entry every millisecond
+ *
+ * Copyright (C) 2013 Parrot S.A.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <pthread.h>
+#include <unistd.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <error.h>
+#include <time.h>
+
+#include <rs_hmap.h>
+#include <rs_cmap.h>
+
+enum mode {
+	MODE_MUTEX,
+	MODE_CMAP,
+};
+
+struct bench {
+	enum mode mode;
+	struct rs_hmap hmap;
+	pthread_mutex_t mutex;
+	struct rs_cmap cmap;
+	char (*keys)[16];
+	unsigned nkeys;
+	bool stop;
+};
+
+struct worker {
+	struct bench *bench;
+	pthread_t thread;
+	unsigned long lookups;
+	unsigned seed;
+};
+
+static void usage(int exit_code)
+{
+	FILE *out = exit_code ? stderr : stdout;
+	fprintf(out, "usage : rs_cmap_bench [-t THREADS] [-d DURATION] "
+		"[-n KEYS]\n"
+		"\tLooks up a table of KEYS entries (default 10000) from 1 to "
+		"THREADS threads (default, the number of cpus), during "
+		"DURATION ms (default 1000) for each run, and prints the "
+		"lookups per second.\n");
+
+	exit(exit_code);
+}
+
+static void *reader(void *arg)
+{
+	struct worker *worker = arg;
+	struct bench *bench = worker->bench;
+	struct rs_cmap_reader cmap_reader;
+	unsigned long lookups = 0;
+	const char *key;
+	void *data;
+
+	if (bench->mode == MODE_CMAP)
+		rs_cmap_reader_register(&bench->cmap, &cmap_reader);
+	while (!__atomic_load_n(&bench->stop, __ATOMIC_RELAXED)) {
+		key = bench->keys[rand_r(&worker->seed) % bench->nkeys];
+		if (bench->mode == MODE_CMAP) {
+			rs_cmap_lookup(&bench->cmap, &cmap_reader, key, &data);
+		} else {
+			pthread_mutex_lock(&bench->mutex);
+			rs_hmap_lookup(&bench->hmap, key, &data);
+			pthread_mutex_unlock(&bench->mutex);
+		}
+		lookups++;
+	}
+	if (bench->mode == MODE_CMAP)
+		rs_cmap_reader_unregister(&bench->cmap, &cmap_reader);
+	worker->lookups = lookups;
+
+	return NULL;
+}
+
+static void *writer(void *arg)
+{
+	struct bench *bench = arg;
+	unsigned i = 0;
+	const char *key;
+	void *data;
+
+	while (!__atomic_load_n(&bench->stop, __ATOMIC_RELAXED)) {
+		key = bench->keys[i++ % bench->nkeys];
+		if (bench->mode == MODE_CMAP) {
+			rs_cmap_replace(&bench->cmap, key, NULL);
+		} else {
+			pthread_mutex_lock(&bench->mutex);
+			rs_hmap_remove(&bench->hmap, key, &data);
+			rs_hmap_insert(&bench->hmap, key, NULL);
+			pthread_mutex_unlock(&bench->mutex);
+		}
+		usleep(1000);
+	}
+
+	return NULL;
+}
+
+static double run(struct bench *bench, unsigned nthreads, unsigned duration)
+{
+	struct worker *workers;
+	pthread_t writer_thread;
+	struct timespec start;
+	struct timespec end;
+	unsigned long lookups = 0;
+	double seconds;
+	unsigned i;
+	int ret;
+
+	workers = calloc(nthreads, sizeof(*workers));
+	if (NULL == workers)
+		error(EXIT_FAILURE, errno, "calloc");
+	bench->stop = false;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nthreads; i++) {
+		workers[i].bench = bench;
+		workers[i].seed = i;
+		ret = pthread_create(&workers[i].thread, NULL, reader,
+				workers + i);
+		if (ret != 0)
+			error(EXIT_FAILURE, ret, "pthread_create");
+	}
+	ret = pthread_create(&writer_thread, NULL, writer, bench);
+	if (ret != 0)
+		error(EXIT_FAILURE, ret, "pthread_create");
+
+	usleep(duration * 1000);
+	__atomic_store_n(&bench->stop, true, __ATOMIC_RELAXED);
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		lookups += workers[i].lookups;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	pthread_join(writer_thread, NULL);
+	free(workers);
+
+	seconds = (end.tv_sec - start.tv_sec) +
+			(end.tv_nsec - start.tv_nsec) / 1e9;
+
+	return lookups / seconds;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench bench;
+	unsigned max_threads;
+	unsigned duration = 1000;
+	unsigned threads;
+	double base[2] = {0, 0};
+	double rate[2];
+	unsigned i;
+	int opt;
+	int ret;
+
+	memset(&bench, 0, sizeof(bench));
+	bench.nkeys = 10000;
+	max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "ht:d:n:")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			bench.nkeys = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(EXIT_SUCCESS);
+			break;
+		default:
+			usage(EXIT_FAILURE);
+		}
+	}
+	if (optind != argc || 0 == max_threads || 0 == bench.nkeys)
+		usage(EXIT_FAILURE);
+
+	bench.keys = calloc(bench.nkeys, sizeof(*bench.keys));
+	if (NULL == bench.keys)
+		error(EXIT_FAILURE, errno, "calloc");
+	ret = rs_hmap_init(&bench.hmap, bench.nkeys);
+	if (ret < 0)
+		error(EXIT_FAILURE, -ret, "rs_hmap_init");
+	ret = rs_cmap_init(&bench.cmap, bench.nkeys, NULL);
+	if (ret < 0)
+		error(EXIT_FAILURE, -ret, "rs_cmap_init");
+	pthread_mutex_init(&bench.mutex, NULL);
+	for (i = 0; i < bench.nkeys; i++) {
+		snprintf(bench.keys[i], sizeof(bench.keys[i]), "route%u", i);
+		rs_hmap_insert(&bench.hmap, bench.keys[i], NULL);
+		rs_cmap_insert(&bench.cmap, bench.keys[i], NULL);
+	}
+
+	printf("threads\tmutex lookups/s\tspeedup\tcmap lookups/s\tspeedup\n");
+	for (threads = 1; threads <= max_threads; threads++) {
+		bench.mode = MODE_MUTEX;
+		rate[MODE_MUTEX] = run(&bench, threads, duration);
+		bench.mode = MODE_CMAP;
+		rate[MODE_CMAP] = run(&bench, threads, duration);
+		if (threads == 1)
+			memcpy(base, rate, sizeof(base));
+		printf("%u\t%.0f\t%.2f\t%.0f\t%.2f\n", threads,
+				rate[MODE_MUTEX], rate[MODE_MUTEX] / base[0],
+				rate[MODE_CMAP], rate[MODE_CMAP] / base[1]);
+	}
+
+	rs_cmap_clean(&bench.cmap);
+	rs_hmap_clean(&bench.hmap);
+	pthread_mutex_destroy(&bench.mutex);
+	free(bench.keys);
+
+	return EXIT_SUCCESS;
+}
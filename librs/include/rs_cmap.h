@@ -0,0 +1,208 @@
+/**
+ * @file rs_cmap.h
+ *
+ * @brief concurrent hash map, with string keys, for tables looked up by many
+ * threads and seldom modified. Lookups take no lock and write no shared
+ * memory: each reading thread registers a reader, on which it publishes the
+ * epoch it has entered its read section at. Writers lock only the stripe of
+ * their bucket, entries are never modified in place, but replaced by new
+ * ones, the removed entries being freed once no reader can reach them
+ * anymore, i.e. once all the readers have left the read section they were in
+ * when the entry was removed
+ *
+ * Copyright (C) 2013 Parrot S.A.
+ */
+
+#ifndef RS_CMAP_H_
+#define RS_CMAP_H_
+#include <stddef.h>
+#include <stdint.h>
+
+#include <pthread.h>
+
+#include <rs_hmap.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def RS_CMAP_STRIPES
+ * @brief Number of locks the buckets are distributed on, for writers
+ */
+#define RS_CMAP_STRIPES 16
+
+/**
+ * @def RS_CMAP_SIZE_MAX
+ * @brief Maximum number of buckets of a concurrent hash map
+ */
+#define RS_CMAP_SIZE_MAX (1U << 30)
+
+/**
+ * @struct rs_cmap_node
+ * @brief Entry of a concurrent hash map, immutable once published
+ */
+struct rs_cmap_node {
+	struct rs_cmap_node *next;	/**< next entry of the bucket */
+	struct rs_cmap_node *retired;	/**< next entry waiting to be freed */
+	uint64_t epoch;			/**< epoch it has been removed at */
+	uint32_t hash;			/**< full hash of the key */
+	void *data;			/**< entry data */
+	char key[];			/**< entry key */
+};
+
+/**
+ * @struct rs_cmap_reader
+ * @brief Per thread read side state, on its own cache line, for the readers
+ * not to disturb each other
+ */
+struct rs_cmap_reader {
+	uint64_t epoch;			/**< epoch entered at, 0 if outside */
+	unsigned depth;			/**< read sections nesting level */
+	struct rs_cmap_reader *next;	/**< next registered reader */
+} __attribute__((aligned(64)));
+
+/**
+ * @struct rs_cmap
+ * @brief Concurrent hash map structure. The fields modified by the writers
+ * start on their own cache line, for the writes not to invalidate the one
+ * read by all the lookups. The epoch, loaded on entering each read section
+ * but modified only by the removals, has its own cache line too, for the
+ * insertions not to invalidate it
+ */
+struct rs_cmap {
+	struct rs_cmap_node **buckets;	/**< hash map buckets */
+	size_t mask;			/**< number of buckets - 1 */
+	struct rs_hmap_seed seed;	/**< seed of rs_hmap_hash_sip() */
+	void (*free_cb)(void *);	/**< called on data of freed entries */
+	/** incremented at each removal */
+	uint64_t epoch __attribute__((aligned(64)));
+	/** number of entries */
+	size_t count __attribute__((aligned(64)));
+	pthread_mutex_t lock;		/**< protects readers and retired */
+	struct rs_cmap_reader *readers;	/**< registered readers */
+	struct rs_cmap_node *retired;	/**< removed, not freed yet */
+	pthread_mutex_t stripes[RS_CMAP_STRIPES];	/**< writers' locks */
+};
+
+/**
+ * Initializes a concurrent hash map. When not used anymore, it must be
+ * cleaned with a call to rs_cmap_clean()
+ * @param map Hash map to initialize
+ * @param size Number of buckets, rounded up to a power of two, fixed for all
+ * the lifetime of the map. can't be more than RS_CMAP_SIZE_MAX
+ * @param free_cb Callback called on the data of the entries, once removed or
+ * replaced and unreachable by the readers, or when the map is cleaned. Can be
+ * NULL
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_cmap_init(struct rs_cmap *map, size_t size, void (*free_cb)(void *));
+
+/**
+ * Reinitializes a concurrent hash map, freeing all the entries. No thread
+ * must use it anymore
+ * @param map Hash map to clean
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_cmap_clean(struct rs_cmap *map);
+
+/**
+ * Registers a reader, each thread looking up the map must have its own
+ * @param map Hash map
+ * @param reader Reader to initialize and register
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_cmap_reader_register(struct rs_cmap *map,
+		struct rs_cmap_reader *reader);
+
+/**
+ * Unregisters a reader, which must be outside any read section
+ * @param map Hash map
+ * @param reader Reader registered with rs_cmap_reader_register()
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_cmap_reader_unregister(struct rs_cmap *map,
+		struct rs_cmap_reader *reader);
+
+/**
+ * Enters a read section, read sections can be nested. The entries reachable
+ * when it is entered, and their data, aren't freed before it is left
+ * @param map Hash map
+ * @param reader Reader of the calling thread
+ */
+void rs_cmap_read_lock(struct rs_cmap *map, struct rs_cmap_reader *reader);
+
+/**
+ * Leaves a read section
+ * @param reader Reader of the calling thread
+ */
+void rs_cmap_read_unlock(struct rs_cmap_reader *reader);
+
+/**
+ * Lookups an entry in a concurrent hash map, without taking any lock. Unless
+ * the caller is in a read section, the data returned can be freed by
+ * free_cb as soon as the function returns, if the entry is removed
+ * concurrently
+ * @param map Hash map
+ * @param reader Reader of the calling thread
+ * @param key String key
+ * @param data In output, the matching data, or NULL if no entry was found.
+ * can't be NULL
+ * @return Negative errno-compatible value on error, 0 on success. -ENOENT if
+ * the entry wasn't found
+ */
+int rs_cmap_lookup(struct rs_cmap *map, struct rs_cmap_reader *reader,
+		const char *key, void **data);
+
+/**
+ * Inserts an entry in a concurrent hash map
+ * @param map Hash map
+ * @param key String key
+ * @param data Piece of data to associate with the key. Can be NULL
+ * @return Negative errno-compatible value on error, 0 on success. -EEXIST if
+ * an entry with the same key is already present
+ */
+int rs_cmap_insert(struct rs_cmap *map, const char *key, void *data);
+
+/**
+ * Inserts an entry in a concurrent hash map, replacing the entry with the
+ * same key if any. The readers see either the previous entry or the new one
+ * @param map Hash map
+ * @param key String key
+ * @param data Piece of data to associate with the key. Can be NULL
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_cmap_replace(struct rs_cmap *map, const char *key, void *data);
+
+/**
+ * Removes an entry from a concurrent hash map, its data being passed to
+ * free_cb once no reader can access it anymore
+ * @param map Hash map
+ * @param key String key
+ * @return Negative errno-compatible value on error, 0 on success. -ENOENT if
+ * the entry wasn't found
+ */
+int rs_cmap_remove(struct rs_cmap *map, const char *key);
+
+/**
+ * Frees the removed entries no reader can access anymore. Called by the
+ * writers, needed only for the entries removed while a reader was in a long
+ * read section to be freed before the next write
+ * @param map Hash map
+ * @return Negative errno-compatible value on error, otherwise the number of
+ * removed entries still waiting to be freed
+ */
+int rs_cmap_reclaim(struct rs_cmap *map);
+
+/**
+ * Returns the number of entries of a concurrent hash map
+ * @param map Hash map
+ * @return Number of entries, 0 if map is NULL
+ */
+size_t rs_cmap_get_count(const struct rs_cmap *map);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RS_CMAP_H_ */
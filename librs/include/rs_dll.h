@@ -213,6 +213,15 @@ int rs_dll_rewind(struct rs_dll *dll);
  */
 struct rs_node *rs_dll_remove(struct rs_dll *dll, struct rs_node *node);
 
+/**
+ * Unchains a given node of the list, in constant time, without searching for
+ * it
+ * @param dll Doubly linked list
+ * @param node Node to remove, which _must_ belong to the list
+ * @return node, NULL on error (NULL parameter)
+ */
+struct rs_node *rs_dll_remove_node(struct rs_dll *dll, struct rs_node *node);
+
 /**
  * Unchains and returns a given element of the list
  * @param dll Doubly linked list
@@ -0,0 +1,206 @@
+/**
+ * @file rs_himg.h
+ *
+ * @brief hash map images, i.e. immutable hash tables stored in a file, which
+ * are mapped in memory and looked up in place, without being parsed nor
+ * loaded, the pages being shared by all the processes mapping the same file.
+ * An image is built once, e.g. at build time or when a configuration
+ * changes, from key / value pairs or from a rs_hmap. The image only contains
+ * offsets, it can be mapped at any address
+ *
+ * Copyright (C) 2013 Parrot S.A.
+ */
+
+#ifndef RS_HIMG_H_
+#define RS_HIMG_H_
+#include <stddef.h>
+#include <stdint.h>
+
+#include <rs_hmap.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def RS_HIMG_MAGIC
+ * @brief First bytes of an image, "RSHI", read in the byte order of the
+ * machine which built it
+ */
+#define RS_HIMG_MAGIC 0x49485352U
+
+/**
+ * @def RS_HIMG_VERSION
+ * @brief Version of the format of the images
+ */
+#define RS_HIMG_VERSION 1
+
+/**
+ * @struct rs_himg_header
+ * @brief Header of an image, followed by (mask + 1) slots, then by the
+ * records, each one being 8 bytes aligned
+ */
+struct rs_himg_header {
+	uint32_t magic;			/**< RS_HIMG_MAGIC */
+	uint32_t version;		/**< RS_HIMG_VERSION */
+	uint64_t size;			/**< size of the image in bytes */
+	struct rs_hmap_seed seed;	/**< seed of rs_hmap_hash_sip() */
+	uint32_t count;			/**< number of entries */
+	uint32_t mask;			/**< number of slots - 1 */
+};
+
+/**
+ * @struct rs_himg_slot
+ * @brief Slot of the hash table of an image, linear probing is used
+ */
+struct rs_himg_slot {
+	uint32_t hash;			/**< full hash of the key */
+	uint32_t offset;		/**< offset of the record, 0 if empty */
+};
+
+/**
+ * @struct rs_himg_record
+ * @brief Entry of an image, the key is followed by the value, which starts
+ * on the next 8 bytes boundary
+ */
+struct rs_himg_record {
+	uint32_t key_len;		/**< size of the key in bytes */
+	uint32_t value_len;		/**< size of the value in bytes */
+	uint8_t key[];			/**< key */
+};
+
+/**
+ * @struct rs_himg_builder
+ * @brief Entries collected for building an image
+ */
+struct rs_himg_builder {
+	struct rs_himg_builder_entry *entries;	/**< array of entries */
+	size_t count;			/**< number of entries */
+	size_t capacity;		/**< allocated entries */
+	struct rs_hmap_seed seed;	/**< seed of the image */
+};
+
+/**
+ * @struct rs_himg
+ * @brief Image mapped in memory
+ */
+struct rs_himg {
+	const uint8_t *base;		/**< start of the mapping */
+	size_t size;			/**< size of the mapping */
+	const struct rs_himg_header *header;	/**< header of the image */
+	const struct rs_himg_slot *slots;	/**< hash table */
+};
+
+/**
+ * Callback converting the data of a rs_hmap entry to the value stored in the
+ * image
+ * @param data Data of the entry
+ * @param value In output, start of the value
+ * @param length In output, size of the value in bytes
+ * @param userdata User data passed to rs_himg_builder_add_hmap()
+ * @return Negative errno-compatible value to abort, 0 on success
+ */
+typedef int (*rs_himg_value_cb)(void *data, const void **value,
+		size_t *length, void *userdata);
+
+/**
+ * Initializes a builder, using the library's default seed
+ * @param builder Builder to initialize
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_himg_builder_init(struct rs_himg_builder *builder);
+
+/**
+ * Sets the seed of the image, for the images built from the same entries to
+ * be identical
+ * @param builder Builder
+ * @param seed Seed
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_himg_builder_set_seed(struct rs_himg_builder *builder,
+		const struct rs_hmap_seed *seed);
+
+/**
+ * Adds an entry to the image to build, the key and the value are copied
+ * @param builder Builder
+ * @param key Key
+ * @param key_len Size of the key in bytes
+ * @param value Value, can be NULL if value_len is 0
+ * @param value_len Size of the value in bytes
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_himg_builder_add(struct rs_himg_builder *builder, const void *key,
+		size_t key_len, const void *value, size_t value_len);
+
+/**
+ * Adds all the entries of a hash map to the image to build. String keys are
+ * stored without their terminating NUL
+ * @param builder Builder
+ * @param map Hash map
+ * @param cb Callback converting the data of the entries to values, NULL for
+ * storing empty values
+ * @param userdata User data passed to cb
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_himg_builder_add_hmap(struct rs_himg_builder *builder,
+		struct rs_hmap *map, rs_himg_value_cb cb, void *userdata);
+
+/**
+ * Writes the image to a file, which is replaced atomically, the processes
+ * having mapped the previous one keeping it
+ * @param builder Builder
+ * @param path Path of the image
+ * @return Negative errno-compatible value on error, 0 on success. -EEXIST if
+ * the same key has been added twice
+ */
+int rs_himg_builder_write(struct rs_himg_builder *builder, const char *path);
+
+/**
+ * Reinitializes a builder, freeing the entries added
+ * @param builder Builder
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_himg_builder_clean(struct rs_himg_builder *builder);
+
+/**
+ * Maps an image read-only, only its header is checked
+ * @param img Image to initialize
+ * @param path Path of the image
+ * @return Negative errno-compatible value on error, 0 on success. -EPROTO if
+ * the file isn't a valid image
+ */
+int rs_himg_open(struct rs_himg *img, const char *path);
+
+/**
+ * Lookups an entry in an image
+ * @param img Image
+ * @param key Key
+ * @param key_len Size of the key in bytes
+ * @param value In output, pointer to the value in the mapping, valid until
+ * the image is closed, 8 bytes aligned
+ * @param value_len In output, size of the value in bytes, can be NULL
+ * @return Negative errno-compatible value on error, 0 on success. -ENOENT if
+ * the entry wasn't found
+ */
+int rs_himg_lookup(const struct rs_himg *img, const void *key,
+		size_t key_len, const void **value, size_t *value_len);
+
+/**
+ * Returns the number of entries of an image
+ * @param img Image
+ * @return Number of entries, 0 if img is NULL or not mapped
+ */
+size_t rs_himg_get_count(const struct rs_himg *img);
+
+/**
+ * Unmaps an image
+ * @param img Image
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_himg_close(struct rs_himg *img);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RS_HIMG_H_ */
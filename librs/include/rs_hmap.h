@@ -12,6 +12,8 @@
 
 #ifndef RS_HMAP_H_
 #define RS_HMAP_H_
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,14 +26,67 @@ extern "C" {
  */
 #define RS_HMAP_PRIME_MAX 2147483647U
 
+/**
+ * @def RS_HMAP_INLINE_KEY_SIZE
+ * @brief Binary keys up to this size are stored in the entries, the bigger
+ * ones being allocated separately
+ */
+#define RS_HMAP_INLINE_KEY_SIZE 16
+
+/**
+ * @enum rs_hmap_key_type
+ * @brief Type of the keys of a hash map
+ */
+enum rs_hmap_key_type {
+	RS_HMAP_KEY_STRING = 0,		/**< NUL-terminated strings */
+	RS_HMAP_KEY_U32,		/**< uint32_t, e.g. pids or fds */
+	RS_HMAP_KEY_U64,		/**< uint64_t */
+	RS_HMAP_KEY_BINARY,		/**< fixed length byte arrays */
+};
+
+/**
+ * @struct rs_hmap_seed
+ * @brief Secret key of the hash function, making the hash values
+ * unpredictable, for the map not to degenerate on crafted keys
+ */
+struct rs_hmap_seed {
+	uint64_t k0;			/**< first half of the key */
+	uint64_t k1;			/**< second half of the key */
+};
+
+/**
+ * Hash function of a hash map
+ * @param key Key to compute the hash of
+ * @param len Size of the key in bytes, without the NUL for strings
+ * @param seed Seed of the map
+ * @return hash value
+ */
+typedef uint32_t (*rs_hmap_hash_cb)(const void *key, size_t len,
+		const struct rs_hmap_seed *seed);
+
 /**
  * @struct rs_hmap_entry
  * @brief Hash map entry structure
  */
 struct rs_hmap_entry {
 	void *data;			/**< entry data */
-	char *key;			/**< entry key */
 	struct rs_hmap_entry *next;	/**< next entry with same hash value*/
+	uint32_t hash;			/**< full hash of the key */
+	/**
+	 * the key, allocated for the string keys and for the binary keys
+	 * bigger than RS_HMAP_INLINE_KEY_SIZE, stored inline otherwise. Use
+	 * rs_hmap_get_entry_key() for not depending on the map's key type
+	 */
+	union {
+		/** string key, or big binary key */
+		char *key;
+		/** small binary key */
+		union {
+			uint32_t u32;
+			uint64_t u64;
+			uint8_t bytes[RS_HMAP_INLINE_KEY_SIZE];
+		} inline_key;
+	};
 };
 
 /**
@@ -41,11 +96,16 @@ struct rs_hmap_entry {
 struct rs_hmap {
 	struct rs_hmap_entry **buckets;	/**< hash map buckets */
 	size_t size;			/**< hash map size (prime number) */
+	enum rs_hmap_key_type key_type;	/**< type of the keys */
+	size_t key_len;			/**< size of the keys, 0 for strings */
+	size_t count;			/**< number of entries */
+	rs_hmap_hash_cb hash;		/**< hash function */
+	struct rs_hmap_seed seed;	/**< seed of the hash function */
 };
 
 /**
- * Initializes a hash map. When not used anymore, a hash map must be cleaned
- * with a call to rs_hmap_clean()
+ * Initializes a hash map with string keys. When not used anymore, a hash map
+ * must be cleaned with a call to rs_hmap_clean()
  * @param map Hash map to initialize
  * @param size Size of the bucket. It is fixed for all the lifetime of the hash
  * map. can't be more than RS_HMAP_PRIME_MAX
@@ -53,6 +113,53 @@ struct rs_hmap {
  */
 int rs_hmap_init(struct rs_hmap *map, size_t size);
 
+/**
+ * Initializes a hash map with keys of a given type, which must then be
+ * accessed with rs_hmap_lookup_key(), rs_hmap_insert_key() and
+ * rs_hmap_remove_key(). The map uses rs_hmap_hash_sip(), with a seed chosen
+ * randomly at the library's loading
+ * @param map Hash map to initialize
+ * @param size Size of the bucket, see rs_hmap_init()
+ * @param type Type of the keys
+ * @param key_len Size of the keys in bytes for RS_HMAP_KEY_BINARY, ignored
+ * otherwise
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_hmap_init_keys(struct rs_hmap *map, size_t size,
+		enum rs_hmap_key_type type, size_t key_len);
+
+/**
+ * Changes the hash function of a hash map, or its seed
+ * @param map Hash map, which must be empty
+ * @param hash Hash function, NULL for rs_hmap_hash_sip()
+ * @param seed Seed passed to the hash function, NULL for keeping the current
+ * one
+ * @return Negative errno-compatible value on error, 0 on success. -EBUSY if
+ * the map isn't empty
+ */
+int rs_hmap_set_hash(struct rs_hmap *map, rs_hmap_hash_cb hash,
+		const struct rs_hmap_seed *seed);
+
+/**
+ * Retrieves the seed chosen randomly at the library's loading, which the maps
+ * use by default
+ * @param seed In output, the seed
+ */
+void rs_hmap_get_default_seed(struct rs_hmap_seed *seed);
+
+/**
+ * Default hash function, SipHash-1-3, folded to 32 bits. The key is processed
+ * 8 bytes at a time. Without the seed, colliding keys can't be computed in
+ * advance, which protects the maps filled with untrusted keys against hash
+ * flooding
+ * @param key Key to compute the hash of
+ * @param len Size of the key in bytes
+ * @param seed Secret key
+ * @return hash value
+ */
+uint32_t rs_hmap_hash_sip(const void *key, size_t len,
+		const struct rs_hmap_seed *seed);
+
 /**
  * Reinitializes a hash map. Releases internally used resources. Equivalent to
  * rs_hmap_clean_cb(map, NULL);
@@ -77,7 +184,7 @@ int rs_hmap_clean_cb(struct rs_hmap *map, void (*free_cb)(void *));
  * same key, the first found is returned.
  *
  * @param map Hash map
- * @param key String key
+ * @param key String key, the map must have string keys
  * @param data In output, a pointer to a matching data, or to NULL if no entry
  * was found. can't be NULL
  * @return Negative errno-compatible value on error, 0 on success. -ENOENT if
@@ -90,7 +197,7 @@ int rs_hmap_lookup(struct rs_hmap *map, const char *key, void **data);
  * already present.
  *
  * @param map Hash map
- * @param key String key
+ * @param key String key, the map must have string keys
  * @param data Piece of data to associate with the key. Can be NULL
  * @return Negative errno-compatible value on error, 0 on success
  */
@@ -101,7 +208,7 @@ int rs_hmap_insert(struct rs_hmap *map, const char *key, void *data);
  * been inserted twice, only the first occurrence found is removed.
  *
  * @param map Hash map
- * @param key String key
+ * @param key String key, the map must have string keys
  * @param data In output, a pointer to a matching data, or NULL if no entry was
  * found. can't be NULL
  * @return Negative errno-compatible value on error, 0 on success. -ENOENT if
@@ -109,6 +216,47 @@ int rs_hmap_insert(struct rs_hmap *map, const char *key, void *data);
  */
 int rs_hmap_remove(struct rs_hmap *map, const char *key, void **data);
 
+/**
+ * Same as rs_hmap_lookup(), for a map of any type of keys
+ * @param map Hash map
+ * @param key Pointer to the key, i.e. to an uint32_t for RS_HMAP_KEY_U32, to
+ * the first byte for RS_HMAP_KEY_BINARY, or the string itself
+ * @param data In output, a pointer to a matching data, or to NULL if no entry
+ * was found. can't be NULL
+ * @return Negative errno-compatible value on error, 0 on success. -ENOENT if
+ * the entry wasn't found
+ */
+int rs_hmap_lookup_key(struct rs_hmap *map, const void *key, void **data);
+
+/**
+ * Same as rs_hmap_insert(), for a map of any type of keys, the key is copied
+ * @param map Hash map
+ * @param key Pointer to the key, see rs_hmap_lookup_key()
+ * @param data Piece of data to associate with the key. Can be NULL
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_hmap_insert_key(struct rs_hmap *map, const void *key, void *data);
+
+/**
+ * Same as rs_hmap_remove(), for a map of any type of keys
+ * @param map Hash map
+ * @param key Pointer to the key, see rs_hmap_lookup_key()
+ * @param data In output, a pointer to a matching data, or NULL if no entry was
+ * found. can be NULL
+ * @return Negative errno-compatible value on error, 0 on success. -ENOENT if
+ * the entry wasn't found
+ */
+int rs_hmap_remove_key(struct rs_hmap *map, const void *key, void **data);
+
+/**
+ * Returns the key of an entry, whether it is allocated or stored inline
+ * @param map Hash map the entry belongs to
+ * @param entry Entry
+ * @return Key of the entry, NULL on error
+ */
+const void *rs_hmap_get_entry_key(const struct rs_hmap *map,
+		const struct rs_hmap_entry *entry);
+
 #ifdef __cplusplus
 }
 #endif
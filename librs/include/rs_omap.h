@@ -0,0 +1,140 @@
+/**
+ * @file rs_omap.h
+ *
+ * @brief open addressing hash map, with string keys. Contrary to rs_hmap, the
+ * map grows with the number of entries it holds. The entries are stored in a
+ * flat array of slots, with one control byte per slot, holding 7 bits of the
+ * key's hash, the control bytes being probed by groups of
+ * RS_OMAP_GROUP_WIDTH, using SIMD instructions when available, so that most
+ * lookups compare at most one key. Growing is incremental, the entries of the
+ * previous array being moved a few at a time, by the following operations
+ *
+ * Copyright (C) 2013 Parrot S.A.
+ */
+
+#ifndef RS_OMAP_H_
+#define RS_OMAP_H_
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def RS_OMAP_GROUP_WIDTH
+ * @brief Number of control bytes probed at once
+ */
+#define RS_OMAP_GROUP_WIDTH 16
+
+/**
+ * @def RS_OMAP_SIZE_MAX
+ * @brief Maximum number of entries a map can be initialized for
+ */
+#define RS_OMAP_SIZE_MAX (1U << 30)
+
+/**
+ * @struct rs_omap_slot
+ * @brief Slot of an open addressing hash map
+ */
+struct rs_omap_slot {
+	uint32_t hash;			/**< full hash of the key */
+	char *key;			/**< entry key */
+	void *data;			/**< entry data */
+};
+
+/**
+ * @struct rs_omap_table
+ * @brief Array of slots and their control bytes, internal
+ */
+struct rs_omap_table {
+	uint8_t *ctrl;			/**< capacity + group width bytes */
+	struct rs_omap_slot *slots;	/**< capacity slots */
+	size_t mask;			/**< capacity - 1, power of two */
+	size_t growth_left;		/**< inserts left before growing */
+	size_t tombstones;		/**< slots of removed entries */
+};
+
+/**
+ * @struct rs_omap
+ * @brief Open addressing hash map structure
+ */
+struct rs_omap {
+	struct rs_omap_table table;	/**< slots the entries are added to */
+	struct rs_omap_table old;	/**< slots being moved, if growing */
+	size_t moved;			/**< number of old slots processed */
+	size_t count;			/**< number of entries */
+};
+
+/**
+ * Initializes an open addressing hash map. When not used anymore, it must be
+ * cleaned with a call to rs_omap_clean()
+ * @param map Hash map to initialize
+ * @param size Number of entries the map is expected to hold, it grows past
+ * it if needed, can't be more than RS_OMAP_SIZE_MAX
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_omap_init(struct rs_omap *map, size_t size);
+
+/**
+ * Reinitializes a hash map. Releases internally used resources. Equivalent to
+ * rs_omap_clean_cb(map, NULL);
+ * @param map Hash map to clean
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_omap_clean(struct rs_omap *map);
+
+/**
+ * Reinitializes a hash map. Releases internally used resources and allows the
+ * user to free the resources still referenced in the map, via a callback
+ * @param map Hash map to clean
+ * @param free_cb callback called on each value still stored in the map, can
+ * be NULL
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+int rs_omap_clean_cb(struct rs_omap *map, void (*free_cb)(void *));
+
+/**
+ * Lookup an entry in hash map
+ * @param map Hash map
+ * @param key String key
+ * @param data In output, a pointer to the matching data, or to NULL if no
+ * entry was found. can't be NULL
+ * @return Negative errno-compatible value on error, 0 on success. -ENOENT if
+ * the entry wasn't found
+ */
+int rs_omap_lookup(struct rs_omap *map, const char *key, void **data);
+
+/**
+ * Insert an entry in hash map, the key is duplicated
+ * @param map Hash map
+ * @param key String key
+ * @param data Piece of data to associate with the key. Can be NULL
+ * @return Negative errno-compatible value on error, 0 on success. -EEXIST if
+ * an entry with the same key is already present
+ */
+int rs_omap_insert(struct rs_omap *map, const char *key, void *data);
+
+/**
+ * Remove an entry from hash map and retrieve associated data
+ * @param map Hash map
+ * @param key String key
+ * @param data In output, a pointer to the matching data, or NULL if no entry
+ * was found. can be NULL
+ * @return Negative errno-compatible value on error, 0 on success. -ENOENT if
+ * the entry wasn't found
+ */
+int rs_omap_remove(struct rs_omap *map, const char *key, void **data);
+
+/**
+ * Returns the number of entries of a hash map
+ * @param map Hash map
+ * @return Number of entries, 0 if map is NULL
+ */
+size_t rs_omap_get_count(const struct rs_omap *map);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RS_OMAP_H_ */
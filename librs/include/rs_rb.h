@@ -59,6 +59,18 @@ int rs_rb_init(struct rs_rb *rb, void *buffer, size_t size);
  */
 size_t rs_rb_get_size(struct rs_rb *rb);
 
+/**
+ * Changes the size of a ring buffer, preserving the data it contains. Only
+ * ring buffers whose memory is managed by rs_rb, i.e. initialized with a NULL
+ * buffer, can be resized.
+ * @param rb Ring buffer
+ * @param size New size of the buffer, rounded the same way as in rs_rb_init()
+ * @return -ENOBUFS if the data stored doesn't fit in the new size, another
+ * negative errno-compatible value on error, 0 otherwise. On error, the ring
+ * buffer is left untouched
+ */
+int rs_rb_resize(struct rs_rb *rb, size_t size);
+
 /**
  * Empty a buffer
  * @param rb Ring buffer
@@ -0,0 +1,372 @@
+/**
+ * @file rs_cmap.c
+ *
+ * @brief concurrent hash map implementation. The epoch is incremented each
+ * time an entry is unlinked, the entry being tagged with the epoch before the
+ * increment. A reader entering a read section publishes the current epoch, so
+ * a reader which has published an epoch greater than the entry's one has
+ * loaded it after the entry was unlinked, and can't reach it. Hence an entry
+ * can be freed when all the readers in a read section have published a
+ * greater epoch.
+ *
+ * Copyright (C) 2013 Parrot S.A.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <ut_string.h>
+
+#include "rs_cmap.h"
+
+/**
+ * Says whether or not a concurrent hash map is valid
+ * @param map Hash map to test
+ * @return non-zero if the hash map is invalid, 0 otherwise
+ */
+static int map_is_invalid(const struct rs_cmap *map)
+{
+	return NULL == map || NULL == map->buckets;
+}
+
+static uint32_t hash_key(const struct rs_cmap *map, const char *key)
+{
+	return rs_hmap_hash_sip(key, strlen(key), &map->seed);
+}
+
+static pthread_mutex_t *stripe(struct rs_cmap *map, size_t bucket)
+{
+	return map->stripes + (bucket & (RS_CMAP_STRIPES - 1));
+}
+
+static void free_node(struct rs_cmap *map, struct rs_cmap_node *node)
+{
+	if (NULL != map->free_cb)
+		map->free_cb(node->data);
+	free(node);
+}
+
+/**
+ * Searches an entry in a bucket, whose stripe must be locked
+ * @param map Hash map
+ * @param bucket Index of the bucket
+ * @param key Key
+ * @param hash Hash of the key
+ * @param link In output, pointer to the link to the entry found
+ * @return Entry found, NULL if none
+ */
+static struct rs_cmap_node *find_locked(struct rs_cmap *map, size_t bucket,
+		const char *key, uint32_t hash, struct rs_cmap_node ***link)
+{
+	struct rs_cmap_node **l = map->buckets + bucket;
+	struct rs_cmap_node *node;
+
+	for (node = *l; NULL != node; l = &node->next, node = *l)
+		if (node->hash == hash && strcmp(node->key, key) == 0)
+			break;
+	*link = l;
+
+	return node;
+}
+
+/**
+ * Frees the removed entries no reader in a read section can reach
+ * @param map Hash map, whose lock must be held
+ * @return Number of removed entries left
+ */
+static int reclaim_locked(struct rs_cmap *map)
+{
+	struct rs_cmap_reader *reader;
+	struct rs_cmap_node **link;
+	struct rs_cmap_node *node;
+	uint64_t min = UINT64_MAX;
+	uint64_t epoch;
+	int left = 0;
+
+	/* pairs with the fence of rs_cmap_read_lock() */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for (reader = map->readers; NULL != reader; reader = reader->next) {
+		epoch = __atomic_load_n(&reader->epoch, __ATOMIC_SEQ_CST);
+		if (epoch != 0 && epoch < min)
+			min = epoch;
+	}
+
+	link = &map->retired;
+	while (NULL != (node = *link)) {
+		if (node->epoch < min) {
+			*link = node->retired;
+			free_node(map, node);
+		} else {
+			link = &node->retired;
+			left++;
+		}
+	}
+
+	return left;
+}
+
+/**
+ * Schedules the freeing of an entry, just unlinked from its bucket
+ * @param map Hash map
+ * @param node Entry
+ */
+static void retire(struct rs_cmap *map, struct rs_cmap_node *node)
+{
+	pthread_mutex_lock(&map->lock);
+	node->epoch = __atomic_fetch_add(&map->epoch, 1, __ATOMIC_SEQ_CST);
+	node->retired = map->retired;
+	map->retired = node;
+	reclaim_locked(map);
+	pthread_mutex_unlock(&map->lock);
+}
+
+static int add(struct rs_cmap *map, const char *key, void *data, bool replace)
+{
+	struct rs_cmap_node **link;
+	struct rs_cmap_node *node;
+	struct rs_cmap_node *old;
+	size_t length;
+	size_t bucket;
+
+	if (map_is_invalid(map) || ut_string_is_invalid(key))
+		return -EINVAL;
+
+	length = strlen(key);
+	node = malloc(sizeof(*node) + length + 1);
+	if (NULL == node)
+		return -ENOMEM;
+	memcpy(node->key, key, length + 1);
+	node->hash = hash_key(map, key);
+	node->data = data;
+	node->retired = NULL;
+	node->epoch = 0;
+
+	bucket = node->hash & map->mask;
+	pthread_mutex_lock(stripe(map, bucket));
+	old = find_locked(map, bucket, key, node->hash, &link);
+	if (NULL != old && !replace) {
+		pthread_mutex_unlock(stripe(map, bucket));
+		free(node);
+		return -EEXIST;
+	}
+	if (NULL != old) {
+		/* readers on old can still go on to the next entries */
+		node->next = old->next;
+	} else {
+		node->next = map->buckets[bucket];
+		link = map->buckets + bucket;
+		__atomic_add_fetch(&map->count, 1, __ATOMIC_RELAXED);
+	}
+	/* the node must be visible initialized */
+	__atomic_store_n(link, node, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(stripe(map, bucket));
+
+	if (NULL != old)
+		retire(map, old);
+
+	return 0;
+}
+
+int rs_cmap_init(struct rs_cmap *map, size_t size, void (*free_cb)(void *))
+{
+	size_t buckets = 1;
+	int i;
+
+	if (NULL == map)
+		return -EINVAL;
+	if (RS_CMAP_SIZE_MAX < size)
+		return -E2BIG;
+
+	while (buckets < size)
+		buckets <<= 1;
+
+	memset(map, 0, sizeof(*map));
+	map->buckets = calloc(buckets, sizeof(*map->buckets));
+	if (NULL == map->buckets)
+		return -errno;
+	map->mask = buckets - 1;
+	rs_hmap_get_default_seed(&map->seed);
+	map->free_cb = free_cb;
+	/* 0 means outside of a read section */
+	map->epoch = 1;
+	pthread_mutex_init(&map->lock, NULL);
+	for (i = 0; i < RS_CMAP_STRIPES; i++)
+		pthread_mutex_init(map->stripes + i, NULL);
+
+	return 0;
+}
+
+int rs_cmap_clean(struct rs_cmap *map)
+{
+	struct rs_cmap_node *node;
+	size_t i;
+
+	if (NULL == map)
+		return -EINVAL;
+	if (NULL == map->buckets)
+		return 0;
+
+	for (i = 0; i <= map->mask; i++) {
+		while (NULL != (node = map->buckets[i])) {
+			map->buckets[i] = node->next;
+			free_node(map, node);
+		}
+	}
+	while (NULL != (node = map->retired)) {
+		map->retired = node->retired;
+		free_node(map, node);
+	}
+	pthread_mutex_destroy(&map->lock);
+	for (i = 0; i < RS_CMAP_STRIPES; i++)
+		pthread_mutex_destroy(map->stripes + i);
+	free(map->buckets);
+	memset(map, 0, sizeof(*map));
+
+	return 0;
+}
+
+int rs_cmap_reader_register(struct rs_cmap *map,
+		struct rs_cmap_reader *reader)
+{
+	if (map_is_invalid(map) || NULL == reader)
+		return -EINVAL;
+
+	memset(reader, 0, sizeof(*reader));
+	pthread_mutex_lock(&map->lock);
+	reader->next = map->readers;
+	map->readers = reader;
+	pthread_mutex_unlock(&map->lock);
+
+	return 0;
+}
+
+int rs_cmap_reader_unregister(struct rs_cmap *map,
+		struct rs_cmap_reader *reader)
+{
+	struct rs_cmap_reader **link;
+	int ret = -ENOENT;
+
+	if (map_is_invalid(map) || NULL == reader)
+		return -EINVAL;
+	if (reader->depth != 0)
+		return -EBUSY;
+
+	pthread_mutex_lock(&map->lock);
+	for (link = &map->readers; NULL != *link; link = &(*link)->next) {
+		if (*link == reader) {
+			*link = reader->next;
+			ret = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&map->lock);
+
+	return ret;
+}
+
+void rs_cmap_read_lock(struct rs_cmap *map, struct rs_cmap_reader *reader)
+{
+	uint64_t epoch;
+
+	if (reader->depth++ != 0)
+		return;
+
+	epoch = __atomic_load_n(&map->epoch, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&reader->epoch, epoch, __ATOMIC_RELAXED);
+	/*
+	 * either the writers see the epoch published, or this reader sees the
+	 * entries they have unlinked before, as unlinked
+	 */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void rs_cmap_read_unlock(struct rs_cmap_reader *reader)
+{
+	if (--reader->depth == 0)
+		__atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+int rs_cmap_lookup(struct rs_cmap *map, struct rs_cmap_reader *reader,
+		const char *key, void **data)
+{
+	struct rs_cmap_node *node;
+	uint32_t hash;
+
+	if (map_is_invalid(map) || NULL == reader ||
+			ut_string_is_invalid(key) || NULL == data)
+		return -EINVAL;
+
+	*data = NULL;
+	hash = hash_key(map, key);
+	rs_cmap_read_lock(map, reader);
+	node = __atomic_load_n(map->buckets + (hash & map->mask),
+			__ATOMIC_ACQUIRE);
+	while (NULL != node &&
+			(node->hash != hash || strcmp(node->key, key) != 0))
+		node = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+	if (NULL != node)
+		*data = node->data;
+	rs_cmap_read_unlock(reader);
+
+	return NULL == node ? -ENOENT : 0;
+}
+
+int rs_cmap_insert(struct rs_cmap *map, const char *key, void *data)
+{
+	return add(map, key, data, false);
+}
+
+int rs_cmap_replace(struct rs_cmap *map, const char *key, void *data)
+{
+	return add(map, key, data, true);
+}
+
+int rs_cmap_remove(struct rs_cmap *map, const char *key)
+{
+	struct rs_cmap_node **link;
+	struct rs_cmap_node *node;
+	uint32_t hash;
+	size_t bucket;
+
+	if (map_is_invalid(map) || ut_string_is_invalid(key))
+		return -EINVAL;
+
+	hash = hash_key(map, key);
+	bucket = hash & map->mask;
+	pthread_mutex_lock(stripe(map, bucket));
+	node = find_locked(map, bucket, key, hash, &link);
+	if (NULL == node) {
+		pthread_mutex_unlock(stripe(map, bucket));
+		return -ENOENT;
+	}
+	__atomic_store_n(link, node->next, __ATOMIC_RELEASE);
+	__atomic_sub_fetch(&map->count, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(stripe(map, bucket));
+
+	retire(map, node);
+
+	return 0;
+}
+
+int rs_cmap_reclaim(struct rs_cmap *map)
+{
+	int left;
+
+	if (map_is_invalid(map))
+		return -EINVAL;
+
+	pthread_mutex_lock(&map->lock);
+	left = reclaim_locked(map);
+	pthread_mutex_unlock(&map->lock);
+
+	return left;
+}
+
+size_t rs_cmap_get_count(const struct rs_cmap *map)
+{
+	return NULL == map ? 0 : __atomic_load_n(&map->count,
+			__ATOMIC_RELAXED);
+}
@@ -283,6 +283,30 @@ struct rs_node *rs_dll_remove(struct rs_dll *dll, struct rs_node *node)
 	return needle == NULL ? NULL : dll_remove_impl(dll, needle);
 }
 
+struct rs_node *rs_dll_remove_node(struct rs_dll *dll, struct rs_node *node)
+{
+	if (NULL == dll || NULL == node)
+		return NULL;
+
+	/* keep list coherent */
+	if (node == dll->head)
+		dll->head = node->next;
+	if (node == dll->tail)
+		dll->tail = node->prev;
+
+	/* unchain */
+	if (node->next)
+		node->next->prev = node->prev;
+	if (node->prev)
+		node->prev->next = node->next;
+	node->next = node->prev = NULL;
+	dll->count--;
+
+	rs_dll_rewind(dll);
+
+	return node;
+}
+
 int rs_dll_foreach(struct rs_dll *dll, rs_node_cb cb)
 {
 	struct rs_node *n;
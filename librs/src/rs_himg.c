@@ -0,0 +1,438 @@
+/**
+ * @file rs_himg.c
+ *
+ * @brief hash map images implementation. The slots are sized for a load
+ * factor of 1/2 at most, so that the linear probing sequences stay short and
+ * always end on an empty slot
+ *
+ * Copyright (C) 2013 Parrot S.A.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include "rs_himg.h"
+
+/**
+ * @def ALIGN8
+ * @brief Rounds up to the next multiple of 8
+ */
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t)7)
+
+/**
+ * @struct rs_himg_builder_entry
+ * @brief Entry added to a builder
+ */
+struct rs_himg_builder_entry {
+	uint8_t *buffer;		/**< key, followed by value */
+	uint32_t key_len;		/**< size of the key */
+	uint32_t value_len;		/**< size of the value */
+};
+
+static uint64_t record_size(uint64_t key_len, uint64_t value_len)
+{
+	return ALIGN8(ALIGN8(sizeof(struct rs_himg_record) + key_len) +
+			value_len);
+}
+
+static const void *record_value(const struct rs_himg_record *record)
+{
+	return (const uint8_t *)record +
+			ALIGN8(sizeof(*record) + record->key_len);
+}
+
+static uint64_t slots_offset(void)
+{
+	return ALIGN8(sizeof(struct rs_himg_header));
+}
+
+int rs_himg_builder_init(struct rs_himg_builder *builder)
+{
+	if (NULL == builder)
+		return -EINVAL;
+
+	memset(builder, 0, sizeof(*builder));
+	rs_hmap_get_default_seed(&builder->seed);
+
+	return 0;
+}
+
+int rs_himg_builder_set_seed(struct rs_himg_builder *builder,
+		const struct rs_hmap_seed *seed)
+{
+	if (NULL == builder || NULL == seed)
+		return -EINVAL;
+
+	builder->seed = *seed;
+
+	return 0;
+}
+
+int rs_himg_builder_add(struct rs_himg_builder *builder, const void *key,
+		size_t key_len, const void *value, size_t value_len)
+{
+	struct rs_himg_builder_entry *entries;
+	struct rs_himg_builder_entry *entry;
+	size_t capacity;
+
+	if (NULL == builder || NULL == key || 0 == key_len ||
+			(NULL == value && 0 != value_len))
+		return -EINVAL;
+	if (key_len > UINT32_MAX || value_len > UINT32_MAX)
+		return -EFBIG;
+
+	if (builder->count == builder->capacity) {
+		capacity = builder->capacity == 0 ? 64 : 2 * builder->capacity;
+		entries = realloc(builder->entries,
+				capacity * sizeof(*entries));
+		if (NULL == entries)
+			return -ENOMEM;
+		builder->entries = entries;
+		builder->capacity = capacity;
+	}
+
+	entry = builder->entries + builder->count;
+	entry->buffer = malloc(key_len + value_len);
+	if (NULL == entry->buffer)
+		return -ENOMEM;
+	memcpy(entry->buffer, key, key_len);
+	if (0 != value_len)
+		memcpy(entry->buffer + key_len, value, value_len);
+	entry->key_len = key_len;
+	entry->value_len = value_len;
+	builder->count++;
+
+	return 0;
+}
+
+int rs_himg_builder_add_hmap(struct rs_himg_builder *builder,
+		struct rs_hmap *map, rs_himg_value_cb cb, void *userdata)
+{
+	struct rs_hmap_entry *entry;
+	const void *value;
+	const void *key;
+	size_t value_len;
+	size_t key_len;
+	size_t i;
+	int ret;
+
+	if (NULL == builder || NULL == map || NULL == map->buckets)
+		return -EINVAL;
+
+	for (i = 0; i < map->size; i++) {
+		for (entry = map->buckets[i]; NULL != entry;
+				entry = entry->next) {
+			key = rs_hmap_get_entry_key(map, entry);
+			if (map->key_type == RS_HMAP_KEY_STRING)
+				key_len = strlen(key);
+			else
+				key_len = map->key_len;
+			value = NULL;
+			value_len = 0;
+			if (NULL != cb) {
+				ret = cb(entry->data, &value, &value_len,
+						userdata);
+				if (ret < 0)
+					return ret;
+			}
+			ret = rs_himg_builder_add(builder, key, key_len, value,
+					value_len);
+			if (ret < 0)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Serializes the entries of a builder
+ * @param builder Builder
+ * @param size In output, size of the image
+ * @param image In output, image allocated, to free
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+static int build(struct rs_himg_builder *builder, uint8_t **image,
+		uint64_t *size)
+{
+	struct rs_himg_builder_entry *entry;
+	struct rs_himg_header *header;
+	struct rs_himg_record *record;
+	struct rs_himg_record *other;
+	struct rs_himg_slot *slots;
+	uint64_t nslots = 8;
+	uint64_t offset;
+	uint32_t hash;
+	uint32_t i;
+	size_t n;
+
+	while (nslots < 2 * (uint64_t)builder->count)
+		nslots <<= 1;
+	*size = slots_offset() + nslots * sizeof(*slots);
+	for (n = 0; n < builder->count; n++)
+		*size += record_size(builder->entries[n].key_len,
+				builder->entries[n].value_len);
+	/* offsets are stored on 32 bits */
+	if (*size > UINT32_MAX || *size > SIZE_MAX)
+		return -EFBIG;
+
+	*image = calloc(1, *size);
+	if (NULL == *image)
+		return -ENOMEM;
+	header = (struct rs_himg_header *)*image;
+	header->magic = RS_HIMG_MAGIC;
+	header->version = RS_HIMG_VERSION;
+	header->size = *size;
+	header->seed = builder->seed;
+	header->count = builder->count;
+	header->mask = nslots - 1;
+	slots = (struct rs_himg_slot *)(*image + slots_offset());
+
+	offset = slots_offset() + nslots * sizeof(*slots);
+	for (n = 0; n < builder->count; n++) {
+		entry = builder->entries + n;
+		record = (struct rs_himg_record *)(*image + offset);
+		record->key_len = entry->key_len;
+		record->value_len = entry->value_len;
+		memcpy(record->key, entry->buffer, entry->key_len);
+		memcpy((uint8_t *)record_value(record),
+				entry->buffer + entry->key_len,
+				entry->value_len);
+
+		hash = rs_hmap_hash_sip(entry->buffer, entry->key_len,
+				&builder->seed);
+		for (i = hash & header->mask; slots[i].offset != 0;
+				i = (i + 1) & header->mask) {
+			other = (struct rs_himg_record *)(*image +
+					slots[i].offset);
+			if (slots[i].hash == hash &&
+					other->key_len == record->key_len &&
+					memcmp(other->key, record->key,
+						record->key_len) == 0) {
+				free(*image);
+				return -EEXIST;
+			}
+		}
+		slots[i].hash = hash;
+		slots[i].offset = offset;
+		offset += record_size(entry->key_len, entry->value_len);
+	}
+
+	return 0;
+}
+
+int rs_himg_builder_write(struct rs_himg_builder *builder, const char *path)
+{
+	uint8_t *image = NULL;
+	char *tmp = NULL;
+	uint64_t size;
+	uint64_t done = 0;
+	ssize_t sret;
+	int ret;
+	int fd;
+
+	if (NULL == builder || NULL == path || '\0' == *path)
+		return -EINVAL;
+
+	ret = build(builder, &image, &size);
+	if (ret < 0)
+		return ret;
+
+	/* written aside, then renamed, for the readers to never see it partial */
+	ret = asprintf(&tmp, "%s.XXXXXX", path);
+	if (ret < 0) {
+		tmp = NULL;
+		ret = -ENOMEM;
+		goto out;
+	}
+	fd = mkostemp(tmp, O_CLOEXEC);
+	if (-1 == fd) {
+		ret = -errno;
+		goto out;
+	}
+	while (done < size) {
+		sret = write(fd, image + done, size - done);
+		if (-1 == sret) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			break;
+		}
+		done += sret;
+	}
+	if (done == size && (fchmod(fd, 0644) == -1 || fsync(fd) == -1))
+		ret = -errno;
+	close(fd);
+	if (done == size && ret >= 0 && rename(tmp, path) == -1)
+		ret = -errno;
+	if (ret < 0)
+		unlink(tmp);
+	else
+		ret = 0;
+out:
+	free(tmp);
+	free(image);
+
+	return ret;
+}
+
+int rs_himg_builder_clean(struct rs_himg_builder *builder)
+{
+	size_t i;
+
+	if (NULL == builder)
+		return -EINVAL;
+
+	for (i = 0; i < builder->count; i++)
+		free(builder->entries[i].buffer);
+	free(builder->entries);
+	memset(builder, 0, sizeof(*builder));
+
+	return 0;
+}
+
+int rs_himg_open(struct rs_himg *img, const char *path)
+{
+	const struct rs_himg_header *header;
+	struct stat st;
+	void *base;
+	int ret;
+	int fd;
+
+	if (NULL == img || NULL == path)
+		return -EINVAL;
+
+	memset(img, 0, sizeof(*img));
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (-1 == fd)
+		return -errno;
+	if (fstat(fd, &st) == -1) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+	if ((uint64_t)st.st_size < slots_offset() ||
+			(uint64_t)st.st_size > SIZE_MAX) {
+		close(fd);
+		return -EPROTO;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	ret = -errno;
+	close(fd);
+	if (MAP_FAILED == base)
+		return ret;
+
+	header = base;
+	if (header->magic != RS_HIMG_MAGIC ||
+			header->version != RS_HIMG_VERSION ||
+			header->size != (uint64_t)st.st_size ||
+			(header->mask & (header->mask + 1ULL)) != 0 ||
+			header->count > header->mask ||
+			slots_offset() + (header->mask + 1ULL) *
+			sizeof(struct rs_himg_slot) > header->size) {
+		munmap(base, st.st_size);
+		return -EPROTO;
+	}
+
+	img->base = base;
+	img->size = st.st_size;
+	img->header = header;
+	img->slots = (const struct rs_himg_slot *)(img->base + slots_offset());
+
+	return 0;
+}
+
+/**
+ * Returns the record at a given offset, if it lies in the image
+ * @param img Image
+ * @param offset Offset of the record
+ * @return Record, NULL if the image is corrupted
+ */
+static const struct rs_himg_record *record_at(const struct rs_himg *img,
+		uint32_t offset)
+{
+	const struct rs_himg_record *record;
+
+	if (offset % 8 != 0 ||
+			offset + sizeof(*record) > (uint64_t)img->size)
+		return NULL;
+	record = (const struct rs_himg_record *)(img->base + offset);
+	if (offset + record_size(record->key_len, record->value_len) >
+			(uint64_t)img->size)
+		return NULL;
+
+	return record;
+}
+
+int rs_himg_lookup(const struct rs_himg *img, const void *key,
+		size_t key_len, const void **value, size_t *value_len)
+{
+	const struct rs_himg_record *record;
+	const struct rs_himg_slot *slot;
+	uint32_t mask;
+	uint32_t hash;
+	uint64_t probe;
+	uint32_t i;
+
+	if (NULL == img || NULL == img->base || NULL == key || 0 == key_len ||
+			NULL == value)
+		return -EINVAL;
+
+	*value = NULL;
+	mask = img->header->mask;
+	hash = rs_hmap_hash_sip(key, key_len, &img->header->seed);
+	for (probe = 0, i = hash & mask; probe <= mask;
+			probe++, i = (i + 1) & mask) {
+		slot = img->slots + i;
+		if (slot->offset == 0)
+			return -ENOENT;
+		if (slot->hash != hash)
+			continue;
+		record = record_at(img, slot->offset);
+		if (NULL == record)
+			return -EPROTO;
+		if (record->key_len != key_len ||
+				memcmp(record->key, key, key_len) != 0)
+			continue;
+
+		*value = record_value(record);
+		if (NULL != value_len)
+			*value_len = record->value_len;
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+size_t rs_himg_get_count(const struct rs_himg *img)
+{
+	if (NULL == img || NULL == img->header)
+		return 0;
+
+	return img->header->count;
+}
+
+int rs_himg_close(struct rs_himg *img)
+{
+	if (NULL == img)
+		return -EINVAL;
+
+	if (NULL != img->base)
+		munmap((void *)img->base, img->size);
+	memset(img, 0, sizeof(*img));
+
+	return 0;
+}
@@ -12,11 +12,18 @@
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE
 #endif
+#include <sys/types.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+
 #include <assert.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <time.h>
 
 #include <ut_string.h>
 
@@ -38,21 +45,81 @@ static const uint32_t hash_prime[] = {
 };
 
 /**
- * Converts a string to a hash value. by Daniel Bernstein djb2 string hash
- * function
- * @see http://www.cse.yorku.ca/~oz/hash.html
- * @param key String to compute the hash of
- * @return hash value
- **/
-static uint32_t hash_string(const char *key)
+ * @var default_seed
+ * @brief Seed of the maps whose seed hasn't been set explicitly
+ */
+static struct rs_hmap_seed default_seed;
+
+/**
+ * constructor called at the library's loading, chooses the default seed
+ */
+static void __attribute__ ((constructor)) default_seed_init(void)
 {
-	const unsigned char *str = (const unsigned char *)key;
-	uint32_t hash = 5381;
-	unsigned int c;
-	while ((c = *str++))
-		hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+	struct timespec ts;
+	ssize_t ret = -1;
+	int fd;
+
+	fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+	if (fd != -1) {
+		ret = read(fd, &default_seed, sizeof(default_seed));
+		close(fd);
+	}
+	if (ret == sizeof(default_seed))
+		return;
 
-	return hash;
+	/* weaker, but still not known in advance */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	default_seed.k0 = ts.tv_nsec ^ ((uint64_t)getpid() << 32);
+	default_seed.k1 = ts.tv_sec ^ (uintptr_t)&ts;
+}
+
+void rs_hmap_get_default_seed(struct rs_hmap_seed *seed)
+{
+	if (NULL != seed)
+		*seed = default_seed;
+}
+
+#define ROTL64(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIP_ROUND(v0, v1, v2, v3) do { \
+	v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32); \
+	v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2; \
+	v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0; \
+	v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32); \
+} while (0)
+
+uint32_t rs_hmap_hash_sip(const void *key, size_t len,
+		const struct rs_hmap_seed *seed)
+{
+	const uint8_t *in = key;
+	const uint8_t *end = in + (len & ~(size_t)7);
+	uint64_t v0 = seed->k0 ^ 0x736f6d6570736575ULL;
+	uint64_t v1 = seed->k1 ^ 0x646f72616e646f6dULL;
+	uint64_t v2 = seed->k0 ^ 0x6c7967656e657261ULL;
+	uint64_t v3 = seed->k1 ^ 0x7465646279746573ULL;
+	uint64_t b = (uint64_t)len << 56;
+	uint64_t m;
+	int i;
+
+	for (; in != end; in += 8) {
+		memcpy(&m, in, sizeof(m));
+		v3 ^= m;
+		SIP_ROUND(v0, v1, v2, v3);
+		v0 ^= m;
+	}
+	for (i = len & 7; i > 0; i--)
+		b |= (uint64_t)in[i - 1] << (8 * (i - 1));
+	v3 ^= b;
+	SIP_ROUND(v0, v1, v2, v3);
+	v0 ^= b;
+
+	v2 ^= 0xff;
+	SIP_ROUND(v0, v1, v2, v3);
+	SIP_ROUND(v0, v1, v2, v3);
+	SIP_ROUND(v0, v1, v2, v3);
+	b = v0 ^ v1 ^ v2 ^ v3;
+
+	return b ^ (b >> 32);
 }
 
 /**
@@ -65,7 +132,89 @@ static int map_is_invalid(struct rs_hmap *map)
 	return NULL == map || NULL == map->buckets;
 }
 
+/**
+ * Says whether or not a key is valid for a given hash map
+ * @param map Hash map, valid
+ * @param key Key to test
+ * @return non-zero if the key is invalid, 0 otherwise
+ */
+static int key_is_invalid(struct rs_hmap *map, const void *key)
+{
+	if (map->key_type == RS_HMAP_KEY_STRING)
+		return ut_string_is_invalid(key);
+
+	return NULL == key;
+}
+
+static uint32_t hash_key(struct rs_hmap *map, const void *key)
+{
+	size_t len = map->key_len;
+
+	if (map->key_type == RS_HMAP_KEY_STRING)
+		len = strlen(key);
+
+	return map->hash(key, len, &map->seed);
+}
+
+/**
+ * Says whether the keys of a map are allocated or stored inline in the entries
+ * @param map Hash map
+ * @return true if the keys are allocated
+ */
+static bool key_is_allocated(const struct rs_hmap *map)
+{
+	return map->key_type == RS_HMAP_KEY_STRING ||
+			map->key_len > RS_HMAP_INLINE_KEY_SIZE;
+}
+
+static const void *entry_key(const struct rs_hmap *map,
+		const struct rs_hmap_entry *entry)
+{
+	if (key_is_allocated(map))
+		return entry->key;
+
+	return entry->inline_key.bytes;
+}
+
+/**
+ * Frees an entry and its key, if allocated
+ * @param map Hash map the entry belongs to
+ * @param entry Entry to free
+ */
+static void entry_free(const struct rs_hmap *map, struct rs_hmap_entry *entry)
+{
+	if (key_is_allocated(map))
+		free(entry->key);
+	free(entry);
+}
+
+/**
+ * Says whether an entry has a given key, the keys being compared only if
+ * their full hashes are equal
+ * @param map Hash map
+ * @param entry Entry
+ * @param key Key
+ * @param hash Hash of the key
+ * @return true if the entry has the key
+ */
+static bool entry_matches(struct rs_hmap *map, struct rs_hmap_entry *entry,
+		const void *key, uint32_t hash)
+{
+	if (entry->hash != hash)
+		return false;
+	if (map->key_type == RS_HMAP_KEY_STRING)
+		return strcmp(key, entry->key) == 0;
+
+	return memcmp(key, entry_key(map, entry), map->key_len) == 0;
+}
+
 int rs_hmap_init(struct rs_hmap *map, size_t size)
+{
+	return rs_hmap_init_keys(map, size, RS_HMAP_KEY_STRING, 0);
+}
+
+int rs_hmap_init_keys(struct rs_hmap *map, size_t size,
+		enum rs_hmap_key_type type, size_t key_len)
 {
 	size_t i = 0;
 
@@ -74,10 +223,33 @@ int rs_hmap_init(struct rs_hmap *map, size_t size)
 	if (RS_HMAP_PRIME_MAX < size)
 		return -E2BIG;
 
+	switch (type) {
+	case RS_HMAP_KEY_STRING:
+		key_len = 0;
+		break;
+	case RS_HMAP_KEY_U32:
+		key_len = sizeof(uint32_t);
+		break;
+	case RS_HMAP_KEY_U64:
+		key_len = sizeof(uint64_t);
+		break;
+	case RS_HMAP_KEY_BINARY:
+		if (0 == key_len)
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+
 	/* get upper prime number */
 	while (hash_prime[i] <= size)
 		i++;
 
+	memset(map, 0, sizeof(*map));
+	map->key_type = type;
+	map->key_len = key_len;
+	map->hash = rs_hmap_hash_sip;
+	map->seed = default_seed;
 	map->size = hash_prime[i];
 	map->buckets = calloc(map->size, sizeof(*map->buckets));
 	if (NULL == map->buckets)
@@ -86,6 +258,22 @@ int rs_hmap_init(struct rs_hmap *map, size_t size)
 	return 0;
 }
 
+int rs_hmap_set_hash(struct rs_hmap *map, rs_hmap_hash_cb hash,
+		const struct rs_hmap_seed *seed)
+{
+	if (map_is_invalid(map))
+		return -EINVAL;
+	/* the hashes cached in the entries would be wrong */
+	if (0 != map->count)
+		return -EBUSY;
+
+	map->hash = NULL != hash ? hash : rs_hmap_hash_sip;
+	if (NULL != seed)
+		map->seed = *seed;
+
+	return 0;
+}
+
 int rs_hmap_clean(struct rs_hmap *map)
 {
 	return rs_hmap_clean_cb(map, NULL);
@@ -105,8 +293,7 @@ int rs_hmap_clean_cb(struct rs_hmap *map, void (*free_cb)(void *))
 			next = entry->next;
 			if (free_cb)
 				free_cb(entry->data);
-			free(entry->key);
-			free(entry);
+			entry_free(map, entry);
 			entry = next;
 		}
 	}
@@ -118,42 +305,51 @@ int rs_hmap_clean_cb(struct rs_hmap *map, void (*free_cb)(void *))
 
 int rs_hmap_lookup(struct rs_hmap *map, const char *key,
 		void **data)
+{
+	if (map_is_invalid(map) || map->key_type != RS_HMAP_KEY_STRING)
+		return -EINVAL;
+
+	return rs_hmap_lookup_key(map, key, data);
+}
+
+int rs_hmap_lookup_key(struct rs_hmap *map, const void *key, void **data)
 {
 	struct rs_hmap_entry *entry;
 	uint32_t hash;
 
-	if (map_is_invalid(map) || ut_string_is_invalid(key) || NULL == data)
+	if (map_is_invalid(map) || key_is_invalid(map, key) || NULL == data)
 		return -EINVAL;
 
 	*data = NULL;
-	hash = hash_string(key);
-	hash = hash % map->size;
-	entry = map->buckets[hash];
+	hash = hash_key(map, key);
+	entry = map->buckets[hash % map->size];
 
-	if (!entry)
+	/* a lone entry in the bucket can have another key as well */
+	while (NULL != entry && !entry_matches(map, entry, key, hash))
+		entry = entry->next;
+	if (NULL == entry)
 		return -ENOENT;
 
-	/* compare keys only on collision */
-	if (NULL != entry->next) {
-		while (entry && (strcmp(key, entry->key) != 0))
-			entry = entry->next;
-
-		if (NULL == entry)
-			return -ENOENT;
-	}
-
 	(*data) = entry->data;
 
 	return 0;
 }
 
 int rs_hmap_insert(struct rs_hmap *map, const char *key, void *data)
+{
+	if (map_is_invalid(map) || map->key_type != RS_HMAP_KEY_STRING)
+		return -EINVAL;
+
+	return rs_hmap_insert_key(map, key, data);
+}
+
+int rs_hmap_insert_key(struct rs_hmap *map, const void *key, void *data)
 {
 	int ret;
 	uint32_t hash;
 	struct rs_hmap_entry *entry;
 
-	if (map_is_invalid(map) || ut_string_is_invalid(key))
+	if (map_is_invalid(map) || key_is_invalid(map, key))
 		return -EINVAL;
 
 	entry = calloc(1, sizeof(*entry));
@@ -163,53 +359,64 @@ int rs_hmap_insert(struct rs_hmap *map, const char *key, void *data)
 	}
 
 	entry->data = data;
-	entry->key = strdup(key);
-	if (NULL == entry->key) {
-		ret = -ENOMEM;
-		goto out;
+	if (map->key_type == RS_HMAP_KEY_STRING) {
+		entry->key = strdup(key);
+		if (NULL == entry->key) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	} else if (key_is_allocated(map)) {
+		entry->key = malloc(map->key_len);
+		if (NULL == entry->key) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		memcpy(entry->key, key, map->key_len);
+	} else {
+		memcpy(entry->inline_key.bytes, key, map->key_len);
 	}
-	hash = hash_string(key);
+	hash = hash_key(map, key);
+	entry->hash = hash;
 	hash = hash % map->size;
 
 	/* insert at list head */
 	entry->next = map->buckets[hash];
 	map->buckets[hash] = entry;
+	map->count++;
 
 	return 0;
 out:
-	if (NULL != entry) {
-		free(entry->key);
-		free(entry);
-	}
+	if (NULL != entry)
+		entry_free(map, entry);
 
 	return ret;
 }
 
 int rs_hmap_remove(struct rs_hmap *map, const char *key,
 			 void **data)
+{
+	if (map_is_invalid(map) || map->key_type != RS_HMAP_KEY_STRING)
+		return -EINVAL;
+
+	return rs_hmap_remove_key(map, key, data);
+}
+
+int rs_hmap_remove_key(struct rs_hmap *map, const void *key, void **data)
 {
 	struct rs_hmap_entry *entry, *prev = NULL;
 	uint32_t hash;
 
-	if (map_is_invalid(map)  || ut_string_is_invalid(key))
+	if (map_is_invalid(map) || key_is_invalid(map, key))
 		return -EINVAL;
 	if (NULL != data)
 		*data = NULL;
 
-	hash = hash_string(key);
-	hash = hash % map->size;
-	entry = map->buckets[hash];
-	if (NULL == entry)
-		return -ENOENT;
-
-	/* compare keys only on collision */
-	if (NULL != entry->next) {
-		while (NULL != entry && (strcmp(key, entry->key) != 0)) {
-			prev = entry;
-			entry = entry->next;
-		}
+	hash = hash_key(map, key);
+	entry = map->buckets[hash % map->size];
+	while (NULL != entry && !entry_matches(map, entry, key, hash)) {
+		prev = entry;
+		entry = entry->next;
 	}
-
 	if (NULL == entry)
 		return -ENOENT;
 
@@ -219,12 +426,21 @@ int rs_hmap_remove(struct rs_hmap *map, const char *key,
 
 	/* remove entry */
 	if (NULL == prev)
-		map->buckets[hash] = entry->next;
+		map->buckets[hash % map->size] = entry->next;
 	else
 		prev->next = entry->next;
+	map->count--;
 
-	free(entry->key);
-	free(entry);
+	entry_free(map, entry);
 
 	return 0;
 }
+
+const void *rs_hmap_get_entry_key(const struct rs_hmap *map,
+		const struct rs_hmap_entry *entry)
+{
+	if (NULL == map || NULL == entry)
+		return NULL;
+
+	return entry_key(map, entry);
+}
@@ -0,0 +1,514 @@
+/**
+ * @file rs_omap.c
+ *
+ * @brief open addressing hash map implementation. Each slot has a control
+ * byte, either CTRL_EMPTY, CTRL_DELETED (tombstone) or, for a full slot, the 7
+ * most significant bits of the hash of its key. The probe sequence visits
+ * groups of RS_OMAP_GROUP_WIDTH consecutive control bytes, the first
+ * RS_OMAP_GROUP_WIDTH ones being mirrored after the last, so that a group
+ * can start anywhere without wrapping. The probe stops at the first group
+ * containing an empty slot.
+ *
+ * Copyright (C) 2013 Parrot S.A.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <ut_string.h>
+
+#include "rs_omap.h"
+
+/**
+ * @def CTRL_EMPTY
+ * @brief Control byte of a slot which has never been used since the last
+ * resize
+ */
+#define CTRL_EMPTY 0x80
+
+/**
+ * @def CTRL_DELETED
+ * @brief Control byte of a slot whose entry has been removed, probes must go
+ * past it
+ */
+#define CTRL_DELETED 0xfe
+
+/**
+ * @def MOVE_BATCH
+ * @brief Number of slots of the previous array processed by each insert or
+ * remove, while growing
+ */
+#define MOVE_BATCH (2 * RS_OMAP_GROUP_WIDTH)
+
+/**
+ * Computes the hash of a string key, FNV-1a, followed by murmur3's finalizer,
+ * for all the bits of the hash, used for probing, to depend on the whole key
+ * @param key String to compute the hash of
+ * @return hash value
+ */
+static uint32_t hash_key(const char *key)
+{
+	const unsigned char *str = (const unsigned char *)key;
+	uint32_t hash = 2166136261U;
+
+	while (*str) {
+		hash ^= *str++;
+		hash *= 16777619U;
+	}
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bU;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35U;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+/**
+ * Returns the control byte stored for a full slot
+ * @param hash Hash of the key of the slot
+ * @return Control byte
+ */
+static uint8_t hash_ctrl(uint32_t hash)
+{
+	return hash >> 25;
+}
+
+#ifdef __SSE2__
+
+/**
+ * Finds the control bytes of a group equal to a given value
+ * @param group First control byte of the group
+ * @param c Value searched
+ * @return Bit mask, bit i being set if byte i matches
+ */
+static uint32_t group_match(const uint8_t *group, uint8_t c)
+{
+	__m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(c)));
+}
+
+/**
+ * Finds the slots of a group which are empty or deleted
+ * @param group First control byte of the group
+ * @return Bit mask, bit i being set if slot i isn't full
+ */
+static uint32_t group_match_free(const uint8_t *group)
+{
+	/* full slots are the only ones with the most significant bit clear */
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+}
+
+#else /* __SSE2__ */
+
+static uint32_t group_match(const uint8_t *group, uint8_t c)
+{
+	uint32_t match = 0;
+	int i;
+
+	for (i = 0; i < RS_OMAP_GROUP_WIDTH; i++)
+		if (group[i] == c)
+			match |= 1U << i;
+
+	return match;
+}
+
+static uint32_t group_match_free(const uint8_t *group)
+{
+	uint32_t match = 0;
+	int i;
+
+	for (i = 0; i < RS_OMAP_GROUP_WIDTH; i++)
+		if (group[i] & 0x80)
+			match |= 1U << i;
+
+	return match;
+}
+
+#endif /* __SSE2__ */
+
+static uint32_t group_match_empty(const uint8_t *group)
+{
+	return group_match(group, CTRL_EMPTY);
+}
+
+static bool ctrl_is_full(uint8_t c)
+{
+	return (c & 0x80) == 0;
+}
+
+/**
+ * Returns the capacity needed to store a given number of entries, the
+ * maximum load factor being 7/8
+ * @param size Number of entries
+ * @return Capacity, a power of two
+ */
+static size_t capacity_for(size_t size)
+{
+	size_t capacity = RS_OMAP_GROUP_WIDTH;
+
+	while (capacity - capacity / 8 < size)
+		capacity <<= 1;
+
+	return capacity;
+}
+
+static int table_alloc(struct rs_omap_table *table, size_t capacity)
+{
+	if (capacity > SIZE_MAX / 2 / sizeof(*table->slots))
+		return -ENOMEM;
+
+	table->ctrl = malloc(capacity + RS_OMAP_GROUP_WIDTH);
+	table->slots = malloc(capacity * sizeof(*table->slots));
+	if (NULL == table->ctrl || NULL == table->slots) {
+		free(table->ctrl);
+		free(table->slots);
+		memset(table, 0, sizeof(*table));
+		return -ENOMEM;
+	}
+	memset(table->ctrl, CTRL_EMPTY, capacity + RS_OMAP_GROUP_WIDTH);
+	table->mask = capacity - 1;
+	table->growth_left = capacity - capacity / 8;
+	table->tombstones = 0;
+
+	return 0;
+}
+
+static void table_free(struct rs_omap_table *table)
+{
+	free(table->ctrl);
+	free(table->slots);
+	memset(table, 0, sizeof(*table));
+}
+
+static void table_set_ctrl(struct rs_omap_table *table, size_t i, uint8_t c)
+{
+	table->ctrl[i] = c;
+	if (i < RS_OMAP_GROUP_WIDTH)
+		table->ctrl[table->mask + 1 + i] = c;
+}
+
+/**
+ * Searches the slot of a key in an array of slots
+ * @param table Array of slots, can be unallocated
+ * @param key Key
+ * @param hash Hash of the key
+ * @param index In output, index of the slot found
+ * @return Slot found, NULL if none
+ */
+static struct rs_omap_slot *table_find(const struct rs_omap_table *table,
+		const char *key, uint32_t hash, size_t *index)
+{
+	const uint8_t *group;
+	struct rs_omap_slot *slot;
+	uint32_t match;
+	size_t probe;
+	size_t pos;
+	size_t i;
+
+	if (NULL == table->ctrl)
+		return NULL;
+
+	pos = hash & table->mask;
+	/* triangular probing visits each group once */
+	for (probe = 1; probe <= (table->mask + 1) / RS_OMAP_GROUP_WIDTH;
+			probe++) {
+		group = table->ctrl + pos;
+		match = group_match(group, hash_ctrl(hash));
+		while (match != 0) {
+			i = (pos + __builtin_ctz(match)) & table->mask;
+			match &= match - 1;
+			slot = table->slots + i;
+			if (slot->hash == hash && strcmp(slot->key, key) == 0) {
+				*index = i;
+				return slot;
+			}
+		}
+		if (group_match_empty(group) != 0)
+			return NULL;
+		pos = (pos + probe * RS_OMAP_GROUP_WIDTH) & table->mask;
+	}
+
+	return NULL;
+}
+
+/**
+ * Stores an entry in the first free slot of its probe sequence, the key
+ * mustn't be present already, and a free slot must exist
+ * @param table Array of slots
+ * @param hash Hash of the key
+ * @param key Key, whose ownership is transferred
+ * @param data Data
+ */
+static void table_put(struct rs_omap_table *table, uint32_t hash, char *key,
+		void *data)
+{
+	struct rs_omap_slot *slot;
+	uint32_t match;
+	size_t probe = 1;
+	size_t pos;
+	size_t i;
+
+	pos = hash & table->mask;
+	while ((match = group_match_free(table->ctrl + pos)) == 0) {
+		pos = (pos + probe * RS_OMAP_GROUP_WIDTH) & table->mask;
+		probe++;
+	}
+	i = (pos + __builtin_ctz(match)) & table->mask;
+	if (table->ctrl[i] == CTRL_EMPTY)
+		table->growth_left--;
+	else
+		table->tombstones--;
+	table_set_ctrl(table, i, hash_ctrl(hash));
+	slot = table->slots + i;
+	slot->hash = hash;
+	slot->key = key;
+	slot->data = data;
+}
+
+/**
+ * Frees the slot at a given index. The slot can be marked empty again only if
+ * no window of RS_OMAP_GROUP_WIDTH control bytes containing it has ever been
+ * full, otherwise a probe may have gone past it
+ * @param table Array of slots
+ * @param i Index of the slot
+ */
+static void table_erase(struct rs_omap_table *table, size_t i)
+{
+	uint32_t before;
+	uint32_t after;
+	unsigned gap;
+
+	before = group_match_empty(table->ctrl +
+			((i - RS_OMAP_GROUP_WIDTH) & table->mask));
+	after = group_match_empty(table->ctrl + i);
+	if (before != 0 && after != 0) {
+		gap = __builtin_ctz(after) + __builtin_clz(before) -
+				(32 - RS_OMAP_GROUP_WIDTH);
+		if (gap < RS_OMAP_GROUP_WIDTH) {
+			table_set_ctrl(table, i, CTRL_EMPTY);
+			table->growth_left++;
+			return;
+		}
+	}
+	table_set_ctrl(table, i, CTRL_DELETED);
+	table->tombstones++;
+}
+
+/**
+ * Moves entries of the previous array of slots to the current one, if
+ * growing, freeing the previous array once all its slots are processed
+ * @param map Hash map
+ * @param n Maximum number of slots to process, SIZE_MAX for all of them
+ */
+static void move_slots(struct rs_omap *map, size_t n)
+{
+	struct rs_omap_table *old = &map->old;
+	struct rs_omap_slot *slot;
+
+	if (NULL == old->ctrl)
+		return;
+
+	while (n-- > 0 && map->moved <= old->mask) {
+		if (ctrl_is_full(old->ctrl[map->moved])) {
+			slot = old->slots + map->moved;
+			table_put(&map->table, slot->hash, slot->key,
+					slot->data);
+			/* for lookups not to find it twice */
+			table_set_ctrl(old, map->moved, CTRL_DELETED);
+		}
+		map->moved++;
+	}
+	if (map->moved > old->mask)
+		table_free(old);
+}
+
+/**
+ * Replaces the array of slots by a bigger one, or by one of the same size if
+ * the current one is filled mostly with tombstones. The entries are then
+ * moved progressively
+ * @param map Hash map, whose array of slots has no growth left
+ * @return Negative errno-compatible value on error, 0 on success
+ */
+static int grow(struct rs_omap *map)
+{
+	struct rs_omap_table table;
+	size_t capacity;
+	int ret;
+
+	/* finish the previous growth first */
+	move_slots(map, SIZE_MAX);
+	if (map->table.growth_left != 0)
+		return 0;
+
+	capacity = map->table.mask + 1;
+	if (map->count > capacity / 2 - capacity / 16)
+		capacity <<= 1;
+	ret = table_alloc(&table, capacity);
+	if (ret < 0)
+		return ret;
+	map->old = map->table;
+	map->table = table;
+	map->moved = 0;
+	move_slots(map, MOVE_BATCH);
+
+	return 0;
+}
+
+/**
+ * Says whether or not a hash map is valid
+ * @param map Hash map to test
+ * @return non-zero if the hash map is invalid, 0 otherwise
+ */
+static int map_is_invalid(const struct rs_omap *map)
+{
+	return NULL == map || NULL == map->table.ctrl;
+}
+
+int rs_omap_init(struct rs_omap *map, size_t size)
+{
+	if (NULL == map)
+		return -EINVAL;
+	if (RS_OMAP_SIZE_MAX < size)
+		return -E2BIG;
+
+	memset(map, 0, sizeof(*map));
+
+	return table_alloc(&map->table, capacity_for(size));
+}
+
+int rs_omap_clean(struct rs_omap *map)
+{
+	return rs_omap_clean_cb(map, NULL);
+}
+
+static void table_clean(struct rs_omap_table *table, void (*free_cb)(void *))
+{
+	size_t i;
+
+	if (NULL == table->ctrl)
+		return;
+
+	for (i = 0; i <= table->mask; i++) {
+		if (!ctrl_is_full(table->ctrl[i]))
+			continue;
+		if (free_cb)
+			free_cb(table->slots[i].data);
+		free(table->slots[i].key);
+	}
+	table_free(table);
+}
+
+int rs_omap_clean_cb(struct rs_omap *map, void (*free_cb)(void *))
+{
+	if (NULL == map)
+		return -EINVAL;
+
+	table_clean(&map->table, free_cb);
+	table_clean(&map->old, free_cb);
+	memset(map, 0, sizeof(*map));
+
+	return 0;
+}
+
+int rs_omap_lookup(struct rs_omap *map, const char *key, void **data)
+{
+	struct rs_omap_slot *slot;
+	uint32_t hash;
+	size_t i;
+
+	if (map_is_invalid(map) || ut_string_is_invalid(key) || NULL == data)
+		return -EINVAL;
+
+	*data = NULL;
+	hash = hash_key(key);
+	slot = table_find(&map->table, key, hash, &i);
+	if (NULL == slot)
+		slot = table_find(&map->old, key, hash, &i);
+	if (NULL == slot)
+		return -ENOENT;
+
+	*data = slot->data;
+
+	return 0;
+}
+
+int rs_omap_insert(struct rs_omap *map, const char *key, void *data)
+{
+	int ret;
+	uint32_t hash;
+	char *dup;
+	size_t i;
+
+	if (map_is_invalid(map) || ut_string_is_invalid(key))
+		return -EINVAL;
+
+	hash = hash_key(key);
+	if (NULL != table_find(&map->table, key, hash, &i) ||
+			NULL != table_find(&map->old, key, hash, &i))
+		return -EEXIST;
+
+	dup = strdup(key);
+	if (NULL == dup)
+		return -ENOMEM;
+
+	move_slots(map, MOVE_BATCH);
+	if (map->table.growth_left == 0) {
+		ret = grow(map);
+		if (ret < 0) {
+			free(dup);
+			return ret;
+		}
+	}
+	table_put(&map->table, hash, dup, data);
+	map->count++;
+
+	return 0;
+}
+
+int rs_omap_remove(struct rs_omap *map, const char *key, void **data)
+{
+	struct rs_omap_slot *slot;
+	uint32_t hash;
+	size_t i;
+
+	if (map_is_invalid(map) || ut_string_is_invalid(key))
+		return -EINVAL;
+	if (NULL != data)
+		*data = NULL;
+
+	hash = hash_key(key);
+	slot = table_find(&map->table, key, hash, &i);
+	if (NULL != slot) {
+		table_erase(&map->table, i);
+	} else {
+		slot = table_find(&map->old, key, hash, &i);
+		if (NULL == slot)
+			return -ENOENT;
+		table_set_ctrl(&map->old, i, CTRL_DELETED);
+	}
+
+	if (NULL != data)
+		*data = slot->data;
+	free(slot->key);
+	map->count--;
+	move_slots(map, MOVE_BATCH);
+
+	return 0;
+}
+
+size_t rs_omap_get_count(const struct rs_omap *map)
+{
+	return NULL == map ? 0 : map->count;
+}
@@ -91,6 +91,33 @@ int rs_rb_init(struct rs_rb *rb, void *buffer, size_t size)
 	return 0;
 }
 
+int rs_rb_resize(struct rs_rb *rb, size_t size)
+{
+	int ret;
+	struct rs_rb new_rb;
+
+	if (NULL == rb || !rb->mirror)
+		return -EINVAL;
+
+	ret = rs_rb_init(&new_rb, NULL, size);
+	if (ret < 0)
+		return ret;
+	if (new_rb.size < rb->len) {
+		rs_rb_clean(&new_rb);
+		return -ENOBUFS;
+	}
+
+	/* thanks to the mirroring, stored data are always contiguous */
+	memcpy(new_rb.base, rs_rb_get_read_ptr(rb), rb->len);
+	new_rb.len = rb->len;
+	new_rb.write = rb->len & new_rb.size_mask;
+
+	rs_rb_clean(rb);
+	*rb = new_rb;
+
+	return 0;
+}
+
 size_t rs_rb_get_size(struct rs_rb *rb)
 {
 	return NULL == rb ? 0 : rb->size;
@@ -0,0 +1,319 @@
+/**
+ * @file rs_cmap_test.c
+ * @brief unit tests for librs concurrent hash map implementation
+ *
+ * Copyright (C) 2013 Parrot S.A.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include <CUnit/Basic.h>
+
+#include <fautes.h>
+
+#include <rs_cmap.h>
+
+#define READERS 4
+#define KEYS 64
+
+static int freed;
+
+static void count_free(void *data)
+{
+	freed++;
+}
+
+static void testRS_CMAP_INIT(void)
+{
+	int ret;
+	struct rs_cmap map;
+
+	/* normal use cases */
+	ret = rs_cmap_init(&map, 10, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(map.mask, 15);
+	CU_ASSERT_PTR_NOT_NULL(map.buckets);
+	CU_ASSERT_EQUAL(rs_cmap_get_count(&map), 0);
+	/* lookups don't share their cache lines with the writers */
+	CU_ASSERT(offsetof(struct rs_cmap, free_cb) < 64);
+	CU_ASSERT_EQUAL(offsetof(struct rs_cmap, epoch), 64);
+	CU_ASSERT_EQUAL(offsetof(struct rs_cmap, count), 128);
+	ret = rs_cmap_clean(&map);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* error use cases */
+	ret = rs_cmap_init(&map, RS_CMAP_SIZE_MAX + 1U, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_cmap_init(NULL, 10, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_cmap_clean(NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+}
+
+static void testRS_CMAP_LOOKUP(void)
+{
+	int ret;
+	struct rs_cmap map;
+	struct rs_cmap_reader reader;
+	void *needle = NULL;
+
+	/* initialization */
+	ret = rs_cmap_init(&map, 10, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_cmap_reader_register(&map, &reader);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	ret = rs_cmap_insert(&map, "ursule", (void *)42);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_cmap_insert(&map, "gédéon", (void *)66);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(rs_cmap_get_count(&map), 2);
+	ret = rs_cmap_lookup(&map, &reader, "ursule", &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(needle, (void *)42);
+	ret = rs_cmap_lookup(&map, &reader, "gédéon", &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(needle, (void *)66);
+	ret = rs_cmap_lookup(&map, &reader, "frénégonde", &needle);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	CU_ASSERT_PTR_NULL(needle);
+	CU_ASSERT_EQUAL(reader.depth, 0);
+	CU_ASSERT_EQUAL(reader.epoch, 0);
+
+	/* error use cases */
+	ret = rs_cmap_insert(&map, "ursule", NULL);
+	CU_ASSERT_EQUAL(ret, -EEXIST);
+	ret = rs_cmap_insert(&map, "", NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_cmap_lookup(NULL, &reader, "ursule", &needle);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_cmap_lookup(&map, NULL, "ursule", &needle);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_cmap_lookup(&map, &reader, NULL, &needle);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_cmap_lookup(&map, &reader, "ursule", NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	ret = rs_cmap_reader_unregister(&map, &reader);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_cmap_reader_unregister(&map, &reader);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	rs_cmap_clean(&map);
+}
+
+static void testRS_CMAP_REMOVE(void)
+{
+	int ret;
+	struct rs_cmap map;
+	struct rs_cmap_reader reader;
+	void *needle = NULL;
+
+	/* initialization */
+	freed = 0;
+	ret = rs_cmap_init(&map, 10, count_free);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_cmap_reader_register(&map, &reader);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_cmap_insert(&map, "ursule", (void *)42);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_cmap_insert(&map, "gédéon", (void *)66);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	/* nothing is freed while a reader may access it */
+	rs_cmap_read_lock(&map, &reader);
+	ret = rs_cmap_lookup(&map, &reader, "ursule", &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_cmap_replace(&map, "ursule", (void *)88);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_cmap_remove(&map, "gédéon");
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(freed, 0);
+	CU_ASSERT_EQUAL(rs_cmap_reclaim(&map), 2);
+	ret = rs_cmap_reader_unregister(&map, &reader);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+	rs_cmap_read_unlock(&reader);
+	CU_ASSERT_EQUAL(rs_cmap_reclaim(&map), 0);
+	CU_ASSERT_EQUAL(freed, 2);
+	/* the entries removed after it entered its read section aren't */
+	rs_cmap_read_lock(&map, &reader);
+	ret = rs_cmap_remove(&map, "ursule");
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(freed, 2);
+	rs_cmap_read_unlock(&reader);
+	ret = rs_cmap_lookup(&map, &reader, "ursule", &needle);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	ret = rs_cmap_lookup(&map, &reader, "gédéon", &needle);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	CU_ASSERT_EQUAL(rs_cmap_get_count(&map), 0);
+
+	/* replacing inserts if needed */
+	ret = rs_cmap_replace(&map, "frénégonde", (void *)42);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_cmap_lookup(&map, &reader, "frénégonde", &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(needle, (void *)42);
+
+	/* error use cases */
+	ret = rs_cmap_remove(&map, "ursule");
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	ret = rs_cmap_remove(NULL, "ursule");
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_cmap_remove(&map, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_cmap_reclaim(NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	rs_cmap_reader_unregister(&map, &reader);
+	rs_cmap_clean(&map);
+	/* the retired entries and the remaining one */
+	CU_ASSERT_EQUAL(freed, 4);
+}
+
+struct reader_ctx {
+	struct rs_cmap *map;
+	bool *stop;
+	unsigned long errors;
+	unsigned long lookups;
+};
+
+static void *reader_thread(void *arg)
+{
+	struct reader_ctx *ctx = arg;
+	struct rs_cmap_reader reader;
+	unsigned *value;
+	char key[16];
+	unsigned i = 0;
+
+	rs_cmap_reader_register(ctx->map, &reader);
+	while (!__atomic_load_n(ctx->stop, __ATOMIC_RELAXED)) {
+		snprintf(key, sizeof(key), "key%u", i++ % KEYS);
+		rs_cmap_read_lock(ctx->map, &reader);
+		/* always present, values are checked for use after free */
+		if (rs_cmap_lookup(ctx->map, &reader, key,
+				(void **)&value) != 0 || *value != 0xcafe)
+			ctx->errors++;
+		rs_cmap_read_unlock(&reader);
+		__atomic_add_fetch(&ctx->lookups, 1, __ATOMIC_RELAXED);
+	}
+	rs_cmap_reader_unregister(ctx->map, &reader);
+
+	return NULL;
+}
+
+static void free_value(void *data)
+{
+	unsigned *value = data;
+
+	*value = 0xdead;
+	free(value);
+}
+
+static unsigned *new_value(void)
+{
+	unsigned *value = malloc(sizeof(*value));
+
+	if (NULL != value)
+		*value = 0xcafe;
+
+	return value;
+}
+
+static void testRS_CMAP_CONCURRENT(void)
+{
+	int ret;
+	struct rs_cmap map;
+	struct reader_ctx ctx[READERS];
+	pthread_t threads[READERS];
+	bool stop = false;
+	char key[16];
+	unsigned i;
+	unsigned errors = 0;
+
+	/* initialization */
+	ret = rs_cmap_init(&map, KEYS / 4, free_value);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (i = 0; i < KEYS; i++) {
+		snprintf(key, sizeof(key), "key%u", i);
+		if (rs_cmap_insert(&map, key, new_value()) != 0)
+			errors++;
+	}
+	for (i = 0; i < READERS; i++) {
+		ctx[i].map = &map;
+		ctx[i].stop = &stop;
+		ctx[i].errors = 0;
+		ctx[i].lookups = 0;
+		ret = pthread_create(threads + i, NULL, reader_thread,
+				ctx + i);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+	}
+
+	/* normal use cases */
+	/* for all the readers to run concurrently with the writes */
+	for (i = 0; i < READERS; i++)
+		while (__atomic_load_n(&ctx[i].lookups, __ATOMIC_RELAXED) == 0)
+			sched_yield();
+	for (i = 0; i < 50000; i++) {
+		snprintf(key, sizeof(key), "key%u", i % KEYS);
+		if (rs_cmap_replace(&map, key, new_value()) != 0)
+			errors++;
+	}
+	__atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+	for (i = 0; i < READERS; i++) {
+		pthread_join(threads[i], NULL);
+		errors += ctx[i].errors;
+		CU_ASSERT(ctx[i].lookups > 0);
+	}
+	CU_ASSERT_EQUAL(errors, 0);
+	CU_ASSERT_EQUAL(rs_cmap_get_count(&map), KEYS);
+	CU_ASSERT_EQUAL(rs_cmap_reclaim(&map), 0);
+
+	/* cleanup */
+	rs_cmap_clean(&map);
+}
+
+static const struct test_t tests[] = {
+		{
+				.fn = testRS_CMAP_INIT,
+				.name = "rs_cmap_init"
+		},
+		{
+				.fn = testRS_CMAP_LOOKUP,
+				.name = "rs_cmap_lookup"
+		},
+		{
+				.fn = testRS_CMAP_REMOVE,
+				.name = "rs_cmap_remove"
+		},
+		{
+				.fn = testRS_CMAP_CONCURRENT,
+				.name = "rs_cmap_concurrent"
+		},
+
+		/* NULL guard */
+		{.fn = NULL, .name = NULL},
+};
+
+static int init_cmap_suite(void)
+{
+	return 0; /* return non-zero on error */
+}
+
+static int clean_cmap_suite(void)
+{
+	return 0; /* return non-zero on error */
+}
+
+struct suite_t cmap_suite = {
+		.name = "rs_cmap",
+		.init = init_cmap_suite,
+		.clean = clean_cmap_suite,
+		.tests = tests,
+};
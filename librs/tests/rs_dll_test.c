@@ -596,6 +596,53 @@ static void testRS_DLL_REMOVE(void)
 	CU_ASSERT_PTR_NULL(node);
 }
 
+static void testRS_DLL_REMOVE_NODE(void)
+{
+	struct int_node int_node_a = {.val = 17,};
+	struct int_node int_node_b = {.val = 42,};
+	struct int_node int_node_c = {.val = 666,};
+	struct rs_node *node;
+	struct rs_dll dll;
+	int ret = 0;
+
+	ret = rs_dll_init(&dll, &dll_test_vtable);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	ret = rs_dll_enqueue(&dll, &(int_node_a.node));
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = rs_dll_enqueue(&dll, &(int_node_b.node));
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = rs_dll_enqueue(&dll, &(int_node_c.node));
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+	/* normal use cases */
+	node = rs_dll_remove_node(&dll, &(int_node_b.node));
+	CU_ASSERT_PTR_EQUAL(node, &(int_node_b.node));
+	CU_ASSERT_EQUAL(rs_dll_get_count(&dll), 2);
+	node = rs_dll_next_from(&dll, NULL);
+	CU_ASSERT_EQUAL(to_int_node(node)->val, 17);
+	node = rs_dll_next_from(&dll, node);
+	CU_ASSERT_EQUAL(to_int_node(node)->val, 666);
+
+	/* tail */
+	node = rs_dll_remove_node(&dll, &(int_node_c.node));
+	CU_ASSERT_PTR_EQUAL(node, &(int_node_c.node));
+	CU_ASSERT_PTR_EQUAL(dll.tail, &(int_node_a.node));
+
+	/* head, the list is then empty */
+	node = rs_dll_remove_node(&dll, &(int_node_a.node));
+	CU_ASSERT_PTR_EQUAL(node, &(int_node_a.node));
+	CU_ASSERT(rs_dll_is_empty(&dll));
+	CU_ASSERT_PTR_NULL(dll.head);
+	CU_ASSERT_PTR_NULL(dll.tail);
+
+	/* error use case */
+	node = rs_dll_remove_node(NULL, &(int_node_a.node));
+	CU_ASSERT_PTR_NULL(node);
+	node = rs_dll_remove_node(&dll, NULL);
+	CU_ASSERT_PTR_NULL(node);
+}
+
 static int parity_cb(struct rs_node *n, const void *data)
 {
 	const int my_odd = *((const int *)data);
@@ -820,6 +867,10 @@ static const struct test_t tests[] = {
 				.fn = testRS_DLL_REMOVE,
 				.name = "rs_dll_remove"
 		},
+		{
+				.fn = testRS_DLL_REMOVE_NODE,
+				.name = "rs_dll_remove_node"
+		},
 		{
 				.fn = testRS_DLL_REMOVE_MATCH,
 				.name = "rs_dll_remove_match"
@@ -18,18 +18,24 @@
 const char rs_interp[] __attribute__((section(".interp"))) = FUSION_INTERPRETER;
 
 struct suite_t *librs_test_suites[] = {
+		&cmap_suite,
 		&dll_suite,
+		&himg_suite,
 		&hmap_suite,
 		&node_suite,
+		&omap_suite,
 		&rb_suite,
 		NULL, /* NULL guard */
 };
 
 static void librs_pool_initializer(void)
 {
+	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(cmap_suite);
 	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(dll_suite);
+	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(himg_suite);
 	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(hmap_suite);
 	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(node_suite);
+	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(omap_suite);
 	FAUTES_GET_ACTIVE_STATE_FROM_ENVIRONMENT(rb_suite);
 }
 
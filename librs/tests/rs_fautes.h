@@ -10,9 +10,12 @@
 #ifndef RS_FAUTES_H_
 #define RS_FAUTES_H_
 
+extern struct suite_t cmap_suite;
 extern struct suite_t dll_suite;
+extern struct suite_t himg_suite;
 extern struct suite_t hmap_suite;
 extern struct suite_t node_suite;
+extern struct suite_t omap_suite;
 extern struct suite_t rb_suite;
 
 /**
@@ -0,0 +1,279 @@
+/**
+ * @file rs_himg_test.c
+ * @brief unit tests for librs hash map images
+ *
+ * Copyright (C) 2013 Parrot S.A.
+ */
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <CUnit/Basic.h>
+
+#include <fautes.h>
+
+#include <rs_himg.h>
+
+#define IMG_PATH "/tmp/rs_himg_test.img"
+
+static void testRS_HIMG_BUILDER(void)
+{
+	int ret;
+	struct rs_himg_builder builder;
+	struct rs_hmap_seed seed = {.k0 = 1, .k1 = 2};
+
+	/* normal use cases */
+	ret = rs_himg_builder_init(&builder);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_himg_builder_set_seed(&builder, &seed);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_himg_builder_add(&builder, "ursule", 6, "42", 2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_himg_builder_add(&builder, "gédéon", 8, NULL, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(builder.count, 2);
+	ret = rs_himg_builder_write(&builder, IMG_PATH);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(access(IMG_PATH, R_OK), 0);
+
+	/* error use cases */
+	ret = rs_himg_builder_add(&builder, "ursule", 6, "66", 2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_himg_builder_write(&builder, IMG_PATH);
+	CU_ASSERT_EQUAL(ret, -EEXIST);
+	ret = rs_himg_builder_add(&builder, NULL, 6, "66", 2);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_himg_builder_add(&builder, "ursule", 0, "66", 2);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_himg_builder_add(&builder, "ursule", 6, NULL, 2);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_himg_builder_write(&builder, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_himg_builder_write(&builder, "/nonexistent/rs_himg.img");
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_himg_builder_init(NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	ret = rs_himg_builder_clean(&builder);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_NULL(builder.entries);
+	unlink(IMG_PATH);
+}
+
+static void testRS_HIMG_LOOKUP(void)
+{
+	int ret;
+	struct rs_himg_builder builder;
+	struct rs_himg img;
+	const void *value;
+	size_t length;
+	char key[16];
+	unsigned i;
+	unsigned errors = 0;
+
+	/* initialization */
+	ret = rs_himg_builder_init(&builder);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (i = 0; i < 10000; i++) {
+		snprintf(key, sizeof(key), "key%u", i);
+		if (rs_himg_builder_add(&builder, key, strlen(key), &i,
+				sizeof(i)) != 0)
+			errors++;
+	}
+	CU_ASSERT_EQUAL(errors, 0);
+	ret = rs_himg_builder_write(&builder, IMG_PATH);
+	CU_ASSERT_EQUAL(ret, 0);
+	rs_himg_builder_clean(&builder);
+
+	/* normal use cases */
+	ret = rs_himg_open(&img, IMG_PATH);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	CU_ASSERT_EQUAL(rs_himg_get_count(&img), 10000);
+	for (i = 0; i < 10000; i++) {
+		snprintf(key, sizeof(key), "key%u", i);
+		if (rs_himg_lookup(&img, key, strlen(key), &value,
+				&length) != 0 || length != sizeof(i) ||
+				*(const unsigned *)value != i ||
+				(uintptr_t)value % 8 != 0)
+			errors++;
+	}
+	CU_ASSERT_EQUAL(errors, 0);
+	ret = rs_himg_lookup(&img, "key10000", 8, &value, &length);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	CU_ASSERT_PTR_NULL(value);
+	/* the key length is part of the key */
+	ret = rs_himg_lookup(&img, "key12", 4, &value, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(*(const unsigned *)value, 1);
+
+	/* error use cases */
+	ret = rs_himg_lookup(NULL, "key1", 4, &value, &length);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_himg_lookup(&img, NULL, 4, &value, &length);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_himg_lookup(&img, "key1", 4, NULL, &length);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	ret = rs_himg_close(&img);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(rs_himg_get_count(&img), 0);
+	ret = rs_himg_lookup(&img, "key1", 4, &value, &length);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	unlink(IMG_PATH);
+}
+
+static int value_cb(void *data, const void **value, size_t *length,
+		void *userdata)
+{
+	*value = data;
+	*length = strlen(data) + 1;
+
+	return 0;
+}
+
+static void testRS_HIMG_HMAP(void)
+{
+	int ret;
+	struct rs_hmap map;
+	struct rs_himg_builder builder;
+	struct rs_himg img;
+	const void *value;
+	uint32_t pid = 1234;
+
+	/* normal use cases */
+	ret = rs_hmap_init(&map, 10);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_hmap_insert(&map, "ursule", "grizzly");
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_hmap_insert(&map, "gédéon", "goose");
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_himg_builder_init(&builder);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_himg_builder_add_hmap(&builder, &map, value_cb, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	rs_hmap_clean(&map);
+	ret = rs_hmap_init_keys(&map, 10, RS_HMAP_KEY_U32, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_hmap_insert_key(&map, &pid, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_himg_builder_add_hmap(&builder, &map, NULL, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_himg_builder_write(&builder, IMG_PATH);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	ret = rs_himg_open(&img, IMG_PATH);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	CU_ASSERT_EQUAL(rs_himg_get_count(&img), 3);
+	ret = rs_himg_lookup(&img, "ursule", 6, &value, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_STRING_EQUAL(value, "grizzly");
+	ret = rs_himg_lookup(&img, "gédéon", strlen("gédéon"), &value, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_STRING_EQUAL(value, "goose");
+	ret = rs_himg_lookup(&img, &pid, sizeof(pid), &value, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* error use cases */
+	ret = rs_himg_builder_add_hmap(&builder, NULL, NULL, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	rs_himg_close(&img);
+	rs_himg_builder_clean(&builder);
+	rs_hmap_clean(&map);
+	unlink(IMG_PATH);
+}
+
+static void testRS_HIMG_OPEN(void)
+{
+	int ret;
+	int fd;
+	struct rs_himg_builder builder;
+	struct rs_himg img;
+	uint32_t version = RS_HIMG_VERSION + 1;
+	ssize_t sret;
+
+	/* initialization */
+	ret = rs_himg_builder_init(&builder);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_himg_builder_write(&builder, IMG_PATH);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	/* an empty image is valid */
+	ret = rs_himg_open(&img, IMG_PATH);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(rs_himg_get_count(&img), 0);
+	rs_himg_close(&img);
+
+	/* error use cases */
+	fd = open(IMG_PATH, O_WRONLY | O_CLOEXEC);
+	CU_ASSERT_FATAL(fd >= 0);
+	sret = pwrite(fd, &version, sizeof(version),
+			offsetof(struct rs_himg_header, version));
+	CU_ASSERT_EQUAL(sret, sizeof(version));
+	ret = rs_himg_open(&img, IMG_PATH);
+	CU_ASSERT_EQUAL(ret, -EPROTO);
+	/* truncated */
+	ret = ftruncate(fd, sizeof(struct rs_himg_header) + 1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_himg_open(&img, IMG_PATH);
+	CU_ASSERT_EQUAL(ret, -EPROTO);
+	close(fd);
+	ret = rs_himg_open(&img, "/nonexistent/rs_himg.img");
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	ret = rs_himg_open(NULL, IMG_PATH);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_himg_close(NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	rs_himg_builder_clean(&builder);
+	unlink(IMG_PATH);
+}
+
+static const struct test_t tests[] = {
+		{
+				.fn = testRS_HIMG_BUILDER,
+				.name = "rs_himg_builder"
+		},
+		{
+				.fn = testRS_HIMG_LOOKUP,
+				.name = "rs_himg_lookup"
+		},
+		{
+				.fn = testRS_HIMG_HMAP,
+				.name = "rs_himg_hmap"
+		},
+		{
+				.fn = testRS_HIMG_OPEN,
+				.name = "rs_himg_open"
+		},
+
+		/* NULL guard */
+		{.fn = NULL, .name = NULL},
+};
+
+static int init_himg_suite(void)
+{
+	return 0; /* return non-zero on error */
+}
+
+static int clean_himg_suite(void)
+{
+	return 0; /* return non-zero on error */
+}
+
+struct suite_t himg_suite = {
+		.name = "rs_himg",
+		.init = init_himg_suite,
+		.clean = clean_himg_suite,
+		.tests = tests,
+};
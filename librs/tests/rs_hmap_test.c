@@ -6,6 +6,7 @@
  *
  * Copyright (C) 2013 Parrot S.A.
  */
+#include <string.h>
 #include <errno.h>
 
 #include <CUnit/Basic.h>
@@ -78,6 +79,12 @@ static void testRS_HMAP_CLEAN_FREE(void)
 	CU_ASSERT_NOT_EQUAL(ret, 0);
 }
 
+static uint32_t hash_constant(const void *key, size_t len,
+		const struct rs_hmap_seed *seed)
+{
+	return 42;
+}
+
 static void testRS_HMAP_LOOKUP(void)
 {
 	int ret;
@@ -104,6 +111,22 @@ static void testRS_HMAP_LOOKUP(void)
 	ret = rs_hmap_lookup(&map, "frénégonde", &needle);
 	CU_ASSERT_EQUAL(ret, -ENOENT);
 	CU_ASSERT_PTR_EQUAL(needle, NULL);
+	rs_hmap_clean(&map);
+	/* "a" and "c" fall in the same bucket, "a" being alone in it */
+	ret = rs_hmap_init(&map, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_hmap_set_hash(&map, hash_constant, NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_hmap_insert(&map, "a", data1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_hmap_lookup(&map, "c", &needle);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	CU_ASSERT_PTR_EQUAL(needle, NULL);
+	ret = rs_hmap_remove(&map, "c", &needle);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	ret = rs_hmap_lookup(&map, "a", &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(needle, data1);
 
 	/* error use cases */
 	ret = rs_hmap_lookup(NULL, "ursule", &needle);
@@ -190,6 +213,137 @@ static void testRS_HMAP_REMOVE(void)
 	rs_hmap_clean(&map);
 }
 
+static void testRS_HMAP_KEYS(void)
+{
+	int ret;
+	struct rs_hmap map;
+	uint32_t pid = 1234;
+	uint64_t big = 0x100000000ULL;
+	uint8_t id[16] = {1, 2, 3};
+	uint8_t long_id[24] = {1, 2, 3};
+	struct rs_hmap_entry *entry;
+	uint32_t hash;
+	void *needle = NULL;
+
+	/* normal use cases */
+	ret = rs_hmap_init_keys(&map, 10, RS_HMAP_KEY_U32, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(map.key_len, sizeof(uint32_t));
+	ret = rs_hmap_insert_key(&map, &pid, (void *)42);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_hmap_lookup_key(&map, &pid, &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(needle, (void *)42);
+	pid++;
+	ret = rs_hmap_lookup_key(&map, &pid, &needle);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	pid--;
+	ret = rs_hmap_remove_key(&map, &pid, &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(needle, (void *)42);
+	CU_ASSERT_EQUAL(map.count, 0);
+	rs_hmap_clean(&map);
+
+	ret = rs_hmap_init_keys(&map, 10, RS_HMAP_KEY_U64, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_hmap_insert_key(&map, &big, (void *)66);
+	CU_ASSERT_EQUAL(ret, 0);
+	big = 0;
+	ret = rs_hmap_lookup_key(&map, &big, &needle);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	big = 0x100000000ULL;
+	ret = rs_hmap_lookup_key(&map, &big, &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(needle, (void *)66);
+	rs_hmap_clean(&map);
+
+	/* small binary keys are stored in the entry, bigger ones aren't */
+	ret = rs_hmap_init_keys(&map, 10, RS_HMAP_KEY_BINARY, sizeof(id));
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_hmap_insert_key(&map, id, (void *)42);
+	CU_ASSERT_EQUAL(ret, 0);
+	hash = rs_hmap_hash_sip(id, sizeof(id), &map.seed);
+	entry = map.buckets[hash % map.size];
+	CU_ASSERT_PTR_EQUAL(rs_hmap_get_entry_key(&map, entry),
+			entry->inline_key.bytes);
+	id[15] = 1;
+	ret = rs_hmap_lookup_key(&map, id, &needle);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	id[15] = 0;
+	ret = rs_hmap_lookup_key(&map, id, &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(needle, (void *)42);
+	rs_hmap_clean(&map);
+	ret = rs_hmap_init_keys(&map, 10, RS_HMAP_KEY_BINARY, sizeof(long_id));
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_hmap_insert_key(&map, long_id, (void *)66);
+	CU_ASSERT_EQUAL(ret, 0);
+	hash = rs_hmap_hash_sip(long_id, sizeof(long_id), &map.seed);
+	entry = map.buckets[hash % map.size];
+	CU_ASSERT_PTR_EQUAL(rs_hmap_get_entry_key(&map, entry), entry->key);
+	CU_ASSERT_EQUAL(memcmp(entry->key, long_id, sizeof(long_id)), 0);
+	ret = rs_hmap_lookup_key(&map, long_id, &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(needle, (void *)66);
+	long_id[23] = 1;
+	ret = rs_hmap_remove_key(&map, long_id, &needle);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+
+	/* error use cases */
+	ret = rs_hmap_lookup(&map, "ursule", &needle);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_hmap_insert(&map, "ursule", NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_hmap_insert_key(&map, NULL, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_hmap_init_keys(&map, 10, RS_HMAP_KEY_BINARY, 0);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_hmap_init_keys(&map, 10, (enum rs_hmap_key_type)42, 4);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_NULL(rs_hmap_get_entry_key(&map, NULL));
+
+	/* cleanup */
+	rs_hmap_clean(&map);
+}
+
+static void testRS_HMAP_SET_HASH(void)
+{
+	int ret;
+	struct rs_hmap map;
+	struct rs_hmap_seed seed1 = {.k0 = 1, .k1 = 2};
+	struct rs_hmap_seed seed2 = {.k0 = 2, .k1 = 1};
+	uint32_t hash;
+	void *needle = NULL;
+
+	/* normal use cases */
+	hash = rs_hmap_hash_sip("ursule", 6, &seed1);
+	CU_ASSERT_EQUAL(hash, rs_hmap_hash_sip("ursule", 6, &seed1));
+	CU_ASSERT_NOT_EQUAL(hash, rs_hmap_hash_sip("ursule", 6, &seed2));
+	CU_ASSERT_NOT_EQUAL(hash, rs_hmap_hash_sip("ursulf", 6, &seed1));
+	/* whole words and tail bytes are both taken into account */
+	CU_ASSERT_NOT_EQUAL(rs_hmap_hash_sip("gédéon12", 9, &seed1),
+			rs_hmap_hash_sip("gédéon12", 8, &seed1));
+	ret = rs_hmap_init(&map, 10);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_hmap_set_hash(&map, NULL, &seed1);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(map.hash, rs_hmap_hash_sip);
+	ret = rs_hmap_insert(&map, "ursule", (void *)42);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(map.buckets[hash % map.size]->hash, hash);
+	ret = rs_hmap_lookup(&map, "ursule", &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* error use cases */
+	ret = rs_hmap_set_hash(&map, hash_constant, NULL);
+	CU_ASSERT_EQUAL(ret, -EBUSY);
+	ret = rs_hmap_set_hash(NULL, hash_constant, NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	rs_hmap_clean(&map);
+}
+
 static const struct test_t tests[] = {
 		{
 				.fn = testRS_HMAP_INIT,
@@ -215,6 +369,14 @@ static const struct test_t tests[] = {
 				.fn = testRS_HMAP_REMOVE,
 				.name = "rs_hmap_remove"
 		},
+		{
+				.fn = testRS_HMAP_KEYS,
+				.name = "rs_hmap_keys"
+		},
+		{
+				.fn = testRS_HMAP_SET_HASH,
+				.name = "rs_hmap_set_hash"
+		},
 
 		/* NULL guard */
 		{.fn = NULL, .name = NULL},
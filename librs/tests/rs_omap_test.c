@@ -0,0 +1,296 @@
+/**
+ * @file rs_omap_test.c
+ * @brief unit tests for librs open addressing hash map implementation
+ *
+ * Copyright (C) 2013 Parrot S.A.
+ */
+#include <stdio.h>
+#include <errno.h>
+
+#include <CUnit/Basic.h>
+
+#include <fautes.h>
+
+#include <rs_omap.h>
+
+static void testRS_OMAP_INIT(void)
+{
+	int ret;
+	struct rs_omap map;
+
+	/* normal use cases */
+	ret = rs_omap_init(&map, 10);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(map.table.mask + 1, RS_OMAP_GROUP_WIDTH);
+	CU_ASSERT_PTR_NOT_NULL(map.table.ctrl);
+	CU_ASSERT_EQUAL(rs_omap_get_count(&map), 0);
+	rs_omap_clean(&map);
+	/* load factor of 7/8 at most */
+	ret = rs_omap_init(&map, 100);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(map.table.mask + 1, 128);
+	rs_omap_clean(&map);
+
+	/* error use cases */
+	ret = rs_omap_init(&map, RS_OMAP_SIZE_MAX + 1U);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_omap_init(NULL, 10);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_omap_clean(NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(rs_omap_get_count(NULL), 0);
+}
+
+static void testRS_OMAP_CLEAN_FREE(void)
+{
+	int ret;
+	struct rs_omap map;
+	int *data1 = calloc(1, sizeof(int));
+	int *data2 = calloc(1, sizeof(int));
+
+	/* normal use cases */
+	ret = rs_omap_init(&map, 10);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_omap_insert(&map, "ursule", data1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_omap_insert(&map, "gédéon", data2);
+	CU_ASSERT_EQUAL(ret, 0);
+	/* valgrind will tell */
+	ret = rs_omap_clean_cb(&map, free);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_NULL(map.table.ctrl);
+}
+
+static void testRS_OMAP_LOOKUP(void)
+{
+	int ret;
+	struct rs_omap map;
+	void *data1 = (void *)42;
+	void *data2 = (void *)66;
+	void *needle = NULL;
+
+	/* initialization */
+	ret = rs_omap_init(&map, 10);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_omap_insert(&map, "ursule", data1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_omap_insert(&map, "gédéon", data2);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	ret = rs_omap_lookup(&map, "ursule", &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(needle, data1);
+	ret = rs_omap_lookup(&map, "gédéon", &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(needle, data2);
+	ret = rs_omap_lookup(&map, "frénégonde", &needle);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	CU_ASSERT_PTR_EQUAL(needle, NULL);
+
+	/* error use cases */
+	ret = rs_omap_lookup(NULL, "ursule", &needle);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_omap_lookup(&map, NULL, &needle);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_omap_lookup(&map, "", &needle);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_omap_lookup(&map, "ursule", NULL);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	rs_omap_clean(&map);
+}
+
+static void testRS_OMAP_INSERT(void)
+{
+	int ret;
+	struct rs_omap map;
+	void *needle = NULL;
+
+	/* initialization */
+	ret = rs_omap_init(&map, 10);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	/* inserting NULL is allowed */
+	ret = rs_omap_insert(&map, "ursule", NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(rs_omap_get_count(&map), 1);
+
+	/* error use cases */
+	ret = rs_omap_insert(&map, "ursule", &needle);
+	CU_ASSERT_EQUAL(ret, -EEXIST);
+	CU_ASSERT_EQUAL(rs_omap_get_count(&map), 1);
+	ret = rs_omap_insert(NULL, "ursule", &needle);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_omap_insert(&map, NULL, &needle);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_omap_insert(&map, "", &needle);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	rs_omap_clean(&map);
+	/* inserting in a cleaned hash map must fail cleanly */
+	ret = rs_omap_insert(&map, "ursule", &needle);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+}
+
+static void testRS_OMAP_REMOVE(void)
+{
+	int ret;
+	struct rs_omap map;
+	void *data1 = (void *)42;
+	void *data2 = (void *)66;
+	void *needle = NULL;
+
+	/* initialization */
+	ret = rs_omap_init(&map, 10);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_omap_insert(&map, "ursule", data1);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_omap_insert(&map, "gédéon", data2);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	ret = rs_omap_remove(&map, "ursule", &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(needle, data1);
+	ret = rs_omap_remove(&map, "gédéon", NULL);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(rs_omap_get_count(&map), 0);
+	ret = rs_omap_remove(&map, "ursule", &needle);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+	CU_ASSERT_PTR_EQUAL(needle, NULL);
+	/* can be inserted again */
+	ret = rs_omap_insert(&map, "ursule", data2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_omap_lookup(&map, "ursule", &needle);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_PTR_EQUAL(needle, data2);
+
+	/* error use cases */
+	ret = rs_omap_remove(NULL, "ursule", &needle);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_omap_remove(&map, NULL, &needle);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_omap_remove(&map, "", &needle);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+
+	/* cleanup */
+	rs_omap_clean(&map);
+}
+
+static void testRS_OMAP_GROW(void)
+{
+	int ret;
+	struct rs_omap map;
+	char key[16];
+	void *needle;
+	uintptr_t i;
+	uintptr_t errors = 0;
+
+	/* initialization */
+	ret = rs_omap_init(&map, 0);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	for (i = 0; i < 10000; i++) {
+		snprintf(key, sizeof(key), "key%ju", (uintmax_t)i);
+		if (rs_omap_insert(&map, key, (void *)i) != 0)
+			errors++;
+	}
+	CU_ASSERT_EQUAL(errors, 0);
+	CU_ASSERT_EQUAL(rs_omap_get_count(&map), 10000);
+	CU_ASSERT(map.table.mask + 1 >= 10000);
+	/* entries are found wherever they are, while growing */
+	for (i = 0; i < 10000; i++) {
+		snprintf(key, sizeof(key), "key%ju", (uintmax_t)i);
+		if (rs_omap_lookup(&map, key, &needle) != 0 ||
+				needle != (void *)i)
+			errors++;
+	}
+	CU_ASSERT_EQUAL(errors, 0);
+	for (i = 0; i < 10000; i += 2) {
+		snprintf(key, sizeof(key), "key%ju", (uintmax_t)i);
+		if (rs_omap_remove(&map, key, &needle) != 0 ||
+				needle != (void *)i)
+			errors++;
+	}
+	CU_ASSERT_EQUAL(errors, 0);
+	CU_ASSERT_EQUAL(rs_omap_get_count(&map), 5000);
+	for (i = 0; i < 10000; i++) {
+		snprintf(key, sizeof(key), "key%ju", (uintmax_t)i);
+		ret = rs_omap_lookup(&map, key, &needle);
+		if (ret != (i % 2 == 0 ? -ENOENT : 0))
+			errors++;
+	}
+	CU_ASSERT_EQUAL(errors, 0);
+	rs_omap_clean(&map);
+
+	/* tombstones are reclaimed, without growing */
+	ret = rs_omap_init(&map, 100);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (i = 0; i < 100000; i++) {
+		snprintf(key, sizeof(key), "key%ju", (uintmax_t)i);
+		if (rs_omap_insert(&map, key, NULL) != 0)
+			errors++;
+		if (i >= 50) {
+			snprintf(key, sizeof(key), "key%ju",
+					(uintmax_t)(i - 50));
+			if (rs_omap_remove(&map, key, NULL) != 0)
+				errors++;
+		}
+	}
+	CU_ASSERT_EQUAL(errors, 0);
+	CU_ASSERT_EQUAL(rs_omap_get_count(&map), 50);
+	CU_ASSERT_EQUAL(map.table.mask + 1, 128);
+
+	/* cleanup */
+	rs_omap_clean(&map);
+}
+
+static const struct test_t tests[] = {
+		{
+				.fn = testRS_OMAP_INIT,
+				.name = "rs_omap_init"
+		},
+		{
+				.fn = testRS_OMAP_CLEAN_FREE,
+				.name = "rs_omap_clean_free"
+		},
+		{
+				.fn = testRS_OMAP_LOOKUP,
+				.name = "rs_omap_lookup"
+		},
+		{
+				.fn = testRS_OMAP_INSERT,
+				.name = "rs_omap_insert"
+		},
+		{
+				.fn = testRS_OMAP_REMOVE,
+				.name = "rs_omap_remove"
+		},
+		{
+				.fn = testRS_OMAP_GROW,
+				.name = "rs_omap_grow"
+		},
+
+		/* NULL guard */
+		{.fn = NULL, .name = NULL},
+};
+
+static int init_omap_suite(void)
+{
+	return 0; /* return non-zero on error */
+}
+
+static int clean_omap_suite(void)
+{
+	return 0; /* return non-zero on error */
+}
+
+struct suite_t omap_suite = {
+		.name = "rs_omap",
+		.init = init_omap_suite,
+		.clean = clean_omap_suite,
+		.tests = tests,
+};
@@ -6,6 +6,10 @@
  *
  * Copyright (C) 2013 Parrot S.A.
  */
+#include <unistd.h>
+
+#include <errno.h>
+
 #include <CUnit/Basic.h>
 
 #include <fautes.h>
@@ -56,6 +60,71 @@ static void testRS_RB_GET_SIZE(void)
 	CU_ASSERT_EQUAL(size, 0);
 }
 
+static void testRS_RB_RESIZE(void)
+{
+	struct rs_rb rb;
+	int ret;
+	char buffer[4];
+	size_t page_size = sysconf(_SC_PAGE_SIZE);
+	size_t i;
+	char c;
+
+	/* initialization */
+	ret = rs_rb_init(&rb, NULL, page_size);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	/* fill the buffer, with the data wrapping at it's end */
+	ret = rs_rb_write_incr(&rb, page_size / 2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_rb_read_incr(&rb, page_size / 2);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (i = 0; i < page_size; i++)
+		((char *)rs_rb_get_write_ptr(&rb))[i] = (char)i;
+	ret = rs_rb_write_incr(&rb, page_size);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* normal use cases */
+	ret = rs_rb_resize(&rb, 4 * page_size);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(rs_rb_get_size(&rb), 4 * page_size);
+	CU_ASSERT_EQUAL(rs_rb_get_read_length(&rb), page_size);
+	CU_ASSERT_EQUAL(rs_rb_get_write_length(&rb), 3 * page_size);
+	for (i = 0; i < page_size; i++) {
+		ret = rs_rb_read_at(&rb, i, &c);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(c, (char)i);
+	}
+	ret = rs_rb_read_incr(&rb, page_size / 2);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_rb_resize(&rb, page_size);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(rs_rb_get_read_length(&rb), page_size / 2);
+	ret = rs_rb_read_at(&rb, 0, &c);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(c, (char)(page_size / 2));
+
+	/* error use cases */
+	ret = rs_rb_resize(&rb, 4 * page_size);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_rb_write_incr(&rb, 2 * page_size);
+	CU_ASSERT_EQUAL(ret, 0);
+	/* data stored wouldn't fit */
+	ret = rs_rb_resize(&rb, page_size);
+	CU_ASSERT_EQUAL(ret, -ENOBUFS);
+	CU_ASSERT_EQUAL(rs_rb_get_size(&rb), 4 * page_size);
+	CU_ASSERT_EQUAL(rs_rb_get_read_length(&rb),
+			2 * page_size + page_size / 2);
+	ret = rs_rb_resize(NULL, page_size);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	ret = rs_rb_resize(&rb, 3 * page_size);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+	rs_rb_clean(&rb);
+	/* only ring buffers whose memory is managed by rs_rb can be resized */
+	ret = rs_rb_init(&rb, buffer, 4);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = rs_rb_resize(&rb, 8);
+	CU_ASSERT_NOT_EQUAL(ret, 0);
+}
+
 static void testRS_RB_EMPTY(void)
 {
 	struct rs_rb rb;
@@ -404,6 +473,10 @@ static const struct test_t tests[] = {
 				.fn = testRS_RB_GET_SIZE,
 				.name = "rs_rb_get_size"
 		},
+		{
+				.fn = testRS_RB_RESIZE,
+				.name = "rs_rb_resize"
+		},
 		{
 				.fn = testRS_RB_EMPTY,
 				.name = "rs_rb_empty"